@@ -5,11 +5,17 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <random>
+#include <algorithm>
+#include <tuple>
 #include "BuildVersion.h"
 #include "ScriptAnalyzer.h"
 #include "ScriptRunner.h"
 #include "ArgumentsParser.h"
 #include "MUSENVersion.h"
+#include "CPUFeatures.h"
+#include "VerletList.h"
+#include "CollisionsMatrix.h"
 
 // Handler of external signals.
 void SignalHandler(const int _signal)
@@ -21,6 +27,12 @@ void SignalHandler(const int _signal)
 	delay.detach();
 }
 
+// Handler of external signals to write a checkpoint of the running simulation.
+void CheckpointSignalHandler(int)
+{
+	g_checkpointSignal = 1;		// this is checked by the simulator between time steps
+}
+
 void PrintArgumentsInfo()
 {
 	std::cout << "Usage: cmusen -key[=value] [-key[=value]] ..." << std::endl;
@@ -31,6 +43,12 @@ void PrintArgumentsInfo()
 	std::cout << "Optional arguments:" << std::endl;
 	std::cout << "-t, -threads    maximum number of threads available for the program" << std::endl;
 	std::cout << "-a, -affinity   hexadecimal mask of cores pin threads to them" << std::endl;
+	std::cout << "-b, -benchmark  measure overhead of parallel loops for each thread pool backend" << std::endl;
+	std::cout << "-c, -contacts   measure speed of contact models with per-contact and batch calls" << std::endl;
+	std::cout << "-d, -detection  compare contact detection with grid and sweep and prune on slender and polydisperse scenes" << std::endl;
+	std::cout << "-p, -periodic   compare verlet lists with implicit PBC and with virtual particles on periodic beds" << std::endl;
+	std::cout << "-o, -optimizer  compare adjustment of verlet distance by measured time and by the cost model" << std::endl;
+	std::cout << "-j, -join       compare lookup of contact history by linear search and by merge-join in a compacted bed" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Information:" << std::endl;
 	std::cout << "-v, -version    print information about current version" << std::endl;
@@ -106,6 +124,535 @@ void SetThreadsList(const std::string& _arg)
 	ThreadPool::CThreadPool::SetUserCPUList(listCPUs);
 }
 
+void RunThreadPoolBenchmark()
+{
+	constexpr size_t callsNumber = 100000;
+	const auto Measure = [&](ThreadPool::EBackend _backend, const std::string& _name)
+	{
+		ThreadPool::CThreadPool pool{ 0, _backend };
+		const size_t threads = pool.GetCurrentThreadsNumber();
+		std::vector<size_t> counters(threads, 0);
+		const auto Call = [&] { pool.SubmitParallelJobs(threads, [&](size_t i) { ++counters[i]; }); };
+		for (size_t i = 0; i < callsNumber / 10; ++i) // warm up
+			Call();
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < callsNumber; ++i)
+			Call();
+		const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << _name << ": " << elapsed.count() / callsNumber << " us per parallel call with " << threads << " threads" << std::endl << std::endl;
+	};
+
+	std::cout << "Measuring overhead of " << callsNumber << " empty parallel calls" << std::endl << std::endl;
+	Measure(ThreadPool::EBackend::QUEUE, "Mutex queue");
+	Measure(ThreadPool::EBackend::WORK_STEALING, "Work stealing");
+}
+
+void RunContactModelsBenchmark()
+{
+	constexpr size_t particlesNumber = 20000;
+	constexpr size_t contactsPerParticle = 6;
+	constexpr size_t wallsPerParticle = 4;
+	constexpr size_t repeatsNumber = 50;
+	constexpr double radius = 1e-3;
+	constexpr double overlap = 1e-5;
+	constexpr double timeStep = 1e-7;
+	constexpr double tolerance = 1e-10;	// allowed relative deviation of vectorized kernels from scalar code
+
+	// particles with random velocities; contacts do not have to be geometrically consistent to measure the speed
+	std::mt19937 rng{ 0 };
+	std::uniform_real_distribution<double> distr{ -1.0, 1.0 };
+	const auto RandomVector = [&] { return CVector3{ distr(rng), distr(rng), distr(rng) }; };
+	const double mass = 2500 * PI * std::pow(2 * radius, 3) / 6;
+	SParticleStruct particles;
+	for (size_t i = 0; i < particlesNumber; ++i)
+	{
+		particles.AddParticle(true, CVector3{ 2 * radius * i, 0, 0 }, radius, static_cast<unsigned>(i), mass, 0.4 * mass * radius * radius, RandomVector() * 0.1, RandomVector() * 10.);
+		particles.AddContactRadius(radius);
+	}
+	// differently oriented walls, as in a corner of a container, which particles touch simultaneously
+	const std::vector<CVector3> wallNormals{ CVector3{ 0, 0, 1 }, CVector3{ 1, 0, 0 }, CVector3{ 0, 1, 0 }, CVector3{ 1, 1, 1 }.Normalized() };
+	SWallStruct walls;
+	for (size_t i = 0; i < wallsPerParticle; ++i)
+	{
+		const CVector3& n = wallNormals[i];
+		const CVector3 t1 = (std::fabs(n.x) < 0.9 ? CVector3{ 1, 0, 0 } : CVector3{ 0, 1, 0 }) * n;
+		const CVector3 t2 = n * t1;
+		walls.AddWall(true, static_cast<unsigned>(i), CVector3{ 0 } - t1 - t2, t1 - t2, t2, n, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 });
+	}
+	SInteractProps interactProps{};
+	interactProps.dRollingFriction = 0.01;
+	interactProps.dRestCoeff = 0.5;
+	interactProps.dSlidingFriction = 0.3;
+	interactProps.dAlpha = std::log(interactProps.dRestCoeff) / std::sqrt(PI * PI + std::pow(std::log(interactProps.dRestCoeff), 2));
+	interactProps.dEquivYoungModulus = 5e7;
+	interactProps.dEquivShearModulus = 2e7;
+	std::vector<SInteractProps> interactPropsList{ interactProps };
+
+	// collisions grouped by particles, as in the simulator; random overlaps to cover both sticking and slipping contacts
+	std::vector<SCollision> collisionsPP, collisionsPW;
+	for (size_t i = 0; i < particlesNumber; ++i)
+	{
+		for (size_t j = 1; j <= contactsPerParticle; ++j)
+		{
+			SCollision coll{};
+			coll.nSrcID = static_cast<unsigned>(i);
+			coll.nDstID = static_cast<unsigned>((i + j) % particlesNumber);
+			coll.dNormalOverlap = overlap * (1 + distr(rng));
+			coll.dEquivRadius = radius / 2;
+			coll.dEquivMass = mass / 2;
+			coll.vContactVector = RandomVector().Normalized() * (2 * radius - coll.dNormalOverlap);
+			coll.vTangOverlap = RandomVector() * overlap;
+			collisionsPP.push_back(coll);
+		}
+		// contacts of a particle with walls follow each other, as in rows of the simulator
+		for (size_t j = 0; j < wallsPerParticle; ++j)
+		{
+			SCollision coll{};
+			coll.nSrcID = static_cast<unsigned>(j);
+			coll.nDstID = static_cast<unsigned>(i);
+			coll.vContactVector = particles.Coord(i) - wallNormals[j] * (radius - overlap * (1 + distr(rng)));
+			coll.vTangOverlap = RandomVector() * overlap;
+			collisionsPW.push_back(coll);
+		}
+	}
+
+	// returns the number of calculated contacts per second
+	const auto Measure = [&](const std::vector<SCollision>& _collisions, size_t _rowLength, const auto& _calculate)
+	{
+		std::vector<SCollision> collisions = _collisions;
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t iRepeat = 0; iRepeat < repeatsNumber; ++iRepeat)
+			for (size_t i = 0; i < collisions.size(); i += _rowLength)
+				_calculate(&collisions[i], _rowLength);
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return static_cast<double>(collisions.size() * repeatsNumber) / elapsed.count();
+	};
+	// returns the maximum relative deviation of results of vectorized kernels from scalar ones
+	const auto Compare = [&](const std::vector<SCollision>& _collisions, size_t _rowLength, const auto& _calculate)
+	{
+		std::vector<SCollision> scalar = _collisions, vectorized = _collisions;
+		SetMaxInstructionSet(EInstructionSet::SCALAR);
+		for (size_t i = 0; i < scalar.size(); i += _rowLength)
+			_calculate(&scalar[i], _rowLength);
+		SetMaxInstructionSet(GetSupportedInstructionSet());
+		for (size_t i = 0; i < vectorized.size(); i += _rowLength)
+			_calculate(&vectorized[i], _rowLength);
+		const auto Deviation = [](const CVector3& _v1, const CVector3& _v2)
+		{
+			const double scale = std::max(std::max(_v1.Length(), _v2.Length()), 1e-300);
+			return Length(_v1 - _v2) / scale;
+		};
+		double res = 0;
+		for (size_t i = 0; i < scalar.size(); ++i)
+			res = std::max({ res, Deviation(scalar[i].vTotalForce, vectorized[i].vTotalForce), Deviation(scalar[i].vTangForce, vectorized[i].vTangForce), Deviation(scalar[i].vTangOverlap, vectorized[i].vTangOverlap),
+				Deviation(scalar[i].vResultMoment1, vectorized[i].vResultMoment1), Deviation(scalar[i].vResultMoment2, vectorized[i].vResultMoment2) });
+		return res;
+	};
+	// measures and prints results for one model
+	const auto Run = [&](const std::string& _name, const std::vector<SCollision>& _collisions, size_t _rowLength, const auto& _single, const auto& _batch)
+	{
+		const double single = Measure(_collisions, _rowLength, _single);
+		SetMaxInstructionSet(EInstructionSet::SCALAR);
+		const double batchScalar = Measure(_collisions, _rowLength, _batch);
+		SetMaxInstructionSet(GetSupportedInstructionSet());
+		const double batchVector = Measure(_collisions, _rowLength, _batch);
+		const double deviation = Compare(_collisions, _rowLength, _batch);
+		std::cout << "  " << _name << ": " << single / 1e6 << " / " << batchScalar / 1e6 << " / " << batchVector / 1e6 << " Mcontacts/s, speedup " << batchVector / single
+			<< ", deviation from scalar " << deviation << (deviation <= tolerance ? "" : " - EXCEEDS TOLERANCE") << std::endl;
+	};
+
+	CModelManager modelManager;
+#ifndef STATIC_MODULES
+	modelManager.AddDir(".");	// add current directory
+#endif
+	std::cout << "Measuring speed of contact models on one thread: per-contact / batch scalar / batch " << (GetSupportedInstructionSet() == EInstructionSet::AVX2 ? "AVX2" : "scalar") << " calls" << std::endl;
+	std::cout << "Particle-particle contacts: " << std::endl;
+	for (auto* descriptor : modelManager.GetAvailableModelsDescriptors(EMusenModelType::PP))
+	{
+		auto* model = dynamic_cast<CParticleParticleModel*>(descriptor->GetModel());
+		if (!model || !model->Initialize(&particles, &walls, nullptr, nullptr, &interactPropsList)) continue;
+		model->Precalculate(0, timeStep);
+		Run(model->GetName(), collisionsPP, contactsPerParticle, [&](SCollision* _collisions, size_t _count)
+		{
+			for (size_t i = 0; i < _count; ++i)
+			{
+				model->Calculate(0, timeStep, &_collisions[i]);
+				model->ConsolidateSrc(0, timeStep, particles, &_collisions[i]);
+			}
+		}, [&](SCollision* _collisions, size_t _count)
+		{
+			model->CalculateBatch(0, timeStep, particles, _collisions, _count);
+		});
+	}
+	std::cout << "Particle-wall contacts: " << std::endl;
+	for (auto* descriptor : modelManager.GetAvailableModelsDescriptors(EMusenModelType::PW))
+	{
+		auto* model = dynamic_cast<CParticleWallModel*>(descriptor->GetModel());
+		if (!model || !model->Initialize(&particles, &walls, nullptr, nullptr, &interactPropsList)) continue;
+		model->Precalculate(0, timeStep);
+		Run(model->GetName(), collisionsPW, wallsPerParticle, [&](SCollision* _collisions, size_t _count)
+		{
+			for (size_t i = 0; i < _count; ++i)
+			{
+				model->Calculate(0, timeStep, &_collisions[i]);
+				model->ConsolidatePart(0, timeStep, particles, &_collisions[i]);
+			}
+		}, [&](SCollision* _collisions, size_t _count)
+		{
+			model->CalculateBatch(0, timeStep, particles, _collisions, _count);
+		});
+	}
+	std::cout << std::endl;
+}
+
+void RunContactDetectionBenchmark()
+{
+	constexpr size_t particlesNumber = 30000;
+	constexpr size_t stepsNumber = 200;
+	constexpr double timeStep = 1e-4;
+	constexpr double velocity = 0.5;
+
+	// particles with random positions and velocities; only the time of updates of verlet lists is measured
+	struct SScene
+	{
+		std::string name;
+		CVector3 size;				// size of the domain
+		double minRadius, maxRadius;	// radii are distributed log-uniformly
+	};
+	const std::vector<SScene> scenes{
+		{ "Slender column, monodisperse", CVector3{ 0.02, 0.02, 2.0 }, 1e-3, 1e-3 },
+		{ "Cube, polydisperse 1:25", CVector3{ 0.2, 0.2, 0.2 }, 2e-4, 5e-3 } };
+
+	const auto Run = [&](const SScene& _scene, CVerletList::EBroadPhase _broadPhase, std::pair<std::vector<size_t>, std::vector<unsigned>>& _list)
+	{
+		std::mt19937 rng{ 0 };
+		std::uniform_real_distribution<double> distr{ 0.0, 1.0 };
+		CSimplifiedScene scene;
+		std::vector<CVector3> velocities(particlesNumber);
+		for (size_t i = 0; i < particlesNumber; ++i)
+		{
+			const double radius = _scene.minRadius * std::pow(_scene.maxRadius / _scene.minRadius, distr(rng));
+			const CVector3 coord = EntryWiseProduct(CVector3{ distr(rng), distr(rng), distr(rng) }, _scene.size);
+			scene.AddParticle(i, 0, 0, radius, radius, 1, 1, coord, CVector3{ 0 }, CVector3{ 0 }, CQuaternion{}, 0, 0);
+			velocities[i] = (CVector3{ distr(rng), distr(rng), distr(rng) } * 2 - CVector3{ 1 }) * velocity;
+		}
+		SParticleStruct& particles = scene.GetRefToParticles();
+		CVerletList verletList{ scene };
+		// particles may slightly leave the box before bouncing, so the simulation domain is larger
+		verletList.SetSceneInfo(SVolumeType{ CVector3{ -_scene.maxRadius }, _scene.size + CVector3{ _scene.maxRadius } }, _scene.minRadius, _scene.maxRadius, DEFAULT_MAX_CELLS, DEFAULT_VERLET_DISTANCE_COEFF, false);
+		verletList.SetBroadPhase(_broadPhase);
+		verletList.ResetCurrentData();
+
+		size_t updates = 0;
+		std::chrono::duration<double> elapsed{ 0 };
+		for (size_t iStep = 0; iStep < stepsNumber; ++iStep)
+		{
+			if (verletList.IsNeedToBeUpdated(timeStep, scene.GetMaxPartVerletDistance(), 0))
+			{
+				const auto start = std::chrono::steady_clock::now();
+				verletList.UpdateList(iStep * timeStep);
+				elapsed += std::chrono::steady_clock::now() - start;
+				++updates;
+			}
+			for (size_t i = 0; i < particlesNumber; ++i)
+			{
+				particles.Coord(i) += velocities[i] * timeStep;
+				for (size_t j = 0; j < 3; ++j)
+					if (particles.Coord(i)[j] < 0 || particles.Coord(i)[j] > _scene.size[j])
+						velocities[i][j] *= -1;
+			}
+		}
+		_list = { verletList.m_PPList.Offsets(), verletList.m_PPList.IDs() };
+		std::cout << "    " << (_broadPhase == CVerletList::EBroadPhase::GRID ? "Grid:            " : "Sweep and prune: ") << elapsed.count() * 1e3 / std::max<size_t>(updates, 1) << " ms per update, "
+			<< updates << " updates, " << _list.second.size() << " possible contacts" << std::endl;
+		return elapsed.count() / std::max<size_t>(updates, 1);
+	};
+
+	InitializeThreadPool();
+	std::cout << "Measuring contact detection with " << particlesNumber << " particles on " << GetThreadsNumber() << " threads" << std::endl;
+	for (const auto& s : scenes)
+	{
+		std::cout << "  " << s.name << ":" << std::endl;
+		std::pair<std::vector<size_t>, std::vector<unsigned>> gridList, sweepList;
+		const double gridTime = Run(s, CVerletList::EBroadPhase::GRID, gridList);
+		const double sweepTime = Run(s, CVerletList::EBroadPhase::SWEEP_AND_PRUNE, sweepList);
+		std::cout << "    Speedup " << gridTime / sweepTime << (gridList == sweepList ? "" : " - LISTS DIFFER") << std::endl;
+	}
+	std::cout << std::endl;
+}
+
+void RunPeriodicListsCheck()
+{
+	constexpr size_t particlesNumber = 20000;
+	constexpr double size = 0.3;
+	constexpr double minRadius = 2e-3;
+	constexpr double maxRadius = 1e-2;
+	constexpr size_t updatesNumber = 5;
+
+	// periodic axes as bit masks: x, xy, xyz
+	const std::vector<std::pair<std::string, unsigned>> axes{ { "x", 1 }, { "xy", 3 }, { "xyz", 7 } };
+	using pairs_t = std::vector<std::tuple<unsigned, unsigned, uint8_t>>;
+
+	// polydisperse bed with some inactive particles, a bottom plane and walls crossing the periodic boundaries
+	const auto Run = [&](unsigned _axes, bool _sizeClasses, bool _wallBVH, bool _implicit, pairs_t& _pp, pairs_t& _pw)
+	{
+		std::mt19937 rng{ 0 };
+		std::uniform_real_distribution<double> distr{ 0.0, 1.0 };
+		CSimplifiedScene scene;
+		for (size_t i = 0; i < particlesNumber; ++i)
+		{
+			const double radius = minRadius + (maxRadius - minRadius) * distr(rng) * distr(rng);
+			scene.AddParticle(i, 0, 0, radius, radius, 1, 1, CVector3{ distr(rng), distr(rng), distr(rng) } * size, CVector3{ 0 }, CVector3{ 0 }, CQuaternion{}, 0, 0);
+		}
+		SParticleStruct& particles = scene.GetRefToParticles();
+		for (size_t i = 0; i < particlesNumber; i += 17)
+			particles.Active(i) = false;
+		SWallStruct& walls = scene.GetRefToWalls();
+		walls.AddWall(true, 0, CVector3{ -0.1, -0.1, 0.05 }, CVector3{ 0.4, -0.1, 0.05 }, CVector3{ 0.4, 0.4, 0.05 }, CVector3{ 0, 0, 1 }, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 });
+		walls.AddWall(true, 1, CVector3{ -0.1, -0.1, 0.05 }, CVector3{ 0.4, 0.4, 0.05 }, CVector3{ -0.1, 0.4, 0.05 }, CVector3{ 0, 0, 1 }, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 });
+		walls.AddWall(true, 2, CVector3{ 0.29, 0.0, 0.0 }, CVector3{ 0.31, 0.3, 0.0 }, CVector3{ 0.29, 0.0, 0.3 }, CVector3{ -1, 0, 0 }, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 });
+		walls.AddWall(true, 3, CVector3{ 0.005, 0.0, 0.0 }, CVector3{ 0.005, 0.3, 0.0 }, CVector3{ 0.005, 0.0, 0.3 }, CVector3{ 1, 0, 0 }, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 });
+		scene.UpdateParticlesToBonds();
+		scene.m_PBC.SetDefaultValues();
+		scene.m_PBC.bEnabled = true;
+		scene.m_PBC.bX = _axes & 1;
+		scene.m_PBC.bY = _axes & 2;
+		scene.m_PBC.bZ = _axes & 4;
+		scene.m_PBC.SetDomain(CVector3{ 0 }, CVector3{ size });
+
+		CVerletList verletList{ scene };
+		verletList.SetSizeClassSkin(_sizeClasses);
+		verletList.SetWallBVH(_wallBVH);
+		verletList.SetSceneInfo(SVolumeType{ CVector3{ -0.1 }, CVector3{ size + 0.1 } }, minRadius, maxRadius, DEFAULT_MAX_CELLS, DEFAULT_VERLET_DISTANCE_COEFF, false);
+		verletList.SetConnectedPPContact(false);
+		verletList.SetImplicitPBC(_implicit);
+		scene.SaveVerletCoords();
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < updatesNumber; ++i)
+		{
+			verletList.ResetCurrentData();
+			verletList.UpdateList(0);
+		}
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		// pairs with their virtual shifts, sorted to compare the sets independently of the order within rows
+		for (size_t i = 0; i < verletList.m_PPList.Rows(); ++i)
+			for (size_t j = 0; j < verletList.m_PPList.Size(i); ++j)
+				_pp.emplace_back(static_cast<unsigned>(i), verletList.m_PPList.ID(i, j), verletList.m_PPList.Shift(i, j));
+		for (size_t i = 0; i < verletList.m_PWList.Rows(); ++i)
+			for (size_t j = 0; j < verletList.m_PWList.Size(i); ++j)
+				_pw.emplace_back(static_cast<unsigned>(i), verletList.m_PWList.ID(i, j), verletList.m_PWList.Shift(i, j));
+		std::sort(_pp.begin(), _pp.end());
+		std::sort(_pw.begin(), _pw.end());
+		return elapsed.count() / updatesNumber;
+	};
+
+	InitializeThreadPool();
+	std::cout << "Comparing verlet lists with implicit PBC and with virtual particles on a periodic polydisperse bed with " << particlesNumber << " particles, on " << GetThreadsNumber() << " threads" << std::endl;
+	bool allEqual = true;
+	for (const auto& [name, mask] : axes)
+		for (const bool sizeClasses : { false, true })
+			for (const bool wallBVH : { false, true })
+			{
+				pairs_t ghostPP, ghostPW, implicitPP, implicitPW;
+				const double ghostTime = Run(mask, sizeClasses, wallBVH, false, ghostPP, ghostPW);
+				const double implicitTime = Run(mask, sizeClasses, wallBVH, true, implicitPP, implicitPW);
+				const size_t shifted = std::count_if(implicitPP.begin(), implicitPP.end(), [](const auto& _p) { return std::get<2>(_p) != 0; });
+				const bool equal = ghostPP == implicitPP && ghostPW == implicitPW;
+				allEqual &= equal;
+				std::cout << "  Periodic " << name << (sizeClasses ? ", size classes" : "") << (wallBVH ? ", walls BVH" : "") << ": " << implicitPP.size() << " PP (" << shifted << " across boundaries), " << implicitPW.size() << " PW, "
+					<< ghostTime << " / " << implicitTime << " ms per update with virtual particles / implicit" << (equal ? "" : " - LISTS DIFFER") << std::endl;
+			}
+	std::cout << (allEqual ? "  All lists are identical" : "  SOME LISTS DIFFER") << std::endl;
+	std::cout << std::endl;
+}
+
+void RunVerletDistanceBenchmark()
+{
+	constexpr size_t particlesNumber = 20000;
+	constexpr size_t stepsNumber = 1000;
+	constexpr double timeStep = 1e-4;
+	constexpr double velocity = 0.5;
+	constexpr double minRadius = 2e-4;
+	constexpr double maxRadius = 1e-3;
+	const CVector3 size{ 0.1, 0.1, 0.1 };
+
+	// particles with random positions and velocities; time of updates of verlet lists and of checking of all possible contacts in each step is measured
+	const auto Run = [&](bool _costModel)
+	{
+		std::mt19937 rng{ 0 };
+		std::uniform_real_distribution<double> distr{ 0.0, 1.0 };
+		CSimplifiedScene scene;
+		std::vector<CVector3> velocities(particlesNumber);
+		for (size_t i = 0; i < particlesNumber; ++i)
+		{
+			const double radius = minRadius * std::pow(maxRadius / minRadius, distr(rng));
+			const CVector3 coord = EntryWiseProduct(CVector3{ distr(rng), distr(rng), distr(rng) }, size);
+			scene.AddParticle(i, 0, 0, radius, radius, 1, 1, coord, CVector3{ 0 }, CVector3{ 0 }, CQuaternion{}, 0, 0);
+			velocities[i] = (CVector3{ distr(rng), distr(rng), distr(rng) } * 2 - CVector3{ 1 }) * velocity;
+		}
+		SParticleStruct& particles = scene.GetRefToParticles();
+		CVerletList verletList{ scene };
+		verletList.SetSceneInfo(SVolumeType{ CVector3{ -maxRadius }, size + CVector3{ maxRadius } }, minRadius, maxRadius, DEFAULT_MAX_CELLS, DEFAULT_VERLET_DISTANCE_COEFF, true);
+		verletList.SetCostModel(_costModel);
+		verletList.ResetCurrentData();
+
+		size_t updates = 0, candidates = 0;
+		std::vector<unsigned> contacts(particlesNumber);
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t iStep = 0; iStep < stepsNumber; ++iStep)
+		{
+			if (verletList.IsNeedToBeUpdated(timeStep, scene.GetMaxPartVerletDistance(), 0))
+			{
+				verletList.UpdateList(iStep * timeStep);
+				++updates;
+			}
+			candidates += verletList.m_PPList.Size();
+			const auto stepStart = std::chrono::steady_clock::now();
+			ParallelFor(particlesNumber, [&](size_t i)
+			{
+				contacts[i] = 0;
+				for (const unsigned j : verletList.m_PPList.Row(i))
+					if (SquaredLength(particles.Coord(i) - particles.Coord(j)) <= std::pow(particles.ContactRadius(i) + particles.ContactRadius(j), 2))
+						contacts[i]++;
+			});
+			verletList.AddStepDuration(std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count());
+			for (size_t i = 0; i < particlesNumber; ++i)
+			{
+				particles.Coord(i) += velocities[i] * timeStep;
+				for (size_t j = 0; j < 3; ++j)
+					if (particles.Coord(i)[j] < 0 || particles.Coord(i)[j] > size[j])
+						velocities[i][j] *= -1;
+			}
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "  " << (_costModel ? "Cost model:    " : "Measured time: ") << elapsed.count() << " s, " << updates << " updates, "
+			<< candidates / stepsNumber << " possible contacts per step, final verlet distance " << verletList.GetVerletDistance() << " m" << std::endl;
+		if (_costModel)
+			for (const auto& d : verletList.GetDistanceDecisions())
+				std::cout << "    t = " << d.dTime << " s: " << d.dOldDistance << " -> " << d.dNewDistance << " m, measured update / step " << d.dUpdateDuration * 1e3 << " / " << d.dStepDuration * 1e3
+					<< " ms, predicted cost " << d.dOldCost << " -> " << d.dNewCost << " s per simulated second" << std::endl;
+		return elapsed.count();
+	};
+
+	InitializeThreadPool();
+	std::cout << "Measuring adjustment of verlet distance with " << particlesNumber << " particles, polydisperse 1:" << maxRadius / minRadius << ", on " << GetThreadsNumber() << " threads" << std::endl;
+	const double timeModel = Run(false);
+	const double costModel = Run(true);
+	std::cout << "  Speedup " << timeModel / costModel << std::endl;
+	std::cout << std::endl;
+}
+
+void RunContactHistoryBenchmark()
+{
+	constexpr size_t cellsNumber = 24;		// number of unit cells of the lattice in each direction
+	constexpr size_t repeatsNumber = 100;
+	constexpr double radius = 1e-3;
+	constexpr double overlap = 0.01;		// overlap of neighbouring particles relative to their diameter
+	constexpr double jitter = 0.004;		// random displacement of particles relative to their diameter
+	// ratios of contact radius to radius: only touching neighbours (12 contacts), and contact radii reaching the second (18) and the third (42) shell of neighbours, as for liquid bridges or cohesive contacts
+	const std::vector<double> contactRadiusRatios{ 1.0, 1.45, 1.75 };
+
+	// compacted bed: particles on a face-centred cubic lattice with 12 neighbours each, slightly displaced, so that most of neighbours overlap
+	std::mt19937 rng{ 0 };
+	std::uniform_real_distribution<double> distr{ -1.0, 1.0 };
+	const double lattice = 2 * radius * (1 - overlap) * std::sqrt(2.0);
+	const CVector3 basis[4]{ CVector3{ 0, 0, 0 }, CVector3{ 0.5, 0.5, 0 }, CVector3{ 0.5, 0, 0.5 }, CVector3{ 0, 0.5, 0.5 } };
+	std::vector<CVector3> coords;
+	for (size_t x = 0; x < cellsNumber; ++x)
+		for (size_t y = 0; y < cellsNumber; ++y)
+			for (size_t z = 0; z < cellsNumber; ++z)
+				for (const auto& b : basis)
+					coords.push_back((CVector3{ static_cast<double>(x), static_cast<double>(y), static_cast<double>(z) } + b) * lattice + CVector3{ distr(rng), distr(rng), distr(rng) } * 2 * radius * jitter);
+	const size_t particlesNumber = coords.size();
+	const double size = lattice * cellsNumber;
+	InitializeThreadPool();
+
+	std::cout << "Measuring lookup of contact history with " << particlesNumber << " particles in a compacted bed, " << repeatsNumber << " steps, on " << GetThreadsNumber() << " threads" << std::endl;
+	for (const double ratio : contactRadiusRatios)
+	{
+		const double contactRadius = radius * ratio;
+		CSimplifiedScene scene;
+		for (size_t i = 0; i < particlesNumber; ++i)
+			scene.AddParticle(i, 0, 0, radius, contactRadius, 1, 1, coords[i], CVector3{ 0 }, CVector3{ 0 }, CQuaternion{}, 0, 0);
+		const SParticleStruct& particles = scene.GetRefToParticles();
+		CVerletList verletList{ scene };
+		verletList.SetSceneInfo(SVolumeType{ CVector3{ -2 * contactRadius }, CVector3{ size + 2 * contactRadius } }, contactRadius, contactRadius, DEFAULT_MAX_CELLS, DEFAULT_VERLET_DISTANCE_COEFF, false);
+		verletList.ResetCurrentData();
+		verletList.UpdateList(0);
+
+		const auto IsContact = [&](size_t _i, size_t _j)
+		{
+			return SquaredLength(particles.Coord(_j) - particles.Coord(_i)) < std::pow(particles.ContactRadius(_i) + particles.ContactRadius(_j), 2);
+		};
+
+		// contact history of the previous step, ordered by partners within each particle as in verlet lists
+		std::vector<size_t> sizes(particlesNumber, 0);
+		std::vector<std::vector<SCollision>> parts(1);
+		for (size_t i = 0; i < particlesNumber; ++i)
+			for (const unsigned j : verletList.m_PPList.Row(i))
+				if (IsContact(i, j))
+				{
+					SCollision coll;
+					coll.nSrcID = static_cast<unsigned>(i);
+					coll.nDstID = j;
+					parts.front().push_back(coll);
+					sizes[i]++;
+				}
+		CCollisionsMatrix history;
+		history.Assign(sizes, parts);
+
+		// each existing contact is looked up in the contact history of its particle; found contacts are counted to compare both methods.
+		// every step is timed separately to report the spread of measurements
+		const auto Run = [&](bool _merge, const std::string& _name)
+		{
+			std::vector<size_t> found(GetThreadsNumber(), 0);
+			std::vector<double> times(repeatsNumber);
+			for (size_t iRepeat = 0; iRepeat < repeatsNumber; ++iRepeat)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				ParallelFor(particlesNumber, EScheduling::CONTIGUOUS, [&](size_t iThread, size_t i)
+				{
+					const auto oldColls = history.Row(i);
+					const SCollision* itOld = oldColls.begin();
+					for (const unsigned j : verletList.m_PPList.Row(i))
+					{
+						if (!IsContact(i, j)) continue;
+						const SCollision* pOldCollision = nullptr;
+						if (_merge)
+						{
+							while (itOld != oldColls.end() && itOld->nDstID < j)
+								++itOld;
+							if (itOld != oldColls.end() && itOld->nDstID == j)
+								pOldCollision = itOld;
+						}
+						else
+							for (const auto& oldColl : oldColls)
+								if (oldColl.nDstID == j)
+								{
+									pOldCollision = &oldColl;
+									break;
+								}
+						found[iThread] += pOldCollision != nullptr;
+					}
+				});
+				times[iRepeat] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			std::sort(times.begin(), times.end());
+			const double median = times[repeatsNumber / 2];
+			std::cout << "    " << _name << "min / median / max " << times.front() << " / " << median << " / " << times.back() << " ms per step, " << VectorSum(found) / repeatsNumber << " contacts found" << std::endl;
+			return std::make_pair(median, VectorSum(found));
+		};
+
+		std::cout << "  Contact radius " << ratio << " of radius, " << 2. * static_cast<double>(history.Size()) / static_cast<double>(particlesNumber)
+			<< " contacts and " << 2. * static_cast<double>(verletList.m_PPList.Size()) / static_cast<double>(particlesNumber) << " possible contacts per particle" << std::endl;
+		const auto linear = Run(false, "Linear search: ");
+		const auto merge = Run(true, "Merge-join:    ");
+		std::cout << "    Speedup of median " << linear.first / merge.first << (linear.second == merge.second ? "" : " - RESULTS DIFFER") << std::endl;
+	}
+	std::cout << std::endl;
+}
+
 void RunMusen(const std::string& _arg)
 {
 	InitializeThreadPool();
@@ -136,7 +683,7 @@ int main(int argc, const char *argv[])
 	std::signal(SIGBREAK, SignalHandler);
 #else
 	std::signal(SIGQUIT , SignalHandler);
-	std::signal(SIGUSR1 , SignalHandler);
+	std::signal(SIGUSR1 , CheckpointSignalHandler);
 	std::signal(SIGUSR2 , SignalHandler);
 #endif
 
@@ -156,6 +703,18 @@ int main(int argc, const char *argv[])
 		SetMaxThreads(parser.IsArgumentExist("t") ? parser.GetArgument("t") : parser.GetArgument("threads"));
 	if (parser.IsArgumentExist("affinity") || parser.IsArgumentExist("a"))
 		SetThreadsList(parser.IsArgumentExist("a") ? parser.GetArgument("a") : parser.GetArgument("affinity"));
+	if (parser.IsArgumentExist("benchmark") || parser.IsArgumentExist("b"))
+		RunThreadPoolBenchmark();
+	if (parser.IsArgumentExist("contacts") || parser.IsArgumentExist("c"))
+		RunContactModelsBenchmark();
+	if (parser.IsArgumentExist("detection") || parser.IsArgumentExist("d"))
+		RunContactDetectionBenchmark();
+	if (parser.IsArgumentExist("periodic") || parser.IsArgumentExist("p"))
+		RunPeriodicListsCheck();
+	if (parser.IsArgumentExist("optimizer") || parser.IsArgumentExist("o"))
+		RunVerletDistanceBenchmark();
+	if (parser.IsArgumentExist("join") || parser.IsArgumentExist("j"))
+		RunContactHistoryBenchmark();
 	if (parser.IsArgumentExist("script") || parser.IsArgumentExist("s"))
 		RunMusen(parser.IsArgumentExist("s") ? parser.GetArgument("s") : parser.GetArgument("script"));
 
@@ -6,6 +6,8 @@
 #include "MixedFunctions.h"
 #include "ThreadPool.h"
 #include "MUSENDefinitions.h"
+#include "BinaryStream.h"
+#include <sstream>
 
 CModelEFLiquidDiffusion::CModelEFLiquidDiffusion()
 {
@@ -94,6 +96,7 @@ void CModelEFLiquidDiffusion::PrecalculateEF(double _time, double _timeStep, SPa
 	{
 		DetectAnnealing();
 		InitializeDiffusionModelCPU(_timeStep);
+		RestoreStateCPU();
 	}
 
 	// update temperature if necessary
@@ -255,6 +258,41 @@ void CModelEFLiquidDiffusion::InitializeDiffusionModelCPU(double _timeStep)
 	m_nStatesCPU = desNumStates; // Set number of states present in memory to desired number of states --> ensures if is only entered at beginning and if particle number changes
 }
 
+void CModelEFLiquidDiffusion::RestoreStateCPU()
+{
+	if (m_restoredStateCPU.empty()) return;
+	std::istringstream ss{ m_restoredStateCPU };
+	size_t nStates;
+	ss >> m_curTemp >> m_temperatureCoefCPU >> nStates;
+	// random sequences can be continued only for the same particles
+	if (nStates == m_nStatesCPU)
+		for (size_t i = 0; i < m_nStatesCPU; ++i)
+			ss >> m_pGeneratorsCPU[i];
+	m_restoredStateCPU.clear();
+}
+
+void CModelEFLiquidDiffusion::SaveState(std::ostream& _s) const
+{
+	// generators are written in their standard text representation, which is the only portable way to access their state
+	std::ostringstream ss;
+	ss.precision(17);
+	ss << m_curTemp << " " << m_temperatureCoefCPU << " " << m_nStatesCPU;
+	for (size_t i = 0; i < m_nStatesCPU; ++i)
+		ss << " " << m_pGeneratorsCPU[i];
+	const std::string str = ss.str();
+	WriteBinary(_s, std::vector<char>{ str.begin(), str.end() });
+}
+
+void CModelEFLiquidDiffusion::LoadState(std::istream& _s)
+{
+	std::vector<char> str;
+	ReadBinary(_s, str);
+	m_restoredStateCPU.assign(str.begin(), str.end());
+	// generators already exist if the model has been used in this simulator before
+	if (m_nStatesCPU != 0 && m_nStatesCPU == Particles().Size())
+		RestoreStateCPU();
+}
+
 void CModelEFLiquidDiffusion::UpdateTemperatureCPU(double newTemperature)
 {
 	m_temperatureCoefCPU = std::sqrt(newTemperature/m_parameters[0].value);
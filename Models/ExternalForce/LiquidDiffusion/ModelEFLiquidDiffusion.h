@@ -46,6 +46,8 @@ class CModelEFLiquidDiffusion : public CExternalForceModel
 	double m_tauMinLin = std::numeric_limits<double>::max();
 	double m_tauMinRot = std::numeric_limits<double>::max();
 
+	std::string m_restoredStateCPU; // state of temperature and random number generators restored from a checkpoint; applied once generators are created
+
 	unsigned m_maxPartIndex = 0;
 	unsigned* m_pParticleIndexMapCPU{}; // needed to map index stored in particle property (shifted because of bonds etc) to index used in this model for RNG. Not needed on GPU as all particles are stored together behind each other with consecutive indexes
 
@@ -74,6 +76,10 @@ public:
 	void InitializeSeedsAndRandomGeneratorsCPU(size_t _desNumStates);
 	void CalculateEF(double _time, double _timeStep, size_t _iPart, SParticleStruct& _particles) const override;
 	void CreateUniqueSeeds64(uint64_t* _pSeeds64, unsigned _desNumStates);
+	void RestoreStateCPU();
+
+	void SaveState(std::ostream& _s) const override;
+	void LoadState(std::istream& _s) override;
 
 	//////////////////////////////////////////////////////////////////////////
 	/// GPU Implementation.
@@ -3,6 +3,7 @@
    See LICENSE file for license and warranty information. */
 
 #include "ModelPPHertzMindlin.h"
+#include "CPUFeatures.h"
 
 CModelPPHertzMindlin::CModelPPHertzMindlin()
 {
@@ -90,3 +91,178 @@ void CModelPPHertzMindlin::ConsolidateDst(double _time, double _timeStep, size_t
 	_particles.Force(_iPart) -= _collision->vTotalForce;
 	_particles.Moment(_iPart) += _collision->vResultMoment2;
 }
+
+#ifdef MUSEN_X86_64
+namespace
+{
+	// Components of four vectors, one vector per lane.
+	struct SVector4
+	{
+		__m256d x, y, z;
+	};
+
+	// Collects values _get(0..3) into lanes.
+	template<typename F>
+	MUSEN_TARGET_AVX2 inline __m256d Gather(const F& _get)
+	{
+		return _mm256_set_pd(_get(3), _get(2), _get(1), _get(0));
+	}
+
+	// Collects vectors _get(0..3) into lanes.
+	template<typename F>
+	MUSEN_TARGET_AVX2 inline SVector4 GatherVector(const F& _get)
+	{
+		const CVector3 v0 = _get(0), v1 = _get(1), v2 = _get(2), v3 = _get(3);
+		return { _mm256_set_pd(v3.x, v2.x, v1.x, v0.x), _mm256_set_pd(v3.y, v2.y, v1.y, v0.y), _mm256_set_pd(v3.z, v2.z, v1.z, v0.z) };
+	}
+
+	// Writes vectors from lanes into _set(0..3, vector).
+	template<typename F>
+	MUSEN_TARGET_AVX2 inline void ScatterVector(const SVector4& _v, const F& _set)
+	{
+		alignas(32) double x[4], y[4], z[4];
+		_mm256_store_pd(x, _v.x);
+		_mm256_store_pd(y, _v.y);
+		_mm256_store_pd(z, _v.z);
+		for (size_t i = 0; i < 4; ++i)
+			_set(i, CVector3{ x[i], y[i], z[i] });
+	}
+
+	MUSEN_TARGET_AVX2 inline SVector4 operator+(const SVector4& _a, const SVector4& _b) { return { _mm256_add_pd(_a.x, _b.x), _mm256_add_pd(_a.y, _b.y), _mm256_add_pd(_a.z, _b.z) }; }
+	MUSEN_TARGET_AVX2 inline SVector4 operator-(const SVector4& _a, const SVector4& _b) { return { _mm256_sub_pd(_a.x, _b.x), _mm256_sub_pd(_a.y, _b.y), _mm256_sub_pd(_a.z, _b.z) }; }
+	MUSEN_TARGET_AVX2 inline SVector4 operator*(const SVector4& _a, __m256d _d) { return { _mm256_mul_pd(_a.x, _d), _mm256_mul_pd(_a.y, _d), _mm256_mul_pd(_a.z, _d) }; }
+	MUSEN_TARGET_AVX2 inline SVector4 operator/(const SVector4& _a, __m256d _d) { return { _mm256_div_pd(_a.x, _d), _mm256_div_pd(_a.y, _d), _mm256_div_pd(_a.z, _d) }; }
+	// Cross product, the same as for CVector3.
+	MUSEN_TARGET_AVX2 inline SVector4 operator*(const SVector4& _a, const SVector4& _b)
+	{
+		return {
+			_mm256_sub_pd(_mm256_mul_pd(_a.y, _b.z), _mm256_mul_pd(_a.z, _b.y)),
+			_mm256_sub_pd(_mm256_mul_pd(_a.z, _b.x), _mm256_mul_pd(_a.x, _b.z)),
+			_mm256_sub_pd(_mm256_mul_pd(_a.x, _b.y), _mm256_mul_pd(_a.y, _b.x)) };
+	}
+	MUSEN_TARGET_AVX2 inline __m256d Dot(const SVector4& _a, const SVector4& _b) { return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_a.x, _b.x), _mm256_mul_pd(_a.y, _b.y)), _mm256_mul_pd(_a.z, _b.z)); }
+	MUSEN_TARGET_AVX2 inline __m256d Length(const SVector4& _a) { return _mm256_sqrt_pd(Dot(_a, _a)); }
+	MUSEN_TARGET_AVX2 inline __m256d Abs(__m256d _a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), _a); }
+	MUSEN_TARGET_AVX2 inline __m256d Neg(__m256d _a) { return _mm256_xor_pd(_mm256_set1_pd(-0.0), _a); }
+	// Selects _a in lanes where _mask is set, otherwise _b.
+	MUSEN_TARGET_AVX2 inline SVector4 Select(__m256d _mask, const SVector4& _a, const SVector4& _b) { return { _mm256_blendv_pd(_b.x, _a.x, _mask), _mm256_blendv_pd(_b.y, _a.y, _mask), _mm256_blendv_pd(_b.z, _a.z, _mask) }; }
+	// Mask of lanes with significant vectors, the same as CVector3::IsSignificant().
+	MUSEN_TARGET_AVX2 inline __m256d IsSignificant(const SVector4& _a)
+	{
+		const __m256d minValue = _mm256_set1_pd(1e-100);
+		return _mm256_or_pd(_mm256_or_pd(_mm256_cmp_pd(Abs(_a.x), minValue, _CMP_GT_OQ), _mm256_cmp_pd(Abs(_a.y), minValue, _CMP_GT_OQ)), _mm256_cmp_pd(Abs(_a.z), minValue, _CMP_GT_OQ));
+	}
+
+	// Calculates four collisions at once. Repeats operations of CModelPPHertzMindlin::CalculatePP() in the same order,
+	// so results differ from the scalar version only if the compiler contracts scalar operations into fused multiply-add.
+	MUSEN_TARGET_AVX2 void CalculatePP4(double _timeStep, const SParticleStruct& _particles, const SInteractProps* const _props[4], SCollision* _collisions)
+	{
+		const auto src = [&](size_t i) { return _collisions[i].nSrcID; };
+		const auto dst = [&](size_t i) { return _collisions[i].nDstID; };
+
+		const SVector4 anglVel1 = GatherVector([&](size_t i) { return _particles.AnglVel(src(i)); });
+		const SVector4 anglVel2 = GatherVector([&](size_t i) { return _particles.AnglVel(dst(i)); });
+		const SVector4 vel1     = GatherVector([&](size_t i) { return _particles.Vel(src(i)); });
+		const SVector4 vel2     = GatherVector([&](size_t i) { return _particles.Vel(dst(i)); });
+		const __m256d  radius1  = Gather([&](size_t i) { return _particles.Radius(src(i)); });
+		const __m256d  radius2  = Gather([&](size_t i) { return _particles.Radius(dst(i)); });
+
+		const SVector4 contactVector = GatherVector([&](size_t i) { return _collisions[i].vContactVector; });
+		const SVector4 oldTangOverlap = GatherVector([&](size_t i) { return _collisions[i].vTangOverlap; });
+		const __m256d  normOverlap   = Gather([&](size_t i) { return _collisions[i].dNormalOverlap; });
+		const __m256d  equivRadius   = Gather([&](size_t i) { return _collisions[i].dEquivRadius; });
+		const __m256d  equivMass     = Gather([&](size_t i) { return _collisions[i].dEquivMass; });
+
+		const __m256d youngModulus    = Gather([&](size_t i) { return _props[i]->dEquivYoungModulus; });
+		const __m256d shearModulus    = Gather([&](size_t i) { return _props[i]->dEquivShearModulus; });
+		const __m256d alpha           = Gather([&](size_t i) { return _props[i]->dAlpha; });
+		const __m256d slidingFriction = Gather([&](size_t i) { return _props[i]->dSlidingFriction; });
+		const __m256d rollingFriction = Gather([&](size_t i) { return _props[i]->dRollingFriction; });
+
+		const __m256d zero = _mm256_setzero_pd();
+		const SVector4 zeroVector{ zero, zero, zero };
+		const __m256d radiusSum = _mm256_add_pd(radius1, radius2);
+		const SVector4 rc1 = contactVector * _mm256_div_pd(radius1, radiusSum);
+		const SVector4 rc2 = contactVector * _mm256_div_pd(Neg(radius2), radiusSum);
+		const __m256d contactVectorLen = Length(contactVector);
+		const SVector4 normVector = Select(_mm256_cmp_pd(contactVectorLen, zero, _CMP_NEQ_OQ), contactVector / contactVectorLen, zeroVector);
+
+		// normal and tangential relative velocity
+		const SVector4 relVel        = (vel2 + anglVel2 * rc2) - (vel1 + anglVel1 * rc1);
+		const __m256d  normRelVelLen = Dot(normVector, relVel);
+		const SVector4 normRelVel    = normVector * normRelVelLen;
+		const SVector4 tangRelVel    = relVel - normRelVel;
+
+		// radius of the contact area
+		const __m256d contactAreaRadius = _mm256_sqrt_pd(_mm256_mul_pd(equivRadius, normOverlap));
+
+		// normal force with damping
+		const __m256d dampingFactor = _mm256_mul_pd(_mm256_set1_pd(-_2_SQRT_5_6), alpha);
+		const __m256d Kn = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2), youngModulus), contactAreaRadius);
+		const __m256d normContactForceLen = _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(Neg(normOverlap), Kn), _mm256_set1_pd(2.)), _mm256_set1_pd(3.));
+		const __m256d normDampingForceLen = _mm256_mul_pd(_mm256_mul_pd(dampingFactor, normRelVelLen), _mm256_sqrt_pd(_mm256_mul_pd(Kn, equivMass)));
+		const __m256d normForceLen = _mm256_add_pd(normContactForceLen, normDampingForceLen);
+		const SVector4 normForce = normVector * normForceLen;
+
+		// rotate old tangential overlap
+		SVector4 tangOverlapRot = oldTangOverlap - normVector * Dot(normVector, oldTangOverlap);
+		tangOverlapRot = Select(IsSignificant(tangOverlapRot), tangOverlapRot * _mm256_div_pd(Length(oldTangOverlap), Length(tangOverlapRot)), tangOverlapRot);
+		// calculate new tangential overlap
+		SVector4 tangOverlap = tangOverlapRot + tangRelVel * _mm256_set1_pd(_timeStep);
+
+		// tangential force with damping
+		const __m256d Kt = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(8), shearModulus), contactAreaRadius);
+		const SVector4 tangShearForce = tangOverlap * Kt;
+		const SVector4 tangDampingForce = tangRelVel * _mm256_mul_pd(dampingFactor, _mm256_sqrt_pd(_mm256_mul_pd(Kt, equivMass)));
+
+		// check slipping condition and calculate total tangential force
+		const __m256d tangShearForceLen = Length(tangShearForce);
+		const __m256d frictionForceLen = _mm256_mul_pd(slidingFriction, Abs(normForceLen));
+		const __m256d slip = _mm256_cmp_pd(tangShearForceLen, frictionForceLen, _CMP_GT_OQ);
+		const SVector4 slipTangForce = (tangShearForce * frictionForceLen) / tangShearForceLen;
+		const SVector4 tangForce = Select(slip, slipTangForce, tangShearForce + tangDampingForce);
+		tangOverlap = Select(slip, slipTangForce / Kt, tangOverlap);
+
+		// rolling torque
+		const __m256d rollingFactor = _mm256_mul_pd(Neg(rollingFriction), Abs(normContactForceLen));
+		const SVector4 rollingTorque1 = Select(IsSignificant(anglVel1), anglVel1 * _mm256_div_pd(_mm256_mul_pd(rollingFactor, radius1), Length(anglVel1)), zeroVector);
+		const SVector4 rollingTorque2 = Select(IsSignificant(anglVel2), anglVel2 * _mm256_div_pd(_mm256_mul_pd(rollingFactor, radius2), Length(anglVel2)), zeroVector);
+
+		// final forces and moments
+		const SVector4 totalForce = normForce + tangForce;
+		const SVector4 moment1    = (normVector * tangForce) * radius1 + rollingTorque1;
+		const SVector4 moment2    = (normVector * tangForce) * radius2 + rollingTorque2;
+
+		// store results in collisions
+		ScatterVector(tangOverlap, [&](size_t i, const CVector3& v) { _collisions[i].vTangOverlap   = v; });
+		ScatterVector(tangForce,   [&](size_t i, const CVector3& v) { _collisions[i].vTangForce     = v; });
+		ScatterVector(totalForce,  [&](size_t i, const CVector3& v) { _collisions[i].vTotalForce    = v; });
+		ScatterVector(moment1,     [&](size_t i, const CVector3& v) { _collisions[i].vResultMoment1 = v; });
+		ScatterVector(moment2,     [&](size_t i, const CVector3& v) { _collisions[i].vResultMoment2 = v; });
+	}
+}
+#endif
+
+void CModelPPHertzMindlin::CalculatePPBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	size_t i = 0;
+#ifdef MUSEN_X86_64
+	// groups of four collisions with vector instructions
+	if (GetInstructionSet() >= EInstructionSet::AVX2)
+		for (; i + 4 <= _count; i += 4)
+		{
+			SCollision* collisions = &_collisions[i];
+			const SInteractProps* props[4] = { &InteractionProperty(collisions[0].nInteractProp), &InteractionProperty(collisions[1].nInteractProp), &InteractionProperty(collisions[2].nInteractProp), &InteractionProperty(collisions[3].nInteractProp) };
+			CalculatePP4(_timeStep, Particles(), props, collisions);
+			for (size_t j = 0; j < 4; ++j)
+				CModelPPHertzMindlin::ConsolidateSrc(_time, _timeStep, collisions[j].nSrcID, _particles, &collisions[j]);
+		}
+#endif
+	// remaining collisions; qualified calls are resolved at compile time and can be inlined
+	for (; i < _count; ++i)
+	{
+		SCollision* collision = &_collisions[i];
+		CModelPPHertzMindlin::CalculatePP(_time, _timeStep, collision->nSrcID, collision->nDstID, InteractionProperty(collision->nInteractProp), collision);
+		CModelPPHertzMindlin::ConsolidateSrc(_time, _timeStep, collision->nSrcID, _particles, collision);
+	}
+}
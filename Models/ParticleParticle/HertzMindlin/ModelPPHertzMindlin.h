@@ -13,6 +13,7 @@ public:
 	void CalculatePP(double _time, double _timeStep, size_t _iSrc, size_t _iDst, const SInteractProps& _interactProp, SCollision* _collision) const override;
 	void ConsolidateSrc(double _time, double _timeStep, size_t _iPart, SParticleStruct& _particles, const SCollision* _collision) const override;
 	void ConsolidateDst(double _time, double _timeStep, size_t _iPart, SParticleStruct& _particles, const SCollision* _collision) const override;
+	void CalculatePPBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const override;
 
 	void SetParametersGPU(const std::vector<double>& _parameters, const SPBC& _pbc) override;
 	void CalculatePPGPU(double _time, double _timeStep, const SInteractProps _interactProps[], const SGPUParticles& _particles, SGPUCollisions& _collisions) override;
@@ -45,3 +45,14 @@ void CModelPPSimpleViscoElastic::ConsolidateDst(double _time, double _timeStep,
 {
 	_particles.Force(_iPart) -= _collision->vTotalForce;
 }
+
+void CModelPPSimpleViscoElastic::CalculatePPBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	// qualified calls are resolved at compile time and can be inlined
+	for (size_t i = 0; i < _count; ++i)
+	{
+		SCollision* collision = &_collisions[i];
+		CModelPPSimpleViscoElastic::CalculatePP(_time, _timeStep, collision->nSrcID, collision->nDstID, InteractionProperty(collision->nInteractProp), collision);
+		CModelPPSimpleViscoElastic::ConsolidateSrc(_time, _timeStep, collision->nSrcID, _particles, collision);
+	}
+}
@@ -90,3 +90,14 @@ void CModelPWHertzMindlin::ConsolidateWall(double _time, double _timeStep, size_
 {
 	_walls.Force(_iWall) -= _collision->vTotalForce;
 }
+
+void CModelPWHertzMindlin::CalculatePWBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	// qualified calls are resolved at compile time and can be inlined
+	for (size_t i = 0; i < _count; ++i)
+	{
+		SCollision* collision = &_collisions[i];
+		CModelPWHertzMindlin::CalculatePW(_time, _timeStep, collision->nSrcID, collision->nDstID, InteractionProperty(collision->nInteractProp), collision);
+		CModelPWHertzMindlin::ConsolidatePart(_time, _timeStep, collision->nDstID, _particles, collision);
+	}
+}
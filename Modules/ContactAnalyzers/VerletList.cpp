@@ -4,6 +4,9 @@
 
 #include "VerletList.h"
 #include <cfloat>
+#include <array>
+#include <numeric>
+#include <chrono>
 
 CVerletList::CVerletList(CSimplifiedScene& _Scene): m_Scene(_Scene),
 	m_nThreadsNumber(GetThreadsNumber()),
@@ -26,6 +29,16 @@ CVerletList::CVerletList(CSimplifiedScene& _Scene): m_Scene(_Scene),
 	m_nCellsMax = DEFAULT_MAX_CELLS;
 	m_dVerletDistanceCoeff = DEFAULT_VERLET_DISTANCE_COEFF;
 	m_bAutoAdjustVerletDistance = true;
+	m_bIncrementalUpdate = false;
+	m_incGrid = SIncrementalGrid{};
+	m_bFlatGrid = false;
+	m_broadPhase = EBroadPhase::GRID;
+	m_bWallBVH = false;
+	m_bSizeClassSkin = false;
+	m_dMaxSkin = 0;
+	m_nUpdates = 0;
+	m_bCostModel = false;
+	m_bImplicitPBC = false;
 }
 
 void CVerletList::InitializeList()
@@ -36,6 +49,10 @@ void CVerletList::InitializeList()
 	m_nAutoVerletDistNumerator = 0;
 	m_dVerletDistance = 0;
 	m_nThreadsNumber = GetThreadsNumber();
+	m_vSizeClasses.clear();
+	m_nUpdates = 0;
+	m_costCounters = SCostCounters{};
+	m_vDistanceDecisions.clear();
 }
 
 void CVerletList::SetSceneInfo(const SVolumeType& _simDomain, double _dMinPartRadius, double _dMaxPartRadius, uint32_t _dMaxCellsNumber, double _dVerletCoeff, bool _bAutoAdjust)
@@ -77,6 +94,35 @@ void CVerletList::SetSceneInfo(const SVolumeType& _simDomain, double _dMinPartRa
 		RecalculateGrid();
 }
 
+void CVerletList::SetFlatGrid(bool _bFlat)
+{
+	if (m_bFlatGrid == _bFlat) return;
+	m_bFlatGrid = _bFlat;
+	RecalculateGrid();
+}
+
+void CVerletList::SetBroadPhase(EBroadPhase _broadPhase)
+{
+	if (m_broadPhase == _broadPhase) return;
+	m_broadPhase = _broadPhase;
+	RecalculateGrid();
+}
+
+void CVerletList::SetWallBVH(bool _bEnable)
+{
+	if (m_bWallBVH == _bEnable) return;
+	m_bWallBVH = _bEnable;
+	m_wallBVH.Clear();
+	RecalculateGrid();
+}
+
+void CVerletList::SetSizeClassSkin(bool _bEnable)
+{
+	if (m_bSizeClassSkin == _bEnable) return;
+	m_bSizeClassSkin = _bEnable;
+	RecalculateGrid();
+}
+
 
 void CVerletList::EmptyGrid()
 {
@@ -95,64 +141,31 @@ void CVerletList::EmptyGrid()
 	m_vGrid.clear();
 }
 
-void CVerletList::SortList()
+void CVerletList::ClearNewContacts()
 {
-	std::vector<std::vector<unsigned>> vTempDst(m_PPList.size());  // iDst
-	std::vector<std::vector<uint8_t>> vTempVirt(m_PPList.size()); // virtData
-	// remove old contacts and save new ones
-	ParallelFor(m_PPList.size(), [&](size_t iSrc)
-	{
-		int j = 0;
-		while (j < m_PPList[iSrc].size())
-		{
-			const unsigned iDst = m_PPList[iSrc][j];
-			if (iDst < iSrc)
-			{
-				vTempDst[iSrc].push_back(iDst);
-				m_PPList[iSrc][j] = m_PPList[iSrc].back();
-				m_PPList[iSrc].pop_back();
-				if (m_Scene.m_PBC.bEnabled)
-				{
-					vTempVirt[iSrc].emplace_back(InverseVirtShift(m_PPVirtShift[iSrc][j]));
-					m_PPVirtShift[iSrc][j] = m_PPVirtShift[iSrc].back();
-					m_PPVirtShift[iSrc].pop_back();
-				}
-			}
-			else
-				j++;
-		}
-	});
-
-	// add new contacts
-	ParallelFor([&](size_t iThread)
+	m_vNewPP.resize(GetThreadsNumber());
+	m_vNewPW.resize(GetThreadsNumber());
+	for (size_t i = 0; i < m_vNewPP.size(); ++i)
 	{
-		for (size_t iSrc = 0; iSrc < vTempDst.size(); ++iSrc)
-			for (size_t i = 0; i < vTempDst[iSrc].size(); ++i)
-			{
-				const unsigned iDst = vTempDst[iSrc][i];
-				if (iDst % m_nThreadsNumber == iThread)
-				{
-					m_PPList[iDst].push_back(static_cast<unsigned>(iSrc));
-					if (m_Scene.m_PBC.bEnabled)
-						m_PPVirtShift[iDst].push_back(vTempVirt[iSrc][i]);
-				}
-			}
-	});
+		m_vNewPP[i].clear();
+		m_vNewPW[i].clear();
+	}
 }
 
 void CVerletList::RecalculateGrid()
 {
 	EmptyGrid();
 	ResetCurrentData();
+	RecalculateSizeClasses();
 
-	double dCurrCellSize = 2 * m_dMaxParticleRadius +  m_dVerletDistance;
+	double dCurrCellSize = 2 * m_dMaxParticleRadius + m_dMaxSkin;
 	if (dCurrCellSize == 0)	return;
 
 	// if PBC is enabled, the simulation domain must be large enough to allow generation of virtual particles outside PBC, but still inside the domain
 	if (m_Scene.m_PBC.bEnabled)
 	{
 		m_workDomain = m_SimDomain;
-		const double delta = m_dVerletDistance + 2 * m_dMaxParticleRadius;
+		const double delta = m_dMaxSkin + 2 * m_dMaxParticleRadius;
 		const CVector3 pbcSides{ (double)m_Scene.m_PBC.bX, (double)m_Scene.m_PBC.bY, (double)m_Scene.m_PBC.bZ };
 		for (size_t i = 0; i < 3; ++i)
 			if (pbcSides[i] != 0.0)
@@ -162,15 +175,29 @@ void CVerletList::RecalculateGrid()
 			}
 	}
 
+	if (m_broadPhase == EBroadPhase::SWEEP_AND_PRUNE) return; // no grid is needed
+
 	const double dAverLength = (m_workDomain.coordEnd.x - m_workDomain.coordBeg.x + m_workDomain.coordEnd.y - m_workDomain.coordBeg.y + m_workDomain.coordEnd.z - m_workDomain.coordBeg.z) / 3;
+	size_t iClass = 0;
 	do
 	{
 		m_vGrid.emplace_back();
 		SGridLevel& gl = m_vGrid.back();
 		gl.dCellSize = dCurrCellSize;
-		gl.dMaxPartRadius = (gl.dCellSize -  m_dVerletDistance) / 2;
-		dCurrCellSize /= 2; // proceed to the next grid
-		gl.dMinPartRadius = (dCurrCellSize -  m_dVerletDistance) / 2;
+		if (m_bSizeClassSkin)
+		{
+			// each level contains one size class; smaller particles have smaller verlet distances, so cells are large enough for all contacts of the class
+			gl.dMaxPartRadius = m_vSizeClasses[iClass].dMaxRadius;
+			gl.dMinPartRadius = m_vSizeClasses[iClass].dMinRadius;
+			++iClass; // proceed to the next grid
+			dCurrCellSize = iClass < m_vSizeClasses.size() ? 2 * m_vSizeClasses[iClass].dMaxRadius + m_vSizeClasses[iClass].dVerletDistance : 0;
+		}
+		else
+		{
+			gl.dMaxPartRadius = (gl.dCellSize -  m_dVerletDistance) / 2;
+			dCurrCellSize /= 2; // proceed to the next grid
+			gl.dMinPartRadius = (dCurrCellSize -  m_dVerletDistance) / 2;
+		}
 		if (dAverLength / gl.dCellSize > m_nCellsMax)
 		{
 			gl.dCellSize = dAverLength / m_nCellsMax;
@@ -185,152 +212,793 @@ void CVerletList::RecalculateGrid()
 		if (gl.nCellsY < 1) gl.nCellsY = 1;
 		if (gl.nCellsZ < 1) gl.nCellsZ = 1;
 
-		gl.grid.resize(gl.nCellsX);
-		for (unsigned x = 0; x < gl.nCellsX; ++x)
+		if (m_bFlatGrid)
+		{
+			const size_t nCells = static_cast<size_t>(gl.nCellsX) * gl.nCellsY * gl.nCellsZ;
+			gl.flatParts.vStart.assign(2 * nCells + 1, 0);
+			gl.flatWalls.vStart.assign(nCells + 1, 0);
+		}
+		else
 		{
-			gl.grid[x].resize(gl.nCellsY);
-			for (unsigned y = 0; y < gl.nCellsY; ++y)
-				gl.grid[x][y].resize(gl.nCellsZ);
+			gl.grid.resize(gl.nCellsX);
+			for (unsigned x = 0; x < gl.nCellsX; ++x)
+			{
+				gl.grid[x].resize(gl.nCellsY);
+				for (unsigned y = 0; y < gl.nCellsY; ++y)
+					gl.grid[x][y].resize(gl.nCellsZ);
+			}
 		}
 	} while (dCurrCellSize > 2*m_dMinParticleRadius +  m_dVerletDistance);
 
 	m_vGrid.back().dMinPartRadius = 0;
 }
 
+void CVerletList::RecalculateSizeClasses()
+{
+	// bounds of classes are halved radii, as in levels of the grid; all particles are in one class if they share the same verlet distance
+	std::vector<SSizeClass> vClasses(1);
+	vClasses.back().dMaxRadius = m_dMaxParticleRadius;
+	while (m_bSizeClassSkin && vClasses.size() < MAX_SIZE_CLASSES && vClasses.back().dMaxRadius / 2 > m_dMinParticleRadius)
+	{
+		vClasses.back().dMinRadius = vClasses.back().dMaxRadius / 2;
+		vClasses.emplace_back();
+		vClasses.back().dMaxRadius = vClasses[vClasses.size() - 2].dMinRadius;
+	}
+	const auto SameBounds = [](const SSizeClass& _c1, const SSizeClass& _c2) { return _c1.dMinRadius == _c2.dMinRadius && _c1.dMaxRadius == _c2.dMaxRadius; };
+	if (!std::equal(vClasses.begin(), vClasses.end(), m_vSizeClasses.begin(), m_vSizeClasses.end(), SameBounds))
+		m_vSizeClasses = vClasses;
+
+	// verlet distance grows with the smallest radius of the class; the smallest particles keep the common verlet distance
+	for (auto& sizeClass : m_vSizeClasses)
+		sizeClass.dVerletDistance = m_dMinParticleRadius > 0 ? m_dVerletDistance * std::max(1.0, sizeClass.dMinRadius / m_dMinParticleRadius) : m_dVerletDistance;
+	m_dMaxSkin = m_vSizeClasses.front().dVerletDistance;
+}
+
+unsigned CVerletList::GetSizeClass(double _dRadius) const
+{
+	unsigned iClass = 0;
+	while (iClass + 1 < m_vSizeClasses.size() && _dRadius <= m_vSizeClasses[iClass].dMinRadius - DBL_EPSILON)
+		++iClass;
+	return iClass;
+}
+
+void CVerletList::UpdateParticlesSkin()
+{
+	m_vPartClass.resize(m_vParticles.Size());
+	m_vHalfSkin.resize(m_vParticles.Size());
+	ParallelFor(m_vParticles.Size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+	{
+		m_vPartClass[i] = static_cast<uint8_t>(GetSizeClass(m_vParticles.ContactRadius(i)));
+		m_vHalfSkin[i] = m_vSizeClasses[m_vPartClass[i]].dVerletDistance / 2;
+	});
+}
+
+void CVerletList::GatherSizeClassStatistics()
+{
+	++m_nUpdates;
+	m_costCounters.nLastCandidates = m_PPList.Size();
+	const size_t nRows = m_PPList.Rows();
+	const size_t nBlocks = std::max<size_t>(std::min(GetThreadsNumber(), nRows), 1);
+	const auto BlockBegin = [&](size_t _iBlock) { return nRows * _iBlock / nBlocks; };
+	std::vector<std::array<size_t, MAX_SIZE_CLASSES>> vParticles(nBlocks), vCandidates(nBlocks);
+	ParallelFor(nBlocks, [&](size_t iBlock)
+	{
+		for (size_t i = BlockBegin(iBlock); i < BlockBegin(iBlock + 1); ++i)
+		{
+			if (!m_vParticles.Active(i)) continue;
+			const uint8_t iClass = m_vPartClass[i];
+			vParticles[iBlock][iClass]++;
+			// a contact between particles of different classes is counted for both of them
+			for (const unsigned j : m_PPList.Row(i))
+			{
+				vCandidates[iBlock][iClass]++;
+				if (m_vPartClass[j] != iClass)
+					vCandidates[iBlock][m_vPartClass[j]]++;
+			}
+		}
+	});
+	for (size_t iClass = 0; iClass < m_vSizeClasses.size(); ++iClass)
+	{
+		m_vSizeClasses[iClass].nParticles = 0;
+		for (size_t iBlock = 0; iBlock < nBlocks; ++iBlock)
+		{
+			m_vSizeClasses[iClass].nParticles += vParticles[iBlock][iClass];
+			m_vSizeClasses[iClass].nCandidates += vCandidates[iBlock][iClass];
+		}
+	}
+}
+
 bool CVerletList::IsNeedToBeUpdated(double _dTimeStep, double _dMaxPartDist, double _dMaxWallVel)
 {
+	m_costCounters.nStepsSinceUpdate++;
 	m_dMaxTheorWallDistance += _dMaxWallVel * _dTimeStep;
 	if (m_Scene.m_PBC.bEnabled)
 		m_dMaxTheorWallDistance += 2 * std::max({ fabs(m_Scene.m_PBC.vVel.x), fabs(m_Scene.m_PBC.vVel.y), fabs(m_Scene.m_PBC.vVel.z) });
-	return _dMaxPartDist+ std::max(m_dMaxTheorWallDistance, _dMaxPartDist) >= m_dVerletDistance;
+	// verlet distance of the smallest particles is the smallest one
+	if (_dMaxPartDist + std::max(m_dMaxTheorWallDistance, _dMaxPartDist) < m_dVerletDistance) return false;
+	if (m_dMaxTheorWallDistance >= DEFAULT_TEOR_DISTANCE) return true; // lists are not actual
+	if (m_vSizeClasses.size() <= 1)
+	{
+		if (!m_vSizeClasses.empty())
+			m_vSizeClasses.front().nTriggers++;
+		return true;
+	}
+
+	// possible contacts of two particles remain in the lists, while each of them moved less than a half of its own verlet distance,
+	// so each class is checked with its own distance; maximum squared displacements are negative for classes without active particles
+	const size_t nParticles = m_vParticles.Size();
+	const size_t nBlocks = std::max<size_t>(std::min(GetThreadsNumber(), nParticles), 1);
+	const auto BlockBegin = [&](size_t _iBlock) { return nParticles * _iBlock / nBlocks; };
+	std::vector<std::array<double, MAX_SIZE_CLASSES>> vBlockMaxDist(nBlocks);
+	ParallelFor(nBlocks, [&](size_t iBlock)
+	{
+		vBlockMaxDist[iBlock].fill(-1);
+		for (size_t i = BlockBegin(iBlock); i < BlockBegin(iBlock + 1); ++i)
+			if (m_vParticles.Active(i))
+			{
+				double& dMax = vBlockMaxDist[iBlock][GetSizeClass(m_vParticles.ContactRadius(i))];
+				dMax = std::max(dMax, SquaredLength(m_vParticles.Coord(i) - m_vParticles.CoordVerlet(i)));
+			}
+	});
+	bool bUpdate = false;
+	for (size_t iClass = 0; iClass < m_vSizeClasses.size(); ++iClass)
+	{
+		double dMaxSquared = -1;
+		for (size_t iBlock = 0; iBlock < nBlocks; ++iBlock)
+			dMaxSquared = std::max(dMaxSquared, vBlockMaxDist[iBlock][iClass]);
+		if (dMaxSquared < 0) continue;
+		const double dMaxDist = std::sqrt(dMaxSquared);
+		if (dMaxDist + std::max(m_dMaxTheorWallDistance, dMaxDist) >= m_vSizeClasses[iClass].dVerletDistance)
+		{
+			m_vSizeClasses[iClass].nTriggers++;
+			bUpdate = true;
+		}
+	}
+	return bUpdate;
 }
 
 void CVerletList::UpdateList(double _dCurrTime)
 {
-	if(m_bAutoAdjustVerletDistance)
+	if (m_bAutoAdjustVerletDistance && m_bCostModel)
+		AdjustVerletDistanceByCost(_dCurrTime);
+	else if(m_bAutoAdjustVerletDistance)
 		AutoAdjustVerletDistance(_dCurrTime);
-	m_Scene.AddVirtualParticles(m_dVerletDistance);
-	ClearOldPositions();
-	RecalcPositions();
-	m_PPList.resize(m_vParticles.Size());
-	m_PWList.resize(m_vParticles.Size());
-	for (size_t i = 0; i < m_vParticles.Size(); ++i)
-	{
-		m_PPList[i].clear();
-		m_PWList[i].clear();
-	};
+	m_costCounters.dLastUpdateTime = _dCurrTime;
+	m_costCounters.nStepsSinceUpdate = 0;
+	m_costCounters.dStepsSinceUpdate = 0;
+	const auto start = std::chrono::steady_clock::now();
+	RebuildLists();
+	m_costCounters.dLastUpdateDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-	// resize vectors with shifts in case of PBC
-	if (m_Scene.m_PBC.bEnabled)
+void CVerletList::RebuildLists()
+{
+	if (UpdateListIncremental())
 	{
-		m_PPVirtShift.resize(m_vParticles.Size());
-		m_PWVirtShift.resize(m_vParticles.Size());
-		for (size_t i = 0; i < m_vParticles.Size(); ++i)
-		{
-			m_PPVirtShift[i].clear();
-			m_PWVirtShift[i].clear();
-		}
+		GatherSizeClassStatistics();
+		m_dMaxTheorWallDistance = 0;
+		return;
+	}
+	if (UpdateListImplicitPBC())
+	{
+		GatherSizeClassStatistics();
+		m_dMaxTheorWallDistance = 0;
+		return;
 	}
+	m_Scene.AddVirtualParticles(m_dMaxSkin);
+	UpdateParticlesSkin();
+	ClearNewContacts();
+	if (m_broadPhase == EBroadPhase::SWEEP_AND_PRUNE)
+		UpdateListSweepAndPrune();
 	else
 	{
-		m_PPVirtShift.clear();
-		m_PWVirtShift.clear();
+		ClearOldPositions();
+		RecalcPositions();
 	}
 
 	for (auto& gridLevel : m_vGrid)
 	{
-		ParallelFor(gridLevel.nCellsX * gridLevel.nCellsY * gridLevel.nCellsZ, [&](size_t i)
+		// the cost of a cell is estimated by the number of pairs of particles, which must be checked in it
+		const auto cellCost = [&](size_t i)
+		{
+			const SCellView cell = GetCell(gridLevel, static_cast<unsigned>(i / (gridLevel.nCellsZ * gridLevel.nCellsY)), static_cast<unsigned>(i / gridLevel.nCellsZ % gridLevel.nCellsY), static_cast<unsigned>(i % gridLevel.nCellsZ));
+			return cell.vMainPartIDs.size() * (cell.vMainPartIDs.size() + cell.vSecondaryPartIDs.size() + cell.vWallIDs.size());
+		};
+		ParallelFor(gridLevel.nCellsX * gridLevel.nCellsY * gridLevel.nCellsZ, cellCost, [&](size_t iThread, size_t i)
 		{
 			const unsigned x = static_cast<unsigned>(floor(double(i) / gridLevel.nCellsZ / gridLevel.nCellsY));
 			const unsigned y = static_cast<unsigned>(floor(double(i - x * gridLevel.nCellsZ * gridLevel.nCellsY) / gridLevel.nCellsZ));
 			const unsigned z = static_cast<unsigned>(i) - x* gridLevel.nCellsZ* gridLevel.nCellsY - y* gridLevel.nCellsZ;
-			CheckCollisionPP(gridLevel, x, y, z, x, y, z, true);
-			CheckCollisionPW(gridLevel, gridLevel.grid[x][y][z]);
-			if (gridLevel.grid[x][y][z].vMainPartIDs.size() > 10 &&  gridLevel.grid[x][y][z].vSecondaryPartIDs.empty())
+			const SCellView cell = GetCell(gridLevel, x, y, z);
+			if (cell.vMainPartIDs.empty() && cell.vSecondaryPartIDs.empty()) return; // no contacts can be found from this cell
+			CheckCollisionPP(iThread, gridLevel, x, y, z, x, y, z, true);
+			CheckCollisionPW(iThread, gridLevel, cell);
+			if (cell.vMainPartIDs.size() > 10 && cell.vSecondaryPartIDs.empty())
 			{
-				CheckCollisionPPSorted(gridLevel, x, y, z, x, y, z + 1, ESortCoord::Z);
-				CheckCollisionPPSorted(gridLevel, x, y, z, x, y + 1, z, ESortCoord::Y);
-				CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y, z, ESortCoord::X);
-				CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y + 1, z, ESortCoord::XY);
-				CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y + 1, z + 1, ESortCoord::XY);
-				CheckCollisionPPSorted(gridLevel, x, y, z, x, y + 1, z + 1, ESortCoord::YZ);
-				CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y, z + 1, ESortCoord::XZ);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x, y, z + 1, ESortCoord::Z);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x, y + 1, z, ESortCoord::Y);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y, z, ESortCoord::X);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y + 1, z, ESortCoord::XY);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y + 1, z + 1, ESortCoord::XY);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x, y + 1, z + 1, ESortCoord::YZ);
+				CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y, z + 1, ESortCoord::XZ);
 
 				if (x > 0)
-					CheckCollisionPPSorted(gridLevel, x, y, z, x - 1, y, z + 1, ESortCoord::Z);
+					CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x - 1, y, z + 1, ESortCoord::Z);
 				if (y > 0)
 				{
 					if (x > 0)
-						CheckCollisionPPSorted(gridLevel, x, y, z, x - 1, y - 1, z + 1, ESortCoord::Z);
-					CheckCollisionPPSorted(gridLevel, x, y, z, x, y - 1, z + 1, ESortCoord::Z);
-					CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y - 1, z + 1, ESortCoord::XZ);
-					CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y - 1, z, ESortCoord::X);
+						CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x - 1, y - 1, z + 1, ESortCoord::Z);
+					CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x, y - 1, z + 1, ESortCoord::Z);
+					CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y - 1, z + 1, ESortCoord::XZ);
+					CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y - 1, z, ESortCoord::X);
 					if (z > 0)
-						CheckCollisionPPSorted(gridLevel, x, y, z, x + 1, y - 1, z - 1, ESortCoord::X);
+						CheckCollisionPPSorted(iThread, gridLevel, x, y, z, x + 1, y - 1, z - 1, ESortCoord::X);
 				}
 			}
 			else
 			{
-				CheckCollisionPP(gridLevel, x, y, z, x, y, z + 1);
-				CheckCollisionPP(gridLevel, x, y, z, x, y + 1, z);
-				CheckCollisionPP(gridLevel, x, y, z, x + 1, y, z);
-				CheckCollisionPP(gridLevel, x, y, z, x, y + 1, z + 1);
-				CheckCollisionPP(gridLevel, x, y, z, x + 1, y + 1, z);
-				CheckCollisionPP(gridLevel, x, y, z, x + 1, y, z + 1);
-				CheckCollisionPP(gridLevel, x, y, z, x + 1, y + 1, z + 1);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x, y, z + 1);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x, y + 1, z);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y, z);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x, y + 1, z + 1);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y + 1, z);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y, z + 1);
+				CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y + 1, z + 1);
 
 				if (x > 0)
-					CheckCollisionPP(gridLevel, x, y, z, x - 1, y, z + 1);
+					CheckCollisionPP(iThread, gridLevel, x, y, z, x - 1, y, z + 1);
 				if (y > 0)
 				{
 					if (x > 0)
-						CheckCollisionPP(gridLevel, x, y, z, x - 1, y - 1, z + 1);
-					CheckCollisionPP(gridLevel, x, y, z, x, y - 1, z + 1);
-					CheckCollisionPP(gridLevel, x, y, z, x + 1, y - 1, z + 1);
-					CheckCollisionPP(gridLevel, x, y, z, x + 1, y - 1, z);
+						CheckCollisionPP(iThread, gridLevel, x, y, z, x - 1, y - 1, z + 1);
+					CheckCollisionPP(iThread, gridLevel, x, y, z, x, y - 1, z + 1);
+					CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y - 1, z + 1);
+					CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y - 1, z);
 					if (z > 0)
-						CheckCollisionPP(gridLevel, x, y, z, x + 1, y - 1, z - 1);
+						CheckCollisionPP(iThread, gridLevel, x, y, z, x + 1, y - 1, z - 1);
 				}
 			}
 
 		});
 	}
-	ReassignVirtualContacts(); // shift virtual-real contacts as real-real
+	if (m_bWallBVH)
+		CheckCollisionPWHierarchy();
 	RemoveSBContacts();
 	m_Scene.RemoveVirtualParticles();
-	SortList();
+	m_PPList.Assign(m_vParticles.Size(), m_vNewPP, m_Scene.m_PBC.bEnabled);
+	m_PWList.Assign(m_vParticles.Size(), m_vNewPW, m_Scene.m_PBC.bEnabled);
+	GatherSizeClassStatistics();
+	m_Scene.SaveVerletCoords();
+	if (m_bIncrementalUpdate)
+		RecalcIncrementalGrid();
 	m_dMaxTheorWallDistance = 0;
 }
 
-void CVerletList::RemoveSBContacts()
+bool CVerletList::UpdateListIncremental()
 {
-	if (m_bConnectedPPContact) return; // if it is necessary to consider PP contacts
-	auto& vSolidBonds = m_Scene.GetRefToSolidBonds();
-	auto& vPartToSolidBonds = *m_Scene.GetPointerToPartToSolidBonds();
-	ParallelFor(vPartToSolidBonds.size(), [&](size_t i)
+	const size_t nParticles = m_vParticles.Size();
+	// not possible with PBC, after moving of walls, changes of the grid or new particles
+	if (!m_bIncrementalUpdate || m_Scene.m_PBC.bEnabled || m_dMaxTheorWallDistance != 0 || m_incGrid.dVerletDistance != m_dVerletDistance
+		|| m_incGrid.vPartCell.size() != nParticles || m_PPList.Rows() != nParticles || m_PWList.Rows() != nParticles)
+		return false;
+
+	// Lists of a particle were built when the particle was at CoordVerlet. The lists of all particles contain all pairs, for which
+	// distance <= sum of contact radii + mean verlet distance of both - displacements of both particles since their own last update.
+	// Thus, only lists of particles, which moved far enough, must be updated, to guarantee all contacts until the next update.
+	// A threshold of a quarter of own verlet distance leaves enough margin for not moved particles, so that updates are not needed more often than usual.
+	std::vector<uint8_t> vMoved(nParticles);
+	ParallelFor(nParticles, EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
-		for (size_t j = 0; j < vPartToSolidBonds[i].size(); j++)
-		{
-			const unsigned nBondIndex = vPartToSolidBonds[i][j];
-			if (vSolidBonds.Active(nBondIndex)) // if bond is active
-			{
-				// find index of second particle
-				size_t nSecondPart = vSolidBonds.LeftID(nBondIndex);
-				if (nSecondPart == i)
-					nSecondPart = vSolidBonds.RightID(nBondIndex);
+		const double dThreshold = m_vHalfSkin[i] / 2;
+		vMoved[i] = m_vParticles.Active(i) && SquaredLength(m_vParticles.Coord(i) - m_vParticles.CoordVerlet(i)) >= dThreshold * dThreshold;
+	});
+	std::vector<unsigned> vMovedIDs;
+	for (size_t i = 0; i < nParticles; ++i)
+		if (vMoved[i])
+			vMovedIDs.push_back(static_cast<unsigned>(i));
+	if (vMovedIDs.size() > nParticles * MAX_INCREMENTAL_MOVED_FRACTION) return false; // the whole update is cheaper
+
+	// place moved particles into their new cells and store their current coordinates
+	for (const unsigned i : vMovedIDs)
+	{
+		auto& oldCell = m_incGrid.vPartIDs[m_incGrid.vPartCell[i]];
+		*std::find(oldCell.begin(), oldCell.end(), i) = oldCell.back();
+		oldCell.pop_back();
+		m_incGrid.vPartCell[i] = GetIncrementalCell(m_vParticles.Coord(i));
+		m_incGrid.vPartIDs[m_incGrid.vPartCell[i]].push_back(i);
+		m_vParticles.CoordVerlet(i) = m_vParticles.Coord(i);
+	}
+
+	// keep all contacts between not moved particles; each PP contact is stored in the list of the particle with the smaller index
+	ClearNewContacts();
+	ParallelFor(nParticles, EScheduling::CONTIGUOUS, [&](size_t iThread, size_t i)
+	{
+		if (vMoved[i]) return;
+		for (const unsigned j : m_PPList.Row(i))
+			if (!vMoved[j])
+				m_vNewPP[iThread].push_back({ static_cast<unsigned>(i), j, 0 });
+		for (const unsigned w : m_PWList.Row(i))
+			m_vNewPW[iThread].push_back({ static_cast<unsigned>(i), w, 0 });
+	});
 
-				for (size_t i_2 = 0; i_2 < m_PPList[i].size(); i_2++)
-					if (m_PPList[i][i_2] == nSecondPart)
+	// find new contacts of moved particles
+	ParallelFor(vMovedIDs.size(), EScheduling::STRIDED, [&](size_t iThread, size_t k)
+	{
+		const unsigned i = vMovedIDs[k];
+		const CVector3& coord = m_vParticles.Coord(i);
+		const double dSearchRadius = SearchRadius(i);
+		const double dRadius = dSearchRadius + m_vHalfSkin[i];
+		const size_t iCell = m_incGrid.vPartCell[i];
+		const int x = static_cast<int>(iCell / (m_incGrid.nCellsY * m_incGrid.nCellsZ));
+		const int y = static_cast<int>(iCell / m_incGrid.nCellsZ % m_incGrid.nCellsY);
+		const int z = static_cast<int>(iCell % m_incGrid.nCellsZ);
+		for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, static_cast<int>(m_incGrid.nCellsX) - 1); ++nx)
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, static_cast<int>(m_incGrid.nCellsY) - 1); ++ny)
+				for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, static_cast<int>(m_incGrid.nCellsZ) - 1); ++nz)
+					for (const unsigned j : m_incGrid.vPartIDs[(nx * m_incGrid.nCellsY + ny) * m_incGrid.nCellsZ + nz])
 					{
-						m_PPList[i].erase(m_PPList[i].begin() + i_2);
-						if (m_Scene.m_PBC.bEnabled)
-							m_PPVirtShift[i].erase(m_PPVirtShift[i].begin() + i_2);
-						break;
+						if (j == i || !m_vParticles.Active(j) || (vMoved[j] && j < i)) continue; // contacts between moved particles are found by the one with the smaller index
+						// distance is extended by the displacement of the not moved particle since its last update
+						const double dDist = dSearchRadius + SearchRadius(j) + Length(m_vParticles.Coord(j) - m_vParticles.CoordVerlet(j));
+						if (SquaredLength(coord - m_vParticles.Coord(j)) <= dDist * dDist)
+							m_vNewPP[iThread].push_back({ std::min(i, j), std::max(i, j), 0 });
 					}
+		const auto CheckWall = [&](unsigned _iWall)
+		{
+			if (IsSphereIntersectTriangle(m_vWalls.Coordinates(_iWall), m_vWalls.Edges(_iWall), m_vWalls.NormalVector(_iWall), coord, dRadius).first != EIntersectionType::NO_CONTACT)
+				m_vNewPW[iThread].push_back({ i, _iWall, 0 });
+		};
+		if (m_bWallBVH)
+			m_wallBVH.Query(coord, dRadius, CheckWall);
+		else
+			for (const unsigned w : m_incGrid.vWallIDs[iCell])
+				CheckWall(w);
+	});
+
+	RemoveSBContacts();
+	m_PPList.Assign(nParticles, m_vNewPP, false);
+	m_PWList.Assign(nParticles, m_vNewPW, false);
+	return true;
+}
+
+void CVerletList::RecalcIncrementalGrid()
+{
+	// neighboring cells must contain all possible contacts with extended distance: 2 * max radius + verlet distance + 2 * (verlet distance / 4)
+	m_incGrid.dCellSize = 2 * m_dMaxParticleRadius + 1.5 * m_dMaxSkin;
+	m_incGrid.dVerletDistance = m_dVerletDistance;
+	const CVector3 length = m_workDomain.coordEnd - m_workDomain.coordBeg;
+	const double dAverLength = (length.x + length.y + length.z) / 3;
+	if (m_incGrid.dCellSize <= 0 || dAverLength / m_incGrid.dCellSize > m_nCellsMax)
+		m_incGrid.dCellSize = dAverLength / m_nCellsMax;
+	m_incGrid.nCellsX = static_cast<unsigned>(floor(length.x / m_incGrid.dCellSize)) + 1;
+	m_incGrid.nCellsY = static_cast<unsigned>(floor(length.y / m_incGrid.dCellSize)) + 1;
+	m_incGrid.nCellsZ = static_cast<unsigned>(floor(length.z / m_incGrid.dCellSize)) + 1;
+
+	const size_t nCells = static_cast<size_t>(m_incGrid.nCellsX) * m_incGrid.nCellsY * m_incGrid.nCellsZ;
+	m_incGrid.vPartIDs.resize(nCells);
+	m_incGrid.vWallIDs.resize(nCells);
+	ParallelFor(nCells, [&](size_t i)
+	{
+		m_incGrid.vPartIDs[i].clear();
+		m_incGrid.vWallIDs[i].clear();
+	});
+
+	m_incGrid.vPartCell.resize(m_vParticles.Size());
+	ParallelFor(m_vParticles.Size(), [&](size_t i)
+	{
+		m_incGrid.vPartCell[i] = GetIncrementalCell(m_vParticles.Coord(i));
+	});
+	for (unsigned i = 0; i < m_vParticles.Size(); ++i)
+		m_incGrid.vPartIDs[m_incGrid.vPartCell[i]].push_back(i);
+
+	// walls are placed into all cells, which they cross, and into their neighbors; not needed if walls are searched in the hierarchy
+	for (unsigned iWall = 0; iWall < (m_bWallBVH ? 0 : m_vWalls.Size()); ++iWall)
+	{
+		const size_t iMin = GetIncrementalCell(m_vWalls.MinCoord(iWall));
+		const size_t iMax = GetIncrementalCell(m_vWalls.MaxCoord(iWall));
+		const unsigned nYZ = m_incGrid.nCellsY * m_incGrid.nCellsZ;
+		const unsigned nMinX = static_cast<unsigned>(iMin / nYZ), nMinY = static_cast<unsigned>(iMin / m_incGrid.nCellsZ % m_incGrid.nCellsY), nMinZ = static_cast<unsigned>(iMin % m_incGrid.nCellsZ);
+		const unsigned nMaxX = static_cast<unsigned>(iMax / nYZ), nMaxY = static_cast<unsigned>(iMax / m_incGrid.nCellsZ % m_incGrid.nCellsY), nMaxZ = static_cast<unsigned>(iMax % m_incGrid.nCellsZ);
+		for (unsigned x = nMinX > 0 ? nMinX - 1 : 0; x <= std::min(nMaxX + 1, m_incGrid.nCellsX - 1); ++x)
+			for (unsigned y = nMinY > 0 ? nMinY - 1 : 0; y <= std::min(nMaxY + 1, m_incGrid.nCellsY - 1); ++y)
+				for (unsigned z = nMinZ > 0 ? nMinZ - 1 : 0; z <= std::min(nMaxZ + 1, m_incGrid.nCellsZ - 1); ++z)
+					m_incGrid.vWallIDs[(static_cast<size_t>(x) * m_incGrid.nCellsY + y) * m_incGrid.nCellsZ + z].push_back(iWall);
+	}
+}
+
+size_t CVerletList::GetIncrementalCell(const CVector3& _coord) const
+{
+	const CVector3 relCoord = (_coord - m_workDomain.coordBeg) / m_incGrid.dCellSize;
+	// limit for the case if the point lays outside the domain
+	const auto Index = [](double _val, unsigned _number) { return static_cast<size_t>(std::clamp(floor(_val), 0.0, static_cast<double>(_number - 1))); };
+	return (Index(relCoord.x, m_incGrid.nCellsX) * m_incGrid.nCellsY + Index(relCoord.y, m_incGrid.nCellsY)) * m_incGrid.nCellsZ + Index(relCoord.z, m_incGrid.nCellsZ);
+}
+
+bool CVerletList::UpdateListImplicitPBC()
+{
+	if (!m_bImplicitPBC || !m_Scene.m_PBC.bEnabled) return false;
+	UpdateParticlesSkin();
+	if (!RecalcPeriodicGrid()) return false;
+	ClearNewContacts();
+	const SPeriodicGrid& g = m_pbcGrid;
+	const CVector3& t = m_Scene.m_PBC.boundaryShift;
+	const unsigned* ids = g.parts.vIDs.data();
+	const auto Cell = [&](size_t _iCell) { return SIDRange{ ids + g.parts.vStart[_iCell], ids + g.parts.vStart[_iCell + 1] }; };
+
+	// PP contacts: each pair of neighboring cells is checked once, from the cell with the smaller offset; cells in periodic directions are wrapped and
+	// particles of wrapped cells are shifted by the length of the PBC domain, so that the nearest image is checked. With at least three cells
+	// in each periodic direction, each pair of cells is met only once and each image of a particle is the minimum one.
+	static const std::array<std::array<int, 3>, 13> vOffsets{ {
+		{ 0, 0, 1 }, { 0, 1, -1 }, { 0, 1, 0 }, { 0, 1, 1 },
+		{ 1, -1, -1 }, { 1, -1, 0 }, { 1, -1, 1 }, { 1, 0, -1 }, { 1, 0, 0 }, { 1, 0, 1 }, { 1, 1, -1 }, { 1, 1, 0 }, { 1, 1, 1 } } };
+	const size_t nCells = static_cast<size_t>(g.nCells[0]) * g.nCells[1] * g.nCells[2];
+	const auto cellCost = [&](size_t i) { return Cell(i).size() * Cell(i).size(); };
+	ParallelFor(nCells, cellCost, [&](size_t iThread, size_t iCell)
+	{
+		const SIDRange cell1 = Cell(iCell);
+		if (cell1.empty()) return;
+		for (size_t i = 0; i < cell1.size(); ++i)
+			for (size_t j = i + 1; j < cell1.size(); ++j)
+			{
+				const double dDist = SearchRadius(cell1[i]) + SearchRadius(cell1[j]);
+				if (SquaredLength(m_vParticles.Coord(cell1[i]) - m_vParticles.Coord(cell1[j])) <= dDist * dDist)
+					AddPossibleContactPP(iThread, cell1[i], cell1[j], 0);
+			}
+		const std::array<int, 3> cell{ static_cast<int>(iCell / (g.nCells[1] * g.nCells[2])), static_cast<int>(iCell / g.nCells[2] % g.nCells[1]), static_cast<int>(iCell % g.nCells[2]) };
+		for (const auto& offset : vOffsets)
+		{
+			std::array<int, 3> neighbor{};
+			CVector3 vShift{ 0 };
+			bool bValid = true;
+			for (size_t k = 0; k < 3 && bValid; ++k)
+			{
+				neighbor[k] = cell[k] + offset[k];
+				const int n = static_cast<int>(g.nCells[k]);
+				if (neighbor[k] >= 0 && neighbor[k] < n) continue;
+				bValid = g.bPeriodic[k];
+				// particles of the wrapped cell are shifted to the side of the current cell
+				vShift[k] = neighbor[k] < 0 ? -t[k] : t[k];
+				neighbor[k] = neighbor[k] < 0 ? neighbor[k] + n : neighbor[k] - n;
+			}
+			if (!bValid) continue;
+			const SIDRange cell2 = Cell((static_cast<size_t>(neighbor[0]) * g.nCells[1] + neighbor[1]) * g.nCells[2] + neighbor[2]);
+			if (cell2.empty()) continue;
+			const uint8_t nVirtShift = GetVirtShiftFromVector(vShift);
+			for (const unsigned p1 : cell1)
+			{
+				const CVector3& coord = m_vParticles.Coord(p1);
+				const double dSearchRadius = SearchRadius(p1);
+				for (const unsigned p2 : cell2)
+				{
+					const double dDist = dSearchRadius + SearchRadius(p2);
+					if (SquaredLength(coord - (m_vParticles.Coord(p2) + vShift)) <= dDist * dDist)
+						AddPossibleContactPP(iThread, p1, p2, nVirtShift);
+				}
 			}
 		}
 	});
 
+	// PW contacts: walls are not periodic, so particles are checked at the same shifted positions, at which virtual particles would be created
+	if (!m_vWalls.Empty())
+	{
+		if (m_bWallBVH)
+			m_wallBVH.Update(m_vWalls);
+		const SVolumeType virtDomain = m_Scene.GetVirtualDomain(m_dMaxSkin);
+		ParallelFor(m_vParticles.Size(), EScheduling::STRIDED, [&](size_t iThread, size_t i)
+		{
+			if (!m_vParticles.Active(i)) return;
+			const double dRadius = SearchRadius(i) + m_vHalfSkin[i];
+			const auto CheckWalls = [&](const CVector3& _coord, uint8_t _nVirtShift)
+			{
+				const auto CheckWall = [&](unsigned _iWall)
+				{
+					if (IsSphereIntersectTriangle(m_vWalls.Coordinates(_iWall), m_vWalls.Edges(_iWall), m_vWalls.NormalVector(_iWall), _coord, dRadius).first != EIntersectionType::NO_CONTACT)
+						m_vNewPW[iThread].push_back({ static_cast<unsigned>(i), _iWall, _nVirtShift });
+				};
+				if (m_bWallBVH)
+					m_wallBVH.Query(_coord, dRadius, CheckWall);
+				else
+				{
+					const std::array<unsigned, 3> cell = GetPeriodicCell(_coord);
+					for (const unsigned w : g.vWallIDs[(static_cast<size_t>(cell[0]) * g.nCells[1] + cell[1]) * g.nCells[2] + cell[2]])
+						CheckWall(w);
+				}
+			};
+			CheckWalls(m_vParticles.Coord(i), 0);
+			m_Scene.ForEachVirtualShift(i, virtDomain, [&](const CVector3& _vShift)
+			{
+				CheckWalls(m_vParticles.Coord(i) + _vShift, GetVirtShiftFromVector(_vShift));
+			});
+		});
+	}
+
+	RemoveSBContacts();
+	m_PPList.Assign(m_vParticles.Size(), m_vNewPP, true);
+	m_PWList.Assign(m_vParticles.Size(), m_vNewPW, true);
+	m_Scene.SaveVerletCoords();
+	return true;
+}
+
+bool CVerletList::RecalcPeriodicGrid()
+{
+	// cells must contain all possible contacts in neighboring cells, as on the first level of the hierarchical grid
+	const double dMinCellSize = 2 * m_dMaxParticleRadius + m_dMaxSkin;
+	if (dMinCellSize <= 0) return false;
+	const SPBC& pbc = m_Scene.m_PBC;
+	const std::array<bool, 3> bPeriodic{ pbc.bX, pbc.bY, pbc.bZ };
+	for (size_t i = 0; i < 3; ++i)
+	{
+		m_pbcGrid.bPeriodic[i] = bPeriodic[i];
+		if (bPeriodic[i])
+		{
+			// the PBC domain is divided into whole cells; at least three are needed, so that wrapped neighbors of a cell are different cells
+			const double dLength = pbc.currentDomain.coordEnd[i] - pbc.currentDomain.coordBeg[i];
+			const double dCells = std::min(std::floor(dLength / dMinCellSize), static_cast<double>(m_nCellsMax));
+			if (dCells < 3) return false;
+			m_pbcGrid.nCells[i] = static_cast<unsigned>(dCells);
+			m_pbcGrid.vOrigin[i] = pbc.currentDomain.coordBeg[i];
+			m_pbcGrid.vCellSize[i] = dLength / dCells;
+		}
+		else
+		{
+			const double dLength = m_workDomain.coordEnd[i] - m_workDomain.coordBeg[i];
+			m_pbcGrid.vCellSize[i] = std::max(dMinCellSize, dLength / m_nCellsMax);
+			m_pbcGrid.nCells[i] = static_cast<unsigned>(std::floor(dLength / m_pbcGrid.vCellSize[i])) + 1;
+			m_pbcGrid.vOrigin[i] = m_workDomain.coordBeg[i];
+		}
+	}
+
+	const size_t nCells = static_cast<size_t>(m_pbcGrid.nCells[0]) * m_pbcGrid.nCells[1] * m_pbcGrid.nCells[2];
+	SortIntoCells(m_pbcGrid.parts, nCells, m_vParticles.Size(), [&](size_t i)
+	{
+		if (!m_vParticles.Active(i)) return nCells;
+		const std::array<unsigned, 3> cell = GetPeriodicCell(m_vParticles.Coord(i));
+		return (static_cast<size_t>(cell[0]) * m_pbcGrid.nCells[1] + cell[1]) * m_pbcGrid.nCells[2] + cell[2];
+	});
+
+	// walls are placed into all cells, which they cross, and into their neighbors without wrapping; not needed if walls are searched in the hierarchy
+	m_pbcGrid.vWallIDs.resize(m_bWallBVH ? 0 : nCells);
+	ParallelFor(m_pbcGrid.vWallIDs.size(), [&](size_t i)
+	{
+		m_pbcGrid.vWallIDs[i].clear();
+	});
+	for (unsigned iWall = 0; iWall < (m_bWallBVH ? 0 : m_vWalls.Size()); ++iWall)
+	{
+		const std::array<unsigned, 3> nMin = GetPeriodicCell(m_vWalls.MinCoord(iWall));
+		const std::array<unsigned, 3> nMax = GetPeriodicCell(m_vWalls.MaxCoord(iWall));
+		for (unsigned x = nMin[0] > 0 ? nMin[0] - 1 : 0; x <= std::min(nMax[0] + 1, m_pbcGrid.nCells[0] - 1); ++x)
+			for (unsigned y = nMin[1] > 0 ? nMin[1] - 1 : 0; y <= std::min(nMax[1] + 1, m_pbcGrid.nCells[1] - 1); ++y)
+				for (unsigned z = nMin[2] > 0 ? nMin[2] - 1 : 0; z <= std::min(nMax[2] + 1, m_pbcGrid.nCells[2] - 1); ++z)
+					m_pbcGrid.vWallIDs[(static_cast<size_t>(x) * m_pbcGrid.nCells[1] + y) * m_pbcGrid.nCells[2] + z].push_back(iWall);
+	}
+	return true;
+}
+
+std::array<unsigned, 3> CVerletList::GetPeriodicCell(const CVector3& _coord) const
+{
+	// limit for the case if the point lays outside the grid, e.g. particles, which have not been moved over PBC yet, or shifted positions for walls
+	std::array<unsigned, 3> res{};
+	for (size_t i = 0; i < 3; ++i)
+		res[i] = static_cast<unsigned>(std::clamp(std::floor((_coord[i] - m_pbcGrid.vOrigin[i]) / m_pbcGrid.vCellSize[i]), 0.0, static_cast<double>(m_pbcGrid.nCells[i] - 1)));
+	return res;
+}
+
+void CVerletList::UpdateListSweepAndPrune()
+{
+	const size_t nParticles = m_vParticles.Size();
+	if (nParticles == 0) return;
+	// intervals of particles are their extended spheres, so intervals of two particles overlap if their distance along the axis <= sum of contact radii + mean verlet distance
+
+	// bounding box of intervals of all active particles, calculated over blocks of particles
+	const size_t nBlocks = std::max<size_t>(std::min(GetThreadsNumber(), nParticles), 1);
+	const auto BlockBegin = [&](size_t _iBlock) { return nParticles * _iBlock / nBlocks; };
+	std::vector<CVector3> vBlockMin(nBlocks, CVector3{ DBL_MAX }), vBlockMax(nBlocks, CVector3{ -DBL_MAX });
+	ParallelFor(nBlocks, [&](size_t iBlock)
+	{
+		for (size_t i = BlockBegin(iBlock); i < BlockBegin(iBlock + 1); ++i)
+			if (m_vParticles.Active(i))
+			{
+				const CVector3 vHalfSize{ SearchRadius(i) };
+				vBlockMin[iBlock] = Min(vBlockMin[iBlock], m_vParticles.Coord(i) - vHalfSize);
+				vBlockMax[iBlock] = Max(vBlockMax[iBlock], m_vParticles.Coord(i) + vHalfSize);
+			}
+	});
+	CVector3 vMin{ DBL_MAX }, vMax{ -DBL_MAX };
+	for (size_t i = 0; i < nBlocks; ++i)
+	{
+		vMin = Min(vMin, vBlockMin[i]);
+		vMax = Max(vMax, vBlockMax[i]);
+	}
+	if (vMin.x > vMax.x) return; // no active particles
+
+	// sweep along the longest side of the bounding box, where intervals overlap least; the previous axis is kept if it is almost as long to reuse the order of particles
+	const CVector3 vLength = vMax - vMin;
+	unsigned nAxis = vLength.x >= vLength.y && vLength.x >= vLength.z ? 0 : vLength.y >= vLength.z ? 1 : 2;
+	if (vLength[m_sweep.nAxis] >= 0.9 * vLength[nAxis])
+		nAxis = m_sweep.nAxis;
+	const bool bReuseOrder = nAxis == m_sweep.nAxis && m_sweep.vOrder.size() == nParticles;
+	m_sweep.nAxis = nAxis;
+	m_sweep.dOrigin = vMin[nAxis];
+	m_sweep.dScale = vLength[nAxis] > 0 ? (UINT32_MAX - 1) / vLength[nAxis] : 1;
+	SortSweepParticles(bReuseOrder);
+
+	// gather sorted particles for linear access during the sweep
+	m_sweep.vParticles.resize(nParticles);
+	std::vector<uint32_t> vBlockMaxWidth(nBlocks, 0);
+	ParallelFor(nBlocks, [&](size_t iBlock)
+	{
+		for (size_t k = BlockBegin(iBlock); k < BlockBegin(iBlock + 1); ++k)
+		{
+			SSweepParticle& p = m_sweep.vParticles[k];
+			p.id = m_sweep.vOrder[k];
+			p.coord = m_vParticles.Coord(p.id);
+			p.radius = SearchRadius(p.id);
+			if (m_sweep.vKeys[k] == UINT32_MAX) continue; // inactive
+			p.keyEnd = QuantizeSweepCeil(p.coord[nAxis] + p.radius);
+			vBlockMaxWidth[iBlock] = std::max(vBlockMaxWidth[iBlock], p.keyEnd - m_sweep.vKeys[k]);
+		}
+	});
+	m_sweep.nMaxWidth = *std::max_element(vBlockMaxWidth.begin(), vBlockMaxWidth.end());
+	const size_t nActive = std::lower_bound(m_sweep.vKeys.begin(), m_sweep.vKeys.end(), UINT32_MAX) - m_sweep.vKeys.begin();
+
+	// particle-particle: each particle is checked against the following ones, while their intervals overlap along the axis
+	ParallelFor(nActive, EScheduling::STRIDED, [&](size_t iThread, size_t k)
+	{
+		const SSweepParticle& p1 = m_sweep.vParticles[k];
+		for (size_t l = k + 1; l < nActive && m_sweep.vKeys[l] <= p1.keyEnd; ++l)
+		{
+			const SSweepParticle& p2 = m_sweep.vParticles[l];
+			if (SquaredLength(p1.coord - p2.coord) <= std::pow(p1.radius + p2.radius, 2))
+				AddPossibleContactPP(iThread, p1.id, p2.id);
+		}
+	});
+
+	if (m_bWallBVH) return; // walls are searched in the hierarchy
+
+	// particle-wall: for each wall, particles are found with binary search, whose intervals may overlap the interval of the wall along the axis
+	ParallelFor(m_vWalls.Size(), EScheduling::STRIDED, [&](size_t iThread, size_t w)
+	{
+		const CVector3 vWallMin = m_vWalls.MinCoord(w);
+		const CVector3 vWallMax = m_vWalls.MaxCoord(w);
+		// the wall is extended by the largest half of verlet distance to cover extended spheres of all particles
+		const uint32_t keyBeg = QuantizeSweepFloor(vWallMin[nAxis] - m_dMaxSkin / 2);
+		const uint32_t keyEnd = QuantizeSweepCeil(vWallMax[nAxis] + m_dMaxSkin / 2);
+		// intervals of particles are not wider than the maximum width, so lower bounds of overlapping particles are not smaller than keyBeg - nMaxWidth
+		const uint32_t keyFirst = keyBeg > m_sweep.nMaxWidth ? keyBeg - m_sweep.nMaxWidth : 0;
+		for (size_t k = std::lower_bound(m_sweep.vKeys.begin(), m_sweep.vKeys.begin() + nActive, keyFirst) - m_sweep.vKeys.begin(); k < nActive && m_sweep.vKeys[k] <= keyEnd; ++k)
+		{
+			const SSweepParticle& p = m_sweep.vParticles[k];
+			if (p.keyEnd < keyBeg) continue;
+			const double dRadius = p.radius + m_vHalfSkin[p.id];
+			const CVector3 vPartMin = p.coord - CVector3{ dRadius }, vPartMax = p.coord + CVector3{ dRadius };
+			if (vPartMax.x < vWallMin.x || vPartMin.x > vWallMax.x || vPartMax.y < vWallMin.y || vPartMin.y > vWallMax.y || vPartMax.z < vWallMin.z || vPartMin.z > vWallMax.z) continue;
+			if (IsSphereIntersectTriangle(m_vWalls.Coordinates(w), m_vWalls.Edges(w), m_vWalls.NormalVector(w), p.coord, dRadius).first != EIntersectionType::NO_CONTACT)
+				AddPossibleContactPW(iThread, p.id, static_cast<unsigned>(w));
+		}
+	});
+}
+
+void CVerletList::SortSweepParticles(bool _bReuseOrder)
+{
+	const size_t nParticles = m_vParticles.Size();
+	if (!_bReuseOrder)
+	{
+		m_sweep.vOrder.resize(nParticles);
+		std::iota(m_sweep.vOrder.begin(), m_sweep.vOrder.end(), 0);
+	}
+	// inactive particles get the largest key to be placed at the end
+	m_sweep.vKeys.resize(nParticles);
+	ParallelFor(nParticles, EScheduling::CONTIGUOUS, [&](size_t, size_t k)
+	{
+		const unsigned i = m_sweep.vOrder[k];
+		m_sweep.vKeys[k] = m_vParticles.Active(i) ? QuantizeSweepFloor(m_vParticles.Coord(i)[m_sweep.nAxis] - SearchRadius(i)) : UINT32_MAX;
+	});
+	// particles move only slightly between updates, so the previous order is nearly sorted
+	if (!_bReuseOrder || !InsertionSortSweepParticles())
+		RadixSortSweepParticles();
+}
+
+void CVerletList::RadixSortSweepParticles()
+{
+	const size_t nParticles = m_sweep.vKeys.size();
+	const size_t nBlocks = std::max<size_t>(std::min(GetThreadsNumber(), nParticles), 1);
+	const auto BlockBegin = [&](size_t _iBlock) { return nParticles * _iBlock / nBlocks; };
+	m_sweep.vTempKeys.resize(nParticles);
+	m_sweep.vTempOrder.resize(nParticles);
+	std::vector<std::array<size_t, 256>> vOffsets(nBlocks);
+	for (unsigned nShift = 0; nShift < 32; nShift += 8)
+	{
+		// histogram of digits in each block
+		ParallelFor(nBlocks, [&](size_t iBlock)
+		{
+			vOffsets[iBlock].fill(0);
+			for (size_t k = BlockBegin(iBlock); k < BlockBegin(iBlock + 1); ++k)
+				++vOffsets[iBlock][m_sweep.vKeys[k] >> nShift & 0xFF];
+		});
+		// positions of digits of each block, ordered by digits and then by blocks to keep the sort stable; the pass is skipped if all digits are equal
+		size_t nOffset = 0;
+		bool bSameDigits = false;
+		for (size_t iDigit = 0; iDigit < 256; ++iDigit)
+		{
+			const size_t nStart = nOffset;
+			for (size_t iBlock = 0; iBlock < nBlocks; ++iBlock)
+			{
+				const size_t nCount = vOffsets[iBlock][iDigit];
+				vOffsets[iBlock][iDigit] = nOffset;
+				nOffset += nCount;
+			}
+			bSameDigits |= nOffset - nStart == nParticles;
+		}
+		if (bSameDigits) continue;
+		// scatter
+		ParallelFor(nBlocks, [&](size_t iBlock)
+		{
+			for (size_t k = BlockBegin(iBlock); k < BlockBegin(iBlock + 1); ++k)
+			{
+				const size_t nPos = vOffsets[iBlock][m_sweep.vKeys[k] >> nShift & 0xFF]++;
+				m_sweep.vTempKeys[nPos] = m_sweep.vKeys[k];
+				m_sweep.vTempOrder[nPos] = m_sweep.vOrder[k];
+			}
+		});
+		std::swap(m_sweep.vKeys, m_sweep.vTempKeys);
+		std::swap(m_sweep.vOrder, m_sweep.vTempOrder);
+	}
+}
+
+bool CVerletList::InsertionSortSweepParticles()
+{
+	const size_t nParticles = m_sweep.vKeys.size();
+	const size_t nMaxShifts = MAX_SWEEP_INSERTION_SHIFTS * nParticles;
+	size_t nShifts = 0;
+	for (size_t k = 1; k < nParticles; ++k)
+	{
+		const uint32_t key = m_sweep.vKeys[k];
+		if (m_sweep.vKeys[k - 1] <= key) continue;
+		const unsigned id = m_sweep.vOrder[k];
+		size_t l = k;
+		for (; l > 0 && m_sweep.vKeys[l - 1] > key; --l)
+		{
+			m_sweep.vKeys[l] = m_sweep.vKeys[l - 1];
+			m_sweep.vOrder[l] = m_sweep.vOrder[l - 1];
+		}
+		m_sweep.vKeys[l] = key;
+		m_sweep.vOrder[l] = id;
+		nShifts += k - l;
+		if (nShifts > nMaxShifts) return false; // the order is still a valid permutation, so radix sort can proceed from it
+	}
+	return true;
+}
+
+uint32_t CVerletList::QuantizeSweepFloor(double _val) const
+{
+	return static_cast<uint32_t>(std::clamp(std::floor((_val - m_sweep.dOrigin) * m_sweep.dScale), 0.0, static_cast<double>(UINT32_MAX - 1)));
+}
+
+uint32_t CVerletList::QuantizeSweepCeil(double _val) const
+{
+	return static_cast<uint32_t>(std::clamp(std::ceil((_val - m_sweep.dOrigin) * m_sweep.dScale), 0.0, static_cast<double>(UINT32_MAX - 1)));
+}
+
+void CVerletList::RemoveSBContacts()
+{
+	if (m_bConnectedPPContact) return; // if it is necessary to consider PP contacts
+	auto& vSolidBonds = m_Scene.GetRefToSolidBonds();
+	auto& vPartToSolidBonds = *m_Scene.GetPointerToPartToSolidBonds();
+	if (vSolidBonds.Empty()) return;
+	// checks whether particles are connected with an active bond
+	const auto IsBonded = [&](const CVerletMatrix::SEntry& _contact)
+	{
+		if (_contact.row >= vPartToSolidBonds.size()) return false;
+		for (const unsigned nBondIndex : vPartToSolidBonds[_contact.row])
+			if (vSolidBonds.Active(nBondIndex) && (vSolidBonds.LeftID(nBondIndex) == _contact.id || vSolidBonds.RightID(nBondIndex) == _contact.id))
+				return true;
+		return false;
+	};
+	ParallelFor(m_vNewPP.size(), [&](size_t iThread)
+	{
+		m_vNewPP[iThread].erase(std::remove_if(m_vNewPP[iThread].begin(), m_vNewPP[iThread].end(), IsBonded), m_vNewPP[iThread].end());
+	});
 }
 
 void CVerletList::AddDisregardingTimeInterval(const clock_t& _interval)
@@ -338,6 +1006,36 @@ void CVerletList::AddDisregardingTimeInterval(const clock_t& _interval)
 	m_DisregardingTimeInterval += _interval;
 }
 
+void CVerletList::SaveState(std::ostream& _s) const
+{
+	m_PPList.Save(_s);
+	m_PWList.Save(_s);
+	WriteBinary(_s, m_dVerletDistance);
+	WriteBinary(_s, m_dMaxTheorWallDistance);
+	WriteBinary(_s, m_nAutoVerletDistNumerator);
+	WriteBinary(_s, m_PerformHistory);
+	WriteBinary(_s, m_costCounters);
+	WriteBinary(_s, m_vDistanceDecisions);
+}
+
+void CVerletList::LoadState(std::istream& _s)
+{
+	m_PPList.Load(_s);
+	m_PWList.Load(_s);
+	ReadBinary(_s, m_dVerletDistance);
+	RecalculateGrid();
+	ReadBinary(_s, m_dMaxTheorWallDistance);
+	ReadBinary(_s, m_nAutoVerletDistNumerator);
+	ReadBinary(_s, m_PerformHistory);
+	ReadBinary(_s, m_costCounters);
+	ReadBinary(_s, m_vDistanceDecisions);
+	// measurements of calculation time are restarted; positions of particles in the incremental grid are unknown, so the next update is complete
+	m_LastCPUTime = 0;
+	m_DisregardingTimeInterval = 0;
+	m_incGrid.vPartCell.clear();
+	m_wallBVH.Clear();
+}
+
 void CVerletList::AutoAdjustVerletDistance(double _dCurrentTime)
 {
 	if (m_vParticles.Empty()) return; // no recalculation if there is no particles
@@ -412,50 +1110,90 @@ void CVerletList::AutoAdjustVerletDistance(double _dCurrentTime)
 	}
 }
 
-void CVerletList::ReassignVirtualContacts()
+void CVerletList::AdjustVerletDistanceByCost(double _dCurrentTime)
 {
-	if (m_Scene.GetVirtualParticlesNumber() == 0) return;
-	const size_t realPartNum = m_Scene.GetRealParticlesNumber();
-	for (size_t i = 0; i < m_Scene.GetVirtualParticlesNumber(); i++)
+	SCostCounters& counters = m_costCounters;
+	// intervals, which ended with forced updates, do not show how long lists stay valid
+	if (m_dMaxTheorWallDistance < DEFAULT_TEOR_DISTANCE && counters.nStepsSinceUpdate != 0 && _dCurrentTime > counters.dLastUpdateTime)
 	{
-		const size_t iVirt = i + realPartNum;
-		// for PP contacts
-		for (size_t j = 0; j < m_PPList[iVirt].size(); j++)
+		counters.nIntervals++;
+		counters.nSteps += counters.nStepsSinceUpdate;
+		counters.nCandidates += counters.nLastCandidates;
+		counters.dTime += _dCurrentTime - counters.dLastUpdateTime;
+		counters.dUpdateDuration += counters.dLastUpdateDuration;
+		counters.dStepsDuration += counters.dStepsSinceUpdate;
+	}
+	if (counters.nIntervals < VERLET_COST_WINDOW) return;
+
+	size_t nParticles = 0;
+	double dSumRadius = 0;
+	for (size_t i = 0; i < m_vParticles.Size(); ++i)
+		if (m_vParticles.Active(i))
 		{
-			const unsigned nRealID1 = m_PPList[iVirt][j];
-			const unsigned nRealID2 = m_vParticles.InitIndex(iVirt);
-			uint8_t nVirtShiftPart2 = m_Scene.m_vPBCVirtShift[i];
-			if (nRealID1 < nRealID2)
-			{
-				m_PPList[nRealID1].push_back(nRealID2);
-				m_PPVirtShift[nRealID1].push_back(nVirtShiftPart2);
-			}
-			else
-			{
-				m_PPList[nRealID2].push_back(nRealID1);
-				m_PPVirtShift[nRealID2].push_back(InverseVirtShift(nVirtShiftPart2));
-			}
+			nParticles++;
+			dSumRadius += m_vParticles.ContactRadius(i);
 		}
-		// for PW contacts
-		const size_t iReal = m_vParticles.InitIndex(iVirt);
-		for (size_t j = 0; j < m_PWList[iVirt].size(); j++)
+	const double dDistance = m_dVerletDistance;
+	const double dMeanRadius = nParticles != 0 ? dSumRadius / nParticles : m_dMinParticleRadius;
+	const double dCandidates = static_cast<double>(counters.nCandidates) / counters.nIntervals;
+	const double dStepsPerUpdate = static_cast<double>(counters.nSteps) / counters.nIntervals;
+	const double dTimeStep = counters.dTime / counters.nSteps;
+	const double dUpdateDuration = counters.dUpdateDuration / counters.nIntervals;
+	const double dStepDuration = counters.dStepsDuration / counters.nSteps;
+	counters.nIntervals = counters.nSteps = counters.nCandidates = 0;
+	counters.dTime = counters.dUpdateDuration = counters.dStepsDuration = 0;
+	if (nParticles == 0 || dDistance <= 0) return;
+
+	// Particles move the same distance per time step with any verlet distance, so the number of steps between updates is proportional to the distance.
+	// Possible contacts of a particle are found in a sphere with radius of mean contact diameter + verlet distance, so their number grows with its cube.
+	// The cost of an update depends on numbers of particles and possible contacts, the cost of a time step - on the number of possible contacts.
+	// If durations of time steps are measured, measured durations at the current distance are scaled; the duration of an update is split
+	// into parts of particles and of possible contacts by the relative costs of counted operations. Otherwise, only counted operations are used.
+	const bool bMeasured = dUpdateDuration > 0 && dStepDuration > 0;
+	const double dPairsShare = VERLET_COST_BROAD_PAIR * dCandidates / (VERLET_COST_PARTICLE * nParticles + VERLET_COST_BROAD_PAIR * dCandidates);
+	const auto Cost = [&](double _dDistance)
+	{
+		const double dSteps = std::max(1.0, dStepsPerUpdate * _dDistance / dDistance);
+		const double dPairsRatio = std::pow((2 * dMeanRadius + _dDistance) / (2 * dMeanRadius + dDistance), 3);
+		if (bMeasured)
+			return (dUpdateDuration * (1 - dPairsShare + dPairsShare * dPairsRatio) + dStepDuration * dPairsRatio * dSteps) / (dSteps * dTimeStep);
+		const double dPairs = dCandidates * dPairsRatio;
+		return (VERLET_COST_PARTICLE * nParticles + (VERLET_COST_BROAD_PAIR + VERLET_COST_NARROW_PAIR * dSteps) * dPairs) / (dSteps * dTimeStep);
+	};
+
+	// predicted costs are compared on a logarithmic scale around the current distance, because the model is precise only close to the measurements
+	const double dMinDistance = VERLET_COST_MIN_COEFF * m_dMinParticleRadius;
+	const double dOldCost = Cost(dDistance);
+	double dBestDistance = dDistance;
+	double dBestCost = dOldCost;
+	for (size_t i = 0; i < VERLET_COST_SAMPLES; ++i)
+	{
+		const double dCandidate = dDistance * std::pow(VERLET_COST_MAX_CHANGE, 2.0 * i / (VERLET_COST_SAMPLES - 1) - 1);
+		if (dCandidate < dMinDistance) continue;
+		const double dCost = Cost(dCandidate);
+		if (dCost < dBestCost)
 		{
-			m_PWList[iReal].push_back(m_PWList[iVirt][j]);
-			m_PWVirtShift[iReal].push_back(m_PWVirtShift[iVirt][j]);
+			dBestCost = dCost;
+			dBestDistance = dCandidate;
 		}
 	}
-	m_PPList.resize(realPartNum);
-	m_PWList.resize(realPartNum);
-	m_PPVirtShift.resize(realPartNum);
-	m_PWVirtShift.resize(realPartNum);
+	if (dBestCost > dOldCost * (1 - VERLET_COST_MIN_GAIN))
+	{
+		dBestDistance = dDistance;
+		dBestCost = dOldCost;
+	}
+	m_vDistanceDecisions.push_back({ _dCurrentTime, dDistance, dBestDistance, dCandidates, dStepsPerUpdate, bMeasured ? dUpdateDuration : 0, bMeasured ? dStepDuration : 0, dOldCost, dBestCost });
+	if (dBestDistance == dDistance) return;
+	m_dVerletDistance = dBestDistance;
+	RecalculateGrid();
 }
 
-void CVerletList::InsertParticlesToVector(std::vector<SEntry>& _vec, const std::vector<unsigned>& _partIDs, ESortCoord _dim, ESortDir _dir) const
+void CVerletList::InsertParticlesToVector(std::vector<SEntry>& _vec, const SIDRange& _partIDs, ESortCoord _dim, ESortDir _dir) const
 {
 	_vec.reserve(_partIDs.size());
 	for (const unsigned id : _partIDs)
 	{
-		const double radius = _dir == ESortDir::Right ? m_vParticles.ContactRadius(id) : -m_vParticles.ContactRadius(id);
+		const double radius = _dir == ESortDir::Right ? SearchRadius(id) : -SearchRadius(id);
 		switch (_dim)
 		{
 		case ESortCoord::X : _vec.emplace_back(id, m_vParticles.Coord(id).x + radius); break;
@@ -469,28 +1207,40 @@ void CVerletList::InsertParticlesToVector(std::vector<SEntry>& _vec, const std::
 	std::sort(_vec.begin(), _vec.end());
 }
 
-void CVerletList::CheckCollisionPPSorted(const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, ESortCoord _dim)
+void CVerletList::CheckCollisionPPSorted(size_t _iThread, const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, ESortCoord _dim)
 {
 	if (_nX2 >= _gridLevel.nCellsX || _nY2 >= _gridLevel.nCellsY || _nZ2 >= _gridLevel.nCellsZ) return;
 
 	std::vector<SEntry> setMainRSorted, setMainLSorted;
-	InsertParticlesToVector(setMainRSorted, _gridLevel.grid[_nX1][_nY1][_nZ1].vMainPartIDs, _dim, ESortDir::Right);
-	InsertParticlesToVector(setMainLSorted, _gridLevel.grid[_nX2][_nY2][_nZ2].vMainPartIDs, _dim, ESortDir::Left);
+	InsertParticlesToVector(setMainRSorted, GetCell(_gridLevel, _nX1, _nY1, _nZ1).vMainPartIDs, _dim, ESortDir::Right);
+	InsertParticlesToVector(setMainLSorted, GetCell(_gridLevel, _nX2, _nY2, _nZ2).vMainPartIDs, _dim, ESortDir::Left);
 	for (auto it1 = setMainRSorted.crbegin(); it1 != setMainRSorted.crend(); ++it1) //main-main
 	{
-		const double temp1 = m_dVerletDistance + m_vParticles.ContactRadius(it1->id);
+		const double temp1 = SearchRadius(it1->id);
 		auto iter2 = setMainLSorted.cbegin();
 		for (; iter2 != setMainLSorted.cend(); ++iter2)
-			if (iter2->val - it1->val <= m_dVerletDistance)
+			if (iter2->val <= it1->val) // extended spheres overlap along the sorting direction
 			{
-				if (SquaredLength(m_vParticles.Coord(it1->id) - m_vParticles.Coord(iter2->id)) <= std::pow(temp1 + m_vParticles.ContactRadius(iter2->id), 2))
-					AddPossibleContactPP(it1->id, iter2->id);
+				if (SquaredLength(m_vParticles.Coord(it1->id) - m_vParticles.Coord(iter2->id)) <= std::pow(temp1 + SearchRadius(iter2->id), 2))
+					AddPossibleContactPP(_iThread, it1->id, iter2->id);
 			}
 			else
 				break;
 		if (iter2 == setMainLSorted.cbegin()) break;
 	}
 
+	// main-secondary: the first cell has no secondary particles, but the second one may have, and they are not checked from it
+	const SCellView cell1 = GetCell(_gridLevel, _nX1, _nY1, _nZ1);
+	const SIDRange secondary2 = GetCell(_gridLevel, _nX2, _nY2, _nZ2).vSecondaryPartIDs;
+	if (!secondary2.empty())
+		for (const unsigned p1 : cell1.vMainPartIDs)
+		{
+			const double dTemp1 = SearchRadius(p1);
+			for (const unsigned p2 : secondary2)
+				if (SquaredLength(m_vParticles.Coord(p1) - m_vParticles.Coord(p2)) <= std::pow(dTemp1 + SearchRadius(p2), 2))
+					AddPossibleContactPP(_iThread, p1, p2);
+		}
+
 	// THIS ALGORITHM IS NOT WELL TESTED FOR MULTIGRID APPROACH
 	/*for (auto iter1 = sSetMain1.rbegin(); iter1 != sSetMain1.rend(); iter1++) //main-secondary
 	{
@@ -547,15 +1297,15 @@ void CVerletList::CheckCollisionPPSorted(const SGridLevel& _gridLevel, unsigned
 	return;*/
 }
 
-void CVerletList::CheckCollisionPP(const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, bool _bSameCell /*= false*/)
+void CVerletList::CheckCollisionPP(size_t _iThread, const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, bool _bSameCell /*= false*/)
 {
 	if (_nX2 >= _gridLevel.nCellsX || _nY2 >= _gridLevel.nCellsY || _nZ2 >= _gridLevel.nCellsZ) return;
-	const SGridCell& cell1 = _gridLevel.grid[_nX1][_nY1][_nZ1];
-	const SGridCell& cell2 = _gridLevel.grid[_nX2][_nY2][_nZ2];
+	const SCellView cell1 = GetCell(_gridLevel, _nX1, _nY1, _nZ1);
+	const SCellView cell2 = GetCell(_gridLevel, _nX2, _nY2, _nZ2);
 	for (unsigned i = 0; i < cell1.vMainPartIDs.size(); ++i)
 	{
 		const unsigned p1 = cell1.vMainPartIDs[i];
-		const double dTemp1 = m_dVerletDistance + m_vParticles.ContactRadius(p1);
+		const double dTemp1 = SearchRadius(p1);
 		const CVector3 vPos1 = m_vParticles.Coord(p1);
 		unsigned nStartIndex = 0;
 		if (_bSameCell)
@@ -563,20 +1313,20 @@ void CVerletList::CheckCollisionPP(const SGridLevel& _gridLevel, unsigned _nX1,
 		for (unsigned j = nStartIndex; j < cell2.vMainPartIDs.size(); ++j) //main-main
 		{
 			unsigned p2 = cell2.vMainPartIDs[j];
-			if (SquaredLength(vPos1 - m_vParticles.Coord(p2)) <= std::pow(dTemp1 + m_vParticles.ContactRadius(p2), 2))
+			if (SquaredLength(vPos1 - m_vParticles.Coord(p2)) <= std::pow(dTemp1 + SearchRadius(p2), 2))
 				if (( _bSameCell ) && ( p2 < p1))
-					AddPossibleContactPP(p2, p1);
+					AddPossibleContactPP(_iThread, p2, p1);
 				else
-					AddPossibleContactPP(p1, p2);
+					AddPossibleContactPP(_iThread, p1, p2);
 		}
 		for (unsigned j = 0; j < cell2.vSecondaryPartIDs.size(); ++j) // main-secondary
 		{
 			unsigned p2 = cell2.vSecondaryPartIDs[j];
-			if (SquaredLength(vPos1 - m_vParticles.Coord(p2)) <= pow(dTemp1 + m_vParticles.ContactRadius(p2), 2))
+			if (SquaredLength(vPos1 - m_vParticles.Coord(p2)) <= pow(dTemp1 + SearchRadius(p2), 2))
 				if ((_bSameCell) && (p2 < p1))
-					AddPossibleContactPP(p2, p1);
+					AddPossibleContactPP(_iThread, p2, p1);
 				else
-					AddPossibleContactPP(p1, p2);
+					AddPossibleContactPP(_iThread, p1, p2);
 		}
 	}
 
@@ -585,17 +1335,17 @@ void CVerletList::CheckCollisionPP(const SGridLevel& _gridLevel, unsigned _nX1,
 		{
 			unsigned p1 = cell2.vMainPartIDs[i];
 			const CVector3 vPos1 = m_vParticles.Coord(p1);
-			const double dTemp1 = m_dVerletDistance + m_vParticles.ContactRadius(p1);
+			const double dTemp1 = SearchRadius(p1);
 			for (unsigned j = 0; j < cell1.vSecondaryPartIDs.size(); ++j)
 			{
 				unsigned p2 = cell1.vSecondaryPartIDs[j];
-				if (SquaredLength(vPos1 - m_vParticles.Coord(p2)) <= pow(dTemp1 + m_vParticles.ContactRadius(p2), 2))
-					AddPossibleContactPP(p2, p1);
+				if (SquaredLength(vPos1 - m_vParticles.Coord(p2)) <= pow(dTemp1 + SearchRadius(p2), 2))
+					AddPossibleContactPP(_iThread, p2, p1);
 			}
 		}
 }
 
-void CVerletList::CheckCollisionPW(const SGridLevel& _gridLevel, const SGridCell& _gridCell)
+void CVerletList::CheckCollisionPW(size_t _iThread, const SGridLevel& _gridLevel, const SCellView& _gridCell)
 {
 	for (unsigned iPart = 0; iPart < _gridCell.vMainPartIDs.size(); ++iPart)
 	{
@@ -604,41 +1354,70 @@ void CVerletList::CheckCollisionPW(const SGridLevel& _gridLevel, const SGridCell
 		for (unsigned iWall = 0; iWall < _gridCell.vWallIDs.size(); ++iWall)
 		{
 			const unsigned w = _gridCell.vWallIDs[iWall];
-			if (IsSphereIntersectTriangle(m_vWalls.Coordinates(w), m_vWalls.NormalVector(w), m_vParticles.Coord(p), m_vParticles.ContactRadius(p) + m_dVerletDistance).first != EIntersectionType::NO_CONTACT)
-				AddPossibleContactPW(p, w);
+			if (IsSphereIntersectTriangle(m_vWalls.Coordinates(w), m_vWalls.Edges(w), m_vWalls.NormalVector(w), m_vParticles.Coord(p), SearchRadius(p) + m_vHalfSkin[p]).first != EIntersectionType::NO_CONTACT)
+				AddPossibleContactPW(_iThread, p, w);
 		}
 	}
 }
 
-void CVerletList::AddPossibleContactPP(unsigned _iPart1, unsigned _iPart2)
+void CVerletList::CheckCollisionPWHierarchy()
 {
-	m_PPList[_iPart1].push_back(_iPart2);
-	if (!m_Scene.m_PBC.bEnabled) return;
+	// the hierarchy is only refitted after motion of walls and rebuilt if it became too inefficient
+	m_wallBVH.Update(m_vWalls);
+	ParallelFor(m_vParticles.Size(), EScheduling::STRIDED, [&](size_t iThread, size_t i)
+	{
+		if (!m_vParticles.Active(i)) return;
+		const CVector3& coord = m_vParticles.Coord(i);
+		const double dRadius = SearchRadius(i) + m_vHalfSkin[i];
+		m_wallBVH.Query(coord, dRadius, [&](unsigned _iWall)
+		{
+			if (IsSphereIntersectTriangle(m_vWalls.Coordinates(_iWall), m_vWalls.Edges(_iWall), m_vWalls.NormalVector(_iWall), coord, dRadius).first != EIntersectionType::NO_CONTACT)
+				AddPossibleContactPW(iThread, static_cast<unsigned>(i), _iWall);
+		});
+	});
+}
 
-	// if PBC are enabled
-	const size_t nRealPart = m_Scene.GetRealParticlesNumber();
-	if (_iPart1 >= nRealPart && _iPart2 >= nRealPart) // virtual-virtual contact
-		m_PPList[_iPart1].pop_back();
-	else if (( _iPart1 < nRealPart) && (_iPart2 < nRealPart)) // real-real contact
-		m_PPVirtShift[_iPart1].push_back(0); // put empty shift to fulfill requirements of same size vectors
-	else if ((_iPart1 < nRealPart) && (_iPart2 >= nRealPart)) // real-virtual contact
+void CVerletList::AddPossibleContactPP(size_t _iThread, unsigned _iPart1, unsigned _iPart2)
+{
+	unsigned iSrc = _iPart1;
+	unsigned iDst = _iPart2;
+	uint8_t nVirtShift = 0;
+	if (m_Scene.m_PBC.bEnabled)
 	{
-		m_PPList[_iPart1].back() = m_vParticles.InitIndex(_iPart2);
-		m_PPVirtShift[_iPart1].push_back(m_Scene.m_vPBCVirtShift[_iPart2 - nRealPart]);
+		const size_t nRealPart = m_Scene.GetRealParticlesNumber();
+		if (_iPart1 >= nRealPart && _iPart2 >= nRealPart) // virtual-virtual contact
+			return;
+		if (_iPart2 >= nRealPart) // real-virtual contact
+		{
+			iDst = m_vParticles.InitIndex(_iPart2);
+			nVirtShift = m_Scene.m_vPBCVirtShift[_iPart2 - nRealPart];
+		}
+		else if (_iPart1 >= nRealPart) // virtual-real contact
+		{
+			iSrc = _iPart2;
+			iDst = m_vParticles.InitIndex(_iPart1);
+			nVirtShift = m_Scene.m_vPBCVirtShift[_iPart1 - nRealPart];
+		}
 	}
-	// else virtual-real contact - is correctly approximated with first line. afterwards reassign virtual contact will be used
+	AddPossibleContactPP(_iThread, iSrc, iDst, nVirtShift);
 }
 
-void CVerletList::AddPossibleContactPW(unsigned _iPart, unsigned _iWall)
+void CVerletList::AddPossibleContactPP(size_t _iThread, unsigned _iPart1, unsigned _iPart2, uint8_t _nVirtShift)
 {
-	m_PWList[_iPart].push_back(_iWall);
-	if (!m_Scene.m_PBC.bEnabled) return;
+	// the contact is stored in the list of the particle with the smaller index
+	if (_iPart2 < _iPart1)
+		m_vNewPP[_iThread].push_back({ _iPart2, _iPart1, InverseVirtShift(_nVirtShift) });
+	else
+		m_vNewPP[_iThread].push_back({ _iPart1, _iPart2, _nVirtShift });
+}
 
+void CVerletList::AddPossibleContactPW(size_t _iThread, unsigned _iPart, unsigned _iWall)
+{
 	// if PBC are enabled and particle which was added is virtual
-	if (_iPart >= m_Scene.GetRealParticlesNumber())
-		m_PWVirtShift[_iPart].push_back(m_Scene.m_vPBCVirtShift[_iPart - m_Scene.GetRealParticlesNumber()]);
+	if (m_Scene.m_PBC.bEnabled && _iPart >= m_Scene.GetRealParticlesNumber())
+		m_vNewPW[_iThread].push_back({ m_vParticles.InitIndex(_iPart), _iWall, m_Scene.m_vPBCVirtShift[_iPart - m_Scene.GetRealParticlesNumber()] });
 	else
-		m_PWVirtShift[_iPart].push_back(0); // put empty shift to fulfill requirements of same size vectors
+		m_vNewPW[_iThread].push_back({ _iPart, _iWall, 0 });
 }
 
 void CVerletList::RecalcPositions()
@@ -653,7 +1432,7 @@ void CVerletList::RecalcParticlesPositions()
 	// Here index of grid layers for each specific particle is calculated. Otherwise one particle can be considered twice
 	// if it is directly comes to the boundary of grid size
 	std::vector<unsigned> vGridLevel(nParticles);
-	ParallelFor(m_vParticles.Size(), [&](size_t i)
+	ParallelFor(m_vParticles.Size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
 		if (m_vParticles.Active(i))
 			for (unsigned iGrid = 0; iGrid < m_vGrid.size(); iGrid++)
@@ -671,7 +1450,7 @@ void CVerletList::RecalcParticlesPositions()
 		size_t nMaxIndex = gridLevel.nCellsX*gridLevel.nCellsY* gridLevel.nCellsZ;
 		static std::vector<size_t> vTotalIndex, vIDx, vIDy, vIDz;
 		vTotalIndex.resize(nParticles); vIDx.resize(nParticles); vIDy.resize(nParticles); vIDz.resize(nParticles);
-		ParallelFor(nParticles, [&](size_t i)
+		ParallelFor(nParticles, EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 		{
 			if (m_vParticles.Active(i))
 			{
@@ -686,6 +1465,17 @@ void CVerletList::RecalcParticlesPositions()
 				vTotalIndex[i] = nMaxIndex + 1;
 		});
 
+		if (m_bFlatGrid)
+		{
+			// main and secondary particles of each cell are placed into two subsequent buckets
+			SortIntoCells(gridLevel.flatParts, 2 * nMaxIndex, nParticles, [&](size_t i)
+			{
+				if (vTotalIndex[i] >= nMaxIndex || vGridLevel[i] < iGrid) return 2 * nMaxIndex;
+				return 2 * vTotalIndex[i] + (vGridLevel[i] == iGrid ? 0 : 1);
+			});
+			continue;
+		}
+
 		ParallelFor([&](size_t iThread)
 		{
 			for (unsigned i = 0; i < nParticles; ++i)
@@ -700,15 +1490,60 @@ void CVerletList::RecalcParticlesPositions()
 	}
 }
 
+template <typename FKey>
+void CVerletList::SortIntoCells(SFlatCells& _cells, size_t _nCells, size_t _nObjects, const FKey& _key)
+{
+	if (m_vCellCounters.size() < _nCells)
+		m_vCellCounters = std::vector<std::atomic<unsigned>>(_nCells);
+	ParallelFor(_nCells, [&](size_t i)
+	{
+		m_vCellCounters[i].store(0, std::memory_order_relaxed);
+	});
+
+	// count objects in each cell
+	ParallelFor(_nObjects, EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+	{
+		const size_t iCell = _key(i);
+		if (iCell < _nCells)
+			m_vCellCounters[iCell].fetch_add(1, std::memory_order_relaxed);
+	});
+
+	// calculate positions of cells and set counters to them
+	_cells.vStart.resize(_nCells + 1);
+	_cells.vStart[0] = 0;
+	for (size_t i = 0; i < _nCells; ++i)
+	{
+		_cells.vStart[i + 1] = _cells.vStart[i] + m_vCellCounters[i].load(std::memory_order_relaxed);
+		m_vCellCounters[i].store(_cells.vStart[i], std::memory_order_relaxed);
+	}
+
+	// place objects into cells
+	_cells.vIDs.resize(_cells.vStart.back());
+	ParallelFor(_nObjects, EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+	{
+		const size_t iCell = _key(i);
+		if (iCell < _nCells)
+			_cells.vIDs[m_vCellCounters[iCell].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned>(i);
+	});
+
+	// restore ascending order of objects in each cell, which is mixed if they were placed by several threads
+	if (m_nThreadsNumber > 1)
+		ParallelFor(_nCells, [&](size_t i)
+		{
+			if (_cells.vStart[i + 1] - _cells.vStart[i] > 1)
+				std::sort(_cells.vIDs.begin() + _cells.vStart[i], _cells.vIDs.begin() + _cells.vStart[i + 1]);
+		});
+}
+
 
 void CVerletList::RecalcWallsPositions()
 {
-	ParallelFor(m_vGrid.size(), [&](size_t iGrid)
+	if (m_bWallBVH) return; // walls are searched in the hierarchy
+	// calls addToCell for each cell of the grid level, which may contain contacts with each wall
+	const auto ForEachWallCell = [&](SGridLevel& gridLevel, const auto& addToCell)
 	{
 		for (unsigned iWall = 0; iWall < m_vWalls.Size(); ++iWall)
 		{
-			SGridLevel& gridLevel = m_vGrid[iGrid];
-
 			const CVector3 minCoord = (m_vWalls.MinCoord(iWall) - m_workDomain.coordBeg) / gridLevel.dCellSize;
 			int nMinX = static_cast<int>(floor(minCoord.x));
 			int nMinY = static_cast<int>(floor(minCoord.y));
@@ -738,8 +1573,42 @@ void CVerletList::RecalcWallsPositions()
 			for (int x = nMinX; x <= nMaxX; ++x)
 				for (int y = nMinY; y <= nMaxY; ++y)
 					for (int z = nMinZ; z <= nMaxZ; ++z)
-						gridLevel.grid[x][y][z].vWallIDs.push_back(iWall);
+						addToCell(gridLevel, iWall, x, y, z);
 		}
+	};
+
+	if (!m_bFlatGrid)
+	{
+		ParallelFor(m_vGrid.size(), EScheduling::STRIDED, [&](size_t, size_t iGrid)
+		{
+			ForEachWallCell(m_vGrid[iGrid], [](SGridLevel& gl, unsigned iWall, int x, int y, int z)
+			{
+				gl.grid[x][y][z].vWallIDs.push_back(iWall);
+			});
+		});
+		return;
+	}
+
+	// counting sort of walls into the flat grid: count walls in each cell, calculate positions of cells and place walls
+	ParallelFor(m_vGrid.size(), EScheduling::STRIDED, [&](size_t, size_t iGrid)
+	{
+		SGridLevel& gridLevel = m_vGrid[iGrid];
+		std::vector<unsigned>& vStart = gridLevel.flatWalls.vStart;
+		std::fill(vStart.begin(), vStart.end(), 0);
+		ForEachWallCell(gridLevel, [](SGridLevel& gl, unsigned, int x, int y, int z)
+		{
+			gl.flatWalls.vStart[(static_cast<size_t>(x) * gl.nCellsY + y) * gl.nCellsZ + z + 1]++;
+		});
+		for (size_t i = 1; i < vStart.size(); ++i)
+			vStart[i] += vStart[i - 1];
+		gridLevel.flatWalls.vIDs.resize(vStart.back());
+		// each placed wall shifts the start of its cell, so that afterwards each start is equal to the start of the next cell
+		ForEachWallCell(gridLevel, [](SGridLevel& gl, unsigned iWall, int x, int y, int z)
+		{
+			gl.flatWalls.vIDs[gl.flatWalls.vStart[(static_cast<size_t>(x) * gl.nCellsY + y) * gl.nCellsZ + z]++] = iWall;
+		});
+		std::copy_backward(vStart.begin(), vStart.end() - 1, vStart.end());
+		vStart[0] = 0;
 	});
 }
 
@@ -750,8 +1619,9 @@ void CVerletList::ResetCurrentData()
 
 void CVerletList::ClearOldPositions()
 {
+	if (m_bFlatGrid) return; // flat cells are completely refilled
 	for (size_t i = 0; i < m_vGrid.size(); ++i)
-		ParallelFor(m_vGrid[i].nCellsX, [&](size_t x)
+		ParallelFor(m_vGrid[i].nCellsX, EScheduling::CONTIGUOUS, [&](size_t, size_t x)
 		{
 			for (unsigned y = 0; y < m_vGrid[i].nCellsY; ++y)
 				for (unsigned z = 0; z < m_vGrid[i].nCellsZ; ++z)
@@ -763,33 +1633,53 @@ void CVerletList::ClearOldPositions()
 		});
 }
 
-void CVerletList::GetPWContacts(size_t _iP, std::vector<EIntersectionType>& _vIntersectionType, std::vector<CVector3>& _vContactPoint) const
+CVerletList::SCellView CVerletList::GetCell(const SGridLevel& _gridLevel, unsigned _nX, unsigned _nY, unsigned _nZ) const
 {
-	if (m_PWList[_iP].empty()) return;
+	if (!m_bFlatGrid)
+	{
+		const SGridCell& cell = _gridLevel.grid[_nX][_nY][_nZ];
+		const auto Range = [](const std::vector<unsigned>& _ids) { return SIDRange{ _ids.data(), _ids.data() + _ids.size() }; };
+		return { Range(cell.vMainPartIDs), Range(cell.vSecondaryPartIDs), Range(cell.vWallIDs) };
+	}
+	const size_t iCell = (static_cast<size_t>(_nX) * _gridLevel.nCellsY + _nY) * _gridLevel.nCellsZ + _nZ;
+	const unsigned* parts = _gridLevel.flatParts.vIDs.data();
+	const unsigned* start = _gridLevel.flatParts.vStart.data() + 2 * iCell;
+	const unsigned* walls = _gridLevel.flatWalls.vIDs.data();
+	return { { parts + start[0], parts + start[1] }, { parts + start[1], parts + start[2] },
+		{ walls + _gridLevel.flatWalls.vStart[iCell], walls + _gridLevel.flatWalls.vStart[iCell + 1] } };
+}
 
-	_vIntersectionType.resize(m_PWList[_iP].size());
-	_vContactPoint.resize(m_PWList[_iP].size());
+void CVerletList::GetPWContacts(size_t _iP, std::vector<EIntersectionType>& _vIntersectionType, std::vector<CVector3>& _vContactPoint, std::vector<unsigned>& _vContacts) const
+{
+	_vContacts.clear();
+	const auto walls = m_PWList.Row(_iP);
+	if (walls.empty()) return;
 
-	CVector3 vPartCoord;
-	std::vector<bool> bVirtualContacts(m_PWList[_iP].size(), false); // true for all virtual contacts
-	for (size_t i = 0; i < m_PWList[_iP].size(); ++i)
-	{
-		if(!m_PWVirtShift.empty() && (m_PWVirtShift[_iP][i] != 0)) // virtual contact
-		{
-			vPartCoord = GetVirtualProperty(m_vParticles.Coord(_iP), m_PWVirtShift[_iP][i], m_Scene.m_PBC );
-			bVirtualContacts[i] = true;
-		}
-		else
-			vPartCoord = m_vParticles.Coord(_iP);
+	_vIntersectionType.resize(walls.size());
+	_vContactPoint.resize(walls.size());
 
-		const size_t w = m_PWList[_iP][i];
-		std::tie(_vIntersectionType[i], _vContactPoint[i]) = IsSphereIntersectTriangle(m_vWalls.Coordinates(w), m_vWalls.NormalVector(w), vPartCoord, m_vParticles.ContactRadius(_iP));
+	const CVector3 vCoord = m_vParticles.Coord(_iP);
+	const double dRadius = m_vParticles.ContactRadius(_iP);
+	for (unsigned i = 0; i < walls.size(); ++i)
+	{
+		const uint8_t shift = m_PWList.Shift(_iP, i);
+		const CVector3 vPartCoord = shift == 0 ? vCoord : GetVirtualProperty(vCoord, shift, m_Scene.m_PBC); // virtual contact
+		const size_t w = walls[i];
+		std::tie(_vIntersectionType[i], _vContactPoint[i]) = IsSphereIntersectTriangle(m_vWalls.Coordinates(w), m_vWalls.Edges(w), m_vWalls.NormalVector(w), vPartCoord, dRadius);
+		if (_vIntersectionType[i] != EIntersectionType::NO_CONTACT)
+			_vContacts.push_back(i);
 	}
+	if (_vContacts.empty()) return;
 
-	for (size_t i = 0; i < _vContactPoint.size() - 1; ++i)
+	// only walls in contact are compared pairwise
+	for (size_t k = 0; k < _vContacts.size() - 1; ++k)
+	{
+		const unsigned i = _vContacts[k];
 		if (_vIntersectionType[i] != EIntersectionType::NO_CONTACT)
-			for (size_t j = i + 1; j < _vContactPoint.size(); ++j)
-				if (_vIntersectionType[j] != EIntersectionType::NO_CONTACT && SquaredLength(m_vWalls.NormalVector(m_PWList[_iP][i]) - m_vWalls.NormalVector(m_PWList[_iP][j])) < 1e-6) // simplified unique calculation check
+			for (size_t l = k + 1; l < _vContacts.size(); ++l)
+			{
+				const unsigned j = _vContacts[l];
+				if (_vIntersectionType[j] != EIntersectionType::NO_CONTACT && SquaredLength(m_vWalls.NormalVector(walls[i]) - m_vWalls.NormalVector(walls[j])) < 1e-6) // simplified unique calculation check
 					switch (_vIntersectionType[i])
 					{
 					case EIntersectionType::FACE_CONTACT:
@@ -809,11 +1699,16 @@ void CVerletList::GetPWContacts(size_t _iP, std::vector<EIntersectionType>& _vIn
 						break;
 					default: ;
 					}
+			}
+	}
+
+	if (m_PWList.HasShifts())
+		for (const unsigned i : _vContacts)
+			if (m_PWList.Shift(_iP, i) != 0)
+				for (const unsigned j : _vContacts) // additional check that there is no contact between one wall and real and virtual particles
+					if (j != i && _vIntersectionType[j] != EIntersectionType::NO_CONTACT && m_PWList.Shift(_iP, j) == 0 && walls[j] == walls[i])
+						_vIntersectionType[i] = EIntersectionType::NO_CONTACT;
 
-	for (size_t i = 0; i < m_PWList[_iP].size(); ++i)
-		if (bVirtualContacts[i])
-			for (size_t j = 0; j < m_PWList[_iP].size(); ++j) // additional check that there is no contact between one wall and real and virtual particles
-				if (j != i && _vIntersectionType[j] != EIntersectionType::NO_CONTACT && bVirtualContacts[j] == 0 && m_PWList[_iP][j] == m_PWList[_iP][i])
-					_vIntersectionType[i] = EIntersectionType::NO_CONTACT;
+	_vContacts.erase(std::remove_if(_vContacts.begin(), _vContacts.end(), [&](unsigned _i) { return _vIntersectionType[_i] == EIntersectionType::NO_CONTACT; }), _vContacts.end());
 }
 
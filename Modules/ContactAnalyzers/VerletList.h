@@ -7,6 +7,10 @@
 #include "ThreadPool.h"
 #include "SimplifiedScene.h"
 #include "GeometricFunctions.h"
+#include "VerletMatrix.h"
+#include "WallBVH.h"
+#include <atomic>
+#include <array>
 
 struct SCalcPerfmMetric
 {
@@ -17,22 +21,63 @@ struct SCalcPerfmMetric
 
 #define DEFAULT_TEOR_DISTANCE			1e+12
 #define DEFAULT_VERLET_DISTANCE_COEFF	2
+#define MAX_INCREMENTAL_MOVED_FRACTION	0.25	// if more particles moved, the whole verlet list is rebuilt instead of incremental update
+#define MAX_SWEEP_INSERTION_SHIFTS		8		// average number of shifts per particle, after which insertion sort of sweep and prune is replaced with radix sort
+#define MAX_SIZE_CLASSES				8		// maximum number of size classes of particles with own verlet distances
+
+// cost model to adjust verlet distance. Durations of updates and of time steps are measured; these relative costs of counted operations only split
+// the measured duration of an update into parts of particles and of possible contacts, and replace all measurements if durations of time steps
+// are not reported with AddStepDuration(). Calibrated on one thread with the grid broad phase by timing updates and checks of possible contacts
+// in monodisperse and polydisperse (1:5) beds of 10000 and 40000 particles with verlet distances of 0.1-6 radii: about 750 ns per particle
+// and 90 ns per found possible contact in an update, and 3 ns per possible contact in a time step.
+#define VERLET_COST_PARTICLE			250.0	// cost of one particle in an update of verlet lists
+#define VERLET_COST_BROAD_PAIR			30.0	// cost of finding one possible contact in an update, including rejected candidates
+#define VERLET_COST_NARROW_PAIR			1.0		// cost of checking one possible contact in a time step
+#define VERLET_COST_WINDOW				10		// number of measured intervals between updates, after which verlet distance is adjusted
+#define VERLET_COST_MAX_CHANGE			2.0		// maximum factor, by which verlet distance is changed in one adjustment
+#define VERLET_COST_SAMPLES				33		// number of verlet distances, for which the cost is predicted in one adjustment
+#define VERLET_COST_MIN_GAIN			0.02	// minimum predicted relative gain to change verlet distance; prevents oscillations
+#define VERLET_COST_MIN_COEFF			0.05	// minimum verlet distance relative to the minimum particle radius
 
 class CVerletList
 {
 public:
-	// Contains indexes of connecting objects.
-	std::vector<std::vector<unsigned>> m_PPList;
-	std::vector<std::vector<unsigned>> m_PWList;
-
-	/* Information to calculate between real-virtual particles for PP-contacts.
-	 * For BOX: shifts {x, y, z}; for CYLINDER: angle of rotation {cos(a), sin(a), 0}; for not virtual contact: {0, 0, 0}.
-	 * The length is equal to [partNum][collNumber].*/
-	std::vector<std::vector<uint8_t>> m_PPVirtShift;
-	/* Information to calculate between real-virtual particles for PW-contacts.
-	 * For BOX: shifts {x, y, z}; for CYLINDER: angle of rotation {cos(a), sin(a), 0}; for not virtual contact: {0, 0, 0}.
-	 * The length is equal to [partNum][collNumber].*/
-	std::vector<std::vector<uint8_t>> m_PWVirtShift;
+	// Algorithms to find possible contacts.
+	enum class EBroadPhase : unsigned
+	{
+		GRID = 0,			// Hierarchical grid of cells.
+		SWEEP_AND_PRUNE = 1	// Particles sorted along the dominant axis, overlapping intervals are swept.
+	};
+
+	// Particles with contact radii in (dMinRadius; dMaxRadius], which share one verlet distance, and statistics of their lists.
+	struct SSizeClass
+	{
+		double dMinRadius{ 0 };
+		double dMaxRadius{ 0 };
+		double dVerletDistance{ 0 };	// verlet distance of particles of this class
+		size_t nParticles{ 0 };			// number of active particles at the last update
+		size_t nTriggers{ 0 };			// number of updates, caused by displacements of particles of this class
+		size_t nCandidates{ 0 };		// number of possible PP contacts with particles of this class, summed over all updates
+	};
+
+	// Adjustment of verlet distance by the cost model.
+	struct SDistanceDecision
+	{
+		double dTime;				// simulation time of the adjustment
+		double dOldDistance;		// verlet distance before the adjustment
+		double dNewDistance;		// verlet distance after the adjustment
+		double dCandidates;			// average number of possible PP contacts in an update
+		double dStepsPerUpdate;		// average number of time steps between updates
+		double dUpdateDuration;		// average measured duration of an update [s], 0 if not measured
+		double dStepDuration;		// average measured duration of checking possible contacts in a time step [s], 0 if not measured
+		double dOldCost;			// predicted cost per simulated second with the old distance, in seconds if durations are measured
+		double dNewCost;			// predicted cost per simulated second with the new distance, in seconds if durations are measured
+	};
+
+	// Possible particle-particle contacts with virtual shifts. Each contact is stored in the row of the particle with the smaller index.
+	CVerletMatrix m_PPList;
+	// Possible particle-wall contacts with virtual shifts, stored in rows of particles.
+	CVerletMatrix m_PWList;
 
 	size_t m_nThreadsNumber;	/// Number of available parallel threads.
 
@@ -44,9 +89,40 @@ private:
 		std::vector<unsigned> vWallIDs; // memory which has been allocated for walls
 	};
 
+	// Objects of all cells of a grid level, stored contiguously and ordered by cells.
+	// Objects of cell i occupy range [vStart[i]; vStart[i + 1]) of vIDs.
+	struct SFlatCells
+	{
+		std::vector<unsigned> vStart;	// index of the first object of each cell, the last element is the total number of objects
+		std::vector<unsigned> vIDs;		// indexes of objects, ordered by cells
+	};
+
+	// Contiguous range of indexes of objects.
+	struct SIDRange
+	{
+		const unsigned* first;
+		const unsigned* last;
+
+		const unsigned* begin() const { return first; }
+		const unsigned* end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+		bool empty() const { return first == last; }
+		unsigned operator[](size_t _i) const { return first[_i]; }
+	};
+
+	// Objects of one cell, independent of how the grid is stored.
+	struct SCellView
+	{
+		SIDRange vMainPartIDs;
+		SIDRange vSecondaryPartIDs;
+		SIDRange vWallIDs;
+	};
+
 	struct SGridLevel
 	{
-		std::vector<std::vector<std::vector<SGridCell>>> grid;
+		std::vector<std::vector<std::vector<SGridCell>>> grid;	// cells, used if the flat grid is disabled
+		SFlatCells flatParts;	// particles of all cells, used if the flat grid is enabled: main particles of cell i are in bucket 2*i, secondary ones - in bucket 2*i+1
+		SFlatCells flatWalls;	// walls of all cells, used if the flat grid is enabled
 		double dCellSize;		// cell size in current grid
 		double dMaxPartRadius;	// max radius of particles are being placed into this grid
 		double dMinPartRadius;	// min radius of particles are being considered in contacts in this grid
@@ -65,6 +141,65 @@ private:
 			return _e1.val < _e2.val;
 		}
 	};
+	// Uniform grid, used for incremental updates of verlet lists. Particles are placed into cells by their coordinates at the last update of their lists.
+	struct SIncrementalGrid
+	{
+		double dCellSize;							// cell size, large enough to find all contacts in neighboring cells
+		double dVerletDistance;						// verlet distance, for which the grid was built
+		unsigned nCellsX, nCellsY, nCellsZ;			// number of cells in each direction
+		std::vector<std::vector<unsigned>> vPartIDs;	// particles in each cell
+		std::vector<std::vector<unsigned>> vWallIDs;	// walls, which may contact particles in each cell
+		std::vector<size_t> vPartCell;					// cell of each particle
+	};
+	// Uniform grid over the PBC domain for implicit PBC. Cells in periodic directions are wrapped, so that contacts through boundaries are found
+	// in neighboring cells with minimum-image shifts instead of virtual particles.
+	struct SPeriodicGrid
+	{
+		CVector3 vOrigin;						// coordinates of the beginning of the grid
+		CVector3 vCellSize;						// cell size in each direction; in periodic directions, the PBC domain consists of whole cells
+		std::array<unsigned, 3> nCells{};		// number of cells in each direction
+		std::array<bool, 3> bPeriodic{};		// whether each direction is periodic
+		SFlatCells parts;						// active particles of each cell
+		std::vector<std::vector<unsigned>> vWallIDs;	// walls, which may contact particles in each cell
+	};
+	// Particle with its coordinates, stored by positions along the sweep axis for linear access during the sweep.
+	struct SSweepParticle
+	{
+		CVector3 coord;		// coordinates
+		double radius;		// contact radius, extended by a half of verlet distance of the particle
+		unsigned id;		// index of particle
+		uint32_t keyEnd;	// quantized upper bound of the interval along the sweep axis
+	};
+	// Particles sorted by lower bounds of their intervals along the sweep axis. Kept between updates to exploit temporal coherence.
+	struct SSweepAndPrune
+	{
+		unsigned nAxis{ 0 };						// sweep axis: 0 - X, 1 - Y, 2 - Z
+		double dOrigin{ 0 };						// coordinate of quantization origin along the sweep axis
+		double dScale{ 1 };							// quantization scale along the sweep axis
+		uint32_t nMaxWidth{ 0 };					// maximum quantized width of intervals of particles
+		std::vector<unsigned> vOrder;				// indices of particles sorted by lower bounds; inactive particles are at the end
+		std::vector<uint32_t> vKeys;				// quantized lower bounds of intervals of sorted particles
+		std::vector<SSweepParticle> vParticles;		// sorted particles
+		std::vector<unsigned> vTempOrder;			// buffers for radix sort
+		std::vector<uint32_t> vTempKeys;
+	};
+
+	// Operations, counted between updates of verlet lists for the cost model of verlet distance.
+	struct SCostCounters
+	{
+		double dLastUpdateTime{ 0 };	// time of the last update
+		size_t nLastCandidates{ 0 };	// number of possible PP contacts, found in the last update
+		size_t nStepsSinceUpdate{ 0 };	// number of time steps since the last update
+		size_t nIntervals{ 0 };			// number of measured intervals between updates since the last adjustment
+		size_t nSteps{ 0 };				// total number of time steps in measured intervals
+		size_t nCandidates{ 0 };		// total number of possible PP contacts, found at the beginning of measured intervals
+		double dTime{ 0 };				// total duration of measured intervals
+		double dLastUpdateDuration{ 0 };	// measured duration of the last update [s]
+		double dStepsSinceUpdate{ 0 };		// measured duration of checking possible contacts in time steps since the last update [s]
+		double dUpdateDuration{ 0 };		// total measured duration of updates at the beginning of measured intervals [s]
+		double dStepsDuration{ 0 };			// total measured duration of checking possible contacts in measured intervals [s]
+	};
+
 	enum class ESortCoord : unsigned { X , Y , Z, XY, YZ, XZ };
 	enum class ESortDir : unsigned { Left, Right };
 
@@ -81,6 +216,27 @@ private:
 	uint32_t m_nCellsMax;					/// Maximum allowed number of cells in each direction.
 	double m_dVerletDistanceCoeff;		/// A coefficient to calculate verlet distance.
 	bool m_bAutoAdjustVerletDistance;	/// If set to true - the verlet distance will be automatically adjusted during the simulation.
+	bool m_bIncrementalUpdate;			/// If set to true - only lists of particles, which moved far enough, are updated, if possible.
+	SIncrementalGrid m_incGrid;			/// Grid for incremental updates.
+	std::vector<std::vector<CVerletMatrix::SEntry>> m_vNewPP;	/// Possible PP contacts, found by each thread during the update; placed here to avoid memory reallocation.
+	std::vector<std::vector<CVerletMatrix::SEntry>> m_vNewPW;	/// Possible PW contacts, found by each thread during the update; placed here to avoid memory reallocation.
+	bool m_bFlatGrid;					/// If set to true - cells of all grid levels are stored in contiguous arrays, filled with counting sort.
+	std::vector<std::atomic<unsigned>> m_vCellCounters;	/// Number of objects in each cell, used to sort objects into the flat grid.
+	EBroadPhase m_broadPhase;			/// Algorithm to find possible contacts.
+	SSweepAndPrune m_sweep;				/// State of sweep and prune.
+	bool m_bWallBVH;					/// If set to true - particle-wall contacts are searched in the bounding volume hierarchy of walls instead of the grid.
+	CWallBVH m_wallBVH;					/// Bounding volume hierarchy of walls.
+	bool m_bSizeClassSkin;				/// If set to true - each size class of particles gets verlet distance proportional to its radius, instead of the one of the smallest particles.
+	std::vector<SSizeClass> m_vSizeClasses;	/// Size classes of particles, from the largest to the smallest.
+	std::vector<uint8_t> m_vPartClass;	/// Size class of each particle at the last update.
+	std::vector<double> m_vHalfSkin;	/// Half of verlet distance of each particle at the last update.
+	double m_dMaxSkin;					/// The largest verlet distance of all size classes.
+	size_t m_nUpdates;					/// Number of updates of lists since initialization.
+	bool m_bCostModel;					/// If set to true - the verlet distance is adjusted by the cost model of counted operations instead of measured time.
+	SCostCounters m_costCounters;		/// Operations, counted for the cost model.
+	std::vector<SDistanceDecision> m_vDistanceDecisions;	/// All adjustments of verlet distance by the cost model.
+	bool m_bImplicitPBC;				/// If set to true - contacts through periodic boundaries are found with minimum-image shifts in a wrapped grid instead of virtual particles.
+	SPeriodicGrid m_pbcGrid;			/// Grid for implicit PBC.
 
 	CSimplifiedScene& m_Scene;
 
@@ -96,35 +252,104 @@ public:
 	void SetPointers(const std::vector<SWallStruct>& _vWalls );
 	void SetSceneInfo(const SVolumeType& _simDomain, double _dMinPartRadius, double _dMaxPartRadius, uint32_t _dMaxCellsNumber, double _dVerletCoeff, bool _bAutoAdjust);
 	void SetConnectedPPContact(bool _bPPContact) { m_bConnectedPPContact = _bPPContact;  }
+	void SetIncrementalUpdate(bool _bIncremental) { m_bIncrementalUpdate = _bIncremental; ResetCurrentData(); }
+	bool GetIncrementalUpdate() const { return m_bIncrementalUpdate; }
+	void SetFlatGrid(bool _bFlat);
+	bool GetFlatGrid() const { return m_bFlatGrid; }
+	void SetBroadPhase(EBroadPhase _broadPhase);
+	EBroadPhase GetBroadPhase() const { return m_broadPhase; }
+	void SetWallBVH(bool _bEnable);
+	bool GetWallBVH() const { return m_bWallBVH; }
+	void SetSizeClassSkin(bool _bEnable);
+	bool GetSizeClassSkin() const { return m_bSizeClassSkin; }
+	const std::vector<SSizeClass>& GetSizeClasses() const { return m_vSizeClasses; }
+	size_t GetUpdatesNumber() const { return m_nUpdates; }
+	void SetCostModel(bool _bEnable) { m_bCostModel = _bEnable; }
+	bool GetCostModel() const { return m_bCostModel; }
+	// Adds the measured duration of checking possible contacts in one time step, which is used by the cost model.
+	void AddStepDuration(double _dDuration) { m_costCounters.dStepsSinceUpdate += _dDuration; }
+	const std::vector<SDistanceDecision>& GetDistanceDecisions() const { return m_vDistanceDecisions; }
+	double GetVerletDistance() const { return m_dVerletDistance; }
+	void SetImplicitPBC(bool _bEnable) { m_bImplicitPBC = _bEnable; }
+	bool GetImplicitPBC() const { return m_bImplicitPBC; }
 
 	void ResetCurrentData(); // set current data as not actual
 	bool IsNeedToBeUpdated(double _dTimeStep, double _dMaxPartDist, double _dMaxWallVel); // Returns true if verlet list needs to be updated at the current step.
-	void UpdateList(double _dCurrTime);
-	void GetPWContacts(size_t _iP, std::vector<EIntersectionType>& _vIntersectionType, std::vector<CVector3>& _vContactPoint) const;
-	void ReassignVirtualContacts();
+	void UpdateList(double _dCurrTime); // Updates verlet lists and stores coordinates of particles, which were used for it.
+	// Calculates contacts of particle _iP with walls from its verlet list. Types and contact points are set for all walls of the list, _vContacts receives indices of walls in contact.
+	// Output vectors are only resized, so they can be reused between calls without reallocations.
+	void GetPWContacts(size_t _iP, std::vector<EIntersectionType>& _vIntersectionType, std::vector<CVector3>& _vContactPoint, std::vector<unsigned>& _vContacts) const;
 	void AddDisregardingTimeInterval(const clock_t& _interval);
+	// Writes current lists, verlet distance and state of its adjustment into binary stream.
+	void SaveState(std::ostream& _s) const;
+	// Restores lists, verlet distance and state of its adjustment written with SaveState. Grids are recalculated for the restored verlet distance.
+	void LoadState(std::istream& _s);
 
 private:
 	void AutoAdjustVerletDistance( double _dCurrentTime );
+	// Adjusts verlet distance to minimize the cost per simulated second, predicted from numbers of possible contacts and time steps between updates
+	// and from measured durations of updates and time steps.
+	void AdjustVerletDistanceByCost(double _dCurrentTime);
+	void RebuildLists();	// Finds all possible contacts with the current verlet distance.
 	void RecalculateGrid();	// recalculates whole grids
+	void RecalculateSizeClasses();	// Sets bounds and verlet distances of size classes. Statistics are kept if bounds do not change.
+	unsigned GetSizeClass(double _dRadius) const;	// Returns size class of particles with the given contact radius.
+	void UpdateParticlesSkin();		// Sets size classes and verlet distances of all particles.
+	void GatherSizeClassStatistics();	// Adds numbers of possible contacts of each size class after the update.
+	// Returns contact radius of the particle, extended by a half of its verlet distance. Two particles may contact until the next update, if their extended spheres overlap.
+	double SearchRadius(size_t _iPart) const { return m_vParticles.ContactRadius(_iPart) + m_vHalfSkin[_iPart]; }
 	void EmptyGrid();
-	void SortList();		// Sorts current PP verlet list so that the src is always smaller as the dst.
+	void ClearNewContacts();	// Prepares buffers of each thread for new contacts.
 
 	void RecalcPositions();
 	void RecalcParticlesPositions();
 	void RecalcWallsPositions();
 	void ClearOldPositions();
 
-	void CheckCollisionPP( const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, bool _bSameCell = false );
-	void CheckCollisionPPSorted(const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, ESortCoord _dim);
-	void CheckCollisionPW(const SGridLevel& _gridLevel, const SGridCell& _gridCell);
+	SCellView GetCell(const SGridLevel& _gridLevel, unsigned _nX, unsigned _nY, unsigned _nZ) const; // Returns objects of the cell of the grid.
+	// Places objects into cells of the flat grid with a parallel counting sort. _key(i) returns the cell of object i or a value >= _nCells to skip the object.
+	template <typename FKey>
+	void SortIntoCells(SFlatCells& _cells, size_t _nCells, size_t _nObjects, const FKey& _key);
+
+	// Updates lists only for particles, which moved for more than a quarter of their verlet distance, and for their neighbors.
+	// Returns false if incremental update is not possible and the whole list must be rebuilt.
+	bool UpdateListIncremental();
+	void RecalcIncrementalGrid();	// Places all particles and walls into the grid for incremental updates.
+	size_t GetIncrementalCell(const CVector3& _coord) const;	// Returns index of the cell of the incremental grid, which contains the point.
+
+	// Updates lists with implicit PBC, finding contacts through periodic boundaries with minimum-image shifts and without virtual particles.
+	// Returns false if implicit PBC are disabled or not possible, because the PBC domain is shorter than three cells in a periodic direction.
+	bool UpdateListImplicitPBC();
+	bool RecalcPeriodicGrid();	// Places all active particles and walls into the grid for implicit PBC. Returns false if the grid is too coarse to be wrapped.
+	std::array<unsigned, 3> GetPeriodicCell(const CVector3& _coord) const;	// Returns the cell of the grid for implicit PBC, which contains the point.
+
+	// Finds all possible contacts with sweep and prune along the dominant axis.
+	void UpdateListSweepAndPrune();
+	// Sorts particles by quantized lower bounds of their intervals along the sweep axis. Reuses the order from the previous update if possible.
+	void SortSweepParticles(bool _bReuseOrder);
+	// Sorts particles with parallel LSD radix sort, 8 bits per pass.
+	void RadixSortSweepParticles();
+	// Sorts nearly sorted particles with insertion sort. Returns false if too many shifts were needed and the sorting was stopped.
+	bool InsertionSortSweepParticles();
+	// Quantizes a coordinate along the sweep axis, rounding down or up.
+	uint32_t QuantizeSweepFloor(double _val) const;
+	uint32_t QuantizeSweepCeil(double _val) const;
+
+	void CheckCollisionPP(size_t _iThread, const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, bool _bSameCell = false );
+	void CheckCollisionPPSorted(size_t _iThread, const SGridLevel& _gridLevel, unsigned _nX1, unsigned _nY1, unsigned _nZ1, unsigned _nX2, unsigned _nY2, unsigned _nZ2, ESortCoord _dim);
+	void CheckCollisionPW(size_t _iThread, const SGridLevel& _gridLevel, const SCellView& _gridCell);
+	// Refits the bounding volume hierarchy of walls to their current positions and finds possible contacts of all particles with walls in it.
+	void CheckCollisionPWHierarchy();
 
-	void AddPossibleContactPP(unsigned _iPart1, unsigned _iPart2);	// Add possible contacts into the list
-	void AddPossibleContactPW(unsigned _iPart, unsigned _iWall);	// Add possible contacts into the list
+	// Add possible contacts into the list of the thread. Contacts with virtual particles are stored as contacts with their real particles.
+	void AddPossibleContactPP(size_t _iThread, unsigned _iPart1, unsigned _iPart2);
+	// Adds possible contact between real particles, where the second one is shifted through periodic boundaries.
+	void AddPossibleContactPP(size_t _iThread, unsigned _iPart1, unsigned _iPart2, uint8_t _nVirtShift);
+	void AddPossibleContactPW(size_t _iThread, unsigned _iPart, unsigned _iWall);
 
-	// remove contacts between particles "directly" connected with bonds
+	// remove new contacts between particles "directly" connected with bonds
 	void RemoveSBContacts();
 
 	// for improved contact detection
-	void InsertParticlesToVector(std::vector<SEntry>& _vec, const std::vector<unsigned>& _partIDs, ESortCoord _dim, ESortDir _dir) const;
+	void InsertParticlesToVector(std::vector<SEntry>& _vec, const SIDRange& _partIDs, ESortCoord _dim, ESortDir _dir) const;
 };
\ No newline at end of file
@@ -0,0 +1,178 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+#include "ThreadPool.h"
+#include "BinaryStream.h"
+#include <atomic>
+#include <cstdint>
+
+// Possible contacts of all particles, stored contiguously in compressed sparse row format.
+// Contacts of particle i occupy range [m_offsets[i]; m_offsets[i + 1]) of m_ids and m_shifts, ordered by indices of contact partners.
+class CVerletMatrix
+{
+public:
+	// Possible contact of object row with object id.
+	// For virtual contacts, shift defines the position of the virtual copy of object id: for BOX: shifts {x, y, z}; for CYLINDER: angle of rotation; for not virtual contact: 0.
+	struct SEntry
+	{
+		unsigned row;
+		unsigned id;
+		uint8_t shift;
+	};
+
+	// Contiguous range of values of one row, usable in range-based for loops.
+	template <typename T>
+	struct SRow
+	{
+		T* first;
+		T* last;
+
+		T* begin() const { return first; }
+		T* end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+		bool empty() const { return first == last; }
+		T& operator[](size_t _i) const { return first[_i]; }
+	};
+
+private:
+	std::vector<size_t> m_offsets{ 0 };				// Index of the first contact of each particle, the last element is the total number of contacts.
+	std::vector<unsigned> m_ids;					// Indices of contact partners of all particles, ordered by particles.
+	std::vector<uint8_t> m_shifts;					// Virtual shifts of all contacts. Empty if shifts are not stored.
+	bool m_withShifts{ false };						// Whether virtual shifts are stored.
+	std::vector<std::atomic<unsigned>> m_counters;	// Number of contacts of each particle, used to fill the matrix.
+
+public:
+	// Returns the number of particles.
+	size_t Rows() const { return m_offsets.size() - 1; }
+	// Returns the total number of contacts.
+	size_t Size() const { return m_ids.size(); }
+	// Returns the number of contacts of particle _iRow.
+	size_t Size(size_t _iRow) const { return m_offsets[_iRow + 1] - m_offsets[_iRow]; }
+	// Returns true if virtual shifts of contacts are stored.
+	bool HasShifts() const { return m_withShifts; }
+	// Returns memory reserved to store contacts, in bytes.
+	size_t MemoryUsage() const { return m_offsets.capacity() * sizeof(size_t) + m_ids.capacity() * sizeof(unsigned) + m_shifts.capacity() * sizeof(uint8_t) + m_counters.capacity() * sizeof(unsigned); }
+
+	// Returns indices of contact partners of particle _iRow.
+	SRow<const unsigned> Row(size_t _iRow) const { return { m_ids.data() + m_offsets[_iRow], m_ids.data() + m_offsets[_iRow + 1] }; }
+	// Returns virtual shifts of contacts of particle _iRow. May only be called if shifts are stored.
+	SRow<uint8_t> Shifts(size_t _iRow) { return { m_shifts.data() + m_offsets[_iRow], m_shifts.data() + m_offsets[_iRow + 1] }; }
+	SRow<const uint8_t> Shifts(size_t _iRow) const { return { m_shifts.data() + m_offsets[_iRow], m_shifts.data() + m_offsets[_iRow + 1] }; }
+	// Returns index of the contact partner of the _j-th contact of particle _iRow.
+	unsigned ID(size_t _iRow, size_t _j) const { return m_ids[m_offsets[_iRow] + _j]; }
+	// Returns virtual shift of the _j-th contact of particle _iRow or 0 if shifts are not stored.
+	uint8_t Shift(size_t _iRow, size_t _j) const { return m_withShifts ? m_shifts[m_offsets[_iRow] + _j] : 0; }
+
+	// Returns index of the first contact of each particle, the last element is the total number of contacts.
+	const std::vector<size_t>& Offsets() const { return m_offsets; }
+	// Returns indices of contact partners of all particles.
+	const std::vector<unsigned>& IDs() const { return m_ids; }
+	// Returns virtual shifts of all contacts.
+	const std::vector<uint8_t>& ShiftsData() const { return m_shifts; }
+
+	// Writes all contacts into binary stream.
+	void Save(std::ostream& _s) const
+	{
+		WriteBinary(_s, m_offsets);
+		WriteBinary(_s, m_ids);
+		WriteBinary(_s, m_shifts);
+		WriteBinary(_s, m_withShifts);
+	}
+
+	// Reads all contacts from binary stream.
+	void Load(std::istream& _s)
+	{
+		ReadBinary(_s, m_offsets);
+		ReadBinary(_s, m_ids);
+		ReadBinary(_s, m_shifts);
+		ReadBinary(_s, m_withShifts);
+	}
+
+	// Removes all contacts and sets the number of particles.
+	void Reset(size_t _rows)
+	{
+		m_offsets.assign(_rows + 1, 0);
+		m_ids.clear();
+		m_shifts.clear();
+	}
+
+	// Fills the matrix with contacts from _parts. Contacts may be distributed among parts arbitrarily, e.g. each part is filled by one thread.
+	// Uses a parallel counting sort by rows: contacts of each particle are counted, offsets are calculated with a prefix sum and contacts are placed into their rows.
+	void Assign(size_t _rows, const std::vector<std::vector<SEntry>>& _parts, bool _withShifts)
+	{
+		m_withShifts = _withShifts;
+		if (m_counters.size() < _rows)
+			m_counters = std::vector<std::atomic<unsigned>>(_rows);
+		ParallelFor(_rows, EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+		{
+			m_counters[i].store(0, std::memory_order_relaxed);
+		});
+
+		// count contacts of each particle
+		ParallelFor(_parts.size(), [&](size_t iPart)
+		{
+			for (const SEntry& e : _parts[iPart])
+				m_counters[e.row].fetch_add(1, std::memory_order_relaxed);
+		});
+
+		// calculate offsets with a prefix sum over blocks of particles and set counters to them
+		m_offsets.resize(_rows + 1);
+		const size_t nBlocks = std::max<size_t>(std::min(GetThreadsNumber(), _rows), 1);
+		std::vector<size_t> blockStart(nBlocks + 1, 0);
+		const auto BlockBegin = [&](size_t _iBlock) { return _rows * _iBlock / nBlocks; };
+		ParallelFor(nBlocks, [&](size_t iBlock)
+		{
+			for (size_t i = BlockBegin(iBlock); i < BlockBegin(iBlock + 1); ++i)
+				blockStart[iBlock + 1] += m_counters[i].load(std::memory_order_relaxed);
+		});
+		for (size_t i = 0; i < nBlocks; ++i)
+			blockStart[i + 1] += blockStart[i];
+		ParallelFor(nBlocks, [&](size_t iBlock)
+		{
+			size_t offset = blockStart[iBlock];
+			for (size_t i = BlockBegin(iBlock); i < BlockBegin(iBlock + 1); ++i)
+			{
+				m_offsets[i] = offset;
+				offset += m_counters[i].load(std::memory_order_relaxed);
+				m_counters[i].store(static_cast<unsigned>(m_offsets[i]), std::memory_order_relaxed);
+			}
+		});
+		m_offsets[_rows] = blockStart[nBlocks];
+
+		// place contacts into their rows
+		m_ids.resize(m_offsets[_rows]);
+		m_shifts.resize(_withShifts ? m_offsets[_rows] : 0);
+		ParallelFor(_parts.size(), [&](size_t iPart)
+		{
+			for (const SEntry& e : _parts[iPart])
+			{
+				const unsigned pos = m_counters[e.row].fetch_add(1, std::memory_order_relaxed);
+				m_ids[pos] = e.id;
+				if (_withShifts)
+					m_shifts[pos] = e.shift;
+			}
+		});
+
+		// order contacts in each row, since the order of placing depends on threads; rows are short, so insertion sort is used
+		ParallelFor(_rows, EScheduling::CONTIGUOUS, [&](size_t, size_t iRow)
+		{
+			for (size_t i = m_offsets[iRow] + 1; i < m_offsets[iRow + 1]; ++i)
+			{
+				const unsigned id = m_ids[i];
+				const uint8_t shift = _withShifts ? m_shifts[i] : 0;
+				size_t j = i;
+				for (; j > m_offsets[iRow] && (m_ids[j - 1] > id || (m_ids[j - 1] == id && _withShifts && m_shifts[j - 1] > shift)); --j)
+				{
+					m_ids[j] = m_ids[j - 1];
+					if (_withShifts)
+						m_shifts[j] = m_shifts[j - 1];
+				}
+				m_ids[j] = id;
+				if (_withShifts)
+					m_shifts[j] = shift;
+			}
+		});
+	}
+};
@@ -0,0 +1,117 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#include "WallBVH.h"
+#include "ThreadPool.h"
+#include <cfloat>
+#include <numeric>
+
+void CWallBVH::Update(const SWallStruct& _walls)
+{
+	if (m_nodes.empty() || m_walls.size() != _walls.Size())
+	{
+		Build(_walls);
+		return;
+	}
+	Refit(_walls);
+	if (Cost() > MAX_WALL_BVH_REFIT_RATIO * m_buildCost)
+		Build(_walls);
+}
+
+void CWallBVH::Build(const SWallStruct& _walls)
+{
+	Clear();
+	const size_t nWalls = _walls.Size();
+	if (nWalls == 0) return;
+	m_walls.resize(nWalls);
+	std::iota(m_walls.begin(), m_walls.end(), 0);
+	std::vector<CVector3> centers(nWalls);
+	ParallelFor(nWalls, EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+	{
+		centers[i] = (_walls.MinCoord(i) + _walls.MaxCoord(i)) / 2;
+	});
+	m_nodes.reserve(2 * nWalls / WALL_BVH_LEAF_SIZE + 1);
+	BuildNode(_walls, centers, 0, static_cast<unsigned>(nWalls));
+	m_buildCost = Cost();
+	m_rebuildsNumber++;
+}
+
+unsigned CWallBVH::BuildNode(const SWallStruct& _walls, std::vector<CVector3>& _centers, unsigned _begin, unsigned _end)
+{
+	const unsigned iNode = static_cast<unsigned>(m_nodes.size());
+	m_nodes.emplace_back();
+	CVector3 minCoord{ DBL_MAX }, maxCoord{ -DBL_MAX }, minCenter{ DBL_MAX }, maxCenter{ -DBL_MAX };
+	for (unsigned i = _begin; i < _end; ++i)
+	{
+		minCoord = Min(minCoord, _walls.MinCoord(m_walls[i]));
+		maxCoord = Max(maxCoord, _walls.MaxCoord(m_walls[i]));
+		minCenter = Min(minCenter, _centers[m_walls[i]]);
+		maxCenter = Max(maxCenter, _centers[m_walls[i]]);
+	}
+	if (_end - _begin <= WALL_BVH_LEAF_SIZE)
+	{
+		m_nodes[iNode] = { minCoord, maxCoord, _begin, _end - _begin };
+		return iNode;
+	}
+
+	// split at the median of centers along the longest side, which keeps the tree balanced
+	const CVector3 length = maxCenter - minCenter;
+	const size_t axis = length.x >= length.y && length.x >= length.z ? 0 : length.y >= length.z ? 1 : 2;
+	const unsigned middle = _begin + (_end - _begin) / 2;
+	std::nth_element(m_walls.begin() + _begin, m_walls.begin() + middle, m_walls.begin() + _end, [&](unsigned _w1, unsigned _w2) { return _centers[_w1][axis] < _centers[_w2][axis]; });
+	BuildNode(_walls, _centers, _begin, middle);
+	const unsigned iRight = BuildNode(_walls, _centers, middle, _end);
+	m_nodes[iNode] = { minCoord, maxCoord, iRight, 0 };
+	return iNode;
+}
+
+void CWallBVH::Refit(const SWallStruct& _walls)
+{
+	// leaves are independent
+	ParallelFor(m_nodes.size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+	{
+		SNode& node = m_nodes[i];
+		if (!node.count) return;
+		node.minCoord = _walls.MinCoord(m_walls[node.first]);
+		node.maxCoord = _walls.MaxCoord(m_walls[node.first]);
+		for (unsigned j = node.first + 1; j < node.first + node.count; ++j)
+		{
+			node.minCoord = Min(node.minCoord, _walls.MinCoord(m_walls[j]));
+			node.maxCoord = Max(node.maxCoord, _walls.MaxCoord(m_walls[j]));
+		}
+	});
+	// children are always stored after their parents
+	for (size_t i = m_nodes.size(); i-- > 0;)
+	{
+		SNode& node = m_nodes[i];
+		if (node.count) continue;
+		node.minCoord = Min(m_nodes[i + 1].minCoord, m_nodes[node.first].minCoord);
+		node.maxCoord = Max(m_nodes[i + 1].maxCoord, m_nodes[node.first].maxCoord);
+	}
+	m_refitsNumber++;
+}
+
+void CWallBVH::Clear()
+{
+	m_nodes.clear();
+	m_walls.clear();
+	m_buildCost = 0;
+}
+
+double CWallBVH::Cost() const
+{
+	const auto Area = [](const SNode& _node)
+	{
+		const CVector3 d = _node.maxCoord - _node.minCoord;
+		return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+	};
+	if (m_nodes.empty()) return 0;
+	const double rootArea = Area(m_nodes.front());
+	if (rootArea <= 0) return 0;
+	double res = 0;
+	for (const auto& node : m_nodes)
+		if (!node.count)
+			res += Area(node);
+	return res / rootArea;
+}
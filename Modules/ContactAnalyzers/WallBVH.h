@@ -0,0 +1,82 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+#include "SceneTypes.h"
+
+#define WALL_BVH_LEAF_SIZE			4	// maximum number of walls in a leaf of the bounding volume hierarchy
+#define MAX_WALL_BVH_REFIT_RATIO	2	// if the cost of the refitted hierarchy exceeds the cost after the last build by this factor, the hierarchy is rebuilt
+
+// Bounding volume hierarchy of axis-aligned boxes over triangular walls.
+// After walls move, the hierarchy is refitted: the tree is kept and only the boxes are updated. This is exact for any motion,
+// but boxes may grow and overlap if walls move relative to each other, so the tree is rebuilt if it becomes too expensive to traverse.
+class CWallBVH
+{
+	// Node of the tree. Nodes are stored in depth-first order: the left child of an internal node directly follows it.
+	struct SNode
+	{
+		CVector3 minCoord;	// bounding box
+		CVector3 maxCoord;
+		unsigned first;		// for leaves: index of the first wall in m_walls; for internal nodes: index of the right child
+		unsigned count;		// number of walls in a leaf; 0 for internal nodes
+	};
+
+	std::vector<SNode> m_nodes;		// all nodes, the root is the first one
+	std::vector<unsigned> m_walls;	// indices of walls, ordered by leaves
+	double m_buildCost{ 0 };		// cost of the tree after the last build
+	size_t m_rebuildsNumber{ 0 };	// number of builds of the tree
+	size_t m_refitsNumber{ 0 };		// number of refits of the tree
+
+public:
+	// Builds the tree if the number of walls changed or the refitted tree is too expensive; otherwise refits it to current positions of walls.
+	void Update(const SWallStruct& _walls);
+	// Builds the tree over all walls.
+	void Build(const SWallStruct& _walls);
+	// Updates bounding boxes of all nodes to current positions of walls, keeping the structure of the tree.
+	void Refit(const SWallStruct& _walls);
+	// Removes all nodes.
+	void Clear();
+
+	// Returns the number of walls in the tree.
+	size_t Size() const { return m_walls.size(); }
+	// Returns the number of builds and refits of the tree.
+	size_t RebuildsNumber() const { return m_rebuildsNumber; }
+	size_t RefitsNumber() const { return m_refitsNumber; }
+
+	// Calls _fun(iWall) for each wall, which bounding box intersects the sphere.
+	template <typename FFun>
+	void Query(const CVector3& _center, double _radius, const FFun& _fun) const
+	{
+		if (m_nodes.empty()) return;
+		const double radius2 = _radius * _radius;
+		unsigned stack[64];
+		size_t top = 0;
+		stack[top++] = 0;
+		while (top)
+		{
+			const SNode& node = m_nodes[stack[--top]];
+			if (SquaredDistance(node, _center) > radius2) continue;
+			if (node.count)
+				for (unsigned i = node.first; i < node.first + node.count; ++i)
+					_fun(m_walls[i]);
+			else
+			{
+				stack[top++] = node.first;
+				stack[top++] = static_cast<unsigned>(&node - m_nodes.data()) + 1;
+			}
+		}
+	}
+
+private:
+	// Recursively builds the subtree over walls [_begin; _end) of m_walls. Returns index of its root.
+	unsigned BuildNode(const SWallStruct& _walls, std::vector<CVector3>& _centers, unsigned _begin, unsigned _end);
+	// Returns the cost to traverse the tree: the sum of surface areas of internal nodes relative to the root.
+	double Cost() const;
+	// Returns squared distance from the point to the bounding box of the node.
+	static double SquaredDistance(const SNode& _node, const CVector3& _point)
+	{
+		const CVector3 d = Max(_node.minCoord - _point, _point - _node.maxCoord, CVector3{ 0 });
+		return SquaredLength(d);
+	}
+};
@@ -171,6 +171,21 @@ void CParticleParticleModel::ConsolidateDst(double _time, double _timeStep, SPar
 	ConsolidateDst(_time, _timeStep, _collision->nDstID, _particles, _collision);
 }
 
+void CParticleParticleModel::CalculateBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	CalculatePPBatch(_time, _timeStep, _particles, _collisions, _count);
+}
+
+void CParticleParticleModel::CalculatePPBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	for (size_t i = 0; i < _count; ++i)
+	{
+		SCollision* collision = &_collisions[i];
+		CalculatePP(_time, _timeStep, collision->nSrcID, collision->nDstID, InteractionProperty(collision->nInteractProp), collision);
+		ConsolidateSrc(_time, _timeStep, collision->nSrcID, _particles, collision);
+	}
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// CParticleWallModel
@@ -210,6 +225,21 @@ void CParticleWallModel::ConsolidateWall(double _time, double _timeStep, SWallSt
 	ConsolidateWall(_time, _timeStep, _collision->nSrcID, _walls, _collision);
 }
 
+void CParticleWallModel::CalculateBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	CalculatePWBatch(_time, _timeStep, _particles, _collisions, _count);
+}
+
+void CParticleWallModel::CalculatePWBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const
+{
+	for (size_t i = 0; i < _count; ++i)
+	{
+		SCollision* collision = &_collisions[i];
+		CalculatePW(_time, _timeStep, collision->nSrcID, collision->nDstID, InteractionProperty(collision->nInteractProp), collision);
+		ConsolidatePart(_time, _timeStep, collision->nDstID, _particles, collision);
+	}
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// CSolidBondModel
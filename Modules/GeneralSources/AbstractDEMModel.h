@@ -78,6 +78,11 @@ public:
 	// Is called each time step before real calculations.
 	virtual void Precalculate(double _time, double _timeStep) = 0;
 
+	// Writes internal variables of the model, which change during the simulation, into binary stream. Must be overriden by models with such variables.
+	virtual void SaveState(std::ostream& _s) const {}
+	// Restores internal variables of the model written with SaveState.
+	virtual void LoadState(std::istream& _s) {}
+
 	bool HasGPUSupport() const;
 
 protected:
@@ -115,6 +120,8 @@ public:
 	void Calculate(double _time, double _timeStep, SCollision* _collision) const;
 	void ConsolidateSrc(double _time, double _timeStep, SParticleStruct& _particles, const SCollision* _collision) const;
 	void ConsolidateDst(double _time, double _timeStep, SParticleStruct& _particles, const SCollision* _collision) const;
+	// Calculates _count subsequent collisions starting from _collisions and consolidates their results on source particles.
+	void CalculateBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const;
 
 	virtual void CalculatePPGPU(double _time, double _timeStep, const SInteractProps _interactProps[], const SGPUParticles& _particles, SGPUCollisions& _collisions) {}
 
@@ -126,6 +133,8 @@ protected:
 	virtual void CalculatePP(double _time, double _timeStep, size_t _iSrc, size_t _iDst, const SInteractProps& _interactProp, SCollision* _collision) const = 0;
 	virtual void ConsolidateSrc(double _time, double _timeStep, size_t _iPart, SParticleStruct& _particles, const SCollision* _collision) const {}
 	virtual void ConsolidateDst(double _time, double _timeStep, size_t _iPart, SParticleStruct& _particles, const SCollision* _collision) const {}
+	// Calculates and consolidates on source particles a range of collisions. Can be overriden to calculate the whole range without virtual calls for each collision.
+	virtual void CalculatePPBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const;
 };
 
 
@@ -143,6 +152,8 @@ public:
 	void Calculate(double _time, double _timeStep, SCollision* _collision) const;
 	void ConsolidatePart(double _time, double _timeStep, SParticleStruct& _particles, const SCollision* _collision) const;
 	void ConsolidateWall(double _time, double _timeStep, SWallStruct& _walls, const SCollision* _collision) const;
+	// Calculates _count subsequent collisions starting from _collisions and consolidates their results on particles.
+	void CalculateBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const;
 
 	virtual void CalculatePWGPU(double _time, double _timeStep, const SInteractProps _interactProps[], const SGPUParticles& _particles, const SGPUWalls& _walls, SGPUCollisions& _collisions) {}
 
@@ -155,6 +166,8 @@ protected:
 	virtual void CalculatePW(double _time, double _timeStep, size_t _iWall, size_t _iPart, const SInteractProps& _interactProp, SCollision* _collision) const = 0;
 	virtual void ConsolidatePart(double _time, double _timeStep, size_t _iPart, SParticleStruct& _particles, const SCollision* _collision) const {}
 	virtual void ConsolidateWall(double _time, double _timeStep, size_t _iWall, SWallStruct& _walls, const SCollision* _collision) const {}
+	// Calculates and consolidates on particles a range of collisions. Can be overriden to calculate the whole range without virtual calls for each collision.
+	virtual void CalculatePWBatch(double _time, double _timeStep, SParticleStruct& _particles, SCollision* _collisions, size_t _count) const;
 };
 
 
@@ -0,0 +1,63 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+/*
+ * Raw binary serialization of values and vectors into standard streams. Values are written as their memory representation,
+ * so data can be read back only on the same platform and build. Vectors of trivially copyable values are written with a single call.
+ */
+
+// Writes value into stream.
+template<typename T>
+void WriteBinary(std::ostream& _s, const T& _val)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	_s.write(reinterpret_cast<const char*>(&_val), sizeof(T));
+}
+
+// Writes the size and all elements of the vector into stream.
+template<typename T>
+void WriteBinary(std::ostream& _s, const std::vector<T>& _vec)
+{
+	WriteBinary(_s, static_cast<uint64_t>(_vec.size()));
+	if constexpr (std::is_trivially_copyable_v<T>)
+		_s.write(reinterpret_cast<const char*>(_vec.data()), static_cast<std::streamsize>(_vec.size() * sizeof(T)));
+	else
+		for (const auto& v : _vec)
+			WriteBinary(_s, v);
+}
+
+// Reads value from stream.
+template<typename T>
+void ReadBinary(std::istream& _s, T& _val)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+	if (!_s.read(reinterpret_cast<char*>(&_val), sizeof(T)))
+		throw std::runtime_error("Unexpected end of binary stream");
+}
+
+// Reads the vector, written with WriteBinary, from stream.
+template<typename T>
+void ReadBinary(std::istream& _s, std::vector<T>& _vec)
+{
+	uint64_t size;
+	ReadBinary(_s, size);
+	_vec.resize(static_cast<size_t>(size));
+	if constexpr (std::is_trivially_copyable_v<T>)
+	{
+		if (!_s.read(reinterpret_cast<char*>(_vec.data()), static_cast<std::streamsize>(_vec.size() * sizeof(T))))
+			throw std::runtime_error("Unexpected end of binary stream");
+	}
+	else
+		for (auto& v : _vec)
+			ReadBinary(_s, v);
+}
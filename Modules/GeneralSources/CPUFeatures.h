@@ -0,0 +1,83 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(__x86_64__)
+/// Defined if vector instructions of x86-64 processors can be used.
+#define MUSEN_X86_64
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+/// Enables generation of AVX2 instructions for a single function, independently of compiler settings for the whole file.
+/// Such functions may only be called after checking GetInstructionSet().
+#if defined(MUSEN_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define MUSEN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MUSEN_TARGET_AVX2
+#endif
+
+/// Sets of vector instructions, for which optimized calculation kernels exist. Ordered by increasing capabilities.
+enum class EInstructionSet : unsigned
+{
+	SCALAR = 0,	/// Only scalar code.
+	AVX2 = 1	/// 256-bit vectors, 4 values of double precision.
+};
+
+namespace CPUFeatures
+{
+	/// Upper limit of instruction sets, which may be used by calculation kernels.
+	inline std::atomic<EInstructionSet> g_maxInstructionSet{ EInstructionSet::AVX2 };
+
+	/// Detects the best instruction set supported both by the processor and the operating system.
+	inline EInstructionSet DetectInstructionSet()
+	{
+#if defined(MUSEN_X86_64) && (defined(__GNUC__) || defined(__clang__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return EInstructionSet::AVX2;
+#elif defined(MUSEN_X86_64) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7)
+		{
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx     = (info[2] & (1 << 28)) != 0;
+			__cpuidex(info, 7, 0);
+			const bool avx2    = (info[1] & (1 << 5)) != 0;
+			// the operating system must save YMM registers on context switches
+			if (osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6)
+				return EInstructionSet::AVX2;
+		}
+#endif
+		return EInstructionSet::SCALAR;
+	}
+}
+
+/// Returns the best instruction set supported by the processor.
+inline EInstructionSet GetSupportedInstructionSet()
+{
+	static const EInstructionSet supported = CPUFeatures::DetectInstructionSet();
+	return supported;
+}
+
+/// Returns the instruction set, which should be used by calculation kernels: the best supported one, but not above the limit set with SetMaxInstructionSet().
+inline EInstructionSet GetInstructionSet()
+{
+	const EInstructionSet limit = CPUFeatures::g_maxInstructionSet.load(std::memory_order_relaxed);
+	const EInstructionSet supported = GetSupportedInstructionSet();
+	return limit < supported ? limit : supported;
+}
+
+/// Limits instruction sets used by calculation kernels, e.g. to compare optimized kernels with scalar code.
+inline void SetMaxInstructionSet(EInstructionSet _set)
+{
+	CPUFeatures::g_maxInstructionSet.store(_set, std::memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+namespace ThreadPool
+{
+	template <typename Signature>
+	class CFunctionRef;
+
+	/// A non-owning reference to a callable object. Unlike std::function, it never allocates memory, but the referenced callable must outlive it.
+	/// Intended to pass lambdas into functions, which call them only before returning.
+	template <typename R, typename... Args>
+	class CFunctionRef<R(Args...)>
+	{
+		void* m_object{ nullptr };						/// Pointer to the referenced callable.
+		R(*m_callback)(void*, Args...) { nullptr };		/// Function that casts m_object back to its type and calls it.
+
+	public:
+		CFunctionRef() = default;
+
+		/// Binds to any callable, which can be called with Args and whose result is convertible to R.
+		template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, CFunctionRef> && std::is_invocable_r_v<R, F&, Args...>>>
+		CFunctionRef(F&& _fun)
+			: m_object{ const_cast<void*>(static_cast<const void*>(std::addressof(_fun))) }
+			, m_callback{ [](void* _object, Args... _args) -> R { return (*static_cast<std::remove_reference_t<F>*>(_object))(std::forward<Args>(_args)...); } }
+		{
+		}
+
+		/// Calls the referenced callable.
+		R operator()(Args... _args) const
+		{
+			return m_callback(m_object, std::forward<Args>(_args)...);
+		}
+
+		/// Whether a callable is referenced.
+		explicit operator bool() const
+		{
+			return m_callback != nullptr;
+		}
+	};
+}
@@ -258,7 +258,8 @@ enum class EIntersectionType : int8_t
 
 // return 0 - no contact, 1 - face contact, 2 - edge contact, 3 - vertices contact
 // from publication of Su et al. Discrete element simulation of particle flow
-inline std::pair<EIntersectionType, CVector3> IsSphereIntersectTriangle(const SWallStruct::SCoordinates& _wallCoords, const CVector3& _wallNormalVec,
+// Uses precalculated edges of the triangle.
+inline std::pair<EIntersectionType, CVector3> IsSphereIntersectTriangle(const SWallStruct::SCoordinates& _wallCoords, const SWallStruct::SEdges& _wallEdges, const CVector3& _wallNormalVec,
 	const CVector3& _partCoord, const double _partRadius)
 {
 	if (_partCoord.x <= _wallCoords.minCoord.x - _partRadius
@@ -269,36 +270,34 @@ inline std::pair<EIntersectionType, CVector3> IsSphereIntersectTriangle(const SW
 	 || _partCoord.z >= _wallCoords.maxCoord.z + _partRadius)
 		return { EIntersectionType::NO_CONTACT, {} };
 
-	const CVector3 center = (_wallCoords.vert1 + _wallCoords.vert2 + _wallCoords.vert3) / 3.0;	// center of the plane
-	const double ppd = DotProduct(_partCoord - center, _wallNormalVec);							//particle projection point distance
+	const double ppd = DotProduct(_partCoord - _wallEdges.center, _wallNormalVec);	//particle projection point distance
 	if (std::fabs(ppd) >= _partRadius)
 		return { EIntersectionType::NO_CONTACT, {} };
 
 	const CVector3 A = _partCoord - _wallNormalVec * ppd; // projection point
 
-	const CVector3 edge21 = _wallCoords.vert2 - _wallCoords.vert1;
-	const CVector3 edge31 = _wallCoords.vert3 - _wallCoords.vert1;
+	const CVector3& edge21 = _wallEdges.edge21;
+	const CVector3& edge32 = _wallEdges.edge32;
+	const CVector3& edge13 = _wallEdges.edge13;
 	const CVector3 W = A - _wallCoords.vert1;
 
-	const double d00 = DotProduct(edge21, edge21);
-	const double d01 = DotProduct(edge21, edge31);
-	const double d11 = DotProduct(edge31, edge31);
+	// edge vert3 - vert1 is the negated edge13
+	const double d00 = _wallEdges.sqrLength21;
+	const double d01 = _wallEdges.dot2131;
+	const double d11 = _wallEdges.sqrLength13;
 	const double d20 = DotProduct(W, edge21);
-	const double d21 = DotProduct(W, edge31);
-	const double invDenom = 1.0 / (d00 * d11 - d01 * d01);
-	const double gamma = (d11 * d20 - d01 * d21) * invDenom;
-	const double betta = (d00 * d21 - d01 * d20) * invDenom;
+	const double d21 = -DotProduct(W, edge13);
+	const double gamma = (d11 * d20 - d01 * d21) * _wallEdges.invDenom;
+	const double betta = (d00 * d21 - d01 * d20) * _wallEdges.invDenom;
 	const double alpha = 1.0f - gamma - betta;
 
 	if ((gamma > 0 && gamma < 1) && (alpha > 0 && alpha < 1) && (betta > 0 && betta < 1))
 		return { EIntersectionType::FACE_CONTACT, A };
 	else // A is outside polygon
 	{
-		const CVector3 edge32 = _wallCoords.vert3 - _wallCoords.vert2;
-		const CVector3 edge13 = _wallCoords.vert1 - _wallCoords.vert3;
-		const double lc1 = std::min(std::max(DotProduct(A - _wallCoords.vert1, edge21) / SquaredLength(edge21), 0.), 1.);
-		const double lc2 = std::min(std::max(DotProduct(A - _wallCoords.vert2, edge32) / SquaredLength(edge32), 0.), 1.);
-		const double lc3 = std::min(std::max(DotProduct(A - _wallCoords.vert3, edge13) / SquaredLength(edge13), 0.), 1.);
+		const double lc1 = std::min(std::max(DotProduct(A - _wallCoords.vert1, edge21) / _wallEdges.sqrLength21, 0.), 1.);
+		const double lc2 = std::min(std::max(DotProduct(A - _wallCoords.vert2, edge32) / _wallEdges.sqrLength32, 0.), 1.);
+		const double lc3 = std::min(std::max(DotProduct(A - _wallCoords.vert3, edge13) / _wallEdges.sqrLength13, 0.), 1.);
 		const bool C1IsVertice = lc1 == 0 || lc1 == 1;
 		const bool C2IsVertice = lc2 == 0 || lc2 == 1;
 		const bool C3IsVertice = lc3 == 0 || lc3 == 1;
@@ -0,0 +1,196 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <utility>
+#include <vector>
+
+/// Usage statistics of an object pool.
+struct SObjectPoolStatistics
+{
+	size_t allocations{ 0 };	/// Total number of objects taken from the pool.
+	size_t deallocations{ 0 };	/// Total number of objects returned to the pool.
+	size_t slabs{ 0 };			/// Number of memory blocks requested from the system.
+	size_t bytes{ 0 };			/// Total memory reserved by the pool in bytes.
+
+	/// Number of currently existing objects.
+	size_t Alive() const { return allocations - deallocations; }
+};
+
+/// Allocator for a large number of small short-lived objects of type T.
+/// Memory is requested from the system in slabs of SlabSize objects and is never returned to it, released objects are reused instead.
+/// Each thread keeps its own cache of free objects, which is exchanged with the shared storage in chunks of SlabSize objects, so that both allocation and release are O(1) and need no locking in most cases.
+/// An object may be released by a different thread than the one that allocated it.
+template <typename T, size_t SlabSize = 256>
+class CObjectPool
+{
+	static_assert(SlabSize > 0, "Slab size must be positive");
+
+	/// Memory for one object, linked into a list while free.
+	union SNode
+	{
+		SNode* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	/// Linked list of free nodes.
+	struct SChunk
+	{
+		SNode* head{ nullptr };	/// The first node.
+		size_t size{ 0 };		/// Number of nodes.
+	};
+
+	struct SCache;
+
+	/// Storage shared by all threads.
+	struct SShared
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<SNode[]>> slabs;	/// All memory blocks.
+		std::vector<SChunk> chunks;						/// Chunks of free nodes returned by threads.
+		std::set<const SCache*> caches;					/// Caches of all running threads, to gather statistics.
+		size_t allocations{ 0 };						/// Number of allocations made by already finished threads.
+		size_t deallocations{ 0 };						/// Number of deallocations made by already finished threads.
+	};
+
+	/// Free nodes and statistics of one thread.
+	struct SCache
+	{
+		SChunk current;							/// Nodes used for allocation and release.
+		SChunk spare;							/// Full chunk kept to avoid frequent exchange with the shared storage.
+		std::atomic<size_t> allocations{ 0 };	/// Number of allocations made by this thread; written only by the owner.
+		std::atomic<size_t> deallocations{ 0 };	/// Number of deallocations made by this thread; written only by the owner.
+
+		SCache()
+		{
+			SShared& shared = Shared();
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			shared.caches.insert(this);
+		}
+
+		~SCache()
+		{
+			// return all free nodes and statistics to the shared storage
+			SShared& shared = Shared();
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			if (current.size != 0) shared.chunks.push_back(current);
+			if (spare.size != 0) shared.chunks.push_back(spare);
+			shared.allocations += allocations.load(std::memory_order_relaxed);
+			shared.deallocations += deallocations.load(std::memory_order_relaxed);
+			shared.caches.erase(this);
+		}
+
+		SCache(const SCache& _other) = delete;
+		SCache& operator=(const SCache& _other) = delete;
+		SCache(SCache&& _other) = delete;
+		SCache& operator=(SCache&& _other) = delete;
+	};
+
+public:
+	/// Creates a new object, passing _args to its constructor.
+	template <typename... Args>
+	static T* New(Args&&... _args)
+	{
+		SCache& cache = Cache();
+		if (cache.current.size == 0)
+			Refill(cache);
+		SNode* node = cache.current.head;
+		cache.current.head = node->next;
+		cache.current.size--;
+		cache.allocations.store(cache.allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return ::new(static_cast<void*>(node->storage)) T(std::forward<Args>(_args)...);
+	}
+
+	/// Destroys the object, previously created with New(), and returns its memory to the pool. Does nothing for nullptr.
+	static void Delete(T* _object)
+	{
+		if (!_object) return;
+		_object->~T();
+		SCache& cache = Cache();
+		if (cache.current.size == SlabSize)
+			Flush(cache);
+		SNode* node = reinterpret_cast<SNode*>(_object);
+		node->next = cache.current.head;
+		cache.current.head = node;
+		cache.current.size++;
+		cache.deallocations.store(cache.deallocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	/// Returns usage statistics of the pool, gathered over all threads.
+	static SObjectPoolStatistics GetStatistics()
+	{
+		SShared& shared = Shared();
+		std::lock_guard<std::mutex> lock(shared.mutex);
+		SObjectPoolStatistics res;
+		res.allocations = shared.allocations;
+		res.deallocations = shared.deallocations;
+		for (const SCache* cache : shared.caches)
+		{
+			res.allocations += cache->allocations.load(std::memory_order_relaxed);
+			res.deallocations += cache->deallocations.load(std::memory_order_relaxed);
+		}
+		res.slabs = shared.slabs.size();
+		res.bytes = res.slabs * SlabSize * sizeof(SNode);
+		return res;
+	}
+
+private:
+	/// Shared storage. It is never destroyed, since caches of threads may outlive any static object.
+	static SShared& Shared()
+	{
+		static SShared* shared = new SShared{};
+		return *shared;
+	}
+
+	/// Cache of the current thread.
+	static SCache& Cache()
+	{
+		static thread_local SCache cache;
+		return cache;
+	}
+
+	/// Fills the empty current chunk of the cache, using the spare chunk, chunks returned by other threads or a new slab.
+	static void Refill(SCache& _cache)
+	{
+		if (_cache.spare.size != 0)
+		{
+			std::swap(_cache.current, _cache.spare);
+			return;
+		}
+		SShared& shared = Shared();
+		std::lock_guard<std::mutex> lock(shared.mutex);
+		if (!shared.chunks.empty())
+		{
+			_cache.current = shared.chunks.back();
+			shared.chunks.pop_back();
+			return;
+		}
+		// link all nodes of a new slab into one chunk
+		std::unique_ptr<SNode[]> slab{ new SNode[SlabSize] };
+		for (size_t i = 0; i + 1 < SlabSize; ++i)
+			slab[i].next = &slab[i + 1];
+		slab[SlabSize - 1].next = nullptr;
+		_cache.current = { &slab[0], SlabSize };
+		shared.slabs.push_back(std::move(slab));
+	}
+
+	/// Frees the full current chunk of the cache, moving it to the spare one or to the shared storage.
+	static void Flush(SCache& _cache)
+	{
+		if (_cache.spare.size != 0)
+		{
+			SShared& shared = Shared();
+			std::lock_guard<std::mutex> lock(shared.mutex);
+			shared.chunks.push_back(_cache.spare);
+		}
+		_cache.spare = _cache.current;
+		_cache.current = {};
+	}
+};
@@ -4,21 +4,117 @@
 
 #include "ThreadPool.h"
 #include "MUSENVectorFunctions.h"
+#include <algorithm>
 #include <limits>
 #include <future>
 #include <iostream>
 #include <string>
 #ifdef __linux__
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/sysinfo.h>
+#include <unistd.h>
 #endif
 #ifdef _WIN64
 #define NOMINMAX
 #include <windows.h>
 #undef NOMINMAX
 #endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 constexpr size_t MIN_NONDEDICATED_THREADS = 8;
+constexpr size_t SPIN_ITERATIONS = 256; 	// number of busy-waiting iterations before a thread starts yielding
+constexpr size_t YIELD_ITERATIONS = 1024;	// number of yielding iterations before a thread falls asleep
+
+namespace
+{
+	// Pool, to which the current thread belongs, and its index in the pool. Used to let worker threads submit nested parallel jobs and to bind slots of the persistent parallel region to threads.
+	thread_local const ThreadPool::CThreadPool* t_pool{ nullptr };
+	thread_local size_t t_workerIndex{ 0 };
+
+	// Hints the processor that the thread is busy-waiting.
+	inline void CPURelax()
+	{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+		_mm_pause();
+#endif
+	}
+
+	// Event, on which threads wait actively for a short time before falling asleep.
+	class CHybridEvent
+	{
+		std::atomic<size_t> m_sleeping{ 0 };	// Number of threads currently sleeping on the event.
+		std::mutex m_mutex;
+		std::condition_variable m_event;
+
+	public:
+		// Waits until _ready() returns true.
+		template <typename Predicate>
+		void Wait(Predicate _ready)
+		{
+			for (size_t i = 0; i < SPIN_ITERATIONS; ++i)
+			{
+				if (_ready()) return;
+				CPURelax();
+			}
+			for (size_t i = 0; i < YIELD_ITERATIONS; ++i)
+			{
+				if (_ready()) return;
+				std::this_thread::yield();
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_sleeping.fetch_add(1);
+			m_event.wait(lock, _ready);
+			m_sleeping.fetch_sub(1);
+		}
+
+		// Wakes up sleeping threads. Must be called after the awaited condition has been changed.
+		void Notify()
+		{
+			if (m_sleeping.load() == 0) return;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_event.notify_all();
+		}
+	};
+}
+
+/// State of one parallel call, lives on the stack of the submitting thread until all its batches are finished.
+struct ThreadPool::CThreadPool::SForkJoin
+{
+	CFunctionRef<void(size_t)> batch;	/// Function to run for each batch.
+	std::atomic<size_t> pending;		/// Number of not yet finished batches.
+	std::mutex mutex;					/// Mutex to wait for finishing.
+	std::condition_variable event;		/// Event to wait for finishing.
+	bool done{ false };					/// Set by the thread that finishes the last batch, after which the job is not accessed by worker threads anymore.
+
+	SForkJoin(CFunctionRef<void(size_t)> _batch, size_t _count) : batch{ _batch }, pending{ _count } {}
+
+	/// Marks _count batches as finished.
+	void Finish(size_t _count)
+	{
+		if (pending.fetch_sub(_count, std::memory_order_acq_rel) != _count) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+		event.notify_one();
+	}
+};
+
+/// State of the persistent parallel region, in which worker threads wait for new parallel calls on a barrier instead of receiving them as tasks.
+struct ThreadPool::CThreadPool::SRegion
+{
+	std::function<void(size_t)> worker;		/// Function, which each thread runs for the whole lifetime of the region.
+	std::unique_ptr<SForkJoin> job;			/// Job, which runs the worker function on all threads.
+	CFunctionRef<void(size_t)> batch;		/// Function to run for each batch of the current parallel call.
+	size_t count{ 0 };						/// Number of batches in the current parallel call.
+	bool stop{ false };						/// Whether threads must leave the region.
+	std::atomic<uint64_t> phase{ 0 };		/// Counter of parallel calls within the region.
+	std::atomic<size_t> arrived{ 0 };		/// Number of threads, which have finished the current parallel call.
+	CHybridEvent started;					/// Event to wait for the next parallel call.
+	CHybridEvent finished;					/// Event to wait for all threads to finish the current parallel call.
+};
 
 size_t ThreadPool::CThreadPool::m_globalThreadsLimit = std::numeric_limits<size_t>::max();
 bool ThreadPool::CThreadPool::m_isSystemAffinities = false;
@@ -26,8 +122,11 @@ bool ThreadPool::CThreadPool::m_isUserAffinities = false;
 std::vector<int> ThreadPool::CThreadPool::m_systemCPUList;
 std::vector<int> ThreadPool::CThreadPool::m_userCPUList;
 
-ThreadPool::CThreadPool::CThreadPool(size_t _threads)
+ThreadPool::CThreadPool::CThreadPool(size_t _threads, EBackend _backend)
+	: m_backend{ _backend }
+	, m_region{ std::make_unique<SRegion>() }
 {
+	m_region->worker = [this](size_t _slot) { RegionWorker(_slot); };
 	std::cout << "+---- Start creating thread pool ----+" << std::endl;
 	// if number of threads not specified, calculate it
 	if (_threads == 0)
@@ -46,8 +145,14 @@ ThreadPool::CThreadPool::CThreadPool(size_t _threads)
 #endif
 	// create threads
 	std::cout << " Creating thread pool ... ";
+	if (m_backend == EBackend::WORK_STEALING)
+		for (size_t i = 0; i < _threads; ++i)
+			m_workers.emplace_back(std::make_unique<SWorker>());
 	for (size_t i = 0; i < _threads; ++i)
-		m_threads.emplace_back(&CThreadPool::Worker, this);
+		if (m_backend == EBackend::WORK_STEALING)
+			m_threads.emplace_back(&CThreadPool::WorkStealingWorker, this, i);
+		else
+			m_threads.emplace_back(&CThreadPool::Worker, this, i);
 	std::cout << "successful" << std::endl;
 	// print info
 	PrintCPUListsInfo();
@@ -60,8 +165,21 @@ ThreadPool::CThreadPool::CThreadPool(size_t _threads)
 
 ThreadPool::CThreadPool::~CThreadPool()
 {
+	// release threads from the parallel region, if it was not closed
+	if (m_regionOwner.load() != std::thread::id{})
+	{
+		m_region->stop = true;
+		m_region->phase.fetch_add(1);
+		m_region->started.Notify();
+	}
 	// invalidate the queue
 	m_workQueue.Invalidate();
+	// stop and wake up all work stealing threads
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop.store(true);
+		m_sleepEvent.notify_all();
+	}
 	// join all running threads
 	for (auto& thread : m_threads)
 		if (thread.joinable())
@@ -91,36 +209,134 @@ size_t ThreadPool::CThreadPool::GetCurrentThreadsNumber() const
 	return m_threads.size();
 }
 
-void ThreadPool::CThreadPool::SubmitParallelJobs(size_t _count, const std::function<void(size_t)>& _fun)
+ThreadPool::EBackend ThreadPool::CThreadPool::GetBackend() const
 {
-	using FunType = std::function<void()>;
+	return m_backend;
+}
+
+void ThreadPool::CThreadPool::SubmitParallelJobs(size_t _count, CFunctionRef<void(size_t)> _fun)
+{
+	// number of available threads
+	const size_t threadsNumber = m_threads.size();
+
+	ExecuteBatches(std::min(_count, threadsNumber), [&](size_t iThread)
+	{
+		// call the _fun for each threadsNumber-th parameter
+		for (size_t i = iThread; i < _count; i += threadsNumber)
+			_fun(i);
+	});
+}
+
+void ThreadPool::CThreadPool::SubmitParallelJobs(size_t _count, EScheduling _scheduling, CFunctionRef<void(size_t, size_t)> _fun, CFunctionRef<size_t(size_t)> _cost)
+{
+	if (_count == 0) return;
 
 	// number of available threads
 	const size_t threadsNumber = m_threads.size();
-	// number of tasks per thread
-	const size_t tasksPerThread = _count / threadsNumber;
-	// additional tasks, arising if the number of tasks is not evenly distributable by all threads
-	const size_t additionalTasks = _count % threadsNumber;
+
+	if (_scheduling == EScheduling::STRIDED)
+	{
+		ExecuteBatches(std::min(_count, threadsNumber), [&](size_t iThread)
+		{
+			for (size_t i = iThread; i < _count; i += threadsNumber)
+				_fun(iThread, i);
+		});
+		return;
+	}
+
+	// thread t processes indices [bounds[t]; bounds[t + 1])
+	const std::vector<size_t> bounds = _scheduling == EScheduling::WEIGHTED && _cost ? WeightedRanges(_count, _cost) : EvenRanges(_count);
+
+	ExecuteBatches(threadsNumber, [&](size_t iThread)
+	{
+		for (size_t i = bounds[iThread]; i < bounds[iThread + 1]; ++i)
+			_fun(iThread, i);
+	});
+}
+
+bool ThreadPool::CThreadPool::BeginParallelRegion()
+{
+	if (t_pool == this) return false; // worker threads cannot wait for themselves
+	std::thread::id none;
+	if (!m_regionOwner.compare_exchange_strong(none, std::this_thread::get_id())) return false;
+
+	const size_t threadsNumber = m_threads.size();
+	m_region->stop = false;
+	m_region->phase.store(0);
+	m_region->job = std::make_unique<SForkJoin>(m_region->worker, threadsNumber);
+
+	// occupy all threads with the worker function; they will not return to the pool until the region is closed
+	SForkJoin& job = *m_region->job;
+	if (m_backend == EBackend::WORK_STEALING)
+	{
+		// slots are not passed through deques, where they could be split without waking up threads or taken by a wrong thread:
+		// each thread notices the new opening itself and enters the region with its own index
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_regionOpenings.fetch_add(1);
+		m_sleepEvent.notify_all();
+	}
+	else
+		// each thread stays in the region after taking one of these tasks, so all of them are taken by different threads;
+		// the slot is the index of the thread, which has taken the task, so that the same range of each call always runs on the same thread
+		for (size_t iSlot = 0; iSlot < threadsNumber; ++iSlot)
+		{
+			std::function<void()> task = [&job]
+			{
+				job.batch(t_workerIndex);
+				job.Finish(1);
+			};
+			m_workQueue.Push(std::make_unique<CThreadTask<const std::function<void()>>>(std::move(task)));
+		}
+	return true;
+}
+
+void ThreadPool::CThreadPool::EndParallelRegion()
+{
+	if (m_regionOwner.load() != std::this_thread::get_id()) return;
+
+	// let threads leave the region
+	m_region->stop = true;
+	m_region->phase.fetch_add(1);
+	m_region->started.Notify();
+
+	// wait until all of them have left it
+	{
+		SForkJoin& job = *m_region->job;
+		std::unique_lock<std::mutex> lock(job.mutex);
+		job.event.wait(lock, [&] { return job.done; });
+	}
+	m_region->job.reset();
+	m_regionOwner.store(std::thread::id{});
+}
+
+void ThreadPool::CThreadPool::ExecuteBatches(size_t _count, CFunctionRef<void(size_t)> _batch)
+{
+	if (_count == 0) return;
+	if (m_regionOwner.load(std::memory_order_relaxed) == std::this_thread::get_id())
+		ExecuteBatchesRegion(_count, _batch);
+	else if (m_backend == EBackend::WORK_STEALING)
+		ExecuteBatchesWorkStealing(_count, _batch);
+	else
+		ExecuteBatchesQueue(_count, _batch);
+}
+
+void ThreadPool::CThreadPool::ExecuteBatchesQueue(size_t _count, CFunctionRef<void(size_t)> _batch)
+{
+	using FunType = std::function<void()>;
 
 	int result_counter{ 0 };
 	std::mutex wait_mutex;
 	std::unique_lock<std::mutex> lock(wait_mutex);
 	std::condition_variable wait_event;
 
-	for (size_t iThread = 0; iThread < threadsNumber; ++iThread)
+	for (size_t iBatch = 0; iBatch < _count; ++iBatch)
 	{
-		size_t size = tasksPerThread;
-		if (additionalTasks > iThread) ++size;
-		if (size == 0) break;
-
 		result_counter++;
 
 		// the batch task
-		FunType task = [iThread, threadsNumber, size, &_fun, &result_counter, &wait_event, &wait_mutex]()
+		FunType task = [iBatch, _batch, &result_counter, &wait_event, &wait_mutex]()
 		{
-			// call the _fun tasksPerThread times increasing the parameter
-			for (size_t j = 0; j < size; ++j)
-				_fun(threadsNumber*j + iThread);
+			_batch(iBatch);
 
 			std::unique_lock<std::mutex> lock_task(wait_mutex);
 			--result_counter;
@@ -137,8 +353,155 @@ void ThreadPool::CThreadPool::SubmitParallelJobs(size_t _count, const std::funct
 		wait_event.wait(lock);
 }
 
-void ThreadPool::CThreadPool::Worker()
+void ThreadPool::CThreadPool::ExecuteBatchesWorkStealing(size_t _count, CFunctionRef<void(size_t)> _batch)
+{
+	const bool isWorker = t_pool == this;
+	const size_t index = isWorker ? t_workerIndex : m_workers.size();
+
+	// submit the whole range as one task, it will be split by worker threads
+	SForkJoin job{ _batch, _count };
+	PushTask({ &job, 0, static_cast<uint32_t>(_count) });
+
+	// wait all batches to finish
+	if (isWorker) // help other threads, since this thread may be needed to execute the job
+	{
+		SRangeTask<SForkJoin> task;
+		while (job.pending.load(std::memory_order_acquire) != 0)
+			if (FindTask(index, task))
+				RunTask(index, task);
+			else
+				CPURelax();
+	}
+	else // wait actively for a short time, since most of parallel calls are short
+	{
+		for (size_t i = 0; i < SPIN_ITERATIONS && job.pending.load(std::memory_order_acquire) != 0; ++i)
+			CPURelax();
+		for (size_t i = 0; i < YIELD_ITERATIONS && job.pending.load(std::memory_order_acquire) != 0; ++i)
+			std::this_thread::yield();
+	}
+
+	// make sure the last finishing thread does not access the job anymore
+	std::unique_lock<std::mutex> lock(job.mutex);
+	job.event.wait(lock, [&] { return job.done; });
+}
+
+void ThreadPool::CThreadPool::ExecuteBatchesRegion(size_t _count, CFunctionRef<void(size_t)> _batch)
+{
+	SRegion& region = *m_region;
+
+	// publish the call; threads pick it up as soon as they notice the new phase
+	region.batch = _batch;
+	region.count = _count;
+	region.arrived.store(0);
+	region.phase.fetch_add(1);
+	region.started.Notify();
+
+	// barrier: wait until all threads have finished their batches
+	region.finished.Wait([&] { return region.arrived.load() == m_threads.size(); });
+}
+
+void ThreadPool::CThreadPool::PushTask(const SRangeTask<SForkJoin>& _task)
+{
+	// own deque of a worker thread is preferred, external threads can only use the injection queue
+	if (t_pool != this || !m_workers[t_workerIndex]->deque.Push(_task))
+		while (!m_injectionQueue.Push(_task))
+			std::this_thread::yield();
+
+	// wake up sleeping threads
+	m_submissions.fetch_add(1);
+	if (m_sleeping.load() != 0)
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_sleepEvent.notify_all();
+	}
+}
+
+bool ThreadPool::CThreadPool::FindTask(size_t _index, SRangeTask<SForkJoin>& _task)
+{
+	// own tasks
+	if (_index < m_workers.size() && m_workers[_index]->deque.Pop(_task)) return true;
+	// newly submitted tasks
+	if (m_injectionQueue.Pop(_task)) return true;
+	// steal from other threads, starting from the neighbour
+	const size_t count = m_workers.size();
+	for (size_t i = 1; i <= count; ++i)
+	{
+		const size_t victim = (_index + i) % count;
+		if (victim != _index && m_workers[victim]->deque.Steal(_task)) return true;
+	}
+	return false;
+}
+
+void ThreadPool::CThreadPool::RunTask(size_t _index, SRangeTask<SForkJoin> _task)
+{
+	SForkJoin& job = *_task.job;
+	// split the range in halves, leaving the right ones to other threads
+	if (_index < m_workers.size())
+		while (_task.end - _task.begin > 1)
+		{
+			const uint32_t middle = _task.begin + (_task.end - _task.begin) / 2;
+			if (!m_workers[_index]->deque.Push({ &job, middle, _task.end })) break;
+			_task.end = middle;
+		}
+	for (size_t i = _task.begin; i < _task.end; ++i)
+		job.batch(i);
+	job.Finish(_task.end - _task.begin);
+}
+
+std::vector<size_t> ThreadPool::CThreadPool::EvenRanges(size_t _count) const
+{
+	const size_t threadsNumber = m_threads.size();
+	std::vector<size_t> bounds(threadsNumber + 1);
+	for (size_t i = 0; i <= threadsNumber; ++i)
+		bounds[i] = _count * i / threadsNumber;
+	return bounds;
+}
+
+std::vector<size_t> ThreadPool::CThreadPool::WeightedRanges(size_t _count, CFunctionRef<size_t(size_t)> _cost)
+{
+	const size_t threadsNumber = m_threads.size();
+	// costs are first accumulated in parallel within equal blocks of indices
+	const std::vector<size_t> blocks = EvenRanges(_count);
+	// inclusive prefix sums of costs within each block; reused between calls to avoid reallocations
+	static thread_local std::vector<size_t> buffer;
+	buffer.resize(_count);
+	std::vector<size_t>& prefix = buffer; // the calling thread's buffer, not the one of the worker thread
+	ExecuteBatches(threadsNumber, [&](size_t iBlock)
+	{
+		size_t sum = 0;
+		for (size_t i = blocks[iBlock]; i < blocks[iBlock + 1]; ++i)
+		{
+			sum += _cost(i) + 1; // each index costs at least something, even if there is no work for it
+			prefix[i] = sum;
+		}
+	});
+
+	// total cost of all preceding blocks
+	std::vector<size_t> offsets(threadsNumber + 1, 0);
+	for (size_t iBlock = 0; iBlock < threadsNumber; ++iBlock)
+		offsets[iBlock + 1] = offsets[iBlock] + (blocks[iBlock + 1] != blocks[iBlock] ? prefix[blocks[iBlock + 1] - 1] : 0);
+
+	// each range ends at the first index, at which the accumulated cost exceeds the corresponding part of the total cost
+	std::vector<size_t> bounds(threadsNumber + 1, _count);
+	bounds[0] = 0;
+	size_t iBlock = 0;
+	for (size_t iThread = 1; iThread < threadsNumber; ++iThread)
+	{
+		const size_t target = offsets.back() / threadsNumber * iThread + offsets.back() % threadsNumber * iThread / threadsNumber;
+		while (iBlock + 1 < threadsNumber && offsets[iBlock + 1] <= target)
+			++iBlock;
+		const auto beg = prefix.begin() + blocks[iBlock];
+		const auto end = prefix.begin() + blocks[iBlock + 1];
+		bounds[iThread] = blocks[iBlock] + static_cast<size_t>(std::upper_bound(beg, end, target - offsets[iBlock]) - beg);
+	}
+	return bounds;
+}
+
+void ThreadPool::CThreadPool::Worker(size_t _index)
 {
+	t_pool = this;
+	t_workerIndex = _index;
+
 	while (true)
 	{
 		std::unique_ptr<IThreadTask> task{ nullptr };
@@ -147,6 +510,62 @@ void ThreadPool::CThreadPool::Worker()
 	}
 }
 
+void ThreadPool::CThreadPool::WorkStealingWorker(size_t _index)
+{
+	t_pool = this;
+	t_workerIndex = _index;
+
+	size_t idle = 0; // number of iterations without work
+	uint64_t openings = 0; // the last entered opening of the persistent parallel region
+	SRangeTask<SForkJoin> task;
+	while (!m_stop.load(std::memory_order_acquire))
+	{
+		const uint64_t submissions = m_submissions.load();
+		if (m_regionOpenings.load() != openings) // the region has been opened, stay in it as slot _index until it is closed
+		{
+			++openings; // the next opening is possible only after all threads have left the current region
+			SForkJoin& job = *m_region->job;
+			job.batch(_index);
+			job.Finish(1);
+			idle = 0;
+		}
+		else if (FindTask(_index, task))
+		{
+			RunTask(_index, task);
+			idle = 0;
+		}
+		else if (++idle < SPIN_ITERATIONS)
+			CPURelax();
+		else if (idle < SPIN_ITERATIONS + YIELD_ITERATIONS)
+			std::this_thread::yield();
+		else // sleep until new jobs are submitted
+		{
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_sleeping.fetch_add(1);
+			m_sleepEvent.wait(lock, [&] { return m_submissions.load() != submissions || m_regionOpenings.load() != openings || m_stop.load(); });
+			m_sleeping.fetch_sub(1);
+			idle = 0;
+		}
+	}
+}
+
+void ThreadPool::CThreadPool::RegionWorker(size_t _slot)
+{
+	SRegion& region = *m_region;
+	const size_t threadsNumber = m_threads.size();
+	uint64_t phase = 0; // the last processed parallel call
+	while (true)
+	{
+		region.started.Wait([&] { return region.phase.load() != phase; });
+		++phase; // the next call is published only after all threads have finished the current one
+		if (region.stop) break;
+		for (size_t i = _slot; i < region.count; i += threadsNumber)
+			region.batch(i);
+		if (region.arrived.fetch_add(1) + 1 == threadsNumber)
+			region.finished.Notify();
+	}
+}
+
 void ThreadPool::CThreadPool::SetSystemCPUList()
 {
 #ifdef __linux__
@@ -355,3 +774,48 @@ void ThreadPool::CThreadPool::PrintCPUList(const std::vector<int>& _cpuList, con
 		std::cout << cpu << " ";
 	std::cout << std::endl;
 }
+
+void ReleaseMemoryPages(void* _data, size_t _bytes)
+{
+#ifdef __linux__
+	// released pages of private memory are zero-filled and allocated anew on the first access
+	const uintptr_t pageSize = GetMemoryPageSize();
+	const uintptr_t begin = (reinterpret_cast<uintptr_t>(_data) + pageSize - 1) & ~(pageSize - 1);
+	const uintptr_t end = (reinterpret_cast<uintptr_t>(_data) + _bytes) & ~(pageSize - 1);
+	if (end > begin)
+		madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+size_t GetMemoryPageSize()
+{
+#ifdef __linux__
+	static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return size;
+#else
+	return 4096;
+#endif
+}
+
+int GetMemoryNode(const void* _address)
+{
+#ifdef __linux__
+	int node = -1;
+	constexpr unsigned long flags = 1 | 2; // MPOL_F_NODE | MPOL_F_ADDR: return the node of the page at the address
+	if (syscall(SYS_get_mempolicy, &node, nullptr, 0, const_cast<void*>(_address), flags) != 0) return -1;
+	return node;
+#else
+	return -1;
+#endif
+}
+
+int GetCurrentNode()
+{
+#ifdef __linux__
+	unsigned cpu, node;
+	if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return -1;
+	return static_cast<int>(node);
+#else
+	return -1;
+#endif
+}
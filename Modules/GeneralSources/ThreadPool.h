@@ -6,17 +6,56 @@
 
 #include "ThreadSafeQueue.h"
 #include "ThreadTask.h"
+#include "WorkStealingQueue.h"
+#include "FunctionRef.h"
 #include <functional>
 #include <thread>
 
+/// Defines how indices of a parallel loop are distributed among threads.
+enum class EScheduling
+{
+	STRIDED,	/// Thread t gets indices t, t+N, t+2N, ..., where N is the number of threads.
+	CONTIGUOUS,	/// Each thread gets one contiguous range of indices of approximately equal length.
+	WEIGHTED	/// Each thread gets one contiguous range of indices with approximately equal total cost.
+};
+/// With CONTIGUOUS and WEIGHTED scheduling, each range is processed by a single thread in increasing order of indices.
+
 namespace ThreadPool
 {
+	/// Implementation of tasks distribution among threads.
+	enum class EBackend
+	{
+		QUEUE,			/// All tasks are passed through one queue, protected with a mutex.
+		WORK_STEALING	/// Each thread has its own lock-free deque and steals tasks from other threads, if it runs out of work.
+	};
+
 	class CThreadPool
 	{
+		struct SForkJoin;	/// State of one parallel call.
+		struct SRegion;		/// State of a persistent parallel region.
+		/// Data of one thread for WORK_STEALING backend.
+		struct SWorker
+		{
+			CWorkStealingDeque<SForkJoin> deque;	/// Tasks of this thread.
+		};
+
 		static size_t m_globalThreadsLimit;							/// Maximum number of threads available for this instance of program.
-		CThreadSafeQueue<std::unique_ptr<IThreadTask>> m_workQueue;	/// Queue of submitted works.
+		EBackend m_backend;											/// Used implementation of tasks distribution.
+		CThreadSafeQueue<std::unique_ptr<IThreadTask>> m_workQueue;	/// Queue of submitted works for QUEUE backend.
 		std::vector<std::thread> m_threads;							/// List of available threads.
 
+		std::vector<std::unique_ptr<SWorker>> m_workers;	/// Per-thread data for WORK_STEALING backend.
+		CInjectionQueue<SForkJoin> m_injectionQueue;		/// Tasks submitted from threads not belonging to this pool, for WORK_STEALING backend.
+		std::atomic<bool> m_stop{ false };					/// Whether worker threads must finish, for WORK_STEALING backend.
+		std::atomic<uint64_t> m_submissions{ 0 };			/// Counter of submitted parallel calls, used to wake up sleeping threads.
+		std::atomic<size_t> m_sleeping{ 0 };				/// Number of threads currently sleeping in absence of work.
+		std::mutex m_sleepMutex;							/// Mutex for sleeping threads.
+		std::condition_variable m_sleepEvent;				/// Event to wake up sleeping threads.
+
+		std::unique_ptr<SRegion> m_region;					/// Persistent parallel region, reused each time it is opened.
+		std::atomic<std::thread::id> m_regionOwner{};		/// Thread, which opened the persistent parallel region, or an empty id if there is no open region.
+		std::atomic<uint64_t> m_regionOpenings{ 0 };		/// Counter of openings of the persistent parallel region, after each of which every thread enters it directly, for WORK_STEALING backend.
+
 		static bool m_isSystemAffinities;			/// Master process successfully set affinities taken from system. Takes precedence over user settings.
 		static bool m_isUserAffinities;				/// User has specified cores that system is supposed to run on.
 		static std::vector<int> m_systemCPUList;	/// Core IDs on which threads are allowed to run, set by system. Takes precedence over user settings.
@@ -28,7 +67,7 @@ namespace ThreadPool
 		int m_masterCPU{ -1 };						/// CPU to which the master thread was pinned.
 
 	public:
-		explicit CThreadPool(size_t _threads = 0);
+		explicit CThreadPool(size_t _threads = 0, EBackend _backend = EBackend::WORK_STEALING);
 
 		~CThreadPool();
 		CThreadPool(const CThreadPool& _other) = delete;
@@ -42,6 +81,8 @@ namespace ThreadPool
 		static size_t GetAllowedThreadsNumber();
 		/// Returns number of currently defined threads, for this instance of thread pool.
 		size_t GetCurrentThreadsNumber() const;
+		/// Returns implementation of tasks distribution used by this instance of thread pool.
+		EBackend GetBackend() const;
 
 		/// Creates the list of cores to run on. Information is taken from the user.
 		static void SetUserCPUList(const std::vector<int>& _cores);
@@ -51,11 +92,47 @@ namespace ThreadPool
 		static std::vector<int> GetSystemCPUList();
 
 		/// Submits _count of identical jobs, running _fun(i) _count times with i = [0; count).
-		void SubmitParallelJobs(size_t _count, const std::function<void(size_t)>& _fun);
+		void SubmitParallelJobs(size_t _count, CFunctionRef<void(size_t)> _fun);
+		/// Submits _count of identical jobs, running _fun(t, i) _count times with i = [0; count), distributed among threads according to _scheduling.
+		/// t = [0; threads number) is unique for each thread's portion of indices and can be used to access per-thread data.
+		/// For WEIGHTED scheduling, _cost(i) returns the relative cost of index i.
+		void SubmitParallelJobs(size_t _count, EScheduling _scheduling, CFunctionRef<void(size_t, size_t)> _fun, CFunctionRef<size_t(size_t)> _cost = {});
+
+		/// Opens a persistent parallel region. Until EndParallelRegion() is called, all worker threads stay in the region and execute parallel calls of the current thread directly,
+		/// synchronizing with a spin/sleep barrier after each call. Parallel calls from other threads are delayed until the region is closed.
+		/// Returns false if the region could not be opened, because another one is already open or the current thread belongs to the pool.
+		bool BeginParallelRegion();
+		/// Closes the persistent parallel region, opened by the current thread, and releases worker threads.
+		void EndParallelRegion();
 
 	private:
-		/// Constantly running function, which each thread uses to acquire work items from the queue.
-		void Worker();
+		/// Constantly running function, which each thread uses to acquire work items from the queue. _index is the index of the thread in the pool.
+		void Worker(size_t _index);
+		/// Constantly running function, which each thread uses to acquire work items with WORK_STEALING backend.
+		/// Each time the persistent parallel region is opened, the thread enters it directly as slot _index.
+		void WorkStealingWorker(size_t _index);
+		/// Function, which thread _slot runs while the persistent parallel region is open, executing its batches of each parallel call.
+		void RegionWorker(size_t _slot);
+
+		/// Runs _batch(t) with t = [0; _count) as separate tasks and waits until all of them are finished.
+		void ExecuteBatches(size_t _count, CFunctionRef<void(size_t)> _batch);
+		/// Implementation of ExecuteBatches() for QUEUE backend.
+		void ExecuteBatchesQueue(size_t _count, CFunctionRef<void(size_t)> _batch);
+		/// Implementation of ExecuteBatches() for WORK_STEALING backend.
+		void ExecuteBatchesWorkStealing(size_t _count, CFunctionRef<void(size_t)> _batch);
+		/// Implementation of ExecuteBatches() within the persistent parallel region.
+		void ExecuteBatchesRegion(size_t _count, CFunctionRef<void(size_t)> _batch);
+		/// Submits the task with WORK_STEALING backend and wakes up sleeping threads.
+		void PushTask(const SRangeTask<SForkJoin>& _task);
+		/// Looks for a task in own deque of thread _index, in the injection queue and in deques of other threads. _index is equal to the number of threads for external threads.
+		bool FindTask(size_t _index, SRangeTask<SForkJoin>& _task);
+		/// Executes the task, leaving parts of it to be stolen by other threads. _index is equal to the number of threads for external threads.
+		void RunTask(size_t _index, SRangeTask<SForkJoin> _task);
+
+		/// Splits [0; _count) into contiguous ranges of approximately equal length, one for each thread. Range t is [result[t]; result[t+1]).
+		std::vector<size_t> EvenRanges(size_t _count) const;
+		/// Splits [0; _count) into contiguous ranges of approximately equal total cost, one for each thread. Range t is [result[t]; result[t+1]).
+		std::vector<size_t> WeightedRanges(size_t _count, CFunctionRef<size_t(size_t)> _cost);
 
 		/// Creates the list of cores to run on. Information is taken from the system or starting parameters.
 		static void SetSystemCPUList();
@@ -94,13 +171,27 @@ inline void RestartThreadPool()
 }
 
 /// Submits _count of identical jobs, running function _fun(i) _count times with i = [0; _count).
-inline void ParallelFor(size_t _count, const std::function<void(size_t)>& _fun)
+inline void ParallelFor(size_t _count, ThreadPool::CFunctionRef<void(size_t)> _fun)
 {
 	return GetThreadPool().SubmitParallelJobs(_count, _fun);
 }
 
+/// Submits _count of identical jobs, running function _fun(t, i) _count times with i = [0; _count), distributed among threads according to _scheduling.
+/// t is unique for each thread's portion of indices and can be used to access per-thread data.
+inline void ParallelFor(size_t _count, EScheduling _scheduling, ThreadPool::CFunctionRef<void(size_t, size_t)> _fun)
+{
+	return GetThreadPool().SubmitParallelJobs(_count, _scheduling, _fun);
+}
+
+/// Submits _count of identical jobs, running function _fun(t, i) _count times with i = [0; _count), giving each thread a contiguous range of indices with approximately equal total cost.
+/// _cost(i) returns the relative cost of index i. t is unique for each thread's range and can be used to access per-thread data.
+inline void ParallelFor(size_t _count, ThreadPool::CFunctionRef<size_t(size_t)> _cost, ThreadPool::CFunctionRef<void(size_t, size_t)> _fun)
+{
+	return GetThreadPool().SubmitParallelJobs(_count, EScheduling::WEIGHTED, _fun, _cost);
+}
+
 /// Submits identical jobs, in an amount equal to the number of available threads (N), running function _fun(i) N times with i = [0; N).
-inline void ParallelFor(const std::function<void(size_t)>& _fun)
+inline void ParallelFor(ThreadPool::CFunctionRef<void(size_t)> _fun)
 {
 	return GetThreadPool().SubmitParallelJobs(GetThreadPool().GetCurrentThreadsNumber(), _fun);
 }
@@ -110,3 +201,27 @@ inline size_t GetThreadsNumber()
 {
 	return GetThreadPool().GetCurrentThreadsNumber();
 }
+
+/// Returns pages of memory, which lie completely within [_data; _data + _bytes), to the system, so that they are allocated anew on the NUMA node of the thread, which touches them first.
+/// Contents of the range become undefined. Does nothing on systems without first-touch page placement.
+void ReleaseMemoryPages(void* _data, size_t _bytes);
+/// Returns the size of a page of memory in bytes.
+size_t GetMemoryPageSize();
+/// Returns the NUMA node, on which the page of memory containing _address is allocated, or -1 if it is unknown.
+int GetMemoryNode(const void* _address);
+/// Returns the NUMA node of the processor, on which the calling thread runs, or -1 if it is unknown.
+int GetCurrentNode();
+
+/// Keeps the default thread pool in a persistent parallel region during its lifetime, if _enable is set.
+class CParallelRegion
+{
+	bool m_open{ false };	/// Whether the region was opened by this object.
+
+public:
+	explicit CParallelRegion(bool _enable = true) : m_open{ _enable && GetThreadPool().BeginParallelRegion() } {}
+	~CParallelRegion() { if (m_open) GetThreadPool().EndParallelRegion(); }
+	CParallelRegion(const CParallelRegion& _other) = delete;
+	CParallelRegion& operator=(const CParallelRegion& _other) = delete;
+	CParallelRegion(CParallelRegion&& _other) = delete;
+	CParallelRegion& operator=(CParallelRegion&& _other) = delete;
+};
@@ -0,0 +1,177 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ThreadPool
+{
+	/// A portion [begin; end) of batches of one fork-join job.
+	template <typename Job>
+	struct SRangeTask
+	{
+		Job* job{ nullptr };
+		uint32_t begin{ 0 };
+		uint32_t end{ 0 };
+	};
+
+	/// Lock-free bounded work-stealing deque (Chase-Lev). Push() and Pop() may only be called by the owning thread, Steal() - by any thread.
+	template <typename Job, size_t Capacity = 256>
+	class CWorkStealingDeque
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+		/// Task storage, each field is atomic so that concurrent reading by thieves is well-defined.
+		struct SSlot
+		{
+			std::atomic<Job*> job{ nullptr };
+			std::atomic<uint64_t> range{ 0 };
+		};
+
+		alignas(64) std::atomic<int64_t> m_top{ 0 };	/// Index of the oldest task, thieves take tasks from here.
+		alignas(64) std::atomic<int64_t> m_bottom{ 0 };	/// Index after the newest task, the owner pushes and pops tasks here.
+		std::array<SSlot, Capacity> m_slots;			/// Ring buffer of tasks.
+
+	public:
+		/// Adds a task to the bottom of the deque. Returns false if the deque is full.
+		bool Push(const SRangeTask<Job>& _task)
+		{
+			const int64_t b = m_bottom.load(std::memory_order_relaxed);
+			const int64_t t = m_top.load(std::memory_order_acquire);
+			if (b - t >= static_cast<int64_t>(Capacity)) return false;
+			Store(m_slots[b & (Capacity - 1)], _task);
+			m_bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// Takes the newest task from the bottom of the deque. Returns false if the deque is empty.
+		bool Pop(SRangeTask<Job>& _task)
+		{
+			const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+			m_bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = m_top.load(std::memory_order_relaxed);
+			if (t > b) // empty
+			{
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+			_task = Load(m_slots[b & (Capacity - 1)]);
+			if (t == b) // the last task - compete with thieves
+			{
+				const bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+				return won;
+			}
+			return true;
+		}
+
+		/// Takes the oldest task from the top of the deque. Returns false if the deque is empty or the task was taken by another thread.
+		bool Steal(SRangeTask<Job>& _task)
+		{
+			int64_t t = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = m_bottom.load(std::memory_order_acquire);
+			if (t >= b) return false;
+			_task = Load(m_slots[t & (Capacity - 1)]);
+			return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		}
+
+		/// Whether the deque seems to be empty at the moment.
+		bool Empty() const
+		{
+			return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+		}
+
+	private:
+		static void Store(SSlot& _slot, const SRangeTask<Job>& _task)
+		{
+			_slot.job.store(_task.job, std::memory_order_relaxed);
+			_slot.range.store(static_cast<uint64_t>(_task.begin) << 32 | _task.end, std::memory_order_relaxed);
+		}
+
+		static SRangeTask<Job> Load(const SSlot& _slot)
+		{
+			const uint64_t range = _slot.range.load(std::memory_order_relaxed);
+			return { _slot.job.load(std::memory_order_relaxed), static_cast<uint32_t>(range >> 32), static_cast<uint32_t>(range) };
+		}
+	};
+
+	/// Lock-free bounded multi-producer multi-consumer queue, used to inject tasks into the pool from external threads.
+	template <typename Job, size_t Capacity = 256>
+	class CInjectionQueue
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+
+		struct SCell
+		{
+			std::atomic<size_t> sequence{ 0 };	/// Defines whether the cell is ready to be written or read.
+			SRangeTask<Job> task;				/// Stored task.
+		};
+
+		alignas(64) std::array<SCell, Capacity> m_cells;	/// Ring buffer of cells.
+		alignas(64) std::atomic<size_t> m_enqueuePos{ 0 };	/// Next position to write.
+		alignas(64) std::atomic<size_t> m_dequeuePos{ 0 };	/// Next position to read.
+
+	public:
+		CInjectionQueue()
+		{
+			for (size_t i = 0; i < Capacity; ++i)
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		/// Adds a task to the queue. Returns false if the queue is full.
+		bool Push(const SRangeTask<Job>& _task)
+		{
+			size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				SCell& cell = m_cells[pos & (Capacity - 1)];
+				const size_t seq = cell.sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+				if (diff == 0)
+				{
+					if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						cell.task = _task;
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = m_enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		/// Takes a task from the queue. Returns false if the queue is empty.
+		bool Pop(SRangeTask<Job>& _task)
+		{
+			size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+			while (true)
+			{
+				SCell& cell = m_cells[pos & (Capacity - 1)];
+				const size_t seq = cell.sequence.load(std::memory_order_acquire);
+				const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+				if (diff == 0)
+				{
+					if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						_task = cell.task;
+						cell.sequence.store(pos + Capacity, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = m_dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+	};
+}
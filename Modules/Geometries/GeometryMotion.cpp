@@ -6,6 +6,7 @@
 #include "MixedFunctions.h"
 #include "MUSENStringFunctions.h"
 #include "ProtoFunctions.h"
+#include "BinaryStream.h"
 
 // TODO: sort time-dependent motion intervals
 
@@ -274,6 +275,18 @@ CGeometryMotion::SMotionInfo CGeometryMotion::GetCurrentMotion() const
 	return m_currentMotion;
 }
 
+void CGeometryMotion::SaveMotionInfo(std::ostream& _s) const
+{
+	WriteBinary(_s, m_iMotion);
+	WriteBinary(_s, m_currentMotion);
+}
+
+void CGeometryMotion::LoadMotionInfo(std::istream& _s)
+{
+	ReadBinary(_s, m_iMotion);
+	ReadBinary(_s, m_currentMotion);
+}
+
 CVector3 CGeometryMotion::TimeDependentShift(double _time) const
 {
 	if (m_motionType != EMotionType::TIME_DEPENDENT) return CVector3{ 0.0 };
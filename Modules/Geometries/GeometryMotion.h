@@ -117,6 +117,8 @@ public:
 	void UpdateMotionInfo(double _dependentValue);	// Updates current motion characteristics according to the current time or force.
 	void ResetMotionInfo();							// Resets current motion characteristics to the initial state.
 	SMotionInfo GetCurrentMotion() const;			// Returns current motion characteristics.
+	void SaveMotionInfo(std::ostream& _s) const;	// Writes current motion characteristics into binary stream.
+	void LoadMotionInfo(std::istream& _s);			// Reads current motion characteristics from binary stream.
 
 	CVector3 TimeDependentShift(double _time) const;	// Returns time-dependent translational shift.
 
@@ -411,7 +411,7 @@ bool CObjectsGenerator::IsOverlapped(const std::vector<CVector3>& _partCoords, c
 	// check PW overlaps
 	for (auto id : _existingWallID)
 		for (size_t j = 0; j < _partCoords.size(); ++j)
-			if (IsSphereIntersectTriangle(walls.Coordinates(id), walls.NormalVector(id), _partCoords[j], _partRadii[j]).first != EIntersectionType::NO_CONTACT)
+			if (IsSphereIntersectTriangle(walls.Coordinates(id), walls.Edges(id), walls.NormalVector(id), _partCoords[j], _partRadii[j]).first != EIntersectionType::NO_CONTACT)
 				return true;
 
 	return false;
@@ -164,6 +164,34 @@ void CConsoleSimulator::SetupSimulationManager()
 
 	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.saveCollsionsFlag == true)
 		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->EnableCollisionsAnalysis(m_job.saveCollsionsFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.forceReduction.has_value())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetForceReduction(m_job.forceReduction.value());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.reorderInterval.has_value())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetReorderInterval(m_job.reorderInterval.value());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.incrementalVerletFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetIncrementalVerletUpdate(m_job.incrementalVerletFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.flatVerletGridFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetFlatVerletGrid(m_job.flatVerletGridFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.verletBroadPhase.has_value())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetVerletBroadPhase(m_job.verletBroadPhase.value());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.wallBVHFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetWallBVH(m_job.wallBVHFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.sizeClassVerletFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetSizeClassVerlet(m_job.sizeClassVerletFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.verletCostModelFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetVerletCostModel(m_job.verletCostModelFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.implicitPBCFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetImplicitPBC(m_job.implicitPBCFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.geometryFramesFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetGeometryFrames(m_job.geometryFramesFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.numaPlacementFlag.IsDefined())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetNUMAPlacement(m_job.numaPlacementFlag.ToBool());
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && !m_job.checkpointFile.empty())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetCheckpointFile(m_job.checkpointFile);
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && m_job.checkpointInterval > 0)
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetCheckpointInterval(m_job.checkpointInterval);
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU && !m_job.restartFile.empty())
+		dynamic_cast<CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr())->SetRestartFile(m_job.restartFile);
 
 	// Converts a time factor relative to a recommended time step to a time value
 	auto FactorToTime = [&](double _factor) {
@@ -214,6 +242,8 @@ void CConsoleSimulator::SetupSimulationManager()
 
 	// set other simulator options
 	if (m_job.partVelocityLimit != -1.0) m_simulatorManager.GetSimulatorPtr()->SetPartVelocityLimit(m_job.partVelocityLimit);
+	if (m_job.persistentRegionFlag.IsDefined()) m_simulatorManager.GetSimulatorPtr()->SetPersistentParallelRegion(m_job.persistentRegionFlag.ToBool());
+	if (m_job.asyncSavingFlag.IsDefined()) m_simulatorManager.GetSimulatorPtr()->SetAsyncSaving(m_job.asyncSavingFlag.ToBool());
 }
 
 bool CConsoleSimulator::SimulationPrecheck() const
@@ -247,7 +277,18 @@ bool CConsoleSimulator::SimulationPrecheck() const
 	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::BASE)
 		AddErrorMessage("Wrong simulator type");
 
-	m_systemStructure.ClearAllStatesFrom(0.0);
+	// check restart
+	double startTime = 0.0;
+	if (m_simulatorManager.GetSimulatorPtr()->GetType() == ESimulatorType::CPU)
+	{
+		const auto* cpuSimulator = dynamic_cast<const CCPUSimulator*>(m_simulatorManager.GetSimulatorPtr());
+		AddErrorMessage(cpuSimulator->IsRestartCorrect());
+		startTime = cpuSimulator->GetRestartTime();
+	}
+	else if (!m_job.restartFile.empty())
+		AddErrorMessage("Restart from a checkpoint is only supported by CPU simulator");
+
+	m_systemStructure.ClearAllStatesFrom(startTime);
 	AddErrorMessage(m_simulatorManager.GetSimulatorPtr()->IsDataCorrect());
 
 	// check geometries
@@ -309,6 +350,29 @@ void CConsoleSimulator::PrintSimulationInfo()
 			}
 	if (simulator->GetPartVelocityLimit().has_value())
 		PrintFormatted("Limit particle velocity [m/s]", simulator->GetPartVelocityLimit().value());
+	PrintFormatted("Persistent parallel region", B2S(simulator->GetPersistentParallelRegion()));
+	PrintFormatted("Asynchronous saving", B2S(simulator->GetAsyncSaving()));
+	if (simType == ESimulatorType::CPU)
+	{
+		PrintFormatted("Force reduction", dynamic_cast<const CCPUSimulator*>(simulator)->GetForceReduction() == CCPUSimulator::EForceReduction::BUCKETS ? "BUCKETS" : "THREAD_BUFFERS");
+		PrintFormatted("Reorder particles each N verlet updates", dynamic_cast<const CCPUSimulator*>(simulator)->GetReorderInterval());
+		PrintFormatted("Incremental Verlet update", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetIncrementalVerletUpdate()));
+		PrintFormatted("Flat Verlet grid", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetFlatVerletGrid()));
+		PrintFormatted("Verlet broad phase", dynamic_cast<const CCPUSimulator*>(simulator)->GetVerletBroadPhase() == CVerletList::EBroadPhase::GRID ? "GRID" : "SWEEP_AND_PRUNE");
+		PrintFormatted("Wall BVH", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetWallBVH()));
+		PrintFormatted("Size class Verlet distance", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetSizeClassVerlet()));
+		PrintFormatted("Verlet cost model", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetVerletCostModel()));
+		PrintFormatted("Implicit PBC", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetImplicitPBC()));
+		PrintFormatted("Geometry body frames", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetGeometryFrames()));
+		PrintFormatted("NUMA placement", B2S(dynamic_cast<const CCPUSimulator*>(simulator)->GetNUMAPlacement()));
+		if (!dynamic_cast<const CCPUSimulator*>(simulator)->GetCheckpointFile().empty())
+		{
+			PrintFormatted("Checkpoint file", dynamic_cast<const CCPUSimulator*>(simulator)->GetCheckpointFile());
+			PrintFormatted("Checkpoint interval [s]", dynamic_cast<const CCPUSimulator*>(simulator)->GetCheckpointInterval());
+		}
+		if (!dynamic_cast<const CCPUSimulator*>(simulator)->GetRestartFile().empty())
+			PrintFormatted("Restart from checkpoint", dynamic_cast<const CCPUSimulator*>(simulator)->GetRestartFile(), dynamic_cast<const CCPUSimulator*>(simulator)->GetRestartTime());
+	}
 	PrintModelsInfo();
 	PrintFormatted("Auto-adjust Verlet distance", B2S(simulator->GetAutoAdjustFlag()));
 	PrintFormatted(simulator->GetAutoAdjustFlag() ? "Initial Verlet coefficient" : "Verlet coefficient", simulator->GetVerletCoeff());
@@ -139,6 +139,32 @@ void CScriptAnalyzer::ProcessLine(const std::string& _line, std::ostream& _out /
 		}
 	}
 	else if (key == "LIMIT_PARTICLE_VELOCITY") ss >> m_jobs.back().partVelocityLimit;
+	else if (key == "PERSISTENT_PARALLEL_REGION") ss >> m_jobs.back().persistentRegionFlag;
+	else if (key == "ASYNC_SAVING") ss >> m_jobs.back().asyncSavingFlag;
+	else if (key == "FORCE_REDUCTION")
+	{
+		const auto reduction = ToUpperCase(GetValueFromStream<std::string>(&ss));
+		if		(reduction == "BUCKETS")		m_jobs.back().forceReduction = CCPUSimulator::EForceReduction::BUCKETS;
+		else if (reduction == "THREAD_BUFFERS")	m_jobs.back().forceReduction = CCPUSimulator::EForceReduction::THREAD_BUFFERS;
+	}
+	else if (key == "REORDER_PARTICLES")	m_jobs.back().reorderInterval = GetValueFromStream<size_t>(&ss);
+	else if (key == "INCREMENTAL_VERLET")	ss >> m_jobs.back().incrementalVerletFlag;
+	else if (key == "FLAT_VERLET_GRID")		ss >> m_jobs.back().flatVerletGridFlag;
+	else if (key == "VERLET_BROAD_PHASE")
+	{
+		const auto broadPhase = ToUpperCase(GetValueFromStream<std::string>(&ss));
+		if		(broadPhase == "GRID")				m_jobs.back().verletBroadPhase = CVerletList::EBroadPhase::GRID;
+		else if (broadPhase == "SWEEP_AND_PRUNE")	m_jobs.back().verletBroadPhase = CVerletList::EBroadPhase::SWEEP_AND_PRUNE;
+	}
+	else if (key == "WALL_BVH")				ss >> m_jobs.back().wallBVHFlag;
+	else if (key == "SIZE_CLASS_VERLET")	ss >> m_jobs.back().sizeClassVerletFlag;
+	else if (key == "VERLET_COST_MODEL")	ss >> m_jobs.back().verletCostModelFlag;
+	else if (key == "IMPLICIT_PBC")			ss >> m_jobs.back().implicitPBCFlag;
+	else if (key == "GEOMETRY_FRAMES")		ss >> m_jobs.back().geometryFramesFlag;
+	else if (key == "NUMA_PLACEMENT")		ss >> m_jobs.back().numaPlacementFlag;
+	else if (key == "CHECKPOINT_FILE")		m_jobs.back().checkpointFile = GetRestOfLine(&ss);
+	else if (key == "CHECKPOINT_INTERVAL")	ss >> m_jobs.back().checkpointInterval;
+	else if (key == "RESTART_FILE")			m_jobs.back().restartFile = GetRestOfLine(&ss);
 	else if (key == "MONITOR")				m_jobs.back().vMonitors.push_back(GetRestOfLine(&ss));
 	else if (key == "POSTPROCESS")			m_jobs.back().vPostProcessCommands.push_back(GetRestOfLine(&ss));
 	else if (key.rfind("PACK_GEN", 0) == 0)
@@ -4,6 +4,7 @@
 
 #pragma once
 #include "BaseSimulator.h"
+#include "CPUSimulator.h"
 #include "ExportAsText.h"
 #include "TriState.h"
 #include <array>
@@ -142,6 +143,22 @@ struct SJob
 
 	// other simulator options
 	double partVelocityLimit{ -1.0 };
+	CTriState persistentRegionFlag{ CTriState::EState::UNDEFINED };
+	CTriState asyncSavingFlag{ CTriState::EState::UNDEFINED };
+	std::optional<CCPUSimulator::EForceReduction> forceReduction;
+	std::optional<size_t> reorderInterval;
+	CTriState incrementalVerletFlag{ CTriState::EState::UNDEFINED };
+	CTriState flatVerletGridFlag{ CTriState::EState::UNDEFINED };
+	std::optional<CVerletList::EBroadPhase> verletBroadPhase;
+	CTriState wallBVHFlag{ CTriState::EState::UNDEFINED };
+	CTriState sizeClassVerletFlag{ CTriState::EState::UNDEFINED };
+	CTriState verletCostModelFlag{ CTriState::EState::UNDEFINED };
+	CTriState implicitPBCFlag{ CTriState::EState::UNDEFINED };
+	CTriState geometryFramesFlag{ CTriState::EState::UNDEFINED };
+	CTriState numaPlacementFlag{ CTriState::EState::UNDEFINED };
+	std::string checkpointFile;
+	double checkpointInterval{ 0. };	// each checkpoint synchronously saves the whole results file, so short intervals stall the simulation
+	std::string restartFile;
 
 	// package generator, <index, generator>
 	std::map<size_t, SPackageGenerator> packageGenerators;
@@ -3,6 +3,34 @@
    See LICENSE file for license and warranty information. */
 
 #include "SceneTypes.h"
+#include "ThreadPool.h"
+#include "BinaryStream.h"
+#include <cstring>
+
+namespace
+{
+	// Reorders elements of the vector, so that element i takes the value of element _order[i]. Empty optional vectors are left unchanged.
+	// Elements are copied into an uninitialized buffer, pages of the vector are released, and elements are gathered back by threads, which process the same ranges
+	// of elements with contiguous scheduling. So pages are first touched by these threads and placed on their NUMA nodes. Elements are copied as raw memory.
+	template<typename T>
+	void PermuteVector(std::vector<T>& _vec, const std::vector<size_t>& _order)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Elements are copied into released pages as raw memory");
+		if (_vec.size() != _order.size()) return;
+		std::allocator<T> allocator;
+		T* copy = allocator.allocate(_vec.size()); // not initialized, so that no page is touched by the calling thread
+		ParallelFor(_vec.size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+		{
+			std::memcpy(copy + i, _vec.data() + i, sizeof(T));
+		});
+		ReleaseMemoryPages(_vec.data(), _vec.size() * sizeof(T));
+		ParallelFor(_order.size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+		{
+			std::memcpy(_vec.data() + i, copy + _order[i], sizeof(T));
+		});
+		allocator.deallocate(copy, _vec.size());
+	}
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SGeneralObject
@@ -25,6 +53,33 @@ void SGeneralObject::Resize(size_t n)
 	endActivity.resize(n);
 }
 
+void SGeneralObject::Permute(const std::vector<size_t>& _order)
+{
+	PermuteVector(active, _order);
+	PermuteVector(initIndex, _order);
+	PermuteVector(compoundIndex, _order);
+	PermuteVector(startActivity, _order);
+	PermuteVector(endActivity, _order);
+}
+
+void SGeneralObject::Save(std::ostream& _s) const
+{
+	WriteBinary(_s, active);
+	WriteBinary(_s, initIndex);
+	WriteBinary(_s, compoundIndex);
+	WriteBinary(_s, startActivity);
+	WriteBinary(_s, endActivity);
+}
+
+void SGeneralObject::Load(std::istream& _s)
+{
+	ReadBinary(_s, active);
+	ReadBinary(_s, initIndex);
+	ReadBinary(_s, compoundIndex);
+	ReadBinary(_s, startActivity);
+	ReadBinary(_s, endActivity);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SBasicParticleStruct
 
@@ -35,6 +90,27 @@ void SBasicParticleStruct::AddBasicParticle(bool _active, CVector3 _coord, doubl
 	contactInfo.emplace_back(_coord, _contactRadius, CVector3{ 0 });
 }
 
+void SBasicParticleStruct::Permute(const std::vector<size_t>& _order)
+{
+	SGeneralObject::Permute(_order);
+
+	PermuteVector(contactInfo, _order);
+}
+
+void SBasicParticleStruct::Save(std::ostream& _s) const
+{
+	SGeneralObject::Save(_s);
+
+	WriteBinary(_s, contactInfo);
+}
+
+void SBasicParticleStruct::Load(std::istream& _s)
+{
+	SGeneralObject::Load(_s);
+
+	ReadBinary(_s, contactInfo);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SParticleStruct
 
@@ -77,6 +153,44 @@ void SParticleStruct::Resize(size_t n)
 	if (!thermalInfo.empty())		thermalInfo.resize(n);
 }
 
+void SParticleStruct::ResetAccumulators(size_t n, bool _thermals)
+{
+	SGeneralObject::Resize(n);
+
+	kinematicsInfo.assign(n, SKinematics{ 0, 0, 0, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 }, CVector3{ 0 } });
+	thermalInfo.assign(_thermals ? n : 0, SThermals{ 0, 0, 0 });
+}
+
+void SParticleStruct::Permute(const std::vector<size_t>& _order)
+{
+	SBasicParticleStruct::Permute(_order);
+
+	PermuteVector(kinematicsInfo, _order);
+	PermuteVector(quaternion, _order);
+	PermuteVector(multiSphIndex, _order);
+	PermuteVector(thermalInfo, _order);
+}
+
+void SParticleStruct::Save(std::ostream& _s) const
+{
+	SBasicParticleStruct::Save(_s);
+
+	WriteBinary(_s, kinematicsInfo);
+	WriteBinary(_s, quaternion);
+	WriteBinary(_s, multiSphIndex);
+	WriteBinary(_s, thermalInfo);
+}
+
+void SParticleStruct::Load(std::istream& _s)
+{
+	SBasicParticleStruct::Load(_s);
+
+	ReadBinary(_s, kinematicsInfo);
+	ReadBinary(_s, quaternion);
+	ReadBinary(_s, multiSphIndex);
+	ReadBinary(_s, thermalInfo);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////  SWallStruct
 
@@ -86,6 +200,7 @@ void SWallStruct::AddWall(bool _active, unsigned _initIndex, const CVector3& _ve
 	AddObject(_active, _initIndex);
 
 	coordInfo.emplace_back(_vert1, _vert2, _vert3);
+	edgesInfo.emplace_back(coordInfo.back());
 	normalVector.emplace_back(_normalVector);
 	movementInfo.emplace_back(_vel, _rotVel, _rotCenter);
 	force.emplace_back(0);
@@ -96,11 +211,34 @@ void SWallStruct::Resize(size_t n)
 	SGeneralObject::Resize(n);
 
 	coordInfo.resize(n);
+	edgesInfo.resize(n);
 	normalVector.resize(n);
 	movementInfo.resize(n);
 	force.resize(n);
 }
 
+void SWallStruct::Save(std::ostream& _s) const
+{
+	SGeneralObject::Save(_s);
+
+	WriteBinary(_s, coordInfo);
+	WriteBinary(_s, edgesInfo);
+	WriteBinary(_s, normalVector);
+	WriteBinary(_s, movementInfo);
+	WriteBinary(_s, force);
+}
+
+void SWallStruct::Load(std::istream& _s)
+{
+	SGeneralObject::Load(_s);
+
+	ReadBinary(_s, coordInfo);
+	ReadBinary(_s, edgesInfo);
+	ReadBinary(_s, normalVector);
+	ReadBinary(_s, movementInfo);
+	ReadBinary(_s, force);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SBondStruct
 
@@ -118,6 +256,20 @@ void SBondStruct::Resize(size_t n)
 	connectionInfo.resize(n);
 }
 
+void SBondStruct::Save(std::ostream& _s) const
+{
+	SGeneralObject::Save(_s);
+
+	WriteBinary(_s, connectionInfo);
+}
+
+void SBondStruct::Load(std::istream& _s)
+{
+	SGeneralObject::Load(_s);
+
+	ReadBinary(_s, connectionInfo);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SSolidBondStruct
 
@@ -177,6 +329,36 @@ void SSolidBondStruct::Resize(size_t n)
 	if (!thermalInfo.empty())		        thermalInfo.resize(n);
 }
 
+void SSolidBondStruct::Save(std::ostream& _s) const
+{
+	SBondStruct::Save(_s);
+
+	WriteBinary(_s, baseInfo);
+	WriteBinary(_s, strengthInfo);
+	WriteBinary(_s, kinematicsInfo);
+	WriteBinary(_s, viscosity);
+	WriteBinary(_s, timeThermExpCoeff);
+	WriteBinary(_s, yieldStrength);
+	WriteBinary(_s, normalPlasticStrain);
+	WriteBinary(_s, tangentialPlasticStrain);
+	WriteBinary(_s, thermalInfo);
+}
+
+void SSolidBondStruct::Load(std::istream& _s)
+{
+	SBondStruct::Load(_s);
+
+	ReadBinary(_s, baseInfo);
+	ReadBinary(_s, strengthInfo);
+	ReadBinary(_s, kinematicsInfo);
+	ReadBinary(_s, viscosity);
+	ReadBinary(_s, timeThermExpCoeff);
+	ReadBinary(_s, yieldStrength);
+	ReadBinary(_s, normalPlasticStrain);
+	ReadBinary(_s, tangentialPlasticStrain);
+	ReadBinary(_s, thermalInfo);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SLiquidBondStruct
 
@@ -196,6 +378,22 @@ void SLiquidBondStruct::Resize(size_t n)
 	kinematicsInfo.resize(n);
 }
 
+void SLiquidBondStruct::Save(std::ostream& _s) const
+{
+	SBondStruct::Save(_s);
+
+	WriteBinary(_s, baseInfo);
+	WriteBinary(_s, kinematicsInfo);
+}
+
+void SLiquidBondStruct::Load(std::istream& _s)
+{
+	SBondStruct::Load(_s);
+
+	ReadBinary(_s, baseInfo);
+	ReadBinary(_s, kinematicsInfo);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 ////////// SMultiSphere
 
@@ -213,3 +411,17 @@ void SMultiSphere::Resize(size_t n)
 	matrices.resize(n);
 	props.resize(n);
 }
+
+void SMultiSphere::Save(std::ostream& _s) const
+{
+	WriteBinary(_s, indices);
+	WriteBinary(_s, matrices);
+	WriteBinary(_s, props);
+}
+
+void SMultiSphere::Load(std::istream& _s)
+{
+	ReadBinary(_s, indices);
+	ReadBinary(_s, matrices);
+	ReadBinary(_s, props);
+}
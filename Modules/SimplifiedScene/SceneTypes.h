@@ -5,6 +5,7 @@
 #pragma once
 #include "Quaternion.h"
 #include <vector>
+#include <iosfwd>
 
 #define _EXPAND(x) x
 #define _ADD_GET_SET_3(fun_name, path, var_name) \
@@ -38,6 +39,9 @@ public:
 protected:
 	inline void AddObject(bool _active, unsigned _initIndex);
 	void Resize(size_t n);
+	void Permute(const std::vector<size_t>& _order);
+	void Save(std::ostream& _s) const;
+	void Load(std::istream& _s);
 };
 
 struct SBasicParticleStruct : SGeneralObject
@@ -61,6 +65,11 @@ public:
 	ADD_GET_SET(CoordVerlet,	contactInfo, coordVerlet)		// coordinates of particles, which was used for last verlet calculation
 
 	void AddBasicParticle(bool _active, CVector3 _coord, double _contactRadius, unsigned _initIndex);
+
+protected:
+	void Permute(const std::vector<size_t>& _order);
+	void Save(std::ostream& _s) const;
+	void Load(std::istream& _s);
 };
 
 struct SParticleStruct : SBasicParticleStruct
@@ -128,6 +137,14 @@ public:
 	void AddThermals(double _temperature, double _heatCapacity);
 
 	void Resize(size_t n);
+	// Allocates zero forces, moments and, if _thermals is set, heat fluxes for n particles, without other particle-specific variables. Used as intermediate accumulators of forces.
+	void ResetAccumulators(size_t n, bool _thermals);
+	// Reorders all particles, so that particle i takes all variables of particle _order[i].
+	void Permute(const std::vector<size_t>& _order);
+	// Writes all variables of all particles into binary stream.
+	void Save(std::ostream& _s) const;
+	// Reads all variables of all particles from binary stream.
+	void Load(std::istream& _s);
 };
 
 struct SWallStruct : SGeneralObject
@@ -144,6 +161,22 @@ public:
 			: minCoord{ Min(_vert1, _vert2, _vert3) }, maxCoord{ Max(_vert1, _vert2, _vert3) }, vert1{ _vert1 }, vert2{ _vert2 }, vert3{ _vert3 } {}
 	};
 
+	// Edges of the triangle and values derived from them, precalculated to test contacts with particles. Must be updated whenever coordinates change.
+	struct SEdges
+	{
+		CVector3 center;					// center of the triangle
+		CVector3 edge21, edge32, edge13;	// edge vectors: vert2 - vert1, vert3 - vert2, vert1 - vert3
+		double sqrLength21, sqrLength32, sqrLength13;	// squared lengths of edges
+		double dot2131;						// dot product of edges vert2 - vert1 and vert3 - vert1
+		double invDenom;					// inverse denominator to calculate barycentric coordinates
+
+		SEdges() = default;
+		SEdges(const SCoordinates& _coords)
+			: center{ (_coords.vert1 + _coords.vert2 + _coords.vert3) / 3.0 }, edge21{ _coords.vert2 - _coords.vert1 }, edge32{ _coords.vert3 - _coords.vert2 }, edge13{ _coords.vert1 - _coords.vert3 },
+			sqrLength21{ SquaredLength(edge21) }, sqrLength32{ SquaredLength(edge32) }, sqrLength13{ SquaredLength(edge13) }, dot2131{ -DotProduct(edge21, edge13) },
+			invDenom{ 1.0 / (sqrLength21 * sqrLength13 - dot2131 * dot2131) } {}
+	};
+
 private:
 	struct SMovement
 	{
@@ -157,6 +190,7 @@ private:
 	};
 
 	std::vector<SCoordinates>	coordInfo;
+	std::vector<SEdges>			edgesInfo;
 	std::vector<CVector3>		normalVector;   // TODO: maybe put into SCoordinates
 	std::vector<SMovement>		movementInfo;
 	std::vector<CVector3>		force;
@@ -170,6 +204,7 @@ public:
 	ADD_GET_SET(Vert2,		coordInfo, vert2)
 	ADD_GET_SET(Vert3,		coordInfo, vert3)
 
+	ADD_GET_SET(Edges,			edgesInfo)
 	ADD_GET_SET(NormalVector,	normalVector)
 
 	ADD_GET_SET(Vel,		movementInfo, vel)
@@ -181,6 +216,10 @@ public:
 	void AddWall(bool _active, unsigned _initIndex, const CVector3& _vert1, const CVector3& _vert2, const CVector3& _vert3, const CVector3& _normalVector, const CVector3& _vel, const CVector3& _rotVel, const CVector3& _rotCenter);
 
 	void Resize(size_t n);
+	// Writes all variables of all walls into binary stream.
+	void Save(std::ostream& _s) const;
+	// Reads all variables of all walls from binary stream.
+	void Load(std::istream& _s);
 };
 
 struct SBondStruct : SGeneralObject
@@ -203,6 +242,10 @@ public:
 	void AddBond(bool _active, unsigned _initIndex, size_t _leftID, size_t _rightID);
 
 	void Resize(size_t n);
+
+protected:
+	void Save(std::ostream& _s) const;
+	void Load(std::istream& _s);
 };
 
 struct SSolidBondStruct : SBondStruct
@@ -306,6 +349,10 @@ public:
 	void AddThermals(double _thermalConductivity);
 
 	void Resize(size_t n);
+	// Writes all variables of all bonds into binary stream.
+	void Save(std::ostream& _s) const;
+	// Reads all variables of all bonds from binary stream.
+	void Load(std::istream& _s);
 };
 
 
@@ -347,6 +394,10 @@ public:
 	void AddLiquidBond(bool _active, unsigned _initIndex, size_t _leftID, size_t _rightID, double _volume, double _viscosity, double _surfaceTension);
 
 	void Resize(size_t n);
+	// Writes all variables of all bonds into binary stream.
+	void Save(std::ostream& _s) const;
+	// Reads all variables of all bonds from binary stream.
+	void Load(std::istream& _s);
 };
 
 struct SMultiSphere
@@ -395,6 +446,10 @@ public:
 
 	size_t Size() const { return indices.size(); }
 	void Resize(size_t n);
+	// Writes all variables of all multispheres into binary stream.
+	void Save(std::ostream& _s) const;
+	// Reads all variables of all multispheres from binary stream.
+	void Load(std::istream& _s);
 };
 
 struct SCollision;
@@ -410,7 +465,6 @@ struct SSavedCollision
 	CVector3 vNormVelocity{ 0.0 };	// relative normal velocity of objects at the first moment of contact; or max value for simultaneous contact with several walls
 	CVector3 vTangVelocity{ 0.0 };	// relative tangential velocity of objects at the first moment of contact; or max value for simultaneous contact with several walls
 	CVector3 vContactPoint{ 0.0 };	// point of contact at the dTimeStart; one of them for simultaneous contact with several walls
-	std::vector<SCollision*> vPtr;	// list of collisions with length nCnt, contains pointers to simultaneously existing contacts of a particle and geometry
 };
 
 // Used to describe particle-particle and particle-wall collision.
@@ -4,6 +4,8 @@
 
 #include "SimplifiedScene.h"
 #include "GeometricFunctions.h"
+#include "BinaryStream.h"
+#include <numeric>
 
 CSimplifiedScene::CSimplifiedScene()
 {
@@ -127,6 +129,115 @@ void CSimplifiedScene::UpdateParticlesToBonds()
 	}
 }
 
+std::vector<unsigned> CSimplifiedScene::ReorderParticles()
+{
+	SParticleStruct& particles = *m_Objects.vParticles;
+	const size_t number = particles.Size();
+	if (number < 2 || m_Objects.nVirtualParticles != 0) return {};
+
+	// bounding box of active particles
+	CVector3 minCoord{ std::numeric_limits<double>::max() };
+	CVector3 maxCoord{ std::numeric_limits<double>::lowest() };
+	for (size_t i = 0; i < number; ++i)
+		if (particles.Active(i))
+		{
+			minCoord = Min(minCoord, particles.Coord(i));
+			maxCoord = Max(maxCoord, particles.Coord(i));
+		}
+	if (minCoord.x > maxCoord.x) return {}; // no active particles
+
+	// cells of the size of the largest particle, at most 2^21 cells in each direction to fit into the Morton code
+	const double maxExtent = std::max({ maxCoord.x - minCoord.x, maxCoord.y - minCoord.y, maxCoord.z - minCoord.z });
+	const double cellSize = std::max({ 2 * GetMaxParticleContactRadius(), maxExtent / ((1 << 21) - 1), std::numeric_limits<double>::min() });
+	std::vector<uint64_t> keys(number);
+	ParallelFor(number, [&](size_t i)
+	{
+		if (!particles.Active(i))
+		{
+			keys[i] = std::numeric_limits<uint64_t>::max();
+			return;
+		}
+		const CVector3 pos = (particles.Coord(i) - minCoord) / cellSize;
+		keys[i] = MortonEncode(static_cast<size_t>(pos.x), static_cast<size_t>(pos.y), static_cast<size_t>(pos.z));
+	});
+
+	// new order of particles; ties are resolved by old indices to keep the result deterministic
+	std::vector<size_t> order(number);
+	std::iota(order.begin(), order.end(), 0);
+	const auto Less = [&](size_t _i1, size_t _i2) { return keys[_i1] < keys[_i2] || (keys[_i1] == keys[_i2] && _i1 < _i2); };
+	if (std::is_sorted(order.begin(), order.end(), Less)) return {};
+	std::sort(order.begin(), order.end(), Less);
+
+	std::vector<unsigned> newIndex(number);
+	for (size_t i = 0; i < number; ++i)
+		newIndex[order[i]] = static_cast<unsigned>(i);
+
+	particles.Permute(order);
+	for (size_t i = 0; i < number; ++i)
+		m_vNewIndexes[particles.InitIndex(i)] = i;
+
+	// connections of bonds
+	SSolidBondStruct& solidBonds = *m_Objects.vSolidBonds;
+	ParallelFor(solidBonds.Size(), [&](size_t i)
+	{
+		solidBonds.LeftID(i) = newIndex[solidBonds.LeftID(i)];
+		solidBonds.RightID(i) = newIndex[solidBonds.RightID(i)];
+	});
+	SLiquidBondStruct& liquidBonds = *m_Objects.vLiquidBonds;
+	ParallelFor(liquidBonds.Size(), [&](size_t i)
+	{
+		liquidBonds.LeftID(i) = newIndex[liquidBonds.LeftID(i)];
+		liquidBonds.RightID(i) = newIndex[liquidBonds.RightID(i)];
+	});
+
+	// particles of multispheres
+	for (size_t i = 0; i < m_Objects.vMultiSpheres->Size(); ++i)
+		for (auto& index : m_Objects.vMultiSpheres->Indices(i))
+			index = newIndex[index];
+
+	UpdateParticlesToBonds();
+	m_PBCBand = SPBCBand{}; // indices of particles in the band are not valid anymore
+
+	return newIndex;
+}
+
+void CSimplifiedScene::PlaceParticles()
+{
+	std::vector<size_t> order(m_Objects.vParticles->Size());
+	std::iota(order.begin(), order.end(), 0);
+	m_Objects.vParticles->Permute(order);
+}
+
+void CSimplifiedScene::SaveState(std::ostream& _s) const
+{
+	m_Objects.vParticles->Save(_s);
+	m_Objects.vWalls->Save(_s);
+	m_Objects.vSolidBonds->Save(_s);
+	m_Objects.vLiquidBonds->Save(_s);
+	m_Objects.vMultiSpheres->Save(_s);
+	WriteBinary(_s, m_Objects.nVirtualParticles);
+	WriteBinary(_s, *m_vParticlesToSolidBonds);
+	WriteBinary(_s, m_vNewIndexes);
+	WriteBinary(_s, m_PBC);
+	WriteBinary(_s, m_vPBCVirtShift);
+}
+
+void CSimplifiedScene::LoadState(std::istream& _s)
+{
+	// objects are loaded in place, since models keep pointers to them
+	m_Objects.vParticles->Load(_s);
+	m_Objects.vWalls->Load(_s);
+	m_Objects.vSolidBonds->Load(_s);
+	m_Objects.vLiquidBonds->Load(_s);
+	m_Objects.vMultiSpheres->Load(_s);
+	ReadBinary(_s, m_Objects.nVirtualParticles);
+	ReadBinary(_s, *m_vParticlesToSolidBonds);
+	ReadBinary(_s, m_vNewIndexes);
+	ReadBinary(_s, m_PBC);
+	ReadBinary(_s, m_vPBCVirtShift);
+	m_PBCBand = SPBCBand{};
+}
+
 void CSimplifiedScene::AddParticle(size_t _index, double _dTime)
 {
 	CSphere* pSphere = dynamic_cast<CSphere*>(m_pSystemStructure->GetObjectByIndex(_index));
@@ -444,45 +555,75 @@ void CSimplifiedScene::AddVirtualParticles(double _dVerletDistance)
 {
 	if (!m_PBC.bEnabled) return;
 
-	const double dMaxContactRadius = GetMaxParticleContactRadius();
 	m_vPBCVirtShift.clear(); // remove all shifts
+	const SVolumeType virtDomain = GetVirtualDomain(_dVerletDistance);
+	// only particles closer to boundaries than the verlet distance and two max contact radii get virtual copies, so if possible, only the boundary band is analyzed
+	const std::optional<size_t> nBandSize = GetPBCBandSize(_dVerletDistance + 2 * GetMaxParticleContactRadius());
+	const size_t nCandidates = nBandSize ? *nBandSize : m_Objects.vParticles->Size();
+	for (size_t k = 0; k < nCandidates; ++k)
+	{
+		const size_t i = nBandSize ? m_PBCBand.vIDs[k] : k;
+		ForEachVirtualShift(i, virtDomain, [&](const CVector3& _vShift) { AddVirtualParticleBox(i, _vShift); });
+	}
+}
 
-	// calculate virtual domain
-	const SVolumeType virtDomain{
+SVolumeType CSimplifiedScene::GetVirtualDomain(double _dVerletDistance) const
+{
+	const double dMaxContactRadius = GetMaxParticleContactRadius();
+	return SVolumeType{
 		m_PBC.currentDomain.coordBeg + _dVerletDistance + dMaxContactRadius,
 		m_PBC.currentDomain.coordEnd - _dVerletDistance - dMaxContactRadius
 	};
-	const CVector3& t = m_PBC.boundaryShift;
-	const size_t nRealPartCount = m_Objects.vParticles->Size();
-	for (size_t i = 0; i < nRealPartCount; ++i)
+}
+
+void CSimplifiedScene::UpdatePBCBand(double _dMaxDistance)
+{
+	m_PBCBand.vIDs.clear();
+	m_PBCBand.vDist.clear();
+	m_PBCBand.dMaxDistance = m_PBC.bEnabled ? _dMaxDistance : -1;
+	m_PBCBand.dTravel = 0;
+	m_PBCBand.nParticles = GetRealParticlesNumber();
+	if (!m_PBC.bEnabled) return;
+
+	// particles of the band are gathered over blocks of particles and sorted by their distances
+	const size_t nParticles = m_PBCBand.nParticles;
+	const size_t nBlocks = std::max<size_t>(std::min(GetThreadsNumber(), nParticles), 1);
+	const auto BlockBegin = [&](size_t _iBlock) { return nParticles * _iBlock / nBlocks; };
+	std::vector<std::vector<std::pair<double, unsigned>>> vBlocks(nBlocks);
+	const SVolumeType& domain = m_PBC.currentDomain;
+	ParallelFor(nBlocks, [&](size_t iBlock)
+	{
+		for (size_t i = BlockBegin(iBlock); i < BlockBegin(iBlock + 1); ++i)
+		{
+			const CVector3& coord = m_Objects.vParticles->Coord(i);
+			double dDist = std::numeric_limits<double>::max();
+			if (m_PBC.bX) dDist = std::min({ dDist, coord.x - domain.coordBeg.x, domain.coordEnd.x - coord.x });
+			if (m_PBC.bY) dDist = std::min({ dDist, coord.y - domain.coordBeg.y, domain.coordEnd.y - coord.y });
+			if (m_PBC.bZ) dDist = std::min({ dDist, coord.z - domain.coordBeg.z, domain.coordEnd.z - coord.z });
+			if (dDist <= _dMaxDistance)
+				vBlocks[iBlock].emplace_back(std::max(dDist, 0.0), static_cast<unsigned>(i));
+		}
+	});
+	std::vector<std::pair<double, unsigned>> vBand;
+	for (const auto& block : vBlocks)
+		vBand.insert(vBand.end(), block.begin(), block.end());
+	std::sort(vBand.begin(), vBand.end());
+	m_PBCBand.vIDs.resize(vBand.size());
+	m_PBCBand.vDist.resize(vBand.size());
+	for (size_t i = 0; i < vBand.size(); ++i)
 	{
-		const CVector3& coord = m_Objects.vParticles->Coord(i);
-		const bool xL = m_PBC.bX && (coord.x - m_Objects.vParticles->ContactRadius(i) <= virtDomain.coordBeg.x);
-		const bool yL = m_PBC.bY && (coord.y - m_Objects.vParticles->ContactRadius(i) <= virtDomain.coordBeg.y);
-		const bool zL = m_PBC.bZ && (coord.z - m_Objects.vParticles->ContactRadius(i) <= virtDomain.coordBeg.z);
-
-		const bool xG = m_PBC.bX && (coord.x + m_Objects.vParticles->ContactRadius(i) >= virtDomain.coordEnd.x);
-		const bool yG = m_PBC.bY && (coord.y + m_Objects.vParticles->ContactRadius(i) >= virtDomain.coordEnd.y);
-
-		if (xL)				AddVirtualParticleBox(i, CVector3(t.x, 0, 0));
-		if (yL)				AddVirtualParticleBox(i, CVector3(0, t.y, 0));
-		if (zL)				AddVirtualParticleBox(i, CVector3(0, 0, t.z));
-		if (xL && yL)		AddVirtualParticleBox(i, CVector3(t.x, t.y, 0));
-		if (xL && zL)		AddVirtualParticleBox(i, CVector3(t.x, 0, t.z));
-		if (yL && zL)		AddVirtualParticleBox(i, CVector3(0, t.y, t.z));
-		if (xL && yL && zL)	AddVirtualParticleBox(i, CVector3(t.x, t.y, t.z));
-
-		if (xG && yL)		AddVirtualParticleBox(i, CVector3(-t.x, t.y, 0));
-		if (xG && zL)		AddVirtualParticleBox(i, CVector3(-t.x, 0, t.z));
-		if (yG && zL)		AddVirtualParticleBox(i, CVector3(0, -t.y, t.z));
-
-		if (xG && yL && zL)	AddVirtualParticleBox(i, CVector3(-t.x, t.y, t.z));
-		if (xL && yG && zL)	AddVirtualParticleBox(i, CVector3(t.x, -t.y, t.z));
-		if (xG && yG && zL)	AddVirtualParticleBox(i, CVector3(-t.x, -t.y, t.z));
+		m_PBCBand.vDist[i] = vBand[i].first;
+		m_PBCBand.vIDs[i] = vBand[i].second;
 	}
 }
 
-
+std::optional<size_t> CSimplifiedScene::GetPBCBandSize(double _dDistance) const
+{
+	// a particle, which is closer than _dDistance now, was closer than _dDistance plus the travelled distance at the last refresh
+	const double dDist = _dDistance + m_PBCBand.dTravel;
+	if (m_PBCBand.nParticles != GetRealParticlesNumber() || dDist > m_PBCBand.dMaxDistance) return {};
+	return static_cast<size_t>(std::upper_bound(m_PBCBand.vDist.begin(), m_PBCBand.vDist.end(), dDist) - m_PBCBand.vDist.begin());
+}
 
 void CSimplifiedScene::GetAllParticlesInVolume(const SVolumeType& _volume, std::vector<unsigned>* _pvIndexes) const
 {
@@ -654,6 +795,7 @@ void CSimplifiedScene::ClearAllData()
 	m_Objects.vLiquidBonds->Resize(0);
 	m_Objects.vMultiSpheres->Resize(0);
 	m_Objects.vWalls->Resize(0);
+	m_PBCBand = SPBCBand{};
 }
 
 void CSimplifiedScene::InitializeLiquidBondsCharacteristics(double _dTime)
@@ -3,6 +3,7 @@
 #include "SystemStructure.h"
 #include "SceneOptionalVariables.h"
 #include "SceneTypes.h"
+#include <optional>
 
 /* This class is compressed representation of the data from the system structure which will be used for the calculation. */
 class CSimplifiedScene
@@ -22,6 +23,17 @@ private:
 	std::shared_ptr<std::vector<std::vector<unsigned>>> m_vParticlesToSolidBonds; // array contain information about indexes of bonds which are connected to specific particle
 
 	SObjects m_Objects;	// all objects for consideration in the scene, including virtual ones (in case of periodic boundary conditions)
+
+	// Real particles near periodic boundaries. Only they may cross boundaries or get virtual copies, until particles travel farther than the band allows.
+	struct SPBCBand
+	{
+		std::vector<unsigned> vIDs;		// particles, sorted by their distances to the nearest periodic boundary at the last refresh
+		std::vector<double> vDist;		// distances of these particles to the nearest periodic boundary at the last refresh
+		double dMaxDistance{ -1 };		// all particles, which were closer to periodic boundaries at the last refresh, are in the band; negative if the band is not valid
+		double dTravel{ 0 };			// upper bound of the distance, travelled by particles relative to periodic boundaries since the last refresh
+		size_t nParticles{ 0 };			// number of real particles at the last refresh
+	};
+	SPBCBand m_PBCBand;
 public:
 	std::vector<size_t> m_vNewIndexes; // corresponds to the new indexes
 
@@ -63,6 +75,21 @@ public:
 
 	void AddVirtualParticles(double _dVerletDistance);
 	void RemoveVirtualParticles();
+	// Returns the part of the PBC domain, outside which particles get virtual copies for the given verlet distance.
+	SVolumeType GetVirtualDomain(double _dVerletDistance) const;
+	// Calls _func(shift) for each shift, with which a virtual copy of the real particle is created for the given virtual domain.
+	template<typename F>
+	void ForEachVirtualShift(size_t _iPart, const SVolumeType& _virtDomain, const F& _func) const;
+
+	// Refreshes the boundary band with all real particles closer than _dMaxDistance to periodic boundaries and resets the travelled distance.
+	void UpdatePBCBand(double _dMaxDistance);
+	// Increases the upper bound of the distance, travelled by particles relative to periodic boundaries since the last refresh of the boundary band.
+	void AddPBCBandTravel(double _dDistance) { m_PBCBand.dTravel += _dDistance; }
+	double GetPBCBandTravel() const { return m_PBCBand.dTravel; }
+	// Returns the number of first particles of the boundary band, among which are all particles, that may be closer than _dDistance to periodic boundaries now.
+	// Returns nothing if the band is not valid or such particles may be outside it, so that all particles must be considered.
+	std::optional<size_t> GetPBCBandSize(double _dDistance) const;
+	const std::vector<unsigned>& GetPBCBandParticles() const { return m_PBCBand.vIDs; }
 
 	void SaveVerletCoords(); // save coordinates of all objects which were used for calculation of verlet
 	double GetMaxPartVerletDistance(); // get maximal distance which was made by particle from last verlet updata
@@ -80,6 +107,18 @@ public:
 
 	void UpdateParticlesToBonds();
 
+	// Sorts particles along the Morton space-filling curve, so that particles close in space are also close in memory. Inactive particles are moved to the end.
+	// Remaps all indices of particles in bonds, multispheres and m_vNewIndexes. Must be called when no virtual particles exist.
+	// Returns the new index of each particle, or an empty vector if the order has not changed.
+	std::vector<unsigned> ReorderParticles();
+	// Copies all data of particles into new memory, which pages are first touched by threads processing corresponding ranges of particles with contiguous scheduling.
+	void PlaceParticles();
+
+	// Writes current state of all objects into binary stream: particles, including virtual ones, walls, bonds, multispheres and PBC.
+	void SaveState(std::ostream& _s) const;
+	// Restores the state written with SaveState. The scene must be initialized from the same system structure.
+	void LoadState(std::istream& _s);
+
 	SPBC GetPBC() const { return m_PBC; }
 
 	// a set of slow function // should be called often
@@ -133,4 +172,35 @@ protected:
 	void FindAdjacentWalls(); // Constructs a list of adjacent walls for each wall.
 };
 
+template<typename F>
+void CSimplifiedScene::ForEachVirtualShift(size_t _iPart, const SVolumeType& _virtDomain, const F& _func) const
+{
+	if (!m_Objects.vParticles->Active(_iPart)) return;
+	const CVector3 coord = m_Objects.vParticles->Coord(_iPart);
+	const double dRadius = m_Objects.vParticles->ContactRadius(_iPart);
+	const bool xL = m_PBC.bX && (coord.x - dRadius <= _virtDomain.coordBeg.x);
+	const bool yL = m_PBC.bY && (coord.y - dRadius <= _virtDomain.coordBeg.y);
+	const bool zL = m_PBC.bZ && (coord.z - dRadius <= _virtDomain.coordBeg.z);
+
+	const bool xG = m_PBC.bX && (coord.x + dRadius >= _virtDomain.coordEnd.x);
+	const bool yG = m_PBC.bY && (coord.y + dRadius >= _virtDomain.coordEnd.y);
+
+	const CVector3& t = m_PBC.boundaryShift;
+	if (xL)				_func(CVector3(t.x, 0, 0));
+	if (yL)				_func(CVector3(0, t.y, 0));
+	if (zL)				_func(CVector3(0, 0, t.z));
+	if (xL && yL)		_func(CVector3(t.x, t.y, 0));
+	if (xL && zL)		_func(CVector3(t.x, 0, t.z));
+	if (yL && zL)		_func(CVector3(0, t.y, t.z));
+	if (xL && yL && zL)	_func(CVector3(t.x, t.y, t.z));
+
+	if (xG && yL)		_func(CVector3(-t.x, t.y, 0));
+	if (xG && zL)		_func(CVector3(-t.x, 0, t.z));
+	if (yG && zL)		_func(CVector3(0, -t.y, t.z));
+
+	if (xG && yL && zL)	_func(CVector3(-t.x, t.y, t.z));
+	if (xL && yG && zL)	_func(CVector3(t.x, -t.y, t.z));
+	if (xG && yG && zL)	_func(CVector3(-t.x, -t.y, t.z));
+}
+
 
@@ -337,6 +337,7 @@ void CSimplifiedSceneGPU::CUDAWallsGPU2CPUVerletData(CSimplifiedScene& _pSceneCP
 		wallsCPU.NormalVector(i) = vNormalVector[i];
 		wallsCPU.MinCoord(i) = vMinCoord[i];
 		wallsCPU.MaxCoord(i) = vMaxCoord[i];
+		wallsCPU.Edges(i) = SWallStruct::SEdges{ wallsCPU.Coordinates(i) };
 	});
 }
 
@@ -354,6 +355,7 @@ void CSimplifiedSceneGPU::CUDAWallsGPU2CPUAllData(CSimplifiedScene& _pSceneCPU)
 		wallsCPU.NormalVector(i) = wallsHost.NormalVectors[i];
 		wallsCPU.MinCoord(i) = wallsHost.MinCoords[i];
 		wallsCPU.MaxCoord(i) = wallsHost.MaxCoords[i];
+		wallsCPU.Edges(i) = SWallStruct::SEdges{ wallsCPU.Coordinates(i) };
 		wallsCPU.Vel(i) = wallsHost.Vels[i];
 		wallsCPU.Force(i) = wallsHost.Forces[i];
 		wallsCPU.RotVel(i) = wallsHost.RotVels[i];
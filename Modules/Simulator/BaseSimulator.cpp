@@ -37,6 +37,8 @@ void CBaseSimulator::LoadConfiguration()
 	SetPartMoveLimit(sim.part_move_limit());
 	SetTimeStepFactor(sim.time_step_factor());
 	SetPartVelocityLimit(sim.part_velocity_limit());
+	SetPersistentParallelRegion(sim.persistent_parallel_region());
+	SetAsyncSaving(sim.async_saving());
 
 	// load selective saving parameters
 	m_selectiveSaving = m_pSystemStructure->GetSimulationInfo()->selective_saving();
@@ -89,6 +91,8 @@ void CBaseSimulator::SaveConfiguration()
 	pSim->set_part_move_limit(m_partMoveLimit);
 	pSim->set_time_step_factor(m_timeStepFactor);
 	pSim->set_part_velocity_limit(m_partVelocityLimit.value_or(0.0));
+	pSim->set_persistent_parallel_region(m_persistentParallelRegion);
+	pSim->set_async_saving(m_asyncSaving);
 
 	// save selective saving parameters
 	m_pSystemStructure->GetSimulationInfo()->set_selective_saving(m_selectiveSaving);
@@ -169,6 +173,30 @@ void CBaseSimulator::SetPartVelocityLimit(const std::optional<double>& _velocity
 		m_partVelocityLimit = _velocity;
 }
 
+bool CBaseSimulator::GetPersistentParallelRegion() const
+{
+	return m_persistentParallelRegion;
+}
+
+void CBaseSimulator::SetPersistentParallelRegion(bool _flag)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_persistentParallelRegion = _flag;
+}
+
+bool CBaseSimulator::GetAsyncSaving() const
+{
+	return m_asyncSaving;
+}
+
+void CBaseSimulator::SetAsyncSaving(bool _flag)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_asyncSaving = _flag;
+	if (!m_asyncSaving)
+		m_resultsWriter.Stop();
+}
+
 bool CBaseSimulator::IsSelectiveSavingEnabled() const
 {
 	return m_selectiveSaving;
@@ -375,6 +403,9 @@ std::string CBaseSimulator::IsDataCorrect() const
 
 void CBaseSimulator::p_SaveData()
 {
+	// the background writer must not access system structure, while new objects are added
+	if (!m_generatedObjectsDiff.empty())
+		WaitForSavedResults();
 	AddGeneratedObjectsToSystemStructure();
 
 	if (m_selectiveSaving)
@@ -384,63 +415,186 @@ void CBaseSimulator::p_SaveData()
 
 	if (!m_selectiveSaving || m_selectiveSavingFlags.bTensor)
 	{
+		// activity of bonds is checked in system structure
+		if (m_scene.GetBondsNumber() != 0)
+			WaitForSavedResults();
 		m_additionalSavingData.resize(m_scene.GetTotalParticlesNumber());
 		PrepareAdditionalSavingData();
 	}
 
-	m_pSystemStructure->PrepareTimePointForWrite(m_currentTime);
+	if (m_asyncSaving)
+	{
+		if (!m_resultsWriter.IsRunning())
+			m_resultsWriter.Start([this](const SResultsSnapshot& _snapshot) { WriteResultsSnapshot(_snapshot, false); });
+		SResultsSnapshot snapshot = m_resultsWriter.Acquire();
+		TakeResultsSnapshot(snapshot);
+		m_resultsWriter.Push(std::move(snapshot));
+	}
+	else
+	{
+		SResultsSnapshot snapshot;
+		TakeResultsSnapshot(snapshot);
+		WriteResultsSnapshot(snapshot, true);
+	}
+
+	if (!m_additionalSavingSteps.empty())
+		WaitForSavedResults();
+	for (const auto& function : m_additionalSavingSteps)
+		function();
+}
+
+void CBaseSimulator::WaitForSavedResults()
+{
+	m_resultsWriter.Wait();
+}
+
+void CBaseSimulator::TakeResultsSnapshot(SResultsSnapshot& _snapshot)
+{
+	// returns the number of elements for variables, which are saved, and 0 for others
+	const auto Size = [&](size_t _number, bool _flag) { return !m_selectiveSaving || _flag ? _number : 0; };
+
+	_snapshot.time = m_currentTime;
+
+	// particles
+	const SParticleStruct& particles = m_scene.GetRefToParticles();
+	const size_t nPart = m_scene.GetTotalParticlesNumber();
+	_snapshot.partIndices.resize(nPart);
+	_snapshot.partActive.resize(nPart);
+	_snapshot.partEndActivity.resize(nPart);
+	_snapshot.partCoords.resize(Size(nPart, m_selectiveSavingFlags.bCoordinates));
+	_snapshot.partVels.resize(Size(nPart, m_selectiveSavingFlags.bVelocity));
+	_snapshot.partAnglVels.resize(Size(nPart, m_selectiveSavingFlags.bAngVelocity));
+	_snapshot.partForces.resize(Size(nPart, m_selectiveSavingFlags.bForce));
+	_snapshot.partQuaternions.resize(particles.QuaternionExist() ? Size(nPart, m_selectiveSavingFlags.bQuaternion) : 0);
+	_snapshot.partTensors.resize(Size(nPart, m_selectiveSavingFlags.bTensor));
+	_snapshot.partTemperatures.resize(particles.ThermalsExist() ? Size(nPart, m_selectiveSavingFlags.bTemperature) : 0);
+	ParallelFor(nPart, [&](size_t i)
+	{
+		_snapshot.partIndices[i] = particles.InitIndex(i);
+		_snapshot.partActive[i] = particles.Active(i);
+		_snapshot.partEndActivity[i] = particles.EndActivity(i);
+		if (!_snapshot.partCoords.empty())       _snapshot.partCoords[i]       = m_scene.GetObjectCoord(i);
+		if (!_snapshot.partVels.empty())         _snapshot.partVels[i]         = m_scene.GetObjectVel(i);
+		if (!_snapshot.partAnglVels.empty())     _snapshot.partAnglVels[i]     = m_scene.GetObjectAnglVel(i);
+		if (!_snapshot.partForces.empty())       _snapshot.partForces[i]       = particles.Force(i);
+		if (!_snapshot.partQuaternions.empty())  _snapshot.partQuaternions[i]  = particles.Quaternion(i);
+		if (!_snapshot.partTensors.empty())      _snapshot.partTensors[i]      = m_additionalSavingData[i].stressTensor;
+		if (!_snapshot.partTemperatures.empty()) _snapshot.partTemperatures[i] = particles.Temperature(i);
+	});
+
+	// solid bonds
+	const SSolidBondStruct& solidBonds = m_scene.GetRefToSolidBonds();
+	const size_t nSBonds = m_scene.GetBondsNumber();
+	_snapshot.sbIndices.resize(nSBonds);
+	_snapshot.sbActive.resize(nSBonds);
+	_snapshot.sbEndActivity.resize(nSBonds);
+	_snapshot.sbForces.resize(Size(nSBonds, m_selectiveSavingFlags.bSBForce));
+	_snapshot.sbTangOverlaps.resize(Size(nSBonds, m_selectiveSavingFlags.bSBTangOverlap));
+	_snapshot.sbTotTorques.resize(Size(nSBonds, m_selectiveSavingFlags.bSBTotTorque));
+	ParallelFor(nSBonds, [&](size_t i)
+	{
+		_snapshot.sbIndices[i] = solidBonds.InitIndex(i);
+		_snapshot.sbActive[i] = solidBonds.Active(i);
+		_snapshot.sbEndActivity[i] = solidBonds.EndActivity(i);
+		if (!_snapshot.sbForces.empty())       _snapshot.sbForces[i]       = solidBonds.TotalForce(i);
+		if (!_snapshot.sbTangOverlaps.empty()) _snapshot.sbTangOverlaps[i] = solidBonds.TangentialOverlap(i);
+		if (!_snapshot.sbTotTorques.empty())   _snapshot.sbTotTorques[i]   = Length(solidBonds.NormalMoment(i) + solidBonds.TangentialMoment(i));
+	});
+
+	// liquid bonds
+	const SLiquidBondStruct& liquidBonds = m_scene.GetRefToLiquidBonds();
+	const size_t nLBonds = m_scene.GetLiquidBondsNumber();
+	_snapshot.lbIndices.resize(nLBonds);
+	_snapshot.lbActive.resize(nLBonds);
+	_snapshot.lbEndActivity.resize(nLBonds);
+	_snapshot.lbForces.resize(Size(nLBonds, m_selectiveSavingFlags.bLBForce));
+	ParallelFor(nLBonds, [&](size_t i)
+	{
+		_snapshot.lbIndices[i] = liquidBonds.InitIndex(i);
+		_snapshot.lbActive[i] = liquidBonds.Active(i);
+		_snapshot.lbEndActivity[i] = liquidBonds.EndActivity(i);
+		if (!_snapshot.lbForces.empty()) _snapshot.lbForces[i] = liquidBonds.NormalForce(i) + liquidBonds.TangentialForce(i);
+	});
+
+	// walls
+	const SWallStruct& walls = m_scene.GetRefToWalls();
+	const size_t nWalls = walls.Size();
+	_snapshot.wallIndices.resize(nWalls);
+	_snapshot.wallVerts.resize(3 * Size(nWalls, m_selectiveSavingFlags.bTWPlaneCoord));
+	_snapshot.wallForces.resize(Size(nWalls, m_selectiveSavingFlags.bTWForce));
+	_snapshot.wallVels.resize(Size(nWalls, m_selectiveSavingFlags.bTWVelocity));
+	ParallelFor(nWalls, [&](size_t i)
+	{
+		_snapshot.wallIndices[i] = walls.InitIndex(i);
+		if (!_snapshot.wallVerts.empty())
+		{
+			_snapshot.wallVerts[3 * i + 0] = walls.Vert1(i);
+			_snapshot.wallVerts[3 * i + 1] = walls.Vert2(i);
+			_snapshot.wallVerts[3 * i + 2] = walls.Vert3(i);
+		}
+		if (!_snapshot.wallForces.empty()) _snapshot.wallForces[i] = walls.Force(i);
+		if (!_snapshot.wallVels.empty())   _snapshot.wallVels[i]   = walls.Vel(i);
+	});
+}
+
+void CBaseSimulator::WriteResultsSnapshot(const SResultsSnapshot& _snapshot, bool _parallel)
+{
+	// the background writer does not use the thread pool, which is busy with the simulation
+	const auto Loop = [&](size_t _count, const auto& _function)
+	{
+		if (_parallel)
+			ParallelFor(_count, _function);
+		else
+			for (size_t i = 0; i < _count; ++i)
+				_function(i);
+	};
+
+	const double time = _snapshot.time;
+	m_pSystemStructure->PrepareTimePointForWrite(time);
 
 	// save particles properties
-	SParticleStruct& particles = m_scene.GetRefToParticles();
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
+	Loop(_snapshot.partIndices.size(), [&](size_t i)
 	{
-		CPhysicalObject* pPart = m_pSystemStructure->GetObjectByIndex(particles.InitIndex(i));
-		if (!particles.Active(i) && !pPart->IsActive(m_currentTime)) return;
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bCoordinates) pPart->SetCoordinates(m_scene.GetObjectCoord(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bVelocity)    pPart->SetVelocity(m_scene.GetObjectVel(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bAngVelocity) pPart->SetAngleVelocity(m_scene.GetObjectAnglVel(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bForce)       pPart->SetForce(particles.Force(i));
-		if ((!m_selectiveSaving || m_selectiveSavingFlags.bQuaternion) && particles.QuaternionExist()) pPart->SetOrientation(particles.Quaternion(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bTensor)      pPart->SetStressTensor(m_additionalSavingData[i].stressTensor);
-		if ((!m_selectiveSaving || m_selectiveSavingFlags.bTemperature) && particles.ThermalsExist()) pPart->SetTemperature(particles.Temperature(i));
-
-		pPart->SetObjectActivity(particles.Active(i) ? m_currentTime : particles.EndActivity(i), particles.Active(i));
+		CPhysicalObject* pPart = m_pSystemStructure->GetObjectByIndex(_snapshot.partIndices[i]);
+		if (!_snapshot.partActive[i] && !pPart->IsActive(time)) return;
+		if (!_snapshot.partCoords.empty())       pPart->SetCoordinates(_snapshot.partCoords[i]);
+		if (!_snapshot.partVels.empty())         pPart->SetVelocity(_snapshot.partVels[i]);
+		if (!_snapshot.partAnglVels.empty())     pPart->SetAngleVelocity(_snapshot.partAnglVels[i]);
+		if (!_snapshot.partForces.empty())       pPart->SetForce(_snapshot.partForces[i]);
+		if (!_snapshot.partQuaternions.empty())  pPart->SetOrientation(_snapshot.partQuaternions[i]);
+		if (!_snapshot.partTensors.empty())      pPart->SetStressTensor(_snapshot.partTensors[i]);
+		if (!_snapshot.partTemperatures.empty()) pPart->SetTemperature(_snapshot.partTemperatures[i]);
+		pPart->SetObjectActivity(_snapshot.partActive[i] ? time : _snapshot.partEndActivity[i], _snapshot.partActive[i]);
 	});
 
 	// save solid bonds properties
-	SSolidBondStruct& solidBonds = m_scene.GetRefToSolidBonds();
-	ParallelFor(m_scene.GetBondsNumber(), [&](size_t i)
+	Loop(_snapshot.sbIndices.size(), [&](size_t i)
 	{
-		auto* pSBond = dynamic_cast<CSolidBond*>(m_pSystemStructure->GetObjectByIndex(solidBonds.InitIndex(i)));
-		if (!solidBonds.Active(i) && !pSBond->IsActive(m_currentTime)) return;
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bSBForce)       pSBond->SetForce(solidBonds.TotalForce(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bSBTangOverlap) pSBond->SetTangentialOverlap(solidBonds.TangentialOverlap(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bSBTotTorque)   pSBond->SetTotalTorque(Length(solidBonds.NormalMoment(i) + solidBonds.TangentialMoment(i)));
-		pSBond->SetObjectActivity(solidBonds.Active(i) ? m_currentTime : solidBonds.EndActivity(i), solidBonds.Active(i));
+		auto* pSBond = dynamic_cast<CSolidBond*>(m_pSystemStructure->GetObjectByIndex(_snapshot.sbIndices[i]));
+		if (!_snapshot.sbActive[i] && !pSBond->IsActive(time)) return;
+		if (!_snapshot.sbForces.empty())       pSBond->SetForce(_snapshot.sbForces[i]);
+		if (!_snapshot.sbTangOverlaps.empty()) pSBond->SetTangentialOverlap(_snapshot.sbTangOverlaps[i]);
+		if (!_snapshot.sbTotTorques.empty())   pSBond->SetTotalTorque(_snapshot.sbTotTorques[i]);
+		pSBond->SetObjectActivity(_snapshot.sbActive[i] ? time : _snapshot.sbEndActivity[i], _snapshot.sbActive[i]);
 	});
 
 	// save liquid bonds properties
-	SLiquidBondStruct& liqbond = m_scene.GetRefToLiquidBonds();
-	ParallelFor(m_scene.GetLiquidBondsNumber(), [&](size_t i)
+	Loop(_snapshot.lbIndices.size(), [&](size_t i)
 	{
-		CPhysicalObject* pLBond = m_pSystemStructure->GetObjectByIndex(liqbond.InitIndex(i));
-		if (!liqbond.Active(i) && !pLBond->IsActive(m_currentTime)) return;
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bLBForce) pLBond->SetForce(liqbond.NormalForce(i) + liqbond.TangentialForce(i));
-		pLBond->SetObjectActivity(liqbond.Active(i) ? m_currentTime : liqbond.EndActivity(i), liqbond.Active(i));
+		CPhysicalObject* pLBond = m_pSystemStructure->GetObjectByIndex(_snapshot.lbIndices[i]);
+		if (!_snapshot.lbActive[i] && !pLBond->IsActive(time)) return;
+		if (!_snapshot.lbForces.empty()) pLBond->SetForce(_snapshot.lbForces[i]);
+		pLBond->SetObjectActivity(_snapshot.lbActive[i] ? time : _snapshot.lbEndActivity[i], _snapshot.lbActive[i]);
 	});
 
 	// save wall properties
-	SWallStruct& walls = m_scene.GetRefToWalls();
-	ParallelFor(walls.Size(), [&](size_t i)
+	Loop(_snapshot.wallIndices.size(), [&](size_t i)
 	{
-		auto* pWall = dynamic_cast<CTriangularWall*>(m_pSystemStructure->GetObjectByIndex(walls.InitIndex(i)));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bTWPlaneCoord) pWall->SetPlaneCoord(walls.Vert1(i), walls.Vert2(i), walls.Vert3(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bTWForce)      pWall->SetForce(walls.Force(i));
-		if (!m_selectiveSaving || m_selectiveSavingFlags.bTWVelocity)   pWall->SetVelocity(walls.Vel(i));
+		auto* pWall = dynamic_cast<CTriangularWall*>(m_pSystemStructure->GetObjectByIndex(_snapshot.wallIndices[i]));
+		if (!_snapshot.wallVerts.empty())  pWall->SetPlaneCoord(_snapshot.wallVerts[3 * i + 0], _snapshot.wallVerts[3 * i + 1], _snapshot.wallVerts[3 * i + 2]);
+		if (!_snapshot.wallForces.empty()) pWall->SetForce(_snapshot.wallForces[i]);
+		if (!_snapshot.wallVels.empty())   pWall->SetVelocity(_snapshot.wallVels[i]);
 	});
-
-	for (const auto& function : m_additionalSavingSteps)
-		function();
 }
 
 void CBaseSimulator::PrintStatus() const
@@ -508,7 +662,7 @@ void CBaseSimulator::SetStopValues(const SStopValues& _values)
 void CBaseSimulator::Initialize()
 {
 	// time parameters
-	m_currentTime = 0;
+	m_currentTime = m_startTime;
 	m_lastSavingTime = m_currentTime;
 	m_isPredictionStep = true;
 	m_currSimulationStep = m_initSimulationStep;
@@ -593,11 +747,20 @@ void CBaseSimulator::Simulate()
 
 	if (m_status == ERunningStatus::IDLE)
 		Initialize();
+	// initialization may fail, e.g. if the simulation cannot be restarted from a checkpoint
+	if (m_status == ERunningStatus::TO_BE_STOPPED)
+	{
+		m_status = ERunningStatus::IDLE;
+		return;
+	}
 
 	// start simulation
 	m_status = ERunningStatus::RUNNING;
 	StartSimulation();
 
+	// system structure may be accessed during the pause
+	WaitForSavedResults();
+
 	// performance measurement
 	if (m_status == ERunningStatus::TO_BE_PAUSED)
 		m_chronoPauseStart = std::chrono::system_clock::now();
@@ -619,6 +782,9 @@ void CBaseSimulator::StartSimulation()
 {
 	while (m_status != ERunningStatus::TO_BE_STOPPED && m_status != ERunningStatus::TO_BE_PAUSED)
 	{
+		// all parallel loops of the step are executed by threads waiting on a barrier, instead of waking them up for each loop
+		CParallelRegion region{ m_persistentParallelRegion };
+
 		PreCalculationStep();
 		UpdateCollisionsStep(m_currSimulationStep);
 		CalculateForcesStep(m_currSimulationStep);
@@ -644,6 +810,7 @@ void CBaseSimulator::FinalizeSimulation()
 {
 	if (!g_extSignal)	// if stopped by signal, only close file properly; do not save current time point, as this does not coincide with savings step
 		SaveData();
+	m_resultsWriter.Stop();
 	m_pSystemStructure->SaveToFile();
 }
 
@@ -698,6 +865,8 @@ void CBaseSimulator::CopySimulatorData(const CBaseSimulator& _other)
 	SetPartMoveLimit(_other.m_partMoveLimit);
 	SetTimeStepFactor(_other.m_timeStepFactor);
 	SetPartVelocityLimit(_other.m_partVelocityLimit);
+	SetPersistentParallelRegion(_other.m_persistentParallelRegion);
+	SetAsyncSaving(_other.m_asyncSaving);
 
 	m_inactiveParticles = _other.m_inactiveParticles;
 	m_inactiveBonds = _other.m_inactiveBonds;
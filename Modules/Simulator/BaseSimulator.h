@@ -6,6 +6,7 @@
 
 #include "GenerationManager.h"
 #include "ModelManager.h"
+#include "ResultsWriter.h"
 #include "VerletList.h"
 #include <chrono>
 #include <csignal>
@@ -13,6 +14,7 @@
 #include <optional>
 
 inline volatile sig_atomic_t g_extSignal{ 0 };	// Value of external signal for premature termination in internal loops.
+inline volatile sig_atomic_t g_checkpointSignal{ 0 };	// Is set by external signal to write a checkpoint without stopping the simulation.
 
 class CBaseSimulator : public CMusenComponent
 {
@@ -38,6 +40,7 @@ protected:
 		void AddStress(const CVector3& _contVector, const CVector3& _force, double _volume);
 	};
 
+	double m_startTime{ 0.0 };								// Time point to start the simulation from; differs from zero only when restarting from a checkpoint.
 	double m_currentTime{ 0.0 };							// Current time where simulator is situated.
 	double m_endTime{ DEFAULT_END_TIME };					// Last time point which must be simulated.
 	double m_initSimulationStep{ DEFAULT_SIMULATION_STEP }; // Initial simulation time step.
@@ -65,6 +68,8 @@ protected:
 	double m_partMoveLimit{ 1e-8 };									// Max movement of particles over a single time step; is used to calculate flexible time step.
 	double m_timeStepFactor{ 1.01 };								// Factor used to increase current simulation time step if flexible time step is used.
 	std::optional<double> m_partVelocityLimit{};					// Maximal allowed velocity of particles.
+	bool m_persistentParallelRegion{ false };						// Keep worker threads in one parallel region for the whole simulation step instead of submitting each parallel loop to the thread pool.
+	bool m_asyncSaving{ false };									// Write results into the system structure in a background thread, while the simulation continues.
 
 	CGenerationManager* m_generationManager{ nullptr };
 	CSimplifiedScene m_scene;				// simplified scene
@@ -80,6 +85,7 @@ protected:
 	std::vector<SAdditionalSavingData> m_additionalSavingData;
 	SOptionalVariables m_optionalSceneVars;
 	std::vector<SGeneratedObject> m_generatedObjectsDiff;		// Objects generated since last save in simplified scene, but not yet added to system structure.
+	CResultsWriter m_resultsWriter;								// Background writer of results for asynchronous saving.
 
 	// For performance analysis in console
 	std::chrono::system_clock::time_point m_chronoSimStart;
@@ -152,6 +158,10 @@ public:
 	virtual void SetTimeStepFactor(double _factor);
 	[[nodiscard]] std::optional<double> GetPartVelocityLimit() const;
 	virtual void SetPartVelocityLimit(const std::optional<double>& _velocity);
+	bool GetPersistentParallelRegion() const;
+	void SetPersistentParallelRegion(bool _flag);
+	bool GetAsyncSaving() const;
+	void SetAsyncSaving(bool _flag);
 
 	// selective saving
 	bool IsSelectiveSavingEnabled() const;
@@ -212,12 +222,14 @@ protected:
 	virtual void GenerateNewObjects() {}	// Generates new objects if necessary, returns number of generated objects.
 	virtual void UpdatePBC() {}				// Updates moving PBC.
 	void p_SaveData();						// Saves current state of simplified scene into system structure.
+	void WaitForSavedResults();				// Blocks until all results are written into system structure by the background writer; must be called before accessing system structure.
 	void PrintStatus() const;				// Prints the current simulation status into console.
 
 	bool AdditionalStopCriterionMet(); // Checks whether any additional stop criterion is met.
+	void AddGeneratedObjectsToSystemStructure();
 
 private:
 	void CopySimulatorData(const CBaseSimulator& _other); // Copies content of the given simulator.
-
-	void AddGeneratedObjectsToSystemStructure();
+	void TakeResultsSnapshot(SResultsSnapshot& _snapshot);	// Copies all data, which must be saved, from simplified scene into the snapshot.
+	void WriteResultsSnapshot(const SResultsSnapshot& _snapshot, bool _parallel);	// Writes the snapshot into system structure, in parallel or in the calling thread only.
 };
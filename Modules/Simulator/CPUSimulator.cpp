@@ -3,6 +3,71 @@
    See LICENSE file for license and warranty information. */
 
 #include "CPUSimulator.h"
+#include "BinaryStream.h"
+#include "MUSENfilesystem.h"
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	constexpr char CHECKPOINT_SIGNATURE[8]{ 'M', 'U', 'S', 'E', 'N', 'C', 'H', 'K' };
+	constexpr uint32_t CHECKPOINT_VERSION = 4;
+	constexpr double PBC_BAND_TRAVEL_FACTOR = 2;	// the boundary band is wider than the travel bound of the last interval between updates of verlet lists by this factor
+
+	// Header of a checkpoint file. Checkpoints contain memory representation of data, so they can be read only by the same build.
+	struct SCheckpointHeader
+	{
+		char signature[8]{};
+		uint32_t version{ 0 };
+		uint32_t collisionSize{ 0 };	// Size of a contact, which differs between builds.
+		uint64_t geometries{ 0 };		// Number of geometries in the scene.
+		uint64_t walls{ 0 };			// Number of walls in the scene.
+		uint64_t models{ 0 };			// Number of active models.
+		double time{ 0 };				// Time point of the checkpoint.
+	};
+
+	// Reads the header of the checkpoint and checks that the checkpoint has been written by the same build. Returns false on error.
+	bool ReadCheckpointHeader(std::istream& _s, SCheckpointHeader& _header)
+	{
+		try
+		{
+			ReadBinary(_s, _header);
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+		return std::memcmp(_header.signature, CHECKPOINT_SIGNATURE, sizeof(CHECKPOINT_SIGNATURE)) == 0
+			&& _header.version == CHECKPOINT_VERSION && _header.collisionSize == sizeof(SCollision);
+	}
+
+	// Checks that the checkpoint ends with the signature, i.e. that it has been completely written.
+	bool IsCheckpointComplete(std::istream& _s)
+	{
+		char signature[sizeof(CHECKPOINT_SIGNATURE)];
+		_s.seekg(-static_cast<std::streamoff>(sizeof(signature)), std::ios::end);
+		return _s.read(signature, sizeof(signature)) && std::memcmp(signature, CHECKPOINT_SIGNATURE, sizeof(signature)) == 0;
+	}
+
+	// Calls the function for each variable of the geometry frame, so that all variables are written and read in the same order.
+	template<typename TFrame, typename TFunction>
+	void ForEachFrameVariable(TFrame& _frame, TFunction _function)
+	{
+		_function(_frame.walls);
+		_function(_frame.bodyVerts);
+		_function(_frame.bodyNormals);
+		_function(_frame.contactWalls);
+		_function(_frame.rotation);
+		_function(_frame.translation);
+		_function(_frame.vel);
+		_function(_frame.rotVel);
+		_function(_frame.rotCenter);
+		_function(_frame.bodyCentroid);
+		_function(_frame.boundCenter);
+		_function(_frame.boundRadius);
+		_function(_frame.outdated);
+	}
+}
 
 CCPUSimulator::CCPUSimulator(const CBaseSimulator& _other) :
 	CBaseSimulator{ _other }
@@ -29,8 +94,200 @@ bool CCPUSimulator::IsCollisionsAnalysisEnabled() const
 	return m_analyzeCollisions;
 }
 
+void CCPUSimulator::SetForceReduction(EForceReduction _reduction)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_forceReduction = _reduction;
+}
+
+CCPUSimulator::EForceReduction CCPUSimulator::GetForceReduction() const
+{
+	return m_forceReduction;
+}
+
+void CCPUSimulator::SetReorderInterval(size_t _interval)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_reorderInterval = _interval;
+}
+
+size_t CCPUSimulator::GetReorderInterval() const
+{
+	return m_reorderInterval;
+}
+
+void CCPUSimulator::SetIncrementalVerletUpdate(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetIncrementalUpdate(_enable);
+}
+
+bool CCPUSimulator::GetIncrementalVerletUpdate() const
+{
+	return m_verletList.GetIncrementalUpdate();
+}
+
+void CCPUSimulator::SetFlatVerletGrid(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetFlatGrid(_enable);
+}
+
+bool CCPUSimulator::GetFlatVerletGrid() const
+{
+	return m_verletList.GetFlatGrid();
+}
+
+void CCPUSimulator::SetVerletBroadPhase(CVerletList::EBroadPhase _broadPhase)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetBroadPhase(_broadPhase);
+}
+
+CVerletList::EBroadPhase CCPUSimulator::GetVerletBroadPhase() const
+{
+	return m_verletList.GetBroadPhase();
+}
+
+void CCPUSimulator::SetWallBVH(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetWallBVH(_enable);
+}
+
+bool CCPUSimulator::GetWallBVH() const
+{
+	return m_verletList.GetWallBVH();
+}
+
+void CCPUSimulator::SetSizeClassVerlet(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetSizeClassSkin(_enable);
+}
+
+bool CCPUSimulator::GetSizeClassVerlet() const
+{
+	return m_verletList.GetSizeClassSkin();
+}
+
+void CCPUSimulator::SetVerletCostModel(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetCostModel(_enable);
+}
+
+bool CCPUSimulator::GetVerletCostModel() const
+{
+	return m_verletList.GetCostModel();
+}
+
+void CCPUSimulator::SetImplicitPBC(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_verletList.SetImplicitPBC(_enable);
+}
+
+bool CCPUSimulator::GetImplicitPBC() const
+{
+	return m_verletList.GetImplicitPBC();
+}
+
+void CCPUSimulator::SetGeometryFrames(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	if (_enable == m_geometryFrames) return;
+	m_geometryFrames = _enable;
+	if (m_status != ERunningStatus::PAUSED) return;
+	// switch the running simulation
+	if (m_geometryFrames)
+		InitializeGeometryFrames();
+	else
+	{
+		SynchronizeGeometryWalls();
+		m_frames.clear();
+	}
+}
+
+bool CCPUSimulator::GetGeometryFrames() const
+{
+	return m_geometryFrames;
+}
+
+void CCPUSimulator::SetNUMAPlacement(bool _enable)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_numaPlacement = _enable;
+}
+
+bool CCPUSimulator::GetNUMAPlacement() const
+{
+	return m_numaPlacement;
+}
+
+void CCPUSimulator::SetCheckpointFile(const std::string& _file)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_checkpointFile = _file;
+}
+
+std::string CCPUSimulator::GetCheckpointFile() const
+{
+	return m_checkpointFile;
+}
+
+void CCPUSimulator::SetCheckpointInterval(double _interval)
+{
+	if (m_status != ERunningStatus::IDLE && m_status != ERunningStatus::PAUSED) return;
+	m_checkpointInterval = std::max(_interval, 0.0);
+}
+
+double CCPUSimulator::GetCheckpointInterval() const
+{
+	return m_checkpointInterval;
+}
+
+void CCPUSimulator::SetRestartFile(const std::string& _file)
+{
+	if (m_status != ERunningStatus::IDLE) return;
+	m_restartFile = _file;
+}
+
+std::string CCPUSimulator::GetRestartFile() const
+{
+	return m_restartFile;
+}
+
+double CCPUSimulator::GetRestartTime() const
+{
+	if (m_restartFile.empty()) return 0;
+	std::ifstream file{ UnicodePath(m_restartFile), std::ios::binary };
+	SCheckpointHeader header;
+	if (!ReadCheckpointHeader(file, header)) return 0;
+	return header.time;
+}
+
+std::string CCPUSimulator::IsRestartCorrect() const
+{
+	if (m_restartFile.empty()) return {};
+	if (m_analyzeCollisions)
+		return "Restart from a checkpoint is not supported together with analysis of collisions";
+	std::ifstream file{ UnicodePath(m_restartFile), std::ios::binary };
+	if (!file)
+		return "Cannot open checkpoint " + m_restartFile;
+	SCheckpointHeader header;
+	if (!ReadCheckpointHeader(file, header))
+		return "Checkpoint " + m_restartFile + " is damaged or has been written by another version of the program";
+	if (!IsCheckpointComplete(file))
+		return "Checkpoint " + m_restartFile + " has not been completely written";
+	if (m_pSystemStructure && header.geometries != m_pSystemStructure->GeometriesNumber())
+		return "Checkpoint " + m_restartFile + " does not match the simulated scene";
+	return {};
+}
+
 void CCPUSimulator::Initialize()
 {
+	m_startTime = GetRestartTime();
 	CBaseSimulator::Initialize();
 
 	// delete collisions data
@@ -41,6 +298,27 @@ void CCPUSimulator::Initialize()
 
 	// store particle coordinates
 	m_scene.SaveVerletCoords();
+
+	m_contactForcesTime = 0;
+	m_verletUpdatesNumber = 0;
+	m_pbcSteps = m_pbcCheckedParticles = m_pbcFullChecks = 0;
+
+	if (m_geometryFrames)
+		InitializeGeometryFrames();
+	else
+		m_frames.clear();
+
+	if (m_numaPlacement)
+		PlaceParticlesOnNodes();
+
+	// restore contacts, verlet lists and states of models, which cannot be obtained from the system structure
+	m_lastCheckpointTime = m_currentTime;
+	// the state may be partially overwritten by a failed restart, so the simulation cannot continue
+	if (!m_restartFile.empty() && !LoadCheckpoint(m_restartFile))
+	{
+		*p_out << "Error: Simulation cannot be restarted from checkpoint " << m_restartFile << " and is stopped" << std::endl;
+		m_status = ERunningStatus::TO_BE_STOPPED;
+	}
 }
 
 void CCPUSimulator::InitializeModels()
@@ -62,10 +340,31 @@ void CCPUSimulator::FinalizeSimulation()
 
 	if (m_analyzeCollisions)
 		m_collisionsCalculator.SaveRestCollisions();
+
+	if (m_numaPlacement)
+		PrintNUMAInfo();
+	if (m_verletList.GetSizeClassSkin())
+		PrintSizeClassesInfo();
+	if (m_autoAdjustVerletDistance && m_verletList.GetCostModel())
+		PrintVerletDistanceDecisions();
+	if (m_scene.m_PBC.bEnabled)
+		PrintPBCBandInfo();
+	*p_out << "Time of contact forces calculation [s]: " << m_contactForcesTime << " (" << (m_forceReduction == EForceReduction::BUCKETS ? "buckets" : "thread buffers") << ")" << std::endl;
+	if (m_analyzeCollisions)
+	{
+		*p_out << "Memory of contacts [MB]: " << m_collisionsCalculator.GetMemoryUsage() / (1024. * 1024.) << std::endl;
+		const SObjectPoolStatistics collStat = CCollisionsPool::GetStatistics();
+		*p_out << "Finished contacts created / released: " << collStat.allocations << " / " << collStat.deallocations << ", reserved memory [MB]: " << collStat.bytes / (1024. * 1024.) << std::endl;
+		const SObjectPoolStatistics saveStat = CSavedCollisionsPool::GetStatistics();
+		*p_out << "Saved contacts created / released: " << saveStat.allocations << " / " << saveStat.deallocations << ", reserved memory [MB]: " << saveStat.bytes / (1024. * 1024.) << std::endl;
+	}
 }
 
 void CCPUSimulator::PreCalculationStep()
 {
+	// written before the step, so that the restarted simulation repeats it completely
+	WriteRequestedCheckpoint();
+
 	CBaseSimulator::PreCalculationStep();
 
 	if (m_analyzeCollisions)
@@ -81,15 +380,22 @@ void CCPUSimulator::UpdateCollisionsStep(double _dTimeStep)
 	if (!m_PPModels.empty() || !m_PWModels.empty())
 	{
 		UpdateVerletLists(_dTimeStep); // between PP and PW
+		// checking of possible contacts is the part of a time step, which depends on verlet distance, so its duration is used by the cost model
+		const auto start = std::chrono::steady_clock::now();
 		m_collisionsCalculator.UpdateCollisionMatrixes(_dTimeStep, m_currentTime);
+		if (m_verletList.GetCostModel())
+			m_verletList.AddStepDuration(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
 	}
 }
 
 void CCPUSimulator::CalculateForcesStep(double _dTimeStep)
 {
 	if (!m_EFModels.empty()) CalculateForcesEF(_dTimeStep);
+	// measured on every run to compare strategies of force reduction under the same conditions
+	const auto start = std::chrono::steady_clock::now();
 	if (!m_PPModels.empty()) CalculateForcesPP(_dTimeStep);
 	if (!m_PWModels.empty()) CalculateForcesPW(_dTimeStep);
+	m_contactForcesTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 	if (!m_SBModels.empty()) CalculateForcesSB(_dTimeStep);
 	if (!m_LBModels.empty()) CalculateForcesLB(_dTimeStep);
 	m_collisionsCalculator.CalculateTotalStatisticsInfo();
@@ -98,25 +404,39 @@ void CCPUSimulator::CalculateForcesStep(double _dTimeStep)
 void CCPUSimulator::CalculateForcesPP(double _timeStep)
 {
 	SParticleStruct& particles = m_scene.GetRefToParticles();
+	if (m_forceReduction == EForceReduction::THREAD_BUFFERS)
+		PrepareThreadBuffers(false);
 
 	for (auto* model : m_PPModels)
 	{
 		model->Precalculate(m_currentTime, _timeStep);
 
+		// all collisions of one particle are calculated by one thread to consolidate forces without races
+		auto& collisions = m_collisionsCalculator.m_collMatrixPP;
+
+		if (m_forceReduction == EForceReduction::THREAD_BUFFERS)
+		{
+			// destination particles are consolidated into buffers of the thread, which are summed up after all models
+			ParallelFor(collisions.Rows(), [&](size_t i) { return collisions.Size(i); }, [&](size_t iThread, size_t i)
+			{
+				const auto row = collisions.Row(i);
+				model->CalculateBatch(m_currentTime, _timeStep, particles, row.begin(), row.size());
+				for (const auto& coll : row)
+					model->ConsolidateDst(m_currentTime, _timeStep, m_threadParticles[iThread], &coll);
+			});
+			continue;
+		}
+
 		for (auto& collisions : m_tempCollPPArray)
 			for (auto& coll : collisions)
 				coll.clear();
 
-		ParallelFor(m_collisionsCalculator.m_vCollMatrixPP.size(), [&](size_t i)
+		ParallelFor(collisions.Rows(), [&](size_t i) { return collisions.Size(i); }, [&](size_t iThread, size_t i)
 		{
-			const size_t index = i % m_nThreads;
-			for (auto& coll : m_collisionsCalculator.m_vCollMatrixPP[i])
-			{
-				model->Calculate(m_currentTime, _timeStep, coll);
-				model->ConsolidateSrc(m_currentTime, _timeStep, particles, coll);
-
-				m_tempCollPPArray[index][coll->nDstID % m_nThreads].push_back(coll);
-			}
+			const auto row = collisions.Row(i);
+			model->CalculateBatch(m_currentTime, _timeStep, particles, row.begin(), row.size());
+			for (auto& coll : row)
+				m_tempCollPPArray[iThread][coll.nDstID % m_nThreads].push_back(&coll);
 		});
 
 		ParallelFor([&](size_t i)
@@ -126,31 +446,48 @@ void CCPUSimulator::CalculateForcesPP(double _timeStep)
 					model->ConsolidateDst(m_currentTime, _timeStep, particles, coll);
 		});
 	}
+
+	if (m_forceReduction == EForceReduction::THREAD_BUFFERS)
+		ReduceThreadBuffers(false);
 }
 
 void CCPUSimulator::CalculateForcesPW(double _timeStep)
 {
 	SParticleStruct& particles = m_scene.GetRefToParticles();
 	SWallStruct& walls = m_scene.GetRefToWalls();
+	if (m_forceReduction == EForceReduction::THREAD_BUFFERS)
+		PrepareThreadBuffers(true);
 
 	for (auto* model : m_PWModels)
 	{
 		model->Precalculate(m_currentTime, _timeStep);
 
+		// all collisions of one particle are calculated by one thread to consolidate forces without races
+		auto& collisions = m_collisionsCalculator.m_collMatrixPW;
+
+		if (m_forceReduction == EForceReduction::THREAD_BUFFERS)
+		{
+			// walls are consolidated into buffers of the thread, which are summed up after all models
+			ParallelFor(collisions.Rows(), [&](size_t i) { return collisions.Size(i); }, [&](size_t iThread, size_t i)
+			{
+				const auto row = collisions.Row(i);
+				model->CalculateBatch(m_currentTime, _timeStep, particles, row.begin(), row.size());
+				for (const auto& coll : row)
+					model->ConsolidateWall(m_currentTime, _timeStep, m_threadWalls[iThread], &coll);
+			});
+			continue;
+		}
+
 		for (auto& collisions : m_tempCollPWArray)
 			for (auto& coll : collisions)
 				coll.clear();
 
-		ParallelFor(m_collisionsCalculator.m_vCollMatrixPW.size(), [&](size_t i)
+		ParallelFor(collisions.Rows(), [&](size_t i) { return collisions.Size(i); }, [&](size_t iThread, size_t i)
 		{
-			const size_t index = i % m_nThreads;
-			for (auto& coll : m_collisionsCalculator.m_vCollMatrixPW[i])
-			{
-				model->Calculate(m_currentTime, _timeStep, coll);
-				model->ConsolidatePart(m_currentTime, _timeStep, particles, coll);
-
-				m_tempCollPWArray[index][coll->nSrcID % m_nThreads].push_back(coll);
-			}
+			const auto row = collisions.Row(i);
+			model->CalculateBatch(m_currentTime, _timeStep, particles, row.begin(), row.size());
+			for (auto& coll : row)
+				m_tempCollPWArray[iThread][coll.nSrcID % m_nThreads].push_back(&coll);
 		});
 
 		ParallelFor([&](size_t i)
@@ -160,6 +497,66 @@ void CCPUSimulator::CalculateForcesPW(double _timeStep)
 					model->ConsolidateWall(m_currentTime, _timeStep, walls, coll);
 		});
 	}
+
+	if (m_forceReduction == EForceReduction::THREAD_BUFFERS)
+		ReduceThreadBuffers(true);
+}
+
+void CCPUSimulator::PrepareThreadBuffers(bool _walls)
+{
+	if (!_walls)
+	{
+		const SParticleStruct& particles = m_scene.GetRefToParticles();
+		for (auto& buffer : m_threadParticles)
+			if (buffer.Size() != particles.Size() || buffer.ThermalsExist() != particles.ThermalsExist())
+				buffer.ResetAccumulators(particles.Size(), particles.ThermalsExist());
+	}
+	else
+	{
+		const size_t wallsNumber = m_scene.GetRefToWalls().Size();
+		for (auto& buffer : m_threadWalls)
+			if (buffer.Size() != wallsNumber)
+			{
+				buffer.Resize(wallsNumber);
+				for (size_t i = 0; i < wallsNumber; ++i)
+					buffer.Force(i).Init(0);
+			}
+	}
+}
+
+void CCPUSimulator::ReduceThreadBuffers(bool _walls)
+{
+	if (!_walls)
+	{
+		SParticleStruct& particles = m_scene.GetRefToParticles();
+		const bool thermals = particles.ThermalsExist();
+		// each thread sums up buffers of all threads for its own range of particles
+		ParallelFor(particles.Size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+		{
+			for (auto& buffer : m_threadParticles)
+			{
+				particles.Force(i) += buffer.Force(i);
+				particles.Moment(i) += buffer.Moment(i);
+				buffer.Force(i).Init(0);
+				buffer.Moment(i).Init(0);
+				if (thermals)
+				{
+					particles.HeatFlux(i) += buffer.HeatFlux(i);
+					buffer.HeatFlux(i) = 0;
+				}
+			}
+		});
+	}
+	else
+	{
+		SWallStruct& walls = m_scene.GetRefToWalls();
+		for (auto& buffer : m_threadWalls)
+			for (size_t i = 0; i < walls.Size(); ++i)
+			{
+				walls.Force(i) += buffer.Force(i);
+				buffer.Force(i).Init(0);
+			}
+	}
 }
 
 void CCPUSimulator::CalculateForcesSB(double _timeStep)
@@ -176,14 +573,14 @@ void CCPUSimulator::CalculateForcesSB(double _timeStep)
 
 		std::vector<unsigned> brokenBonds(m_nThreads, 0);
 
-		ParallelFor(m_scene.GetBondsNumber(), [&](size_t iBond)
+		ParallelFor(m_scene.GetBondsNumber(), EScheduling::CONTIGUOUS, [&](size_t iThread, size_t iBond)
 		{
 			if (bonds.Active(iBond))
-				model->Calculate(m_currentTime, _timeStep, iBond, bonds, &brokenBonds[iBond % m_nThreads]);
+				model->Calculate(m_currentTime, _timeStep, iBond, bonds, &brokenBonds[iThread]);
 		});
 		m_brokenBonds += VectorSum(brokenBonds);
 
-		ParallelFor(partToSolidBonds.size(), [&](size_t iPart)
+		ParallelFor(partToSolidBonds.size(), [&](size_t iPart) { return partToSolidBonds[iPart].size(); }, [&](size_t, size_t iPart)
 		{
 			for (size_t j = 0; j < partToSolidBonds[iPart].size(); ++j)
 			{
@@ -208,10 +605,10 @@ void CCPUSimulator::CalculateForcesLB(double _timeStep)
 
 		std::vector<unsigned> brokenBonds(m_nThreads, 0);
 
-		ParallelFor(m_scene.GetLiquidBondsNumber(), [&](size_t i)
+		ParallelFor(m_scene.GetLiquidBondsNumber(), EScheduling::CONTIGUOUS, [&](size_t iThread, size_t i)
 		{
 			if (bonds.Active(i))
-				model->Calculate(m_currentTime, _timeStep, i, bonds, &brokenBonds[i % m_nThreads]);
+				model->Calculate(m_currentTime, _timeStep, i, bonds, &brokenBonds[iThread]);
 		});
 		m_brokenBonds += VectorSum(brokenBonds);
 
@@ -229,7 +626,7 @@ void CCPUSimulator::CalculateForcesEF(double _timeStep)
 	{
 		model->Precalculate(m_currentTime, _timeStep);
 
-		ParallelFor(particles.Size(), [&](size_t iPart)
+		ParallelFor(particles.Size(), EScheduling::CONTIGUOUS, [&](size_t, size_t iPart)
 		{
 			if (particles.Active(iPart))
 				model->Calculate(m_currentTime, _timeStep, iPart, particles);
@@ -242,7 +639,7 @@ void CCPUSimulator::MoveParticles(bool _bPredictionStep)
 	SParticleStruct& particles = m_scene.GetRefToParticles();
 
 	// apply external acceleration
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
+	ParallelFor(m_scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
 		if (!particles.Active(i)) return;
 		particles.Force(i) += m_externalAcceleration * particles.Mass(i);
@@ -266,7 +663,8 @@ void CCPUSimulator::MoveParticles(bool _bPredictionStep)
 	const double dTimeStep = !_bPredictionStep ? m_currSimulationStep : m_currSimulationStep / 2.;
 
 	// move particles
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
+	std::vector<double> vMaxVel(GetThreadsNumber(), 0);	// maximum squared velocity of moved particles in each thread
+	ParallelFor(m_scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t iThread, size_t i)
 	{
 		if (!particles.Active(i)) return;
 
@@ -301,9 +699,19 @@ void CCPUSimulator::MoveParticles(bool _bPredictionStep)
 		else
 			particles.AnglVel(i) += particles.Moment(i) / particles.InertiaMoment(i) * dTimeStep;
 		if (!_bPredictionStep)
+		{
 			particles.Coord(i) += particles.Vel(i)*dTimeStep;
+			vMaxVel[iThread] = std::max(vMaxVel[iThread], particles.Vel(i).SquaredLength());
+		}
 	});
 
+	// particles may approach boundaries of the boundary band with their own velocity and the one of moving PBC
+	if (m_scene.m_PBC.bEnabled && !_bPredictionStep)
+	{
+		const CVector3& pbcVel = m_scene.m_PBC.vVel;
+		m_scene.AddPBCBandTravel((std::sqrt(VectorMax(vMaxVel)) + std::max({ std::fabs(pbcVel.x), std::fabs(pbcVel.y), std::fabs(pbcVel.z) })) * dTimeStep);
+	}
+
 	MoveParticlesOverPBC(); // move virtual particles and check boundaries
 }
 
@@ -321,11 +729,15 @@ void CCPUSimulator::MoveWalls(double _timeStep)
 			geom->Motion()->MotionType() == CGeometryMotion::EMotionType::CONSTANT_FORCE)
 		{
 			double totalForceZ = 0;
-			for (const auto& plane : planes)
-			{
-				const size_t iWall = m_scene.m_vNewIndexes[plane];
-				totalForceZ += walls.Force(iWall).z;
-			}
+			if (m_geometryFrames)	// only walls in verlet lists may have forces
+				for (const auto& j : m_frames[i].contactWalls)
+					totalForceZ += walls.Force(m_frames[i].walls[j]).z;
+			else
+				for (const auto& plane : planes)
+				{
+					const size_t iWall = m_scene.m_vNewIndexes[plane];
+					totalForceZ += walls.Force(iWall).z;
+				}
 			geom->UpdateMotionInfo(totalForceZ);
 		}
 		else
@@ -333,7 +745,9 @@ void CCPUSimulator::MoveWalls(double _timeStep)
 		CVector3 vel = geom->GetCurrentVelocity();
 		CVector3 rotVel = geom->GetCurrentRotVelocity();
 		CVector3 rotCenter;
-		if (geom->RotateAroundCenter())
+		if (geom->RotateAroundCenter() && m_geometryFrames)
+			rotCenter = m_frames[i].rotation * m_frames[i].bodyCentroid + m_frames[i].translation;
+		else if (geom->RotateAroundCenter())
 		{
 			double totalArea{ 0.0 };
 			CVector3 totalWeightedCentroid{ 0.0 };
@@ -369,12 +783,19 @@ void CCPUSimulator::MoveWalls(double _timeStep)
 			CVector3 totalForce = m_externalAcceleration * geom->Mass();
 			CVector3 totalAverVel(0);
 			// calculate total force acting on wall
-			for (const auto& plane : planes)
+			if (m_geometryFrames)
 			{
-				const size_t iWall = m_scene.m_vNewIndexes[plane];
-				totalForce += walls.Force(iWall);
-				totalAverVel += walls.Vel(iWall) / static_cast<double>(planes.size());
+				for (const auto& j : m_frames[i].contactWalls)
+					totalForce += walls.Force(m_frames[i].walls[j]);
+				totalAverVel = m_frames[i].vel;
 			}
+			else
+				for (const auto& plane : planes)
+				{
+					const size_t iWall = m_scene.m_vNewIndexes[plane];
+					totalForce += walls.Force(iWall);
+					totalAverVel += walls.Vel(iWall) / static_cast<double>(planes.size());
+				}
 			if (geom->FreeMotion().x)
 				vel.x = totalAverVel.x + _timeStep * totalForce.x / geom->Mass();
 			if (geom->FreeMotion().y)
@@ -389,7 +810,26 @@ void CCPUSimulator::MoveWalls(double _timeStep)
 		if (!rotVel.IsZero())
 			rotMatrix = CQuaternion(rotVel*_timeStep).ToRotmat();
 
-		ParallelFor(planes.size(), [&](size_t j)
+		if (m_geometryFrames)
+		{
+			// move the whole geometry at once and transform only walls, which may have contacts
+			SGeometryFrame& frame = m_frames[i];
+			frame.vel = vel;
+			frame.rotVel = rotVel;
+			frame.rotCenter = rotCenter;
+			// If the rotation is done around the calculated center, it is important to first rotate the geometry and only then move it.
+			if (!rotVel.IsZero())
+			{
+				frame.rotation = rotMatrix * frame.rotation;
+				frame.translation = rotCenter + rotMatrix * (frame.translation - rotCenter);
+			}
+			frame.translation += vel * _timeStep;
+			frame.outdated = true;
+			TransformGeometryWalls(frame, false);
+			continue;
+		}
+
+		ParallelFor(planes.size(), EScheduling::CONTIGUOUS, [&](size_t, size_t j)
 		{
 			const size_t iWall = m_scene.m_vNewIndexes[planes[j]];
 			walls.Vel(iWall) = vel;
@@ -412,6 +852,7 @@ void CCPUSimulator::MoveWalls(double _timeStep)
 			// update wall properties
 			walls.MinCoord(iWall) = Min(walls.Vert1(iWall), walls.Vert2(iWall), walls.Vert3(iWall));
 			walls.MaxCoord(iWall) = Max(walls.Vert1(iWall), walls.Vert2(iWall), walls.Vert3(iWall));
+			walls.Edges(iWall) = SWallStruct::SEdges{ walls.Coordinates(iWall) };
 
 			if (!rotVel.IsZero())
 				walls.NormalVector(iWall) = Normalized((walls.Vert2(iWall) - walls.Vert1(iWall))*(walls.Vert3(iWall) - walls.Vert1(iWall)));
@@ -423,7 +864,7 @@ void CCPUSimulator::UpdateTemperatures(bool _predictionStep)
 {
 	SParticleStruct& particles = m_scene.GetRefToParticles();
 	const double timeStep = !_predictionStep ? m_currSimulationStep : m_currSimulationStep / 2.;
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
+	ParallelFor(m_scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
 		particles.Temperature(i) += particles.HeatFlux(i) / (particles.HeatCapacity(i) * particles.Mass(i)) * timeStep;
 		particles.Temperature(i) = particles.Temperature(i) < 0.0 ? 0.0 : particles.Temperature(i);
@@ -436,7 +877,7 @@ void CCPUSimulator::MoveMultispheres(double _dTimeStep, bool _bPredictionStep)
 	SParticleStruct& pParticles = m_scene.GetRefToParticles();
 
 	// move particles which does not correlated to any multisphere
-	ParallelFor(pMultispheres.Size(), [&](size_t i)
+	ParallelFor(pMultispheres.Size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
 		if (pParticles.MultiSphIndex(i) == -1)
 		{
@@ -449,7 +890,7 @@ void CCPUSimulator::MoveMultispheres(double _dTimeStep, bool _bPredictionStep)
 	});
 
 	// move all multispheres
-	ParallelFor(pMultispheres.Size(), [&](size_t i)
+	ParallelFor(pMultispheres.Size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
 		CVector3 vTotalForce(0), vTotalMoment(0);
 
@@ -533,25 +974,23 @@ void CCPUSimulator::PrepareAdditionalSavingData()
 	}
 
 	// save stresses caused by particle-particle contact
-	for (auto& collisions : m_collisionsCalculator.m_vCollMatrixPP)
-		for (auto& collision : collisions)
-		{
-			const size_t srcID = collision->nSrcID;
-			const size_t dstID = collision->nDstID;
-			CVector3 connVec = (particles.Coord(srcID) - particles.Coord(dstID)).Normalized();
-			const double srcRadius = particles.Radius(srcID);
-			const double dstRadius = particles.Radius(dstID);
-			m_additionalSavingData[collision->nSrcID].AddStress(-1 * connVec * srcRadius,      collision->vTotalForce, PI * pow(2 * srcRadius, 3) / 6);
-			m_additionalSavingData[collision->nDstID].AddStress(     connVec * dstRadius, -1 * collision->vTotalForce, PI * pow(2 * dstRadius, 3) / 6);
-		}
+	for (const auto& collision : m_collisionsCalculator.m_collMatrixPP.Data())
+	{
+		const size_t srcID = collision.nSrcID;
+		const size_t dstID = collision.nDstID;
+		CVector3 connVec = (particles.Coord(srcID) - particles.Coord(dstID)).Normalized();
+		const double srcRadius = particles.Radius(srcID);
+		const double dstRadius = particles.Radius(dstID);
+		m_additionalSavingData[collision.nSrcID].AddStress(-1 * connVec * srcRadius,      collision.vTotalForce, PI * pow(2 * srcRadius, 3) / 6);
+		m_additionalSavingData[collision.nDstID].AddStress(     connVec * dstRadius, -1 * collision.vTotalForce, PI * pow(2 * dstRadius, 3) / 6);
+	}
 
 	// save stresses caused by particle-wall contacts
-	for (auto& collisions : m_collisionsCalculator.m_vCollMatrixPW)
-		for (auto& collision : collisions)
-		{
-			CVector3 connVec = (collision->vContactVector - particles.Coord(collision->nDstID)).Normalized();
-			m_additionalSavingData[collision->nDstID].AddStress(connVec * particles.Radius(collision->nDstID), collision->vTotalForce, PI * pow(2 * particles.Radius(collision->nDstID), 3) / 6);
-		}
+	for (const auto& collision : m_collisionsCalculator.m_collMatrixPW.Data())
+	{
+		CVector3 connVec = (collision.vContactVector - particles.Coord(collision.nDstID)).Normalized();
+		m_additionalSavingData[collision.nDstID].AddStress(connVec * particles.Radius(collision.nDstID), collision.vTotalForce, PI * pow(2 * particles.Radius(collision.nDstID), 3) / 6);
+	}
 }
 
 void CCPUSimulator::SaveData()
@@ -559,6 +998,7 @@ void CCPUSimulator::SaveData()
 	const clock_t t = clock();
 	if (m_scene.GetRefToParticles().ThermalsExist())
 		m_maxParticleTemperature = m_scene.GetMaxParticleTemperature();
+	SynchronizeGeometryWalls();
 	p_SaveData();
 	m_verletList.AddDisregardingTimeInterval(clock() - t);
 }
@@ -568,12 +1008,390 @@ void CCPUSimulator::UpdateVerletLists(double _dTimeStep)
 	// update max velocity
 	m_maxParticleVelocity = m_scene.GetMaxParticleVelocity();
 	if (m_wallsVelocityChanged)
-		m_maxWallVelocity = m_scene.GetMaxWallVelocity();
+		m_maxWallVelocity = m_geometryFrames ? GetMaxGeometryVelocity() : m_scene.GetMaxWallVelocity();
 	if (m_verletList.IsNeedToBeUpdated(_dTimeStep, m_scene.GetMaxPartVerletDistance(), m_maxWallVelocity))
 	{
+		if (m_reorderInterval != 0 && ++m_verletUpdatesNumber % m_reorderInterval == 0)
+			ReorderParticles();
+		SynchronizeGeometryWalls();
 		m_verletList.UpdateList(m_currentTime);
-		m_scene.SaveVerletCoords();
+		UpdateContactWalls();
+		if (m_scene.m_PBC.bEnabled)
+			UpdatePBCBand();
+	}
+}
+
+void CCPUSimulator::UpdatePBCBand()
+{
+	// the band must contain particles, which may cross boundaries until the next update, and their possible contact partners;
+	// the travel bound of the next interval is predicted from the last one, but it is at least the verlet distance, after which lists are usually updated
+	const auto& vSizeClasses = m_verletList.GetSizeClasses();
+	const double dMaxVerletDistance = vSizeClasses.empty() ? m_verletList.GetVerletDistance() : vSizeClasses.front().dVerletDistance;
+	m_pbcContactDistance = 2 * m_scene.GetMaxParticleContactRadius() + dMaxVerletDistance;
+	const double dTravel = std::max(dMaxVerletDistance, PBC_BAND_TRAVEL_FACTOR * m_scene.GetPBCBandTravel());
+	m_scene.UpdatePBCBand(dTravel + m_pbcContactDistance);
+}
+
+bool CCPUSimulator::ReorderParticles()
+{
+	const std::vector<unsigned> newIndex = m_scene.ReorderParticles();
+	if (newIndex.empty()) return false;
+	m_collisionsCalculator.RemapParticles(newIndex);
+	m_verletList.ResetCurrentData(); // lists must be rebuilt completely
+	// generated particles, which are not yet added to the system structure
+	for (auto& object : m_generatedObjectsDiff)
+		if (object.type == SPHERE)
+			object.indexScene = newIndex[object.indexScene];
+	return true;
+}
+
+void CCPUSimulator::PlaceParticlesOnNodes()
+{
+	// ranges of particles are bound to threads, and thus to NUMA nodes, only within the persistent parallel region
+	if (!m_persistentParallelRegion)
+		*p_out << "NUMA placement of particles has effect only with the persistent parallel region" << std::endl;
+	CParallelRegion region;
+	// compact blocks of particles in space also keep most of contact partners on the same node
+	if (!ReorderParticles())
+		m_scene.PlaceParticles();
+	PrintNUMAInfo();
+}
+
+void CCPUSimulator::PrintNUMAInfo() const
+{
+	const SParticleStruct& particles = m_scene.GetRefToParticles();
+	const size_t pageSize = GetMemoryPageSize();
+	std::vector<size_t> localPages(m_nThreads, 0), totalPages(m_nThreads, 0);
+	std::vector<uint8_t> unknown(m_nThreads, 0);
+	CParallelRegion region;
+	// each thread checks pages, which start in its own range of particles
+	ParallelFor(m_scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t iThread, size_t i)
+	{
+		const auto CheckPage = [&](const void* _address, const void* _previous)
+		{
+			if (_previous && reinterpret_cast<uintptr_t>(_address) / pageSize == reinterpret_cast<uintptr_t>(_previous) / pageSize) return;
+			const int node = GetMemoryNode(_address);
+			const int threadNode = GetCurrentNode();
+			if (node < 0 || threadNode < 0)
+				unknown[iThread] = 1;
+			totalPages[iThread]++;
+			localPages[iThread] += node == threadNode;
+		};
+		CheckPage(&particles.Coord(i), i != 0 ? &particles.Coord(i - 1) : nullptr);
+		CheckPage(&particles.Vel(i), i != 0 ? &particles.Vel(i - 1) : nullptr);
+	});
+	if (VectorSum(totalPages) == 0 || std::find(unknown.begin(), unknown.end(), 1) != unknown.end()) return;
+	*p_out << "NUMA-local pages of particles [%]: " << 100. * static_cast<double>(VectorSum(localPages)) / static_cast<double>(VectorSum(totalPages)) << std::endl;
+}
+
+void CCPUSimulator::PrintSizeClassesInfo() const
+{
+	const size_t updates = m_verletList.GetUpdatesNumber();
+	*p_out << "Verlet list updates: " << updates << std::endl;
+	const auto& classes = m_verletList.GetSizeClasses();
+	for (size_t i = 0; i < classes.size(); ++i)
+		*p_out << "Size class " << i << ": contact radius (" << classes[i].dMinRadius << "; " << classes[i].dMaxRadius << "] [m], verlet distance [m]: " << classes[i].dVerletDistance
+			<< ", particles: " << classes[i].nParticles << ", caused updates: " << classes[i].nTriggers
+			<< ", possible PP contacts per update: " << (updates != 0 ? classes[i].nCandidates / updates : 0) << std::endl;
+}
+
+void CCPUSimulator::PrintVerletDistanceDecisions() const
+{
+	const auto& decisions = m_verletList.GetDistanceDecisions();
+	*p_out << "Adjustments of verlet distance by the cost model: " << decisions.size() << std::endl;
+	for (const auto& d : decisions)
+		*p_out << "Time [s]: " << d.dTime << ", verlet distance [m]: " << d.dOldDistance << " -> " << d.dNewDistance
+			<< ", possible PP contacts per update: " << d.dCandidates << ", steps per update: " << d.dStepsPerUpdate
+			<< ", measured update / step [s]: " << d.dUpdateDuration << " / " << d.dStepDuration
+			<< ", predicted cost per simulated second: " << d.dOldCost << " -> " << d.dNewCost << std::endl;
+}
+
+void CCPUSimulator::PrintPBCBandInfo() const
+{
+	if (m_pbcSteps == 0) return;
+	*p_out << "Particles checked for crossing PBC boundaries per step: " << m_pbcCheckedParticles / m_pbcSteps << " of " << m_scene.GetTotalParticlesNumber()
+		<< ", checks of all particles: " << m_pbcFullChecks << " of " << m_pbcSteps << std::endl;
+}
+
+void CCPUSimulator::InitializeGeometryFrames()
+{
+	const SWallStruct& walls = m_scene.GetRefToWalls();
+	m_frames.assign(m_pSystemStructure->GeometriesNumber(), {});
+	for (size_t i = 0; i < m_frames.size(); ++i)
+	{
+		const auto& planes = m_pSystemStructure->Geometry(i)->Planes();
+		if (planes.empty()) continue;
+		SGeometryFrame& frame = m_frames[i];
+		frame.walls.resize(planes.size());
+		frame.bodyVerts.resize(3 * planes.size());
+		frame.bodyNormals.resize(planes.size());
+		frame.contactWalls.resize(planes.size());
+		CVector3 minCoord{ walls.MinCoord(m_scene.m_vNewIndexes[planes.front()]) };
+		CVector3 maxCoord{ walls.MaxCoord(m_scene.m_vNewIndexes[planes.front()]) };
+		double totalArea{ 0.0 };
+		CVector3 totalWeightedCentroid{ 0.0 };
+		// the body frame coincides with the world frame at the start
+		for (size_t j = 0; j < planes.size(); ++j)
+		{
+			const size_t iWall = m_scene.m_vNewIndexes[planes[j]];
+			frame.walls[j] = iWall;
+			frame.bodyVerts[3 * j + 0] = walls.Vert1(iWall);
+			frame.bodyVerts[3 * j + 1] = walls.Vert2(iWall);
+			frame.bodyVerts[3 * j + 2] = walls.Vert3(iWall);
+			frame.bodyNormals[j] = walls.NormalVector(iWall);
+			frame.contactWalls[j] = static_cast<unsigned>(j);
+			frame.vel += walls.Vel(iWall) / static_cast<double>(planes.size());
+			frame.rotVel = walls.RotVel(iWall);
+			frame.rotCenter = walls.RotCenter(iWall);
+			minCoord = Min(minCoord, walls.MinCoord(iWall));
+			maxCoord = Max(maxCoord, walls.MaxCoord(iWall));
+			const double area = 0.5 * Length((walls.Vert2(iWall) - walls.Vert1(iWall)) * (walls.Vert3(iWall) - walls.Vert1(iWall)));
+			totalArea += area;
+			totalWeightedCentroid += area * (walls.Vert1(iWall) + walls.Vert2(iWall) + walls.Vert3(iWall)) / 3.;
+		}
+		if (totalArea != 0.0)
+			frame.bodyCentroid = totalWeightedCentroid / totalArea;
+		frame.boundCenter = (minCoord + maxCoord) / 2;
+		for (const auto& vert : frame.bodyVerts)
+			frame.boundRadius = std::max(frame.boundRadius, Length(vert - frame.boundCenter));
+	}
+}
+
+void CCPUSimulator::TransformGeometryWalls(SGeometryFrame& _frame, bool _all)
+{
+	SWallStruct& walls = m_scene.GetRefToWalls();
+	ParallelFor(_all ? _frame.walls.size() : _frame.contactWalls.size(), EScheduling::CONTIGUOUS, [&](size_t, size_t k)
+	{
+		const size_t j = _all ? k : _frame.contactWalls[k];
+		const size_t iWall = _frame.walls[j];
+		walls.Vel(iWall) = _frame.vel;
+		walls.RotVel(iWall) = _frame.rotVel;
+		walls.RotCenter(iWall) = _frame.rotCenter;
+		walls.Vert1(iWall) = _frame.rotation * _frame.bodyVerts[3 * j + 0] + _frame.translation;
+		walls.Vert2(iWall) = _frame.rotation * _frame.bodyVerts[3 * j + 1] + _frame.translation;
+		walls.Vert3(iWall) = _frame.rotation * _frame.bodyVerts[3 * j + 2] + _frame.translation;
+		walls.MinCoord(iWall) = Min(walls.Vert1(iWall), walls.Vert2(iWall), walls.Vert3(iWall));
+		walls.MaxCoord(iWall) = Max(walls.Vert1(iWall), walls.Vert2(iWall), walls.Vert3(iWall));
+		walls.Edges(iWall) = SWallStruct::SEdges{ walls.Coordinates(iWall) };
+		walls.NormalVector(iWall) = _frame.rotation * _frame.bodyNormals[j];
+	});
+	if (_all)
+		_frame.outdated = false;
+}
+
+void CCPUSimulator::SynchronizeGeometryWalls()
+{
+	for (auto& frame : m_frames)
+		if (frame.outdated)
+			TransformGeometryWalls(frame, true);
+}
+
+void CCPUSimulator::UpdateContactWalls()
+{
+	if (!m_geometryFrames) return;
+	std::vector<uint8_t> inList(m_scene.GetRefToWalls().Size(), 0);
+	for (const unsigned iWall : m_verletList.m_PWList.IDs())
+		inList[iWall] = 1;
+	ParallelFor(m_frames.size(), [&](size_t i)
+	{
+		SGeometryFrame& frame = m_frames[i];
+		frame.contactWalls.clear();
+		for (size_t j = 0; j < frame.walls.size(); ++j)
+			if (inList[frame.walls[j]])
+				frame.contactWalls.push_back(static_cast<unsigned>(j));
+	});
+}
+
+double CCPUSimulator::GetMaxGeometryVelocity() const
+{
+	double maxVelocity = 0;
+	for (const auto& frame : m_frames)
+	{
+		if (frame.walls.empty()) continue;
+		double velocity = frame.vel.Length();
+		if (!frame.rotVel.IsZero())
+			velocity += frame.rotVel.Length() * (Length(frame.rotation * frame.boundCenter + frame.translation - frame.rotCenter) + frame.boundRadius);
+		maxVelocity = std::max(maxVelocity, velocity);
+	}
+	return maxVelocity;
+}
+
+bool CCPUSimulator::SaveCheckpoint(const std::string& _file)
+{
+	if (m_analyzeCollisions)
+	{
+		*p_out << "Error: Checkpoints cannot be written together with analysis of collisions" << std::endl;
+		return false;
+	}
+
+	const clock_t t = clock();
+
+	// contacts and models refer to objects by their indices, so the system structure must contain all generated objects
+	WaitForSavedResults();
+	AddGeneratedObjectsToSystemStructure();
+	m_pSystemStructure->SaveToFile();
+
+	// write into a temporary file, so that the previous checkpoint remains valid until the new one is complete
+	const std::string tempFile = _file + ".tmp";
+	std::ofstream file{ UnicodePath(tempFile), std::ios::binary | std::ios::trunc };
+	if (!file)
+	{
+		*p_out << "Error: Cannot open checkpoint file " << tempFile << std::endl;
+		return false;
 	}
+
+	SCheckpointHeader header;
+	std::memcpy(header.signature, CHECKPOINT_SIGNATURE, sizeof(CHECKPOINT_SIGNATURE));
+	header.version = CHECKPOINT_VERSION;
+	header.collisionSize = sizeof(SCollision);
+	header.geometries = m_pSystemStructure->GeometriesNumber();
+	header.walls = m_scene.GetWallsNumber();
+	header.models = m_models.size();
+	header.time = m_currentTime;
+	WriteBinary(file, header);
+	// keys of models precede all states, so that they can be checked before anything is restored
+	for (const auto* model : m_models)
+	{
+		const std::string key = model->GetUniqueKey();
+		WriteBinary(file, std::vector<char>{ key.begin(), key.end() });
+	}
+
+	WriteBinary(file, m_currSimulationStep);
+	WriteBinary(file, m_lastSavingTime);
+	WriteBinary(file, m_lastCheckpointTime);
+	WriteBinary(file, m_isPredictionStep);
+	WriteBinary(file, m_inactiveParticles);
+	WriteBinary(file, m_inactiveBonds);
+	WriteBinary(file, m_brokenBonds);
+	WriteBinary(file, m_nGeneratedObjects);
+	WriteBinary(file, m_maxParticleVelocity);
+	WriteBinary(file, m_maxParticleTemperature);
+	WriteBinary(file, m_maxWallVelocity);
+	WriteBinary(file, m_wallsVelocityChanged);
+	WriteBinary(file, m_verletUpdatesNumber);
+
+	m_scene.SaveState(file);
+	m_verletList.SaveState(file);
+	m_collisionsCalculator.SaveState(file);
+	for (size_t i = 0; i < m_pSystemStructure->GeometriesNumber(); ++i)
+		m_pSystemStructure->Geometry(i)->Motion()->SaveMotionInfo(file);
+	WriteBinary(file, m_frames.size());
+	for (const auto& frame : m_frames)
+		ForEachFrameVariable(frame, [&](const auto& _var) { WriteBinary(file, _var); });
+	for (const auto* model : m_models)
+		model->SaveState(file);
+	WriteBinary(file, CHECKPOINT_SIGNATURE);
+
+	file.close();
+	std::error_code error;
+	if (file)
+		std::filesystem::rename(UnicodePath(tempFile), UnicodePath(_file), error);
+	if (!file || error)
+	{
+		*p_out << "Error: Cannot write checkpoint file " << _file << std::endl;
+		return false;
+	}
+
+	const double elapsed = static_cast<double>(clock() - t) / CLOCKS_PER_SEC;
+	m_verletList.AddDisregardingTimeInterval(clock() - t);
+	*p_out << "Checkpoint at time " << m_currentTime << " [s] is written to " << _file << " in " << elapsed << " [s]" << std::endl;
+	return true;
+}
+
+void CCPUSimulator::WriteRequestedCheckpoint()
+{
+	const bool requested = g_checkpointSignal != 0;
+	const bool periodic = m_checkpointInterval > 0 && m_currentTime - m_lastCheckpointTime + 0.1 * m_currSimulationStep > m_checkpointInterval;
+	if (!requested && !periodic) return;
+	g_checkpointSignal = 0;
+	if (m_checkpointFile.empty())
+	{
+		*p_out << "Checkpoint is requested, but checkpoint file is not set" << std::endl;
+		return;
+	}
+	if (periodic)
+		m_lastCheckpointTime = m_currentTime;
+	SaveCheckpoint(m_checkpointFile);
+}
+
+bool CCPUSimulator::LoadCheckpoint(const std::string& _file)
+{
+	std::ifstream file{ UnicodePath(_file), std::ios::binary };
+	SCheckpointHeader header;
+	if (!ReadCheckpointHeader(file, header) || header.geometries != m_pSystemStructure->GeometriesNumber() || header.walls != m_scene.GetWallsNumber() || header.models != m_models.size())
+	{
+		*p_out << "Error: Checkpoint " << _file << " does not match the simulated scene" << std::endl;
+		return false;
+	}
+
+	// models are checked before any state is changed, since their mismatch is the most common reason of a failed restart
+	try
+	{
+		for (const auto* model : m_models)
+		{
+			std::vector<char> key;
+			ReadBinary(file, key);
+			if (std::string{ key.begin(), key.end() } != model->GetUniqueKey())
+			{
+				*p_out << "Error: Models of checkpoint " << _file << " differ from the selected ones" << std::endl;
+				return false;
+			}
+		}
+	}
+	catch (const std::exception& e)
+	{
+		*p_out << "Error: Cannot read checkpoint " << _file << ": " << e.what() << std::endl;
+		return false;
+	}
+
+	try
+	{
+		m_currentTime = header.time;
+		ReadBinary(file, m_currSimulationStep);
+		ReadBinary(file, m_lastSavingTime);
+		ReadBinary(file, m_lastCheckpointTime);
+		ReadBinary(file, m_isPredictionStep);
+		ReadBinary(file, m_inactiveParticles);
+		ReadBinary(file, m_inactiveBonds);
+		ReadBinary(file, m_brokenBonds);
+		ReadBinary(file, m_nGeneratedObjects);
+		ReadBinary(file, m_maxParticleVelocity);
+		ReadBinary(file, m_maxParticleTemperature);
+		ReadBinary(file, m_maxWallVelocity);
+		ReadBinary(file, m_wallsVelocityChanged);
+		ReadBinary(file, m_verletUpdatesNumber);
+
+		m_scene.LoadState(file);
+		m_verletList.LoadState(file);
+		m_collisionsCalculator.LoadState(file);
+		for (size_t i = 0; i < m_pSystemStructure->GeometriesNumber(); ++i)
+			m_pSystemStructure->Geometry(i)->Motion()->LoadMotionInfo(file);
+		size_t nFrames;
+		ReadBinary(file, nFrames);
+		m_frames.resize(nFrames);
+		for (auto& frame : m_frames)
+			ForEachFrameVariable(frame, [&](auto& _var) { ReadBinary(file, _var); });
+		for (auto* model : m_models)
+			model->LoadState(file);
+	}
+	catch (const std::exception& e)
+	{
+		*p_out << "Error: Cannot read checkpoint " << _file << ": " << e.what() << std::endl;
+		return false;
+	}
+
+	// the setting of geometry frames may differ from the checkpointed simulation
+	if (m_geometryFrames && m_frames.empty())
+		InitializeGeometryFrames();
+	else if (!m_geometryFrames && !m_frames.empty())
+	{
+		SynchronizeGeometryWalls();
+		m_frames.clear();
+	}
+	InitializeModelParameters();
+
+	*p_out << "Simulation is restarted from checkpoint " << _file << " at time " << m_currentTime << " [s]" << std::endl;
+	return true;
 }
 
 void CCPUSimulator::CheckParticlesInDomain()
@@ -584,7 +1402,7 @@ void CCPUSimulator::CheckParticlesInDomain()
 	SLiquidBondStruct& liquidBonds = m_scene.GetRefToLiquidBonds();
 	std::vector<size_t> inactiveParticlesNum(m_scene.GetTotalParticlesNumber());
 	std::vector<size_t> inactiveBondsNum(m_scene.GetTotalParticlesNumber());
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
+	ParallelFor(m_scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
 		if ((particles.Active(i)) && (!IsPointInDomain(simDomain, particles.Coord(i)))) // remove particles situated not in the domain
 		{
@@ -621,68 +1439,96 @@ void CCPUSimulator::MoveParticlesOverPBC()
 	const SPBC& pbc = m_scene.m_PBC;
 	if (!pbc.bEnabled) return;
 	SParticleStruct& particles = m_scene.GetRefToParticles();
+	const size_t nParticles = m_scene.GetTotalParticlesNumber();
+	m_pbcShifts.resize(nParticles, 0);
+
+	// only particles of the boundary band, which were close enough to boundaries at the last update of verlet lists, may have crossed them;
+	// if particles may have travelled farther than the band allows, all particles are analyzed
+	const std::optional<size_t> nBandSize = m_scene.GetPBCBandSize(0);
+	const std::vector<unsigned>& vBand = m_scene.GetPBCBandParticles();
+	const size_t nCandidates = nBandSize ? *nBandSize : nParticles;
+	const auto Candidate = [&](size_t _k) { return nBandSize ? vBand[_k] : _k; };
+	m_pbcSteps++;
+	m_pbcCheckedParticles += nCandidates;
+	if (!nBandSize)
+		m_pbcFullChecks++;
 
-	//use <unsigned char> in order to avoid problems with simultaneous writing from several threads
-	//std::vector<unsigned char> vBoundaryCrossed(m_scene.GetTotalParticlesNumber());	// whether the particle crossed the PBC boundary
-	std::vector<uint8_t> vShifts(m_scene.GetTotalParticlesNumber(), 0);	// whether the particle crossed the PBC boundary
-
-	// TODO: It is unnecessary to analyze all particles for all crosses. Only those should be analyzed, who can cross boundary during current verlet step.
 	// shift particles if they crossed boundary
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
+	std::atomic<bool> crossed{ false };
+	ParallelFor(nCandidates, EScheduling::CONTIGUOUS, [&](size_t, size_t k)
 	{
+		const size_t i = Candidate(k);
 		CVector3& vCoord = particles.Coord(i);
+		uint8_t shift = 0;
 		// particle crossed left boundary
-		if (pbc.bX && vCoord.x <= pbc.currentDomain.coordBeg.x)  vShifts[i] = vShifts[i] | 32;
-		if (pbc.bY && vCoord.y <= pbc.currentDomain.coordBeg.y) vShifts[i] = vShifts[i] | 8;
-		if (pbc.bZ && vCoord.z <= pbc.currentDomain.coordBeg.z) vShifts[i] = vShifts[i] | 2;
+		if (pbc.bX && vCoord.x <= pbc.currentDomain.coordBeg.x) shift |= 32;
+		if (pbc.bY && vCoord.y <= pbc.currentDomain.coordBeg.y) shift |= 8;
+		if (pbc.bZ && vCoord.z <= pbc.currentDomain.coordBeg.z) shift |= 2;
 		// particle crossed right boundary
-		if (pbc.bX && vCoord.x >= pbc.currentDomain.coordEnd.x) vShifts[i] = vShifts[i] | 16;
-		if (pbc.bY && vCoord.y >= pbc.currentDomain.coordEnd.y) vShifts[i] = vShifts[i] | 4;
-		if (pbc.bZ && vCoord.z >= pbc.currentDomain.coordEnd.z) vShifts[i] = vShifts[i] | 1;
+		if (pbc.bX && vCoord.x >= pbc.currentDomain.coordEnd.x) shift |= 16;
+		if (pbc.bY && vCoord.y >= pbc.currentDomain.coordEnd.y) shift |= 4;
+		if (pbc.bZ && vCoord.z >= pbc.currentDomain.coordEnd.z) shift |= 1;
 
-		if (vShifts[i])
+		if (shift)
 		{
-			vCoord += GetVectorFromVirtShift(vShifts[i], m_scene.m_PBC.boundaryShift);
-			particles.CoordVerlet(i) += GetVectorFromVirtShift(vShifts[i], m_scene.m_PBC.boundaryShift);
+			m_pbcShifts[i] = shift;
+			vCoord += GetVectorFromVirtShift(shift, m_scene.m_PBC.boundaryShift);
+			particles.CoordVerlet(i) += GetVectorFromVirtShift(shift, m_scene.m_PBC.boundaryShift);
+			crossed.store(true, std::memory_order_relaxed);
 		}
 	});
+	if (!crossed) return;
 
-	// this can be in case when all contact models are turned off
-	if (m_verletList.m_PPList.empty() && m_verletList.m_PWList.empty()) return;
+	// shifts of contacts are modified in rows of crossed particles and of their possible contact partners, which are also in the boundary band,
+	// if it is extended by the largest distance of possible contacts
+	const std::optional<size_t> nRowsBand = nBandSize ? m_scene.GetPBCBandSize(m_pbcContactDistance) : std::nullopt;
+	const size_t nRows = nRowsBand ? *nRowsBand : nParticles;
+	const auto Row = [&](size_t _k) { return nRowsBand ? vBand[_k] : _k; };
 
-	ParallelFor(m_scene.GetTotalParticlesNumber(), [&](size_t i)
-	{
-		// modify shift in possible particle-particle contacts
-		for (size_t j = 0; j < m_verletList.m_PPList[i].size(); j++)
+	// this can be in case when all contact models are turned off
+	if (m_verletList.m_PPList.Rows() != 0 || m_verletList.m_PWList.Rows() != 0)
+		ParallelFor(nRows, EScheduling::CONTIGUOUS, [&](size_t, size_t k)
 		{
-			const size_t srcID = i;
-			const size_t dstID = m_verletList.m_PPList[i][j];
-			if (vShifts[srcID])
-				m_verletList.m_PPVirtShift[i][j] = AddVirtShift(m_verletList.m_PPVirtShift[i][j], vShifts[srcID]);
-			if (vShifts[dstID])
-				m_verletList.m_PPVirtShift[i][j] = SubstractVirtShift(m_verletList.m_PPVirtShift[i][j], vShifts[dstID]);
-		}
+			const size_t i = Row(k);
+			// modify shift in possible particle-particle contacts
+			const auto dstIDs = m_verletList.m_PPList.Row(i);
+			const auto ppShifts = m_verletList.m_PPList.Shifts(i);
+			for (size_t j = 0; j < dstIDs.size(); j++)
+			{
+				const size_t srcID = i;
+				const size_t dstID = dstIDs[j];
+				if (m_pbcShifts[srcID])
+					ppShifts[j] = AddVirtShift(ppShifts[j], m_pbcShifts[srcID]);
+				if (m_pbcShifts[dstID])
+					ppShifts[j] = SubstractVirtShift(ppShifts[j], m_pbcShifts[dstID]);
+			}
 
-		// modify shift in existing particle-particle  collisions
-		for (size_t j = 0; j < m_collisionsCalculator.m_vCollMatrixPP[i].size(); j++)
-		{
-			const unsigned srcID = m_collisionsCalculator.m_vCollMatrixPP[i][j]->nSrcID;
-			const unsigned dstID = m_collisionsCalculator.m_vCollMatrixPP[i][j]->nDstID;
-			if (vShifts[srcID])
-				m_collisionsCalculator.m_vCollMatrixPP[i][j]->nVirtShift = AddVirtShift(m_collisionsCalculator.m_vCollMatrixPP[i][j]->nVirtShift, vShifts[srcID]);
-			if (vShifts[dstID])
-				m_collisionsCalculator.m_vCollMatrixPP[i][j]->nVirtShift = SubstractVirtShift(m_collisionsCalculator.m_vCollMatrixPP[i][j]->nVirtShift, vShifts[dstID]);
-		}
+			// modify shift in existing particle-particle  collisions
+			for (auto& coll : m_collisionsCalculator.m_collMatrixPP.Row(i))
+			{
+				const unsigned srcID = coll.nSrcID;
+				const unsigned dstID = coll.nDstID;
+				if (m_pbcShifts[srcID])
+					coll.nVirtShift = AddVirtShift(coll.nVirtShift, m_pbcShifts[srcID]);
+				if (m_pbcShifts[dstID])
+					coll.nVirtShift = SubstractVirtShift(coll.nVirtShift, m_pbcShifts[dstID]);
+			}
 
-		// modify shift in possible particle-wall contacts
-		for (size_t j = 0; j < m_verletList.m_PWList[i].size(); j++)
-			if (vShifts[i])
-				m_verletList.m_PWVirtShift[i][j] = SubstractVirtShift(m_verletList.m_PWVirtShift[i][j], vShifts[i]);
+			// modify shift in possible particle-wall contacts
+			if (m_pbcShifts[i])
+				for (auto& shift : m_verletList.m_PWList.Shifts(i))
+					shift = SubstractVirtShift(shift, m_pbcShifts[i]);
+
+			// modify shift in existing particle-wall collisions
+			if (m_pbcShifts[i])
+				for (auto& coll : m_collisionsCalculator.m_collMatrixPW.Row(i))
+					coll.nVirtShift = SubstractVirtShift(coll.nVirtShift, m_pbcShifts[i]);
+		});
 
-		// modify shift in existing particle-wall collisions
-		for (size_t j = 0; j < m_collisionsCalculator.m_vCollMatrixPW[i].size(); j++)
-			if (vShifts[i])
-				m_collisionsCalculator.m_vCollMatrixPW[i][j]->nVirtShift = SubstractVirtShift(m_collisionsCalculator.m_vCollMatrixPW[i][j]->nVirtShift, vShifts[i]);
+	// only shifts of analyzed particles may be set
+	ParallelFor(nCandidates, EScheduling::CONTIGUOUS, [&](size_t, size_t k)
+	{
+		m_pbcShifts[Candidate(k)] = 0;
 	});
 }
 
@@ -729,30 +1575,28 @@ void CCPUSimulator::GetOverlapsInfo(double& _dMaxOverlap, double& _dAverageOverl
 	_dMaxOverlap = 0;
 	_dAverageOverlap = 0;
 	size_t nCollNumber = 0;
-	for (const auto& collisions : m_collisionsCalculator.m_vCollMatrixPP)
-		for (const auto coll : collisions)
+	for (const auto& coll : m_collisionsCalculator.m_collMatrixPP.Data())
+	{
+		if ((coll.nSrcID < _nMaxParticleID) || (coll.nDstID < _nMaxParticleID))
 		{
-			if ((coll->nSrcID < _nMaxParticleID) || (coll->nDstID < _nMaxParticleID))
-			{
-				_dMaxOverlap = std::max(_dMaxOverlap, coll->dNormalOverlap);
-				_dAverageOverlap += coll->dNormalOverlap;
-				nCollNumber++;
-			}
+			_dMaxOverlap = std::max(_dMaxOverlap, coll.dNormalOverlap);
+			_dAverageOverlap += coll.dNormalOverlap;
+			nCollNumber++;
 		}
+	}
 
 	const SParticleStruct& particles = m_scene.GetRefToParticles();
-	for (const auto& collisions : m_collisionsCalculator.m_vCollMatrixPW)
-		for (const auto coll : collisions)
+	for (const auto& coll : m_collisionsCalculator.m_collMatrixPW.Data())
+	{
+		if (coll.nDstID < _nMaxParticleID)
 		{
-			if (coll->nDstID < _nMaxParticleID)
-			{
-				const CVector3 vRc = _VIRTUAL_COORDINATE(particles.Coord(coll->nDstID), coll->nVirtShift, m_scene.m_PBC) - coll->vContactVector;
-				const double dOverlap = particles.ContactRadius(coll->nDstID) - vRc.Length();
-				_dMaxOverlap = std::max(_dMaxOverlap, dOverlap);
-				_dAverageOverlap += dOverlap;
-				nCollNumber++;
-			}
+			const CVector3 vRc = _VIRTUAL_COORDINATE(particles.Coord(coll.nDstID), coll.nVirtShift, m_scene.m_PBC) - coll.vContactVector;
+			const double dOverlap = particles.ContactRadius(coll.nDstID) - vRc.Length();
+			_dMaxOverlap = std::max(_dMaxOverlap, dOverlap);
+			_dAverageOverlap += dOverlap;
+			nCollNumber++;
 		}
+	}
 
 	if (nCollNumber)
 		_dAverageOverlap = _dAverageOverlap / nCollNumber;
@@ -8,7 +8,51 @@
 
 class CCPUSimulator : public CBaseSimulator
 {
+public:
+	// Strategies to consolidate results of contacts on objects, which are not owned by the thread that calculates the contact.
+	enum class EForceReduction
+	{
+		BUCKETS,		// Contacts are distributed into per-thread buckets by the second object and consolidated in a separate pass.
+		THREAD_BUFFERS	// Each thread consolidates contacts into its own buffer of forces; buffers are summed up in parallel over objects.
+	};
+
+private:
+	// Rigid motion of walls of one geometry. Walls are stored in the body frame, and the geometry is moved by updating only its transformation.
+	// Walls are transformed into the world frame lazily: on each step only walls, which may have contacts; all walls before verlet lists are updated or data are saved.
+	struct SGeometryFrame
+	{
+		std::vector<size_t> walls;			// Indices of walls of the geometry in the scene.
+		std::vector<CVector3> bodyVerts;	// Vertices of walls in the body frame, three per wall.
+		std::vector<CVector3> bodyNormals;	// Normal vectors of walls in the body frame.
+		std::vector<unsigned> contactWalls;	// Local indices of walls, which are in verlet lists and may have contacts.
+		CMatrix3 rotation{ CMatrix3::Identity() };	// Rotation from the body to the world frame.
+		CVector3 translation{ 0 };			// Translation from the body to the world frame.
+		CVector3 vel{ 0 };					// Current velocity.
+		CVector3 rotVel{ 0 };				// Current rotational velocity.
+		CVector3 rotCenter{ 0 };			// Current center of rotation.
+		CVector3 bodyCentroid{ 0 };			// Area-weighted centroid of walls in the body frame.
+		CVector3 boundCenter{ 0 };			// Center of the bounding sphere of walls in the body frame.
+		double boundRadius{ 0 };			// Radius of the bounding sphere of walls.
+		bool outdated{ false };				// Some walls in the scene are not transformed to the current position.
+	};
+
 	bool m_analyzeCollisions{ false };	// Statistic information about collisions should be saved.
+	EForceReduction m_forceReduction{ EForceReduction::BUCKETS };	// Selected strategy to consolidate contacts.
+	double m_contactForcesTime{ 0 };	// Total time spent to calculate contact forces [s].
+	size_t m_reorderInterval{ 0 };		// Particles are reordered along a space-filling curve on each m_reorderInterval-th update of verlet lists; 0 disables reordering.
+	size_t m_verletUpdatesNumber{ 0 };	// Number of updates of verlet lists since the start of the simulation.
+	bool m_geometryFrames{ false };		// Walls of geometries are stored in body frames and transformed into the world frame only when needed.
+	bool m_numaPlacement{ false };		// Particles are ordered in space and their memory is first touched by threads, which process them, to place it on their NUMA nodes.
+	std::vector<SGeometryFrame> m_frames;	// Body frames of all geometries, if m_geometryFrames is enabled.
+	std::string m_checkpointFile;		// File to write checkpoints of the running simulation into; empty disables checkpoints.
+	double m_checkpointInterval{ 0 };	// Interval of simulation time between periodic checkpoints [s]; 0 writes checkpoints only on external request.
+	double m_lastCheckpointTime{ 0 };	// Time point of the last periodic checkpoint.
+	std::string m_restartFile;			// Checkpoint to restart the simulation from; empty starts the simulation from the beginning.
+	std::vector<uint8_t> m_pbcShifts;	// Shifts of particles over PBC boundaries in the current time step; kept zeroed between steps.
+	double m_pbcContactDistance{ 0 };	// Largest distance of possible contacts at the last refresh of the boundary band of PBC.
+	size_t m_pbcSteps{ 0 };				// Number of checks of particles crossing PBC boundaries.
+	size_t m_pbcCheckedParticles{ 0 };	// Total number of particles analyzed in checks of crossing PBC boundaries.
+	size_t m_pbcFullChecks{ 0 };		// Number of checks of crossing PBC boundaries, which analyzed all particles.
 
 	CCollisionsAnalyzer m_collisionsAnalyzer;
 	CCollisionsCalculator m_collisionsCalculator{ m_scene, m_verletList, m_collisionsAnalyzer };
@@ -17,6 +61,9 @@ class CCPUSimulator : public CBaseSimulator
 	// They are placed here to avoid memory reallocation.
 	std::vector<std::vector<std::vector<SCollision*>>> m_tempCollPPArray{ m_nThreads, std::vector<std::vector<SCollision*>>{ m_nThreads } };
 	std::vector<std::vector<std::vector<SCollision*>>> m_tempCollPWArray{ m_nThreads, std::vector<std::vector<SCollision*>>{ m_nThreads } };
+	// Per-thread buffers of forces for EForceReduction::THREAD_BUFFERS.
+	std::vector<SParticleStruct> m_threadParticles{ m_nThreads };
+	std::vector<SWallStruct> m_threadWalls{ m_nThreads };
 
 public:
 	CCPUSimulator() = default;
@@ -25,6 +72,43 @@ public:
 	void SetSystemStructure(CSystemStructure* _pSystemStructure) override;	// Sets pointer to a system structure.
 	void EnableCollisionsAnalysis(bool _bEnable);	// Enables analyzing of collisions.
 	bool IsCollisionsAnalysisEnabled() const;		// Returns true if analysis of collisions is currently enabled.
+	void SetForceReduction(EForceReduction _reduction);	// Sets the strategy to consolidate contacts.
+	EForceReduction GetForceReduction() const;			// Returns the strategy to consolidate contacts.
+	void SetReorderInterval(size_t _interval);	// Sets how often, in updates of verlet lists, particles are reordered in memory by their positions; 0 disables reordering.
+	size_t GetReorderInterval() const;			// Returns how often, in updates of verlet lists, particles are reordered in memory by their positions.
+	void SetIncrementalVerletUpdate(bool _enable);	// Enables updating of verlet lists only for particles, which moved far enough.
+	bool GetIncrementalVerletUpdate() const;		// Returns true if verlet lists are updated only for particles, which moved far enough.
+	void SetFlatVerletGrid(bool _enable);	// Enables storing of cells of verlet lists in contiguous arrays, filled with counting sort.
+	bool GetFlatVerletGrid() const;			// Returns true if cells of verlet lists are stored in contiguous arrays.
+	void SetVerletBroadPhase(CVerletList::EBroadPhase _broadPhase);	// Sets the algorithm to find possible contacts for verlet lists.
+	CVerletList::EBroadPhase GetVerletBroadPhase() const;			// Returns the algorithm to find possible contacts for verlet lists.
+	void SetWallBVH(bool _enable);	// Enables searching of particle-wall contacts in the bounding volume hierarchy of walls.
+	bool GetWallBVH() const;		// Returns true if particle-wall contacts are searched in the bounding volume hierarchy of walls.
+	void SetSizeClassVerlet(bool _enable);	// Enables verlet distances, proportional to radii of size classes of particles, with updates of verlet lists triggered by each class separately.
+	bool GetSizeClassVerlet() const;		// Returns true if each size class of particles has its own verlet distance.
+	void SetVerletCostModel(bool _enable);	// Enables automatic adjustment of verlet distance by the cost model of counted operations instead of measured time.
+	bool GetVerletCostModel() const;		// Returns true if verlet distance is adjusted by the cost model of counted operations.
+	void SetImplicitPBC(bool _enable);	// Enables finding of contacts through periodic boundaries with minimum-image shifts in a wrapped grid instead of virtual particles.
+	bool GetImplicitPBC() const;		// Returns true if contacts through periodic boundaries are found without virtual particles.
+	void SetGeometryFrames(bool _enable);	// Enables storing of walls of geometries in body frames, transformed into the world frame only when needed.
+	bool GetGeometryFrames() const;			// Returns true if walls of geometries are stored in body frames.
+	void SetNUMAPlacement(bool _enable);	// Enables placing memory of particles on NUMA nodes of threads, which process them.
+	bool GetNUMAPlacement() const;			// Returns true if memory of particles is placed on NUMA nodes of threads, which process them.
+	void SetCheckpointFile(const std::string& _file);	// Sets file to write checkpoints of the running simulation into; empty disables checkpoints.
+	std::string GetCheckpointFile() const;				// Returns file to write checkpoints of the running simulation into.
+	// Sets interval of simulation time between periodic checkpoints; 0 writes checkpoints only on external request.
+	// Each checkpoint also saves the whole system structure into the results file synchronously, which stalls the simulation,
+	// so the interval should be much longer than the saving step.
+	void SetCheckpointInterval(double _interval);
+	double GetCheckpointInterval() const;			// Returns interval of simulation time between periodic checkpoints.
+	void SetRestartFile(const std::string& _file);	// Sets checkpoint to restart the simulation from; empty starts the simulation from the beginning.
+	std::string GetRestartFile() const;				// Returns checkpoint to restart the simulation from.
+	double GetRestartTime() const;					// Returns time point of the checkpoint to restart the simulation from, or 0 if it is not set or cannot be read.
+	std::string IsRestartCorrect() const;			// Checks that the simulation can be restarted from the selected checkpoint. Returns description of the error or an empty string.
+
+	// Writes the complete state of the running simulation into a binary file: the simplified scene, contacts with their history, verlet lists,
+	// motion of geometries and internal variables of models. The simulation restarted from it continues bit-identically. Returns false on error.
+	bool SaveCheckpoint(const std::string& _file);
 
 	void Initialize() override;
 	void InitializeModels() override;
@@ -59,8 +143,28 @@ private:
 	void PrepareAdditionalSavingData() override;
 	void SaveData() override;
 	void UpdateVerletLists(double _dTimeStep);
+	bool ReorderParticles();	// Reorders particles in the scene along a space-filling curve and remaps all their indices in contacts. Returns false if the order has not changed.
+	void PlaceParticlesOnNodes();	// Orders particles in space and places their memory on NUMA nodes of threads, which process them.
+	void PrintNUMAInfo() const;		// Prints the share of memory of particles, which is placed on NUMA nodes of threads processing them.
+	void PrintSizeClassesInfo() const;	// Prints verlet distances, numbers of caused updates and possible contacts of all size classes of particles.
+	void PrintVerletDistanceDecisions() const;	// Prints all adjustments of verlet distance by the cost model.
+	void UpdatePBCBand();			// Refreshes the boundary band of particles, which may cross PBC boundaries or be contact partners of crossing particles.
+	void PrintPBCBandInfo() const;	// Prints the average share of particles analyzed in checks of crossing PBC boundaries.
+	void PrepareThreadBuffers(bool _walls);	// Allocates per-thread buffers of forces for particles or walls, if they do not match the scene.
+	void ReduceThreadBuffers(bool _walls);	// Adds forces from per-thread buffers to particles or walls and resets buffers.
 	void CheckParticlesInDomain();	// Check that all particles are remains in simulation domain.
 
+	void InitializeGeometryFrames();	// Stores current walls of all geometries as their body frames.
+	void TransformGeometryWalls(SGeometryFrame& _frame, bool _all);	// Transforms walls of the geometry into the world frame: all or only those, which may have contacts.
+	void SynchronizeGeometryWalls();	// Transforms all outdated walls of all geometries into the world frame.
+	void UpdateContactWalls();			// Selects walls of each geometry, which are in verlet lists.
+	double GetMaxGeometryVelocity() const;	// Returns maximal velocity of walls, estimated from bounding spheres of geometries.
+
+	void WriteRequestedCheckpoint();				// Writes a checkpoint if its interval has elapsed or it was requested by an external signal.
+	// Restores the state of the initialized simulation from a checkpoint. Returns false on error. The header and models of the checkpoint are checked before any state is changed,
+	// so only a damaged checkpoint, which fails to be read after that, leaves the state partially restored.
+	bool LoadCheckpoint(const std::string& _file);
+
 	// Check that all particles have correct coordinates and update coordinates of virtual particles.
 	// If some real particles crossed the PBC boundaries, returns true (meaning the need to update verlet lists).
 	void MoveParticlesOverPBC();
@@ -20,61 +20,22 @@ CCollisionsCalculator::~CCollisionsCalculator()
 
 void CCollisionsCalculator::ClearCollMatrixes()
 {
-	ClearCollisionMatrix( m_vCollMatrixPP );
-	ClearCollisionMatrix( m_vCollMatrixPW );
+	m_collMatrixPP.Reset(0);
+	m_collMatrixPW.Reset(0);
+	m_prevCollMatrixPP.Reset(0);
+	m_prevCollMatrixPW.Reset(0);
 }
 
 void CCollisionsCalculator::ResizeCollMatrixes()
 {
-	ResizeCollisionMatrix( m_vCollMatrixPP );
-	ResizeCollisionMatrix( m_vCollMatrixPW );
+	ResizeCollisionMatrix( m_collMatrixPP );
+	ResizeCollisionMatrix( m_collMatrixPW );
 }
 
-void CCollisionsCalculator::ClearCollisionMatrix( std::vector<std::vector<SCollision*>>& _matrix )
+void CCollisionsCalculator::ResizeCollisionMatrix( CCollisionsMatrix& _matrix )
 {
-	ParallelFor(_matrix.size(), [&](size_t i)
-	{
-		for (size_t j = 0; j < _matrix[i].size(); j++)
-			if (_matrix[i][j] != nullptr)
-				delete _matrix[i][j]; 			// deallocate memory and remove first pointer
-		_matrix[i].clear();
-	});
-	_matrix.clear();
-}
-
-void CCollisionsCalculator::ResizeCollisionMatrix( std::vector<std::vector<SCollision*>>& _pMatrix )
-{
-	if (_pMatrix.size() != m_Scene.GetTotalParticlesNumber())  // if the matrix was not initialized
-	{
-		ClearCollisionMatrix(_pMatrix);
-		_pMatrix.resize(m_Scene.GetTotalParticlesNumber());
-		for (size_t i = 0; i < _pMatrix.size(); ++i)
-			_pMatrix[i].clear();
-	}
-}
-
-void CCollisionsCalculator::RemoveOldCollisions( std::vector<std::vector<SCollision*>>& _pMatrix )
-{
-	ParallelFor(_pMatrix.size(), [&](size_t i )
-	{
-		size_t j = 0;
-		while ( j < _pMatrix[ i ].size() )
-		{
-			if ( _pMatrix[ i ][ j ] == nullptr )
-				_pMatrix[ i ].erase( _pMatrix[ i ].begin() + j );
-			else
-			{
-				if ( _pMatrix[ i ][ j ]->bContactStillExist == false )
-				{
-					if ( !m_bAnalyzeCollisions )	// otherwise will be really removed in ClearFinishedCollisionMatrix()
-						delete _pMatrix[ i ][ j ];
-					_pMatrix[ i ].erase( _pMatrix[ i ].begin() + j );
-				}
-				else
-					j = j + 1;
-			}
-		}
-	});
+	if (_matrix.Rows() != m_Scene.GetTotalParticlesNumber())  // if the matrix was not initialized
+		_matrix.Reset(m_Scene.GetTotalParticlesNumber());
 }
 
 void CCollisionsCalculator::EnableCollisionsAnalysis( bool _bEnable )
@@ -87,149 +48,190 @@ void CCollisionsCalculator::UpdateCollisionMatrixes( double _dTimeStep, double _
 	ResizeCollMatrixes();
 
 	if ( m_bAnalyzeCollisions )
-		ParallelFor(m_Scene.GetTotalParticlesNumber(), [&](size_t i)
+		ParallelFor(m_Scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 		{
-			for ( size_t j = 0; j < m_vCollMatrixPP[ i ].size(); j++ )
+			for (auto& coll : m_collMatrixPP.Row(i))
 			{
-				m_vCollMatrixPP[ i ][ j ]->pSave->dTimeEnd = _dCurrentTime;
-				m_vCollMatrixPP[ i ][ j ]->bContactStillExist = false;
+				coll.pSave->dTimeEnd = _dCurrentTime;
+				coll.bContactStillExist = false;
 			}
-			for ( size_t j = 0; j < m_vCollMatrixPW[ i ].size(); j++ )
+			for (auto& coll : m_collMatrixPW.Row(i))
 			{
-				m_vCollMatrixPW[ i ][ j ]->pSave->dTimeEnd = _dCurrentTime;
-				m_vCollMatrixPW[ i ][ j ]->bContactStillExist = false;
+				coll.pSave->dTimeEnd = _dCurrentTime;
+				coll.bContactStillExist = false;
 			}
 		});
 	else
-		ParallelFor(m_Scene.GetTotalParticlesNumber(), [&](size_t i)
+		ParallelFor(m_Scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 		{
-			for ( size_t j = 0; j < m_vCollMatrixPP[ i ].size(); j++ )
-				m_vCollMatrixPP[ i ][ j ]->bContactStillExist = false;
-			for (size_t j = 0; j < m_vCollMatrixPW[i].size(); j++)
-				m_vCollMatrixPW[i][j]->bContactStillExist = false;
+			for (auto& coll : m_collMatrixPP.Row(i))
+				coll.bContactStillExist = false;
+			for (auto& coll : m_collMatrixPW.Row(i))
+				coll.bContactStillExist = false;
 		});
 
-	ParallelFor(m_verletList.m_PPList.size(), [&](size_t i)
+	// existing collisions become previous ones; new matrixes are filled from scratch, taking history from previous collisions
+	std::swap(m_collMatrixPP, m_prevCollMatrixPP);
+	std::swap(m_collMatrixPW, m_prevCollMatrixPW);
+
+	const size_t nRows = m_verletList.m_PPList.Rows();
+	const std::vector<size_t>& offsetsPP = m_verletList.m_PPList.Offsets();
+	const std::vector<size_t>& offsetsPW = m_verletList.m_PWList.Offsets();
+	m_collNumberPP.resize(nRows);
+	m_collNumberPW.resize(nRows);
+	m_contactsPP.resize(m_verletList.m_PPList.Size());
+	m_contactsPW.resize(m_verletList.m_PWList.Size());
+
+	// contacts are found and counted first, so that collisions can be written directly into their rows of the new matrixes without copying them
+	const auto possibleCost = [&](size_t i)
+	{
+		return m_verletList.m_PPList.Size(i) + m_verletList.m_PWList.Size(i) + 1;
+	};
+	ParallelFor(nRows, possibleCost, [&](size_t, size_t i)
 	{
-		for (size_t j = 0; j < m_verletList.m_PPList[i].size(); ++j)
-			CheckPPCollision(i, j, _dCurrentTime);
-		CheckPWCollisions( i, _dCurrentTime );
+		m_collNumberPP[i] = FindPPContacts(i, m_contactsPP.data() + offsetsPP[i]);
+		m_collNumberPW[i] = FindPWContacts(i, m_contactsPW.data() + offsetsPW[i]);
 	});
+	m_collMatrixPP.Resize(m_collNumberPP);
+	m_collMatrixPW.Resize(m_collNumberPW);
 
+	// the cost of a particle is mostly defined by the number of found contacts and existing collisions, which are merged
+	const auto contactsCost = [&](size_t i)
+	{
+		return m_collNumberPP[i] + m_prevCollMatrixPP.Size(i) + m_collNumberPW[i] + m_prevCollMatrixPW.Size(i) + 1;
+	};
+	ParallelFor(nRows, contactsCost, [&](size_t, size_t i)
+	{
+		CheckPPCollisions(i, _dCurrentTime, m_contactsPP.data() + offsetsPP[i], m_collNumberPP[i], m_collMatrixPP.Row(i).begin());
+		CheckPWCollisions(i, _dCurrentTime, m_contactsPW.data() + offsetsPW[i], m_collNumberPW[i], m_collMatrixPW.Row(i).begin());
+	});
 
-	// remove unnecessary contacts
+	// save finished contacts
 	if ( m_bAnalyzeCollisions )
 	{
-		CopyFinishedPPCollisions();
-		CopyFinishedPWCollisions();
+		CopyFinishedPPCollisions( m_prevCollMatrixPP );
+		CopyFinishedPWCollisions( m_prevCollMatrixPW );
 	}
-	RemoveOldCollisions( m_vCollMatrixPP );
-	RemoveOldCollisions( m_vCollMatrixPW );
 }
 
-void CCollisionsCalculator::CheckPWCollisions( size_t _nParticle, double _dCurrentTime )
+size_t CCollisionsCalculator::FindPWContacts(size_t _iPart, SPWContact* _contacts) const
+{
+	if (m_verletList.m_PWList.Size(_iPart) == 0) return 0;
+	if (!m_Scene.GetRefToParticles().Active(_iPart)) return 0;
+
+	// reused between calls to avoid reallocations
+	static thread_local std::vector<EIntersectionType> vIntersectionType;
+	static thread_local std::vector<CVector3> vContactPoint;
+	static thread_local std::vector<unsigned> vContacts;
+	m_verletList.GetPWContacts(_iPart, vIntersectionType, vContactPoint, vContacts);
+	for (size_t i = 0; i < vContacts.size(); ++i)
+		_contacts[i] = { vContacts[i], vContactPoint[vContacts[i]] };
+	return vContacts.size();
+}
+
+void CCollisionsCalculator::CheckPWCollisions(size_t _nParticle, double _dCurrentTime, const SPWContact* _contacts, size_t _number, SCollision* _collisions)
 {
-	if ( m_verletList.m_PWList[ _nParticle ].empty() ) return;
+	if (_number == 0) return;
 	const SParticleStruct& pParticles = m_Scene.GetRefToParticles();
 	const SWallStruct& pWalls = m_Scene.GetRefToWalls();
-	if (!pParticles.Active(_nParticle)) return;
 
-	std::vector<EIntersectionType> vIntersectionType;
-	std::vector<CVector3> vContactPoint;
-	m_verletList.GetPWContacts( _nParticle, vIntersectionType, vContactPoint );
+	// reused between calls to avoid reallocations
+	static thread_local std::vector<size_t> newColls; // list of collisions' ID that have been activated at this time step
 
-	auto& partColls = m_vCollMatrixPW[_nParticle]; // vector of collisions for particle _nParticle
+	auto oldColls = m_prevCollMatrixPW.Row(_nParticle);	// collisions of particle _nParticle in the previous time step
 
-	std::vector<size_t> newColls; // list of collisions' ID that have been activated at this time step
-	for (size_t iWall = 0; iWall < vIntersectionType.size(); ++iWall)
+	newColls.clear();
+	// both contacts and previous collisions are ordered by walls and shifts, as in verlet lists, so they are merged in one pass
+	SCollision* itOld = oldColls.begin();
+	for (size_t k = 0; k < _number; ++k)
 	{
-		if (vIntersectionType[iWall] == EIntersectionType::NO_CONTACT) continue;
-		const unsigned nWall = m_verletList.m_PWList[_nParticle][iWall];
-		SCollision* pCollision = nullptr;
+		const unsigned iWall = _contacts[k].iWall;
+		const CVector3& vContactPoint = _contacts[k].vContactPoint;
+		SCollision* pCollision = &_collisions[k];
+		const unsigned nWall = m_verletList.m_PWList.ID(_nParticle, iWall);
+		const uint8_t nVirtShift = m_verletList.m_PWList.Shift(_nParticle, iWall);
+		// skip previous collisions, which do not exist anymore
+		while (itOld != oldColls.end() && (itOld->nSrcID < nWall || (m_Scene.m_PBC.bEnabled && itOld->nSrcID == nWall && itOld->nVirtShift < nVirtShift)))
+			++itOld;
 		// check if this collision have been exists in the previous contact
-		for (auto pOldColl : partColls)
+		SCollision* pOldCollision = itOld != oldColls.end() && itOld->nSrcID == nWall && (!m_Scene.m_PBC.bEnabled || itOld->nVirtShift == nVirtShift) ? itOld : nullptr;
+
+		if (pOldCollision) // take the existing contact
 		{
-			// collision between these particles already exists, it stays virtual, or stays real, or changes its virtuality
-			if (pOldColl->nSrcID == nWall && (!m_Scene.m_PBC.bEnabled || pOldColl->nVirtShift == m_verletList.m_PWVirtShift[_nParticle][iWall]))
-			{
-				pCollision = pOldColl;
-				if (m_Scene.m_PBC.bEnabled)
-					pCollision->nVirtShift = m_verletList.m_PWVirtShift[_nParticle][iWall]; // update shift info in case if real collision became virtual or vice versa
-				break; // such contact was in previous step
-			}
+			pOldCollision->bContactStillExist = true;
+			*pCollision = *pOldCollision;
+			if (m_Scene.m_PBC.bEnabled)
+				pCollision->nVirtShift = nVirtShift; // update shift info in case if real collision became virtual or vice versa
 		}
-
-		if (pCollision == nullptr) // create new contact
+		else // create new contact
 		{
-			pCollision = new SCollision();
+			*pCollision = SCollision{};
 			pCollision->nSrcID = nWall;
 			pCollision->nDstID = static_cast<unsigned>(_nParticle);
 			pCollision->pSave = nullptr;
 			pCollision->nInteractProp = static_cast<uint16_t>(pWalls.CompoundIndex(nWall) * m_Scene.GetCompoundsNumber() + pParticles.CompoundIndex(_nParticle));
 			if (m_Scene.m_PBC.bEnabled)
-				pCollision->nVirtShift = m_verletList.m_PWVirtShift[_nParticle][iWall];
+				pCollision->nVirtShift = nVirtShift;
 
 			// TODO: to conform with new PBC
 			if ( m_bAnalyzeCollisions )
 			{
 				const int nGeomIndex = GetGeometryIndex( nWall );
-				for ( size_t i = 0; i < partColls.size(); ++i )
-					if (partColls[ i ]->pSave->nGeomID == nGeomIndex )
+				// collisions of the particle with walls: existing ones and already found at this time step
+				const auto FindSaved = [&](const SCollision& _other)
+				{
+					if (_other.pSave->nGeomID != nGeomIndex) return false;
+					// collision between these particle and geometry already exists
+					pCollision->pSave = _other.pSave;
+					pCollision->pSave->nCnt++;
+					if ( pCollision->pSave->dTimeStart == _dCurrentTime ) // it is another contact in first time point of collision
 					{
-						// collision between these particle and geometry already exists
-						pCollision->pSave = partColls[ i ]->pSave;
-						pCollision->pSave->nCnt++;
-						pCollision->pSave->vPtr.push_back( pCollision );
-						if ( pCollision->pSave->dTimeStart == _dCurrentTime ) // it is another contact in first time point of collision
-						{
-							CVector3 vecNormV, vecTangV;
-							CalculatePWContactVelocity( nWall, _nParticle, vContactPoint[ i ], vecNormV, vecTangV );
-							pCollision->pSave->vNormVelocity = MaxLength( vecNormV, pCollision->pSave->vNormVelocity );
-							pCollision->pSave->vTangVelocity = MaxLength(vecTangV, pCollision->pSave->vTangVelocity);
-						}
-						break;
+						CVector3 vecNormV, vecTangV;
+						CalculatePWContactVelocity( nWall, _nParticle, vContactPoint, vecNormV, vecTangV );
+						pCollision->pSave->vNormVelocity = MaxLength( vecNormV, pCollision->pSave->vNormVelocity );
+						pCollision->pSave->vTangVelocity = MaxLength(vecTangV, pCollision->pSave->vTangVelocity);
 					}
+					return true;
+				};
+				bool found = false;
+				for (const auto& oldColl : oldColls)
+					if ((found = FindSaved(oldColl))) break;
+				for (size_t i = 0; i < k && !found; ++i)
+					found = FindSaved(_collisions[i]);
 
 				// create completely new collision
 				if ( !pCollision->pSave )
 				{
-					pCollision->pSave = new SSavedCollision();
+					pCollision->pSave = CSavedCollisionsPool::New();
 					pCollision->pSave->nCnt = 1;
-					pCollision->pSave->vPtr.push_back( pCollision );
 					pCollision->pSave->nGeomID = nGeomIndex;
 					pCollision->pSave->dTimeStart = _dCurrentTime;
-					CalculatePWContactVelocity( nWall, _nParticle, vContactPoint[ iWall ], pCollision->pSave->vNormVelocity, pCollision->pSave->vTangVelocity );
-					pCollision->pSave->vContactPoint = vContactPoint[ iWall ];
+					CalculatePWContactVelocity( nWall, _nParticle, vContactPoint, pCollision->pSave->vNormVelocity, pCollision->pSave->vTangVelocity );
+					pCollision->pSave->vContactPoint = vContactPoint;
 				}
 			}
 
-			newColls.push_back(partColls.size());
-			partColls.push_back(pCollision);
+			newColls.push_back(k);
 		}
-		pCollision->vContactVector = vContactPoint[ iWall ];
+		pCollision->vContactVector = vContactPoint;
 		pCollision->bContactStillExist = true;
 	}
 
 	if (!newColls.empty())
 	{
-		// gather deactivated collisions
-		std::vector<size_t> oldColls;
-		for (size_t i = 0; i < partColls.size(); ++i)
-			if (!partColls[i]->bContactStillExist)
-				oldColls.push_back(i);
-
 		for (size_t iCollNew : newColls)								// iterate all new activated collisions
 		{
-			const auto wallIDNew = partColls[iCollNew]->nSrcID;			// wall ID in new activated collision
+			const auto wallIDNew = _collisions[iCollNew].nSrcID;		// wall ID in new activated collision
 			bool found = false;
-			for (size_t iCollOld : oldColls)							// iterate all old deactivated collisions
+			for (const auto& oldColl : oldColls)						// iterate all old deactivated collisions
 			{
 				if (found) break;
-				const auto wallIDOld = partColls[iCollOld]->nSrcID;		// wall ID in old deactivated collision
+				if (oldColl.bContactStillExist) continue;
+				const auto wallIDOld = oldColl.nSrcID;					// wall ID in old deactivated collision
 				for (auto iWall : m_Scene.m_adjacentWalls[wallIDNew])	// iterate all walls adjacent to new wall
 					if (iWall == wallIDOld)								// ID of the wall in this deactivated collision belongs to the list of adjacent walls
 					{
-						partColls[iCollNew]->vTangOverlap = partColls[iCollOld]->vTangOverlap;	// copy data
+						_collisions[iCollNew].vTangOverlap = oldColl.vTangOverlap;	// copy data
 						found = true;
 						break;
 					}
@@ -238,36 +240,64 @@ void CCollisionsCalculator::CheckPWCollisions( size_t _nParticle, double _dCurre
 	}
 }
 
-void CCollisionsCalculator::CheckPPCollision(size_t _iPart1, size_t _iPart2, double _dCurrentTime)
+size_t CCollisionsCalculator::FindPPContacts(size_t _iPart, unsigned* _contacts) const
+{
+	const SParticleStruct& pParticles = m_Scene.GetRefToParticles();
+	if (!pParticles.Active(_iPart)) return 0;
+
+	size_t number = 0;
+	const auto partners = m_verletList.m_PPList.Row(_iPart);
+	for (unsigned j = 0; j < partners.size(); ++j)
+	{
+		const size_t nPart2 = partners[j];
+		if (!pParticles.Active(nPart2)) continue;
+		const uint8_t nVirtShift = m_verletList.m_PPList.Shift(_iPart, j);
+		const CVector3 vCoord2 = m_Scene.m_PBC.bEnabled && nVirtShift != 0 ? GetVirtualProperty(pParticles.Coord(nPart2), nVirtShift, m_Scene.m_PBC) : pParticles.Coord(nPart2);
+		const double dContactDistance = pParticles.ContactRadius(_iPart) + pParticles.ContactRadius(nPart2);
+		if (SquaredLength(vCoord2 - pParticles.Coord(_iPart)) < dContactDistance * dContactDistance)
+			_contacts[number++] = j;
+	}
+	return number;
+}
+
+void CCollisionsCalculator::CheckPPCollisions(size_t _iPart1, double _dCurrentTime, const unsigned* _contacts, size_t _number, SCollision* _collisions)
 {
 	const size_t nPart1 = _iPart1;
-	const size_t nPart2 = m_verletList.m_PPList[_iPart1][_iPart2];
-	const bool bVirtContact = m_Scene.m_PBC.bEnabled && (m_verletList.m_PPVirtShift[_iPart1][_iPart2] != 0);
 	const SParticleStruct& pParticles = m_Scene.GetRefToParticles();
-	if (!pParticles.Active(nPart1) || !pParticles.Active(nPart2)) return;
 
-	const CVector3 vContactVector = !bVirtContact ?
-		pParticles.Coord(nPart2) - pParticles.Coord(nPart1) :
-		GetVirtualProperty(pParticles.Coord(nPart2), m_verletList.m_PPVirtShift[_iPart1][_iPart2], m_Scene.m_PBC) - pParticles.Coord(nPart1);
-	const double dSquaredDistance = SquaredLength(vContactVector);
-	if ((pParticles.ContactRadius(nPart1) + pParticles.ContactRadius(nPart2))*(pParticles.ContactRadius(nPart1) + pParticles.ContactRadius(nPart2)) > dSquaredDistance)
+	// both found contacts and previous collisions are ordered by partners and shifts, as in verlet lists, so they are merged in one pass
+	auto oldColls = m_prevCollMatrixPP.Row(nPart1);
+	SCollision* itOld = oldColls.begin();
+	const auto partners = m_verletList.m_PPList.Row(nPart1);
+	for (size_t k = 0; k < _number; ++k)
 	{
-		SCollision* pCollision = nullptr;
+		const size_t j = _contacts[k];
+		const size_t nPart2 = partners[j];
+		const uint8_t nVirtShift = m_verletList.m_PPList.Shift(nPart1, j);
+		const bool bVirtContact = m_Scene.m_PBC.bEnabled && (nVirtShift != 0);
+		SCollision* pCollision = &_collisions[k];
+
+		const CVector3 vContactVector = !bVirtContact ?
+			pParticles.Coord(nPart2) - pParticles.Coord(nPart1) :
+			GetVirtualProperty(pParticles.Coord(nPart2), nVirtShift, m_Scene.m_PBC) - pParticles.Coord(nPart1);
+		const double dSquaredDistance = SquaredLength(vContactVector);
+
+		// skip previous collisions, which do not exist anymore
+		while (itOld != oldColls.end() && (itOld->nDstID < nPart2 || (m_Scene.m_PBC.bEnabled && itOld->nDstID == nPart2 && itOld->nVirtShift < nVirtShift)))
+			++itOld;
 		// check if this collision have been existed in the previous contact
-		for (auto pOldColl : m_vCollMatrixPP[nPart1])
+		SCollision* pOldCollision = itOld != oldColls.end() && itOld->nDstID == nPart2 && (!m_Scene.m_PBC.bEnabled || itOld->nVirtShift == nVirtShift) ? itOld : nullptr;
+
+		if (pOldCollision) // take the existing contact
 		{
-			if (pOldColl->nDstID == nPart2 && (!m_Scene.m_PBC.bEnabled || pOldColl->nVirtShift == m_verletList.m_PPVirtShift[_iPart1][_iPart2]))
-			{
-				pCollision = pOldColl;
-				if (m_Scene.m_PBC.bEnabled)
-					pCollision->nVirtShift = m_verletList.m_PPVirtShift[_iPart1][_iPart2]; // update shift info in case if real collision became virtual or vice versa
-				break; // such contact was in previous step
-			}
+			pOldCollision->bContactStillExist = true;
+			*pCollision = *pOldCollision;
+			if (m_Scene.m_PBC.bEnabled)
+				pCollision->nVirtShift = nVirtShift; // update shift info in case if real collision became virtual or vice versa
 		}
-
-		if (pCollision == nullptr)  // allocate memory for a new collision
+		else // create a new collision
 		{
-			pCollision = new SCollision();
+			*pCollision = SCollision{};
 			pCollision->nSrcID = static_cast<unsigned>(nPart1);
 			pCollision->nDstID = static_cast<unsigned>(nPart2);
 			pCollision->pSave = nullptr;
@@ -275,12 +305,12 @@ void CCollisionsCalculator::CheckPPCollision(size_t _iPart1, size_t _iPart2, dou
 			pCollision->dEquivRadius = pParticles.ContactRadius(nPart1)*pParticles.ContactRadius(nPart2) / (pParticles.ContactRadius(nPart1) + pParticles.ContactRadius(nPart2));
 			pCollision->dEquivMass = pParticles.Mass(nPart1)*pParticles.Mass(nPart2) / (pParticles.Mass(nPart1) + pParticles.Mass(nPart2));
 			if (m_Scene.m_PBC.bEnabled)
-				pCollision->nVirtShift = bVirtContact ? m_verletList.m_PPVirtShift[_iPart1][_iPart2] : 0;
+				pCollision->nVirtShift = bVirtContact ? nVirtShift : 0;
 
 			// TODO: to conform with new PBC
 			if (m_bAnalyzeCollisions)
 			{
-				pCollision->pSave = new SSavedCollision();
+				pCollision->pSave = CSavedCollisionsPool::New();
 				pCollision->pSave->nCnt = 1;
 				pCollision->pSave->dTimeStart = _dCurrentTime;
 
@@ -298,8 +328,6 @@ void CCollisionsCalculator::CheckPPCollision(size_t _iPart1, size_t _iPart2, dou
 				pCollision->pSave->vTangVelocity = vecRelVelTang;
 				pCollision->pSave->vContactPoint = vecContactPoint;
 			}
-
-			m_vCollMatrixPP[nPart1].push_back(pCollision);
 		}
 		pCollision->dNormalOverlap = pParticles.ContactRadius(nPart1) + pParticles.ContactRadius(nPart2) - sqrt(dSquaredDistance);
 		pCollision->vContactVector = vContactVector;
@@ -348,9 +376,8 @@ void CCollisionsCalculator::ClearFinishedCollisionMatrix( std::vector<SCollision
 	for (size_t i = 0; i < _matrix.size(); ++i)
 		if (_matrix[i])
 		{
-			if (_matrix[i]->pSave)
-				delete _matrix[i]->pSave;
-			delete _matrix[i];
+			CSavedCollisionsPool::Delete(_matrix[i]->pSave);
+			CCollisionsPool::Delete(_matrix[i]);
 		}
 	_matrix.clear();
 }
@@ -369,23 +396,23 @@ void CCollisionsCalculator::SaveCollisions()
 void CCollisionsCalculator::SaveRestCollisions()
 {
 	if ( !m_bAnalyzeCollisions ) return;
-	ParallelFor(m_Scene.GetTotalParticlesNumber(), [&](size_t i)
+	ParallelFor(m_Scene.GetTotalParticlesNumber(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
 	{
-		for ( size_t j = 0; j < m_vCollMatrixPP[ i ].size(); j++ )
+		for (auto& coll : m_collMatrixPP.Row(i))
 		{
-			m_vCollMatrixPP[ i ][ j ]->pSave->dTimeEnd = -1;	// not finished collision
-			m_vCollMatrixPP[ i ][ j ]->bContactStillExist = false;
+			coll.pSave->dTimeEnd = -1;	// not finished collision
+			coll.bContactStillExist = false;
 		}
-		for ( size_t j = 0; j < m_vCollMatrixPW[ i ].size(); j++ )
+		for (auto& coll : m_collMatrixPW.Row(i))
 		{
-			m_vCollMatrixPW[ i ][ j ]->pSave->dTimeEnd = -1; 	// not finished collision
-			m_vCollMatrixPW[ i ][ j ]->bContactStillExist = false;
+			coll.pSave->dTimeEnd = -1; 	// not finished collision
+			coll.bContactStillExist = false;
 		}
 	});
-	CopyFinishedPPCollisions();
-	CopyFinishedPWCollisions();
-	RemoveOldCollisions( m_vCollMatrixPP );
-	RemoveOldCollisions( m_vCollMatrixPW );
+	CopyFinishedPPCollisions( m_collMatrixPP );
+	CopyFinishedPWCollisions( m_collMatrixPW );
+	m_collMatrixPP.Reset(m_Scene.GetTotalParticlesNumber());
+	m_collMatrixPW.Reset(m_Scene.GetTotalParticlesNumber());
 
 	RecalculateSavedIDs();
 	m_collisionsAnalyzer.AddCollisions( m_vFinishedCollisionsPP, m_vFinishedCollisionsPW );
@@ -395,14 +422,18 @@ void CCollisionsCalculator::SaveRestCollisions()
 	ClearFinishedCollisionMatrix( m_vFinishedCollisionsPW );
 }
 
-void CCollisionsCalculator::CopyFinishedPPCollisions()
+void CCollisionsCalculator::CopyFinishedPPCollisions( CCollisionsMatrix& _matrix )
 {
 	if (!m_pSystemStructure->GetPBC().bEnabled)	// no PBC
 	{
-		for (size_t i = 0; i < m_vCollMatrixPP.size(); ++i)
-			for (size_t j = 0; j < m_vCollMatrixPP[i].size(); ++j)
-				if ((!m_vCollMatrixPP[i][j]->bContactStillExist) && (m_vCollMatrixPP[i][j]->pSave->dTimeStart != m_vCollMatrixPP[i][j]->pSave->dTimeEnd))
-					m_vFinishedCollisionsPP.push_back(m_vCollMatrixPP[i][j]);
+		for (auto& coll : _matrix.Data())
+			if (!coll.bContactStillExist)
+			{
+				if (coll.pSave->dTimeStart != coll.pSave->dTimeEnd)
+					m_vFinishedCollisionsPP.push_back(CCollisionsPool::New(coll));
+				else	// too short collision, nothing to save
+					CSavedCollisionsPool::Delete(coll.pSave);
+			}
 	}
 	// TODO: collisions saving with new PBC.
 	else // if PBC exists
@@ -432,29 +463,18 @@ void CCollisionsCalculator::CopyFinishedPPCollisions()
 	}
 }
 
-void CCollisionsCalculator::CopyFinishedPWCollisions()
+void CCollisionsCalculator::CopyFinishedPWCollisions( CCollisionsMatrix& _matrix )
 {
-	for ( size_t i = 0; i < m_vCollMatrixPW.size(); ++i )
-		for (size_t j = 0; j < m_vCollMatrixPW[i].size(); ++j)
-		{
-			SCollision* coll = m_vCollMatrixPW[i][j];
-			if ((!coll->bContactStillExist) && (coll->pSave->dTimeStart != coll->pSave->dTimeEnd))
-			{
-				if (coll->pSave->nCnt == 1)	// collision is ended
-					m_vFinishedCollisionsPW.push_back(coll);
-				else	// not fully finished collision
-				{
-					coll->pSave->nCnt--;
-					// remove pointer to itself
-					std::vector<SCollision*>::iterator it = std::find(coll->pSave->vPtr.begin(), coll->pSave->vPtr.end(), coll);
-					if (it != coll->pSave->vPtr.end())
-						coll->pSave->vPtr.erase(it);
-					// delete collision
-					delete m_vCollMatrixPW[i][j];
-					m_vCollMatrixPW[i][j] = nullptr;
-				}
-			}
-		}
+	for (auto& coll : _matrix.Data())
+	{
+		if (coll.bContactStillExist) continue;
+		if (coll.pSave->nCnt > 1)	// not fully finished collision, other contacts with the same geometry still exist
+			coll.pSave->nCnt--;
+		else if (coll.pSave->dTimeStart != coll.pSave->dTimeEnd)	// collision is ended
+			m_vFinishedCollisionsPW.push_back(CCollisionsPool::New(coll));
+		else	// too short collision, nothing to save
+			CSavedCollisionsPool::Delete(coll.pSave);
+	}
 }
 
 void CCollisionsCalculator::RecalculateSavedIDs()
@@ -471,32 +491,112 @@ void CCollisionsCalculator::RecalculateSavedIDs()
 	}
 }
 
-void CCollisionsCalculator::CalculateStatisticInfo( std::vector<std::vector<SCollision*>>& _matrix )
+void CCollisionsCalculator::SaveState(std::ostream& _s) const
+{
+	m_collMatrixPP.Save(_s);
+	m_collMatrixPW.Save(_s);
+}
+
+void CCollisionsCalculator::LoadState(std::istream& _s)
 {
-	ParallelFor(_matrix.size(), [&](size_t i)
+	ClearCollMatrixes();
+	m_collMatrixPP.Load(_s);
+	m_collMatrixPW.Load(_s);
+}
+
+void CCollisionsCalculator::RemapParticles(const std::vector<unsigned>& _newIndex)
+{
+	// finished collisions keep indices of the scene until they are saved
+	for (auto* coll : m_vFinishedCollisionsPP)
 	{
-		for ( size_t j = 0; j < _matrix[ i ].size(); j++ )
+		coll->nSrcID = _newIndex[coll->nSrcID];
+		coll->nDstID = _newIndex[coll->nDstID];
+	}
+	for (auto* coll : m_vFinishedCollisionsPW)
+		coll->nDstID = _newIndex[coll->nDstID];
+
+	// PP collisions are stored in the row of the particle with the smaller index, as in verlet lists; if the order of particles changes, the collision is turned around
+	const auto FlipPP = [](SCollision& _coll)
+	{
+		std::swap(_coll.nSrcID, _coll.nDstID);
+		std::swap(_coll.vResultMoment1, _coll.vResultMoment2);
+		_coll.nVirtShift = InverseVirtShift(_coll.nVirtShift);
+		_coll.vContactVector *= -1;
+		_coll.vTangOverlap *= -1;
+		_coll.vTangForce *= -1;
+		_coll.vTotalForce *= -1;
+		_coll.dHeatFlux *= -1;
+	};
+	// moves all collisions of _matrix into rows of their new source particles, using the previous matrix as a buffer
+	const auto Remap = [&](CCollisionsMatrix& _matrix, CCollisionsMatrix& _buffer, bool _pp)
+	{
+		std::vector<SCollision>& colls = _matrix.Data();
+		ParallelFor(colls.size(), [&](size_t i)
+		{
+			SCollision& coll = colls[i];
+			coll.nDstID = _newIndex[coll.nDstID];
+			if (!_pp) return;
+			coll.nSrcID = _newIndex[coll.nSrcID];
+			if (coll.nSrcID > coll.nDstID)
+				FlipPP(coll);
+		});
+
+		std::vector<size_t> sizes(_newIndex.size(), 0);
+		for (const auto& coll : colls)
+			sizes[_pp ? coll.nSrcID : coll.nDstID]++;
+		std::vector<size_t> offsets(sizes.size(), 0);
+		for (size_t i = 1; i < sizes.size(); ++i)
+			offsets[i] = offsets[i - 1] + sizes[i - 1];
+		std::vector<std::vector<SCollision>> sorted(1, std::vector<SCollision>(colls.size()));
+		for (const auto& coll : colls)
+			sorted.front()[offsets[_pp ? coll.nSrcID : coll.nDstID]++] = coll;
+		// keep collisions of each particle ordered by partners and shifts, as in verlet lists, to merge them with possible contacts
+		ParallelFor(sizes.size(), EScheduling::CONTIGUOUS, [&](size_t, size_t i)
+		{
+			const auto first = sorted.front().begin() + (offsets[i] - sizes[i]);
+			const auto last = sorted.front().begin() + offsets[i];
+			if (_pp)
+				std::sort(first, last, [](const SCollision& _c1, const SCollision& _c2) { return _c1.nDstID < _c2.nDstID || (_c1.nDstID == _c2.nDstID && _c1.nVirtShift < _c2.nVirtShift); });
+			else
+				std::sort(first, last, [](const SCollision& _c1, const SCollision& _c2) { return _c1.nSrcID < _c2.nSrcID || (_c1.nSrcID == _c2.nSrcID && _c1.nVirtShift < _c2.nVirtShift); });
+		});
+
+		_buffer.Assign(sizes, sorted);
+		std::swap(_matrix, _buffer);
+	};
+	Remap(m_collMatrixPP, m_prevCollMatrixPP, true);
+	Remap(m_collMatrixPW, m_prevCollMatrixPW, false);
+}
+
+void CCollisionsCalculator::CalculateStatisticInfo( CCollisionsMatrix& _matrix )
+{
+	ParallelFor(_matrix.Rows(), [&](size_t i) { return _matrix.Size(i); }, [&](size_t, size_t i)
+	{
+		const auto row = _matrix.Row(i);
+		for (auto& coll : row)
 		{
-			SCollision* pColl = _matrix[i][j];
-			if (pColl->pSave->nCnt < 2 )
+			SSavedCollision* pSave = coll.pSave;
+			if (pSave->nCnt < 2 )
 			{
-				pColl->pSave->vMaxTotalForce = MaxLength(pColl->vTotalForce, pColl->pSave->vMaxTotalForce);
-				pColl->pSave->vMaxTangForce = MaxLength(pColl->vTangForce, pColl->pSave->vMaxTangForce);
-				CVector3 vNormF = pColl->vTotalForce - pColl->vTangForce;
-				pColl->pSave->vMaxNormForce = MaxLength(vNormF, pColl->pSave->vMaxNormForce);
+				pSave->vMaxTotalForce = MaxLength(coll.vTotalForce, pSave->vMaxTotalForce);
+				pSave->vMaxTangForce = MaxLength(coll.vTangForce, pSave->vMaxTangForce);
+				CVector3 vNormF = coll.vTotalForce - coll.vTangForce;
+				pSave->vMaxNormForce = MaxLength(vNormF, pSave->vMaxNormForce);
 			}
 			else
 			{
+				// all simultaneous contacts of a particle with one geometry belong to the same particle
 				CVector3 vSumTotF(0), vSumTanF(0);
-				for ( size_t k = 0; k < pColl->pSave->vPtr.size(); ++k )
-				{
-					vSumTotF += pColl->pSave->vPtr[ k ]->vTotalForce;
-					vSumTanF += pColl->pSave->vPtr[ k ]->vTangForce;
-				}
-				pColl->pSave->vMaxTotalForce = MaxLength(vSumTotF, pColl->pSave->vMaxTotalForce);
-				pColl->pSave->vMaxTangForce = MaxLength(vSumTanF, pColl->pSave->vMaxTangForce);
+				for (const auto& other : row)
+					if (other.pSave == pSave)
+					{
+						vSumTotF += other.vTotalForce;
+						vSumTanF += other.vTangForce;
+					}
+				pSave->vMaxTotalForce = MaxLength(vSumTotF, pSave->vMaxTotalForce);
+				pSave->vMaxTangForce = MaxLength(vSumTanF, pSave->vMaxTangForce);
 				CVector3 vSumNormF = vSumTotF - vSumTanF;
-				pColl->pSave->vMaxNormForce = MaxLength(vSumNormF, pColl->pSave->vMaxNormForce);
+				pSave->vMaxNormForce = MaxLength(vSumNormF, pSave->vMaxNormForce);
 			}
 		}
 	});
@@ -506,7 +606,14 @@ void CCollisionsCalculator::CalculateTotalStatisticsInfo()
 {
 	if ( m_bAnalyzeCollisions )
 	{
-		CalculateStatisticInfo( m_vCollMatrixPP );
-		CalculateStatisticInfo( m_vCollMatrixPW );
+		CalculateStatisticInfo( m_collMatrixPP );
+		CalculateStatisticInfo( m_collMatrixPW );
 	}
-}
\ No newline at end of file
+}
+
+size_t CCollisionsCalculator::GetMemoryUsage() const
+{
+	size_t res = m_collMatrixPP.MemoryUsage() + m_collMatrixPW.MemoryUsage() + m_prevCollMatrixPP.MemoryUsage() + m_prevCollMatrixPW.MemoryUsage();
+	res += m_contactsPP.capacity() * sizeof(unsigned) + m_contactsPW.capacity() * sizeof(SPWContact);
+	return res;
+}
@@ -9,6 +9,12 @@
 #include "ThreadPool.h"
 #include "VerletList.h"
 #include "CollisionsAnalyzer.h"
+#include "CollisionsMatrix.h"
+#include "ObjectPool.h"
+
+// Allocators for finished collisions, which are kept until they are saved.
+using CCollisionsPool = CObjectPool<SCollision>;
+using CSavedCollisionsPool = CObjectPool<SSavedCollision>;
 
 class CCollisionsCalculator : public CMusenComponent
 {
@@ -21,30 +27,49 @@ protected:
 	CCollisionsAnalyzer& m_collisionsAnalyzer;
 	bool m_bAnalyzeCollisions{ false };
 
+	// collisions of the previous time step, used to take history of the existing contacts
+	CCollisionsMatrix m_prevCollMatrixPP;
+	CCollisionsMatrix m_prevCollMatrixPW;
+	// Particle-wall contact, found in the current time step: index of the wall in the row of the verlet list and contact point.
+	struct SPWContact
+	{
+		unsigned iWall;
+		CVector3 vContactPoint;
+	};
+	// contacts, found in the current time step before collisions are created; contacts of each particle are placed at the offset of its row of the verlet list.
+	// placed here to avoid memory reallocation
+	std::vector<unsigned> m_contactsPP;		// indices of partners in rows of the verlet list
+	std::vector<SPWContact> m_contactsPW;
+	// number of collisions of each particle in the current time step
+	std::vector<size_t> m_collNumberPP;
+	std::vector<size_t> m_collNumberPW;
+
 public:
-	std::vector< std::vector<SCollision*>> m_vCollMatrixPP;
-	std::vector< std::vector<SCollision*>> m_vCollMatrixPW;
+	CCollisionsMatrix m_collMatrixPP;
+	CCollisionsMatrix m_collMatrixPW;
 
 private:
-	void ClearCollisionMatrix( std::vector<std::vector<SCollision*>>& _pMatrix ); // removes all entries from collision matrix
-	void ResizeCollisionMatrix( std::vector<std::vector<SCollision*>>& _pMatrix );
+	void ResizeCollisionMatrix( CCollisionsMatrix& _matrix );
 
-	// remove all contacts which are not active in the current time step
-	void RemoveOldCollisions( std::vector<std::vector<SCollision*>>& _pMatrix );
-
-	void CheckPPCollision(size_t _iPart1, size_t _iPart2, double _dCurrentTime); // check the collision between two particles
-	void CheckPWCollisions( size_t _nParticle, double _dCurrentTime ); // check the between particle and wall
+	// find possible contact partners of particle, which are in contact with it, write them to _contacts and return their number
+	size_t FindPPContacts(size_t _iPart, unsigned* _contacts) const;
+	// find walls, which are in contact with particle, write them to _contacts and return their number
+	size_t FindPWContacts(size_t _iPart, SPWContact* _contacts) const;
+	// create collisions between particle and its _number found contact partners, taking history from previous collisions, and write them to _collisions
+	void CheckPPCollisions(size_t _iPart1, double _dCurrentTime, const unsigned* _contacts, size_t _number, SCollision* _collisions);
+	// create collisions between particle and _number found walls, taking history from previous collisions, and write them to _collisions
+	void CheckPWCollisions(size_t _nParticle, double _dCurrentTime, const SPWContact* _contacts, size_t _number, SCollision* _collisions);
 
 	/// Return index of a geometry, which contains triangular wall with index _nWallIndex.
 	int GetGeometryIndex( unsigned _nWallIndex ) const;
 	void CalculatePWContactVelocity(size_t _nWall, size_t _nPart, const CVector3& _vecContactPoint, CVector3& _vecNormV, CVector3& _vecTangV) const;
 	// remove all finished contacts from temporary matrix
 	void ClearFinishedCollisionMatrix( std::vector<SCollision*>& _matrix );
-	void CalculateStatisticInfo( std::vector<std::vector<SCollision*>>& _matrix );
+	void CalculateStatisticInfo( CCollisionsMatrix& _matrix );
 
-	// saves pointers to finished collisions
-	void CopyFinishedPPCollisions();
-	void CopyFinishedPWCollisions();
+	// saves copies of collisions from _matrix, which do not exist anymore
+	void CopyFinishedPPCollisions( CCollisionsMatrix& _matrix );
+	void CopyFinishedPWCollisions( CCollisionsMatrix& _matrix );
 
 public:
 	CCollisionsCalculator(CSimplifiedScene& _scene, CVerletList& _list, CCollisionsAnalyzer& _analyzer);
@@ -63,4 +88,13 @@ public:
 	void SaveRestCollisions();
 	void SaveCollisions();
 	void RecalculateSavedIDs();
-};
\ No newline at end of file
+	// Updates indices of particles in all collisions after reordering of particles in the scene. _newIndex contains the new index of each particle.
+	void RemapParticles(const std::vector<unsigned>& _newIndex);
+	// Writes current collisions with their history into binary stream.
+	void SaveState(std::ostream& _s) const;
+	// Restores current collisions written with SaveState.
+	void LoadState(std::istream& _s);
+
+	// Returns memory reserved to store all collisions, in bytes.
+	size_t GetMemoryUsage() const;
+};
@@ -0,0 +1,104 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+#include "SceneTypes.h"
+#include "ThreadPool.h"
+#include "BinaryStream.h"
+
+// Collisions of all particles, stored contiguously in compressed sparse row format.
+// Collisions of particle i occupy range [m_offsets[i]; m_offsets[i + 1]) of m_collisions, so that all collisions can be streamed linearly.
+// Within a row, collisions are ordered by contact partners and virtual shifts, as possible contacts in verlet lists.
+class CCollisionsMatrix
+{
+public:
+	// Contiguous range of collisions of one particle, usable in range-based for loops.
+	template <typename T>
+	struct SRow
+	{
+		T* first;
+		T* last;
+
+		T* begin() const { return first; }
+		T* end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+		bool empty() const { return first == last; }
+	};
+
+private:
+	std::vector<size_t> m_offsets{ 0 };		// Index of the first collision of each particle, the last element is the total number of collisions.
+	std::vector<SCollision> m_collisions;	// All collisions, ordered by particles.
+
+public:
+	// Returns the number of particles.
+	size_t Rows() const { return m_offsets.size() - 1; }
+	// Returns the total number of collisions.
+	size_t Size() const { return m_collisions.size(); }
+	// Returns the number of collisions of particle _iRow.
+	size_t Size(size_t _iRow) const { return m_offsets[_iRow + 1] - m_offsets[_iRow]; }
+	// Returns memory reserved to store collisions, in bytes.
+	size_t MemoryUsage() const { return m_collisions.capacity() * sizeof(SCollision) + m_offsets.capacity() * sizeof(size_t); }
+
+	// Returns collisions of particle _iRow.
+	SRow<SCollision> Row(size_t _iRow) { return { m_collisions.data() + m_offsets[_iRow], m_collisions.data() + m_offsets[_iRow + 1] }; }
+	SRow<const SCollision> Row(size_t _iRow) const { return { m_collisions.data() + m_offsets[_iRow], m_collisions.data() + m_offsets[_iRow + 1] }; }
+
+	// Returns collision with index _i over all particles.
+	SCollision& operator[](size_t _i) { return m_collisions[_i]; }
+	const SCollision& operator[](size_t _i) const { return m_collisions[_i]; }
+	// Returns all collisions of all particles.
+	std::vector<SCollision>& Data() { return m_collisions; }
+	const std::vector<SCollision>& Data() const { return m_collisions; }
+
+	// Removes all collisions and sets the number of particles.
+	void Reset(size_t _rows)
+	{
+		m_offsets.assign(_rows + 1, 0);
+		m_collisions.clear();
+	}
+
+	// Sets the number of collisions of each particle from _sizes, so that rows can be filled directly.
+	// Collisions are kept or default-constructed and must be overwritten.
+	void Resize(const std::vector<size_t>& _sizes)
+	{
+		m_offsets.resize(_sizes.size() + 1);
+		m_offsets[0] = 0;
+		for (size_t i = 0; i < _sizes.size(); ++i)
+			m_offsets[i + 1] = m_offsets[i] + _sizes[i];
+		m_collisions.resize(m_offsets.back());
+	}
+
+	// Fills the matrix with collisions from _parts. Each part contains collisions of several subsequent particles, parts are ordered by particles.
+	// _sizes contains the number of collisions of each particle.
+	void Assign(const std::vector<size_t>& _sizes, const std::vector<std::vector<SCollision>>& _parts)
+	{
+		Resize(_sizes);
+
+		// positions of each part in the matrix
+		std::vector<size_t> starts(_parts.size() + 1, 0);
+		for (size_t i = 0; i < _parts.size(); ++i)
+			starts[i + 1] = starts[i] + _parts[i].size();
+
+		ParallelFor(_parts.size(), [&](size_t i)
+		{
+			std::copy(_parts[i].begin(), _parts[i].end(), m_collisions.begin() + starts[i]);
+		});
+	}
+
+	// Writes all collisions into binary stream. Links to saved collisions of the collisions analyzer are not preserved.
+	void Save(std::ostream& _s) const
+	{
+		WriteBinary(_s, m_offsets);
+		WriteBinary(_s, m_collisions);
+	}
+
+	// Reads all collisions from binary stream.
+	void Load(std::istream& _s)
+	{
+		ReadBinary(_s, m_offsets);
+		ReadBinary(_s, m_collisions);
+		for (auto& coll : m_collisions)
+			coll.pSave = nullptr;
+	}
+};
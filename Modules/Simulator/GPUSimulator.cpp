@@ -216,8 +216,8 @@ void CGPUSimulator::GenerateNewObjects()
 	// update verlet lists
 	m_verletList.UpdateList(m_currentTime);
 	static STempStorage store; // to reuse memory
-	CUDAUpdateVerletLists(m_verletList.m_PPList, m_verletList.m_PPVirtShift, m_gpu.m_CollisionsPP, store, true);
-	CUDAUpdateVerletLists(m_verletList.m_PWList, m_verletList.m_PWVirtShift, m_gpu.m_CollisionsPW, store, false);
+	CUDAUpdateVerletLists(m_verletList.m_PPList, m_gpu.m_CollisionsPP, store, true);
+	CUDAUpdateVerletLists(m_verletList.m_PWList, m_gpu.m_CollisionsPW, store, false);
 	m_sceneGPU.CUDASaveVerletCoords();
 }
 
@@ -298,8 +298,8 @@ void CGPUSimulator::UpdateVerletLists(double _dTimeStep)
 		m_verletList.UpdateList(m_currentTime);
 
 		static STempStorage storePP, storePW; // to reuse memory
-		CUDAUpdateVerletLists(m_verletList.m_PPList, m_verletList.m_PPVirtShift, m_gpu.m_CollisionsPP, storePP, true);
-		CUDAUpdateVerletLists(m_verletList.m_PWList, m_verletList.m_PWVirtShift, m_gpu.m_CollisionsPW, storePW, false);
+		CUDAUpdateVerletLists(m_verletList.m_PPList, m_gpu.m_CollisionsPP, storePP, true);
+		CUDAUpdateVerletLists(m_verletList.m_PWList, m_gpu.m_CollisionsPW, storePW, false);
 		m_sceneGPU.CUDASaveVerletCoords();
 	}
 }
@@ -335,31 +335,27 @@ void CGPUSimulator::CUDAUpdateActiveCollisions()
 	m_gpu.UpdateActiveCollisionsPW(m_sceneGPU.GetPointerToParticles(), m_sceneGPU.GetPointerToWalls());
 }
 
-void CGPUSimulator::CUDAUpdateVerletLists(const std_matr_u& _verletListCPU, const std_matr_u8& _verletListShiftsCPU,
-	CGPU::SCollisionsHolder& _collisions, STempStorage& _store, bool _bPPVerlet)
+void CGPUSimulator::CUDAUpdateVerletLists(const CVerletMatrix& _verletListCPU, CGPU::SCollisionsHolder& _collisions, STempStorage& _store, bool _bPPVerlet)
 {
 	const size_t nParticles = m_scene.GetTotalParticlesNumber();
-	// calculate total number of possible contacts
-	size_t nCollsions = 0;
-	for (const auto& colls : _verletListCPU)
-		nCollsions += colls.size();
+	const size_t nCollsions = _verletListCPU.Size(); // total number of possible contacts
 
-	// create verlet lists for GPU
+	// create verlet lists for GPU: the CPU list is already stored in the same compressed format
 	_store.hvVerletPartInd.resize(nParticles + 1);
 	_store.hvVerletDst.resize(nCollsions);
 	_store.hvVerletSrc.resize(nCollsions);
 	_store.hvVirtShifts.resize(nCollsions);
 
-	if (!_store.hvVerletPartInd.empty())	_store.hvVerletPartInd.front() = 0;			// for easier access
-	for (size_t i = 1; i < nParticles; ++i)
-		_store.hvVerletPartInd[i] = _store.hvVerletPartInd[i - 1] + (unsigned)_verletListCPU[i-1].size();
-	if (!_store.hvVerletPartInd.empty())	_store.hvVerletPartInd.back() = (unsigned)nCollsions;	// for easier access
+	ParallelFor(nParticles + 1, [&](size_t i)
+	{
+		_store.hvVerletPartInd[i] = static_cast<unsigned>(_verletListCPU.Offsets()[i]);
+	});
+	std::copy(_verletListCPU.IDs().begin(), _verletListCPU.IDs().end(), _store.hvVerletDst.begin());
+	if (_verletListCPU.HasShifts())
+		std::copy(_verletListCPU.ShiftsData().begin(), _verletListCPU.ShiftsData().end(), _store.hvVirtShifts.begin());
 	ParallelFor(nParticles, [&](size_t i)
 	{
-		std::copy(_verletListCPU[i].begin(), _verletListCPU[i].end(), _store.hvVerletDst.begin() + _store.hvVerletPartInd[i]);
-		std::fill(_store.hvVerletSrc.begin() + _store.hvVerletPartInd[i], _store.hvVerletSrc.begin() + _store.hvVerletPartInd[i] + _verletListCPU[i].size(), static_cast<unsigned>(i));
-		if (m_scene.m_PBC.bEnabled)
-			std::copy(_verletListShiftsCPU[i].begin(), _verletListShiftsCPU[i].end(), _store.hvVirtShifts.begin() + _store.hvVerletPartInd[i]);
+		std::fill(_store.hvVerletSrc.begin() + _store.hvVerletPartInd[i], _store.hvVerletSrc.begin() + _store.hvVerletPartInd[i + 1], static_cast<unsigned>(i));
 	});
 
 	// update verlet lists on device
@@ -10,7 +10,6 @@
 class CGPUSimulator : public CBaseSimulator
 {
 	typedef std::vector<std::vector<unsigned>> std_matr_u;
-	typedef std::vector<std::vector<uint8_t>> std_matr_u8;
 
 	struct STempStorage
 	{
@@ -78,7 +77,7 @@ private:
 
 	void CUDAUpdateGlobalCPUData();	// Dispatches necessary GPU operations and gathers data with one read.
 	void CUDAUpdateActiveCollisions();
-	void CUDAUpdateVerletLists(const std_matr_u& _verletListCPU, const std_matr_u8& _verletListShiftsCPU, CGPU::SCollisionsHolder& _collisions, STempStorage& _store, bool _bPPVerlet);
+	void CUDAUpdateVerletLists(const CVerletMatrix& _verletListCPU, CGPU::SCollisionsHolder& _collisions, STempStorage& _store, bool _bPPVerlet);
 	void CUDAInitializeMaterials();
 
 	void CUDAInitializeWalls();			// create or update information about walls for GPU
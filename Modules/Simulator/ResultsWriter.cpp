@@ -0,0 +1,79 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#include "ResultsWriter.h"
+
+CResultsWriter::~CResultsWriter()
+{
+	Stop();
+}
+
+void CResultsWriter::Start(const std::function<void(const SResultsSnapshot&)>& _write)
+{
+	Stop();
+	m_write = _write;
+	m_stop = false;
+	m_thread = std::thread{ &CResultsWriter::Run, this };
+}
+
+void CResultsWriter::Stop()
+{
+	if (!m_thread.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_stop = true;
+	}
+	m_queued.notify_one();
+	m_thread.join();
+	m_buffers.clear();
+}
+
+bool CResultsWriter::IsRunning() const
+{
+	return m_thread.joinable();
+}
+
+SResultsSnapshot CResultsWriter::Acquire()
+{
+	std::unique_lock<std::mutex> lock{ m_mutex };
+	m_written.wait(lock, [this] { return m_queue.size() < RESULTS_QUEUE_SIZE; });
+	if (m_buffers.empty()) return {};
+	SResultsSnapshot res = std::move(m_buffers.back());
+	m_buffers.pop_back();
+	return res;
+}
+
+void CResultsWriter::Push(SResultsSnapshot&& _snapshot)
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_queue.push_back(std::move(_snapshot));
+	}
+	m_queued.notify_one();
+}
+
+void CResultsWriter::Wait()
+{
+	std::unique_lock<std::mutex> lock{ m_mutex };
+	m_written.wait(lock, [this] { return m_queue.empty(); });
+}
+
+void CResultsWriter::Run()
+{
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_queued.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+		if (m_queue.empty()) return;
+		// references to elements of a deque stay valid when new elements are pushed back
+		const SResultsSnapshot& snapshot = m_queue.front();
+		lock.unlock();
+		m_write(snapshot);
+		lock.lock();
+		m_buffers.push_back(std::move(m_queue.front()));
+		m_queue.pop_front();
+		lock.unlock();
+		m_written.notify_all();
+	}
+}
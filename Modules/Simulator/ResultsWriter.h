@@ -0,0 +1,85 @@
+/* Copyright (c) 2013-2020, MUSEN Development Team. All rights reserved.
+   This file is part of MUSEN framework http://msolids.net/musen.
+   See LICENSE file for license and warranty information. */
+
+#pragma once
+
+#include "Matrix3.h"
+#include "Quaternion.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define RESULTS_QUEUE_SIZE	2	// maximum number of snapshots of results, which are waiting or being written at the same time
+
+// Copy of the simplified scene at one time point with all data, which must be written into the system structure.
+// Vectors of variables, which are not saved, are left empty.
+struct SResultsSnapshot
+{
+	double time{ 0 };
+
+	// particles
+	std::vector<size_t> partIndices;		// Indices of particles in the system structure.
+	std::vector<uint8_t> partActive;
+	std::vector<double> partEndActivity;
+	std::vector<CVector3> partCoords;
+	std::vector<CVector3> partVels;
+	std::vector<CVector3> partAnglVels;
+	std::vector<CVector3> partForces;
+	std::vector<CQuaternion> partQuaternions;
+	std::vector<CMatrix3> partTensors;
+	std::vector<double> partTemperatures;
+
+	// solid bonds
+	std::vector<size_t> sbIndices;			// Indices of solid bonds in the system structure.
+	std::vector<uint8_t> sbActive;
+	std::vector<double> sbEndActivity;
+	std::vector<CVector3> sbForces;
+	std::vector<CVector3> sbTangOverlaps;
+	std::vector<double> sbTotTorques;
+
+	// liquid bonds
+	std::vector<size_t> lbIndices;			// Indices of liquid bonds in the system structure.
+	std::vector<uint8_t> lbActive;
+	std::vector<double> lbEndActivity;
+	std::vector<CVector3> lbForces;
+
+	// walls
+	std::vector<size_t> wallIndices;		// Indices of walls in the system structure.
+	std::vector<CVector3> wallVerts;		// Three vertices per wall.
+	std::vector<CVector3> wallForces;
+	std::vector<CVector3> wallVels;
+};
+
+// Writes snapshots of results in a background thread, so that the simulation continues while they are written.
+// Snapshots are passed through a bounded queue, which limits the used memory. Buffers of written snapshots are reused.
+class CResultsWriter
+{
+	std::function<void(const SResultsSnapshot&)> m_write;	// Function to write one snapshot.
+	std::thread m_thread;					// Background thread.
+	std::mutex m_mutex;						// Guards the queue and buffers.
+	std::condition_variable m_queued;		// Is notified when a snapshot is queued or the thread must stop.
+	std::condition_variable m_written;		// Is notified when a snapshot has been written.
+	std::deque<SResultsSnapshot> m_queue;	// Snapshots waiting to be written; the first one is being written.
+	std::vector<SResultsSnapshot> m_buffers;	// Already written snapshots to reuse their memory.
+	bool m_stop{ false };					// The thread must stop after writing all snapshots.
+
+public:
+	CResultsWriter() = default;
+	CResultsWriter(const CResultsWriter&) = delete;
+	CResultsWriter& operator=(const CResultsWriter&) = delete;
+	~CResultsWriter();
+
+	void Start(const std::function<void(const SResultsSnapshot&)>& _write);	// Starts the background thread, which writes snapshots with the given function.
+	void Stop();				// Writes all queued snapshots and stops the background thread.
+	bool IsRunning() const;		// Returns true if the background thread is running.
+
+	SResultsSnapshot Acquire();				// Returns a buffer for the next snapshot. Blocks while the queue is full.
+	void Push(SResultsSnapshot&& _snapshot);	// Queues the snapshot for writing.
+	void Wait();							// Blocks until all queued snapshots are written.
+
+private:
+	void Run();	// Main loop of the background thread.
+};